@@ -0,0 +1,300 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+#include "agc_tracker.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* The int16 level never falls below one LSB either: below it the level
+ * is only quantization and the gain would saturate every sample.
+ */
+#define AGC_MIN_LEVEL_INT16             1.0f
+
+namespace gr {
+  namespace nfc {
+
+    static float
+    block_coefficient (double sample_rate, float time_constant, int n)
+    {
+        if (time_constant <= 0) {
+            return 1.0f;
+        }
+
+        return 1.0f - std::exp(-n / (sample_rate * time_constant));
+    }
+
+    agc_tracker::agc_tracker(double sample_rate, float attack_time, float release_time,
+                             float reference, float amplitude)
+      : d_attack(block_coefficient(sample_rate, attack_time, AGC_BLOCK_SIZE)),
+        d_release(block_coefficient(sample_rate, release_time, AGC_BLOCK_SIZE)),
+        d_reference(reference),
+        d_amplitude(amplitude),
+        d_min_level(std::fabs(amplitude) / AGC_MAX_GAIN)
+    {
+        reset();
+    }
+
+    void
+    agc_tracker::reset()
+    {
+        d_baseline = 0;
+        d_level = d_min_level;
+        d_primed = false;
+    }
+
+    void
+    agc_block_stats (const float *in, int n, float *min, float *max, float *mean)
+    {
+        int i = 0;
+        float lo = in[0], hi = in[0], sum = 0;
+
+#ifdef __SSE2__
+        if (n >= 4) {
+            __m128 vlo = _mm_loadu_ps(in);
+            __m128 vhi = vlo;
+            __m128 vsum = _mm_setzero_ps();
+            float tmp[4];
+
+            for (; i + 4 <= n; i += 4) {
+                __m128 v = _mm_loadu_ps(in + i);
+                vlo = _mm_min_ps(vlo, v);
+                vhi = _mm_max_ps(vhi, v);
+                vsum = _mm_add_ps(vsum, v);
+            }
+
+            _mm_storeu_ps(tmp, vlo);
+            lo = std::min(std::min(tmp[0], tmp[1]), std::min(tmp[2], tmp[3]));
+            _mm_storeu_ps(tmp, vhi);
+            hi = std::max(std::max(tmp[0], tmp[1]), std::max(tmp[2], tmp[3]));
+            _mm_storeu_ps(tmp, vsum);
+            sum = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+        }
+#endif
+
+        for (; i < n; i++) {
+            lo = std::min(lo, in[i]);
+            hi = std::max(hi, in[i]);
+            sum += in[i];
+        }
+
+        *min = lo;
+        *max = hi;
+        *mean = sum / n;
+    }
+
+    void
+    agc_block_apply (const float *in, float *out, int n, float gain, float offset)
+    {
+        int i = 0;
+
+#ifdef __SSE2__
+        __m128 vgain = _mm_set1_ps(gain);
+        __m128 voffset = _mm_set1_ps(offset);
+
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_loadu_ps(in + i);
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(v, vgain), voffset));
+        }
+#endif
+
+        for (; i < n; i++) {
+            out[i] = in[i] * gain + offset;
+        }
+    }
+
+    void
+    agc_block_stats (const short *in, int n, float *min, float *max, float *mean)
+    {
+        int i = 0;
+        short lo = in[0], hi = in[0];
+        int sum = 0;
+
+#ifdef __SSE2__
+        if (n >= 8) {
+            __m128i vlo = _mm_loadu_si128((const __m128i *) in);
+            __m128i vhi = vlo;
+            __m128i vsum = _mm_setzero_si128();
+            __m128i ones = _mm_set1_epi16(1);
+            short tmp16[8];
+            int tmp32[4];
+
+            for (; i + 8 <= n; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+                vlo = _mm_min_epi16(vlo, v);
+                vhi = _mm_max_epi16(vhi, v);
+                /* Pairwise sums in 32-bit, cannot overflow on a block */
+                vsum = _mm_add_epi32(vsum, _mm_madd_epi16(v, ones));
+            }
+
+            _mm_storeu_si128((__m128i *) tmp16, vlo);
+            lo = *std::min_element(tmp16, tmp16 + 8);
+            _mm_storeu_si128((__m128i *) tmp16, vhi);
+            hi = *std::max_element(tmp16, tmp16 + 8);
+            _mm_storeu_si128((__m128i *) tmp32, vsum);
+            sum = tmp32[0] + tmp32[1] + tmp32[2] + tmp32[3];
+        }
+#endif
+
+        for (; i < n; i++) {
+            lo = std::min(lo, in[i]);
+            hi = std::max(hi, in[i]);
+            sum += in[i];
+        }
+
+        *min = lo;
+        *max = hi;
+        *mean = float(sum) / n;
+    }
+
+    void
+    agc_block_apply (const short *in, short *out, int n, float gain, float offset)
+    {
+        int frac = 14;
+        int i = 0;
+
+        /* Largest Q format that keeps in * gain + offset within 32 bits */
+        while (frac > 0 && (std::fabs(gain) * (1 << frac) > 32767.0f ||
+                            std::fabs(offset) * (1 << frac) > float(1 << 29))) {
+            frac--;
+        }
+
+        /* Saturate the gain itself when the field is off (level at its floor).
+         * |in * gain_q| < 2^30, so an offset clamped to 2^30 keeps the sum in
+         * 32 bits and still saturates the samples it would have.
+         */
+        int gain_q = int(std::min(std::max(std::lrint(gain * (1 << frac)), -32767L), 32767L));
+        int64_t offset_q64 = std::llrint(std::min(std::max(double(offset) * (1 << frac), -1e18), 1e18)) +
+            ((1 << frac) >> 1);
+        int offset_q = int(std::min(std::max(offset_q64, -(int64_t(1) << 30)), int64_t(1) << 30));
+
+#ifdef __SSE2__
+        __m128i vgain = _mm_set1_epi16((short) gain_q);
+        __m128i voffset = _mm_set1_epi32(offset_q);
+        __m128i vshift = _mm_cvtsi32_si128(frac);
+
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+            __m128i plo = _mm_mullo_epi16(v, vgain);
+            __m128i phi = _mm_mulhi_epi16(v, vgain);
+            __m128i p0 = _mm_add_epi32(_mm_unpacklo_epi16(plo, phi), voffset);
+            __m128i p1 = _mm_add_epi32(_mm_unpackhi_epi16(plo, phi), voffset);
+            p0 = _mm_sra_epi32(p0, vshift);
+            p1 = _mm_sra_epi32(p1, vshift);
+            /* packs saturates to [-32768, 32767] */
+            _mm_storeu_si128((__m128i *) (out + i), _mm_packs_epi32(p0, p1));
+        }
+#endif
+
+        for (; i < n; i++) {
+            int64_t v = (int64_t(in[i]) * gain_q + offset_q) >> frac;
+            out[i] = (short) std::min(std::max(v, int64_t(-32768)), int64_t(32767));
+        }
+    }
+
+    void
+    agc_tracker::update(float min, float max, float mean, int n, float min_level,
+                        float *gain, float *offset)
+    {
+        float peak, a;
+        float attack = d_attack, release = d_release;
+
+        if (n != AGC_BLOCK_SIZE) {
+            /* Last partial block of the stream, scale the coefficients */
+            attack = 1.0f - std::pow(1.0f - d_attack, float(n) / AGC_BLOCK_SIZE);
+            release = 1.0f - std::pow(1.0f - d_release, float(n) / AGC_BLOCK_SIZE);
+        }
+
+        if (!d_primed) {
+            /* Start from the first block instead of converging from 0 */
+            d_baseline = mean;
+            d_level = std::max(max - min, min_level);
+            d_primed = true;
+        }
+
+        /* Baseline: rises with the field, barely follows the pauses */
+        a = (mean > d_baseline) ? attack : release;
+        d_baseline += a * (mean - d_baseline);
+
+        /* Level: peak deviation from the baseline */
+        peak = std::max(max - d_baseline, d_baseline - min);
+        a = (peak > d_level) ? attack : release;
+        d_level = std::max(d_level + a * (peak - d_level), min_level);
+
+        *gain = d_amplitude / d_level;
+        *offset = d_reference - d_baseline * *gain;
+    }
+
+    void
+    agc_tracker::process_block(const float *in, float *out, int n)
+    {
+        float min, max, mean, gain, offset;
+
+        agc_block_stats(in, n, &min, &max, &mean);
+        update(min, max, mean, n, d_min_level, &gain, &offset);
+        agc_block_apply(in, out, n, gain, offset);
+    }
+
+    void
+    agc_tracker::process_block(const short *in, short *out, int n)
+    {
+        float min, max, mean, gain, offset;
+
+        agc_block_stats(in, n, &min, &max, &mean);
+        update(min, max, mean, n, std::max(d_min_level, AGC_MIN_LEVEL_INT16), &gain, &offset);
+        agc_block_apply(in, out, n, gain, offset);
+    }
+
+    void
+    agc_tracker::process(const float *in, float *out, int n)
+    {
+        while (n > 0) {
+            int len = std::min(n, int(AGC_BLOCK_SIZE));
+
+            process_block(in, out, len);
+
+            in += len;
+            out += len;
+            n -= len;
+        }
+    }
+
+    void
+    agc_tracker::process(const short *in, short *out, int n)
+    {
+        while (n > 0) {
+            int len = std::min(n, int(AGC_BLOCK_SIZE));
+
+            process_block(in, out, len);
+
+            in += len;
+            out += len;
+            n -= len;
+        }
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,117 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_AGC_TRACKER_H
+#define INCLUDED_NFC_AGC_TRACKER_H
+
+/* Largest gain, reached when the field is off: the level does not fall
+ * below amplitude / AGC_MAX_GAIN (1e-4 for an amplitude of 0.25).
+ */
+#define AGC_MAX_GAIN                    2500.0f
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Baseline (DC) tracker with automatic gain control for the
+     * AM envelope, independent from the GNU Radio runtime.
+     *
+     * The envelope is processed in blocks of AGC_BLOCK_SIZE samples. The
+     * baseline follows the block mean and the level follows the block
+     * peak deviation from the baseline. Both trackers rise with the
+     * attack time constant and fall with the release time constant, so
+     * a short reader pause (deep drop) barely moves the baseline, while
+     * the field coming back is followed immediately.
+     *
+     * Every sample of a block is then mapped with the same affine
+     * transform:
+     *
+     *   out = (in - baseline) * (amplitude / level) + reference
+     *
+     * which is what the hand-tuned offsets of tag_signal_impl did for one
+     * recording: the tag response ends up around \p reference whatever
+     * the coupling and the carrier drift are.
+     *
+     * The level floor is relative to \p amplitude, so it follows the
+     * units: the int16 path on a capture scaled by S, with \p reference
+     * and \p amplitude scaled by S, has the same floor as the float path
+     * and takes the same decisions on weak signals. The int16 floor is
+     * in addition at least one LSB, which only matters for amplitudes
+     * under AGC_MAX_GAIN LSB.
+     */
+    class agc_tracker
+    {
+     public:
+      enum { AGC_BLOCK_SIZE = 64 };
+
+      /*!
+       * \param sample_rate sample rate of the envelope (Hz)
+       * \param attack_time time constant used when the trackers rise (s)
+       * \param release_time time constant used when the trackers fall (s)
+       * \param reference output level of the baseline
+       * \param amplitude output deviation of the tracked peak level
+       */
+      agc_tracker(double sample_rate, float attack_time, float release_time,
+                  float reference, float amplitude);
+
+      void reset();
+
+      /*!
+       * Process \p n samples, \p n must be a multiple of AGC_BLOCK_SIZE
+       * except for the very last call of a stream. Keeping the blocking
+       * fixed makes the output independent from the way the stream is cut.
+       */
+      void process(const float *in, float *out, int n);
+
+      /*!
+       * Fixed-point variant, \p reference and \p amplitude are then in
+       * int16 units. The trackers are the same, only the block statistics
+       * and the affine map run on int16 with saturation.
+       */
+      void process(const short *in, short *out, int n);
+
+      float baseline() const { return d_baseline; }
+      float level() const { return d_level; }
+
+     private:
+      void update(float min, float max, float mean, int n, float min_level,
+                  float *gain, float *offset);
+      void process_block(const float *in, float *out, int n);
+      void process_block(const short *in, short *out, int n);
+
+      float d_attack;
+      float d_release;
+      float d_reference;
+      float d_amplitude;
+      float d_min_level;
+
+      float d_baseline;
+      float d_level;
+      bool d_primed;
+    };
+
+    /* Block statistics helpers, SIMD when available */
+    void agc_block_stats(const float *in, int n, float *min, float *max, float *mean);
+    void agc_block_apply(const float *in, float *out, int n, float gain, float offset);
+    void agc_block_stats(const short *in, int n, float *min, float *max, float *mean);
+    void agc_block_apply(const short *in, short *out, int n, float gain, float offset);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_AGC_TRACKER_H */
@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+#
+# Times the GNU Radio chain file_source -> tag_signal -> slicer -> decoder on
+# a float capture, and prints the result in the same form as nfc_decode -B
+# so that both can be compared on the same file:
+#
+#   python bench_chain.py capture.f32 [tag|reader] [threshold]
+#   nfc_decode -B -f float -t capture.f32 -T threshold:0.5 > /dev/null
+
+import os
+import sys
+import time
+
+from gnuradio import gr, blocks
+import nfc
+
+path = sys.argv[1]
+direction = sys.argv[2] if len(sys.argv) > 2 else 'tag'
+threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 0.5
+sample_rate = 4e6
+
+tb = gr.top_block()
+src = blocks.file_source(gr.sizeof_float, path, False)
+signal = nfc.tag_signal()
+slicer = blocks.threshold_ff(threshold, threshold, 0)
+to_char = blocks.float_to_char()
+if direction == 'tag':
+	decoder = nfc.tag_decoder(sample_rate)
+else:
+	decoder = nfc.modified_miller_decoder(sample_rate)
+sink = blocks.null_sink(gr.sizeof_char)
+tb.connect(src, signal, slicer, to_char, decoder, sink)
+
+# Decoded frames go to stdout like with nfc_decode
+start = time.time()
+tb.run()
+seconds = time.time() - start
+
+total = os.path.getsize(path)
+sys.stderr.write('gnuradio: %d bytes in %.3f s, %.3f s/GB, %.1f MB/s\n' %
+	(total, seconds, seconds * 1e9 / max(total, 1), total / max(seconds, 1e-9) * 1e-6))
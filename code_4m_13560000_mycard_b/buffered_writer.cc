@@ -0,0 +1,160 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include "buffered_writer.h"
+
+namespace gr {
+  namespace nfc {
+
+    buffered_writer::buffered_writer(size_t capacity)
+      : d_fd(-1),
+        d_own_fd(false),
+        d_error(false),
+        d_buf(capacity),
+        d_len(0),
+        d_written(0)
+    {
+    }
+
+    buffered_writer::~buffered_writer()
+    {
+        close();
+    }
+
+    bool
+    buffered_writer::open(const char *path)
+    {
+        close();
+
+        if (!strcmp(path, "-")) {
+            d_fd = STDOUT_FILENO;
+        } else {
+            d_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (d_fd < 0) {
+                return false;
+            }
+            d_own_fd = true;
+        }
+
+        d_error = false;
+        d_len = 0;
+        d_written = 0;
+        return true;
+    }
+
+    bool
+    buffered_writer::close()
+    {
+        bool ok;
+
+        if (d_fd < 0) {
+            return true;
+        }
+
+        ok = flush();
+        if (d_own_fd && ::close(d_fd) != 0) {
+            ok = false;
+        }
+
+        d_fd = -1;
+        d_own_fd = false;
+        return ok;
+    }
+
+    unsigned char *
+    buffered_writer::reserve(size_t n)
+    {
+        if (d_len + n > d_buf.size()) {
+            flush();
+            if (n > d_buf.size()) {
+                /* Only for records larger than the whole buffer */
+                d_buf.resize(n);
+            }
+        }
+
+        return &d_buf[d_len];
+    }
+
+    void
+    buffered_writer::write(const void *data, size_t n)
+    {
+        const unsigned char *p = (const unsigned char *) data;
+
+        while (n > 0) {
+            size_t len;
+
+            if (d_len == d_buf.size()) {
+                flush();
+            }
+            len = std::min(n, d_buf.size() - d_len);
+            memcpy(&d_buf[d_len], p, len);
+            d_len += len;
+            p += len;
+            n -= len;
+        }
+    }
+
+    bool
+    buffered_writer::flush()
+    {
+        size_t done = 0;
+
+        while (done < d_len && !d_error) {
+            ssize_t r = ::write(d_fd, &d_buf[done], d_len - done);
+
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r <= 0) {
+                d_error = true;
+                break;
+            }
+            done += r;
+        }
+
+        /* After an error the data is dropped, close() reports it */
+        d_written += d_len;
+        d_len = 0;
+        return !d_error;
+    }
+
+    bool
+    buffered_writer::sync()
+    {
+        bool ok = flush();
+
+        return sync_fd(d_fd) && ok;
+    }
+
+    bool
+    sync_fd (int fd)
+    {
+        return fsync(fd) == 0 || errno == EINVAL || errno == EROFS;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
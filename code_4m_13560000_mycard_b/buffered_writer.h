@@ -0,0 +1,93 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_BUFFERED_WRITER_H
+#define INCLUDED_NFC_BUFFERED_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* Default buffer, written out in one write() when full */
+#define BUFFERED_WRITER_SIZE            (1 << 20)
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Output file written in large batches, counterpart of
+     * capture_file.
+     *
+     * Records are formatted straight into the buffer: reserve() room for
+     * the largest record, fill it, commit() what was used. Nothing is
+     * allocated once the writer is open, and the file only sees
+     * write() calls of the buffer size.
+     */
+    class buffered_writer
+    {
+     public:
+      buffered_writer(size_t capacity = BUFFERED_WRITER_SIZE);
+      ~buffered_writer();
+
+      /*! Create \p path, "-" is stdout. Returns false with errno set */
+      bool open(const char *path);
+
+      /*! Flush and close, false if any write failed */
+      bool close();
+
+      /*! At least \p n bytes of room, flushes the buffer first if needed */
+      unsigned char *reserve(size_t n);
+
+      /*! \p n bytes of the reserved room were used */
+      void commit(size_t n) { d_len += n; }
+
+      void write(const void *data, size_t n);
+
+      /*! Write out the buffer, false if a write failed */
+      bool flush();
+
+      /*! Write out the buffer and fsync the file, false if either failed */
+      bool sync();
+
+      /*! Bytes written so far, buffered ones included */
+      uint64_t offset() const { return d_written + d_len; }
+
+      bool is_open() const { return d_fd >= 0; }
+
+     private:
+      /* Owns the descriptor */
+      buffered_writer(const buffered_writer &);
+      buffered_writer &operator=(const buffered_writer &);
+
+      int d_fd;
+      bool d_own_fd;
+      bool d_error;
+      std::vector<unsigned char> d_buf;
+      size_t d_len;
+      uint64_t d_written;
+    };
+
+    /*! fsync \p fd, false with errno set on error. Pipes and terminals
+     * have nothing to sync and succeed.
+     */
+    bool sync_fd(int fd);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_BUFFERED_WRITER_H */
@@ -0,0 +1,198 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture_file.h"
+
+/* Consumed pages are dropped from the mapping by steps of this size */
+#define CAPTURE_RELEASE_STEP            (64 << 20)
+
+namespace gr {
+  namespace nfc {
+
+    capture_file::capture_file()
+      : d_fd(-1),
+        d_own_fd(false),
+        d_map(NULL),
+        d_size(0),
+        d_offset(0),
+        d_released(0),
+        d_error(0)
+    {
+    }
+
+    capture_file::~capture_file()
+    {
+        close();
+    }
+
+    bool
+    capture_file::open(const char *path, bool use_mmap)
+    {
+        struct stat st;
+
+        close();
+        d_path = path;
+        d_error = 0;
+
+        if (!strcmp(path, "-")) {
+            d_fd = STDIN_FILENO;
+        } else {
+            d_fd = ::open(path, O_RDONLY);
+            if (d_fd < 0) {
+                return false;
+            }
+            d_own_fd = true;
+        }
+
+        if (use_mmap && fstat(d_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+            uint64_t(st.st_size) == uint64_t(size_t(st.st_size))) {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, d_fd, 0);
+
+            if (map != MAP_FAILED) {
+                d_map = (const unsigned char *) map;
+                d_size = st.st_size;
+                madvise(map, d_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+                /* Only honoured for file mappings on some kernels, harmless otherwise */
+                madvise(map, d_size, MADV_HUGEPAGE);
+#endif
+                return true;
+            }
+        }
+
+        if (fstat(d_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            d_size = st.st_size;
+        }
+
+        return true;
+    }
+
+    void
+    capture_file::close()
+    {
+        if (d_map) {
+            munmap((void *) d_map, d_size);
+            d_map = NULL;
+        }
+        if (d_own_fd) {
+            ::close(d_fd);
+        }
+
+        d_fd = -1;
+        d_own_fd = false;
+        d_size = 0;
+        d_offset = 0;
+        d_released = 0;
+    }
+
+    void
+    capture_file::release(uint64_t upto)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+
+        upto -= upto % page;
+        if (upto < d_released + CAPTURE_RELEASE_STEP) {
+            return;
+        }
+
+        /* Read-only private mapping: the pages are simply mapped again
+         * from the page cache if they are touched later.
+         */
+        madvise((void *) (d_map + d_released), upto - d_released, MADV_DONTNEED);
+        d_released = upto;
+    }
+
+    bool
+    capture_file::seek(uint64_t offset)
+    {
+        if (!d_map || offset > d_size) {
+            return false;
+        }
+
+        d_offset = offset;
+        d_released = std::min(d_released, offset - offset % sysconf(_SC_PAGESIZE));
+        return true;
+    }
+
+    size_t
+    capture_file::next(const void **data, size_t max, size_t item_size)
+    {
+        size_t len;
+
+        max -= max % item_size;
+
+        if (d_map) {
+            release(d_offset);
+
+            len = size_t(std::min(uint64_t(max), d_size - d_offset));
+            len -= len % item_size;
+            *data = d_map + d_offset;
+            d_offset += len;
+            return len;
+        }
+
+        if (d_fd < 0 || d_error) {
+            return 0;
+        }
+
+        if (d_buf.size() < max) {
+            d_buf.resize(max);
+        }
+
+        /* Fill the whole view, so only the end of the stream is partial */
+        len = 0;
+        while (len < max) {
+            ssize_t r = read(d_fd, &d_buf[len], max - len);
+
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r < 0) {
+                /* Not the end of the capture: say so, hand out what was
+                 * read and stop there
+                 */
+                d_error = errno;
+                fprintf(stderr, "%s: %s\n", d_path.c_str(), strerror(d_error));
+                break;
+            }
+            if (r == 0) {
+                break;
+            }
+            len += r;
+        }
+
+        len -= len % item_size;
+        *data = &d_buf[0];
+        d_offset += len;
+        return len;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,99 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_CAPTURE_FILE_H
+#define INCLUDED_NFC_CAPTURE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Sequential reader for capture files.
+     *
+     * Regular files are memory mapped read-only and next() hands out
+     * views straight into the mapping, without any copy. The kernel is
+     * told the access is sequential (and may use huge pages) so it reads
+     * ahead aggressively; the pages already consumed are dropped from the
+     * mapping so that the resident size stays small on multi-gigabyte
+     * recordings.
+     *
+     * Pipes, stdin ("-") and files that cannot be mapped fall back to
+     * read() into an internal buffer. A failed read() is reported on
+     * stderr and ends the capture there, see failed().
+     */
+    class capture_file
+    {
+     public:
+      capture_file();
+      ~capture_file();
+
+      /*! Open \p path, "-" is stdin. Returns false with errno set on error */
+      bool open(const char *path, bool use_mmap = true);
+      void close();
+
+      /*!
+       * Next view of at most \p max bytes, returns its length (0 at end of
+       * file or after a read error). Views always hold a whole number of
+       * \p item_size items, a trailing partial item is dropped. The view
+       * stays valid until the next call.
+       */
+      size_t next(const void **data, size_t max, size_t item_size = 1);
+
+      /*! Move to byte \p offset, only for mapped files */
+      bool seek(uint64_t offset);
+
+      /*! Total size in bytes, 0 when unknown (pipe) */
+      uint64_t size() const { return d_size; }
+
+      /*! Bytes already handed out */
+      uint64_t offset() const { return d_offset; }
+
+      bool mapped() const { return d_map != NULL; }
+
+      /*! True if a read() failed, the capture then ended early. Kept
+       * until the next open()
+       */
+      bool failed() const { return d_error != 0; }
+
+     private:
+      /* Owns the descriptor and the mapping */
+      capture_file(const capture_file &);
+      capture_file &operator=(const capture_file &);
+
+      void release(uint64_t upto);
+
+      int d_fd;
+      bool d_own_fd;
+      const unsigned char *d_map;
+      uint64_t d_size;
+      uint64_t d_offset;
+      uint64_t d_released;
+      std::vector<unsigned char> d_buf;
+      std::string d_path;
+      int d_error;                      /* errno of the failed read(), 0 if none */
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_CAPTURE_FILE_H */
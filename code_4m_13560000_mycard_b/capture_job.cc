@@ -0,0 +1,641 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "capture_job.h"
+#include "miller_decoder.h"
+#include "manchester_decoder.h"
+
+/* Samples read per direction and per pass */
+#define SERIAL_CHUNK_SAMPLES            65536
+
+namespace gr {
+  namespace nfc {
+
+    capture_config::capture_config()
+      : format(FORMAT_CHAR),
+        sample_rate(4e6)
+    {
+        channels[NFC_READER] = 0;
+        channels[NFC_TAG] = 0;
+        memset(&agc, 0, sizeof(agc));
+        parse_slicer("threshold:0.5", &slicers[NFC_READER]);
+        parse_slicer("threshold:0.5", &slicers[NFC_TAG]);
+    }
+
+    bool
+    capture_config::parse_option(int opt, const char *arg)
+    {
+        switch (opt) {
+        case 'r':
+            paths[NFC_READER] = arg;
+            return true;
+        case 't':
+            paths[NFC_TAG] = arg;
+            return true;
+        case 'f':
+            if (!parse_format(arg, &format)) {
+                fprintf(stderr, "Unknown format %s\n", arg);
+                return false;
+            }
+            return true;
+        case 's':
+            sample_rate = atof(arg);
+            if (sample_rate <= 0) {
+                fprintf(stderr, "Bad sample rate %s\n", arg);
+                return false;
+            }
+            return true;
+        case 'R':
+        case 'T':
+            if (!parse_slicer(arg, &slicers[opt == 'R' ? NFC_READER : NFC_TAG])) {
+                fprintf(stderr, "Bad slicer %s\n", arg);
+                return false;
+            }
+            return true;
+        case 'a':
+            if (!parse_agc(arg, &agc)) {
+                fprintf(stderr, "Bad AGC parameters %s\n", arg);
+                return false;
+            }
+            return true;
+        case 'w':
+            switch (sscanf(arg, "%d,%d", &channels[NFC_READER], &channels[NFC_TAG])) {
+            case 1:
+                channels[NFC_TAG] = channels[NFC_READER];
+                /* Fall through */
+            case 2:
+                if (channels[NFC_READER] >= 0 && channels[NFC_TAG] >= 0) {
+                    return true;
+                }
+            }
+            fprintf(stderr, "Bad WAV channels %s\n", arg);
+            return false;
+        }
+
+        return false;
+    }
+
+    capture_stream::capture_stream()
+      : d_input(FORMAT_CHAR),
+        d_channel(0),
+        d_format(FORMAT_CHAR),
+        d_item_size(1),
+        d_chunk(0),
+        d_pos(0)
+    {
+    }
+
+    bool
+    capture_stream::open(const capture_config &config, int d, bool use_mmap)
+    {
+        const char *path = config.paths[d].c_str();
+
+        d_input = config.format;
+        d_channel = config.channels[d];
+        d_format = config.format;
+
+        switch (d_input) {
+        case FORMAT_WAV:
+            if (!d_wav.open(path, use_mmap)) {
+                return false;
+            }
+            if (d_channel >= d_wav.channels()) {
+                fprintf(stderr, "%s: no channel %d (%d channels)\n", path,
+                        d_channel, d_wav.channels());
+                return false;
+            }
+            d_format = d_wav.format();
+            d_buf.resize(size_t(SERIAL_CHUNK_SAMPLES) * d_wav.sample_size());
+            break;
+
+        case FORMAT_NFCB:
+            if (!d_nfcb.open(path)) {
+                return false;
+            }
+            d_format = FORMAT_PACKED;
+            d_pos = 0;
+            break;
+
+        case FORMAT_NFCR:
+            fprintf(stderr, "%s: .nfcr captures hold runs, not samples\n", path);
+            return false;
+
+        default:
+            if (!d_file.open(path, use_mmap)) {
+                perror(path);
+                return false;
+            }
+            break;
+        }
+
+        d_item_size = format_item_size(d_format);
+        d_chunk = SERIAL_CHUNK_SAMPLES / format_item_samples(d_format);
+
+        return true;
+    }
+
+    double
+    capture_stream::sample_rate() const
+    {
+        switch (d_input) {
+        case FORMAT_WAV:
+            return d_wav.sample_rate();
+        case FORMAT_NFCB:
+            return d_nfcb.info().sample_rate;
+        default:
+            return 0;
+        }
+    }
+
+    bool
+    capture_stream::next(const void **items, int *nitems)
+    {
+        switch (d_input) {
+        case FORMAT_WAV:
+            *nitems = int(d_wav.read(d_channel, &d_buf[0], d_chunk));
+            *items = &d_buf[0];
+            break;
+
+        case FORMAT_NFCB:
+            *nitems = int(std::min(uint64_t(d_chunk), d_nfcb.nsamples() / 8 - d_pos));
+            *items = d_nfcb.data() + d_pos;
+            d_pos += *nitems;
+            break;
+
+        default:
+            *nitems = int(d_file.next(items, d_chunk * d_item_size, d_item_size) / d_item_size);
+            break;
+        }
+
+        return size_t(*nitems) == d_chunk;
+    }
+
+    capture_job::capture_job(const capture_config &config)
+      : d_config(config),
+        d_tap(NULL)
+    {
+    }
+
+    bool
+    capture_job::open(bool use_mmap)
+    {
+        bool have_rate = false;
+
+        for (int d = 0; d < 2; d++) {
+            if (d_config.paths[d].empty()) {
+                continue;
+            }
+
+            const char *path = d_config.paths[d].c_str();
+            double rate;
+
+            if (d_config.format == FORMAT_WAV) {
+                if (!d_wav[d].open(path, use_mmap)) {
+                    return false;
+                }
+                if (d_config.channels[d] >= d_wav[d].channels()) {
+                    fprintf(stderr, "%s: no channel %d (%d channels)\n", path,
+                            d_config.channels[d], d_wav[d].channels());
+                    return false;
+                }
+                rate = d_wav[d].sample_rate();
+            } else if (d_config.format == FORMAT_NFCB || d_config.format == FORMAT_NFCR) {
+                bool nfcr = d_config.format == FORMAT_NFCR;
+
+                if (!(nfcr ? d_nfcr[d].open(path) : d_nfcb[d].open(path))) {
+                    return false;
+                }
+
+                const nfcb_info &info = nfcr ? d_nfcr[d].info() : d_nfcb[d].info();
+                if (info.direction != d) {
+                    fprintf(stderr, "%s: %s capture\n", path,
+                            info.direction == NFC_READER ? "reader" : "tag");
+                    return false;
+                }
+                rate = info.sample_rate;
+            } else {
+                if (!d_files[d].open(path, use_mmap)) {
+                    perror(path);
+                    return false;
+                }
+                continue;
+            }
+
+            /* Self-describing captures give the sample rate */
+            if (have_rate && rate != d_config.sample_rate) {
+                fprintf(stderr, "%s: sample rate %g differs from %g\n", path,
+                        rate, d_config.sample_rate);
+                return false;
+            }
+            d_config.sample_rate = rate;
+            have_rate = true;
+        }
+
+        return true;
+    }
+    bool
+    capture_job::can_split() const
+    {
+        for (int d = 0; d < 2; d++) {
+            if (d_config.paths[d].empty()) {
+                continue;
+            }
+
+            if (d_config.format == FORMAT_NFCR) {
+                /* Runs skip the idle field anyway */
+                return false;
+            }
+
+            if (d_config.format == FORMAT_WAV) {
+                /* Mapped mono files only, the scan needs a plain array */
+                if (d_wav[d].channels() != 1 || !d_wav[d].mapped() ||
+                    !capture_chunks::can_split(d_config.slicers[d], d_config.agc)) {
+                    return false;
+                }
+                continue;
+            }
+
+            if (d_config.format == FORMAT_NFCB) {
+                /* Chunk positions are shared, both need the same origin */
+                if (!d_nfcb[d].contiguous() ||
+                    d_nfcb[d].offset_of(0) != d_nfcb[d_config.paths[0].empty() ? 1 : 0].offset_of(0)) {
+                    return false;
+                }
+                continue;
+            }
+
+            /* Chunks need random access and a slicer without memory */
+            if (!d_files[d].mapped() ||
+                !capture_chunks::can_split(d_config.slicers[d], d_config.agc)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    uint64_t
+    capture_job::size() const
+    {
+        if (d_config.format == FORMAT_NFCB) {
+            return d_nfcb[0].size() + d_nfcb[1].size();
+        }
+        if (d_config.format == FORMAT_NFCR) {
+            return d_nfcr[0].size() + d_nfcr[1].size();
+        }
+        if (d_config.format == FORMAT_WAV) {
+            return d_wav[0].size() + d_wav[1].size();
+        }
+
+        return d_files[0].size() + d_files[1].size();
+    }
+
+    bool
+    capture_job::failed() const
+    {
+        return d_files[0].failed() || d_files[1].failed() ||
+            d_wav[0].failed() || d_wav[1].failed();
+    }
+
+    int64_t
+    capture_job::start_time_ns(uint64_t *start_sample) const
+    {
+        int d = d_config.paths[NFC_READER].empty() ? NFC_TAG : NFC_READER;
+
+        *start_sample = 0;
+        if (d_config.format == FORMAT_NFCB) {
+            *start_sample = d_nfcb[d].offset_of(0);
+            return d_nfcb[d].info().start_time_ns;
+        }
+        if (d_config.format == FORMAT_NFCR) {
+            *start_sample = d_nfcr[d].offset_of(0);
+            return d_nfcr[d].info().start_time_ns;
+        }
+
+        return 0;
+    }
+
+    sample_format
+    capture_job::stage_format(int d) const
+    {
+        return d_config.format == FORMAT_WAV ? d_wav[d].format() : d_config.format;
+    }
+
+    sample_format
+    capture_job::item_format(int d) const
+    {
+        return d_config.format == FORMAT_NFCB ? FORMAT_PACKED : stage_format(d);
+    }
+
+    uint64_t
+    capture_job::decode_serial(frame_sink *sink, uint64_t start, uint64_t end, uint64_t preroll)
+    {
+        range_filter filter(sink, start, end);
+        frame_queue queues[2];
+        frame_queue *active_queues[2] = { NULL, NULL };
+        frame_decoder *decoders[2] = { NULL, NULL };
+        frame_decoder *running[2] = { NULL, NULL };
+        sample_stage *stages[2] = { NULL, NULL };
+        nfcr_cursor *cursors[2] = { NULL, NULL };
+        std::vector<unsigned char> samples[2];
+        bool open[2] = { false, false };
+        uint64_t pos[2] = { 0, 0 };      /* Next sample, absolute but for nfcb */
+        uint64_t segment_end[2] = { 0, 0 };
+        bool nfcb = d_config.format == FORMAT_NFCB;
+        uint64_t total = 0;
+        int item_size = format_item_size(d_config.format);
+        int item_samples = format_item_samples(d_config.format);
+        size_t chunk = size_t(SERIAL_CHUNK_SAMPLES / item_samples) * item_size;
+        uint64_t from = start > preroll ? start - preroll : 0;
+
+        for (int d = 0; d < 2; d++) {
+            if (d_config.paths[d].empty()) {
+                continue;
+            }
+
+            if (d == NFC_READER) {
+                decoders[d] = new miller_decoder(d_config.sample_rate, &queues[d]);
+            } else {
+                decoders[d] = new manchester_decoder(d_config.sample_rate, &queues[d]);
+            }
+            stages[d] = new sample_stage(stage_format(d), d_config.sample_rate,
+                                         d_config.slicers[d], d_config.agc, decoders[d]);
+            running[d] = decoders[d];
+            active_queues[d] = &queues[d];
+            open[d] = true;
+
+            /* Enter the captures at the start of the pre-roll */
+            if (nfcb) {
+                /* Segments start on a byte, the samples of a byte share it */
+                pos[d] = d_nfcb[d].sample_at(from) & ~uint64_t(7);
+                stages[d]->reset(d_nfcb[d].offset_of(pos[d]));
+                segment_end[d] = d_nfcb[d].segment_end(pos[d]);
+            } else if (d_config.format == FORMAT_NFCR) {
+                uint64_t sample = d_nfcr[d].sample_at(from);
+
+                cursors[d] = new nfcr_cursor(d_nfcr[d]);
+                cursors[d]->seek(sample);
+                pos[d] = d_nfcr[d].offset_of(sample);
+                stages[d]->reset(pos[d]);
+            } else if (d_config.format == FORMAT_WAV) {
+                samples[d].resize(size_t(SERIAL_CHUNK_SAMPLES) * d_wav[d].sample_size());
+                if (from > 0) {
+                    d_wav[d].seek(from);
+                    stages[d]->reset(from);
+                    pos[d] = from;
+                }
+            } else if (from > 0) {
+                uint64_t skip = from / item_samples * item_size;
+
+                if (d_files[d].mapped()) {
+                    skip = std::min(skip, d_files[d].size() - d_files[d].size() % item_size);
+                    d_files[d].seek(skip);
+                } else {
+                    /* Pipes and read(): through the data */
+                    uint64_t done = 0;
+                    const void *view;
+                    size_t n;
+
+                    while (done < skip &&
+                           (n = d_files[d].next(&view, size_t(std::min(skip - done, uint64_t(chunk))),
+                                                item_size)) > 0) {
+                        done += n;
+                    }
+                    skip = done;
+                    total += done;
+                }
+                pos[d] = skip / item_size * item_samples;
+                stages[d]->reset(pos[d]);
+            }
+        }
+
+        /* Both captures advance in lockstep so that the merge queues stay short */
+        while (open[NFC_READER] || open[NFC_TAG]) {
+            for (int d = 0; d < 2; d++) {
+                const void *view;
+
+                if (!open[d]) {
+                    continue;
+                }
+
+                if (decoders[d]->pending_start() >= end) {
+                    /* Past the range, nothing in it can come out any more */
+                    stages[d]->finish();
+                    open[d] = false;
+                    running[d] = NULL;
+                    continue;
+                }
+
+                if (cursors[d]) {
+                    /* Runs straight to the decoder, idle stretches cost one run */
+                    frame_decoder *decoder = decoders[d];
+                    uint64_t stop = pos[d] + SERIAL_CHUNK_SAMPLES;
+                    nfcr_run run;
+                    bool more;
+
+                    while ((more = cursors[d]->next(&run))) {
+                        if (run.offset != pos[d]) {
+                            /* Discontinuity, the decoder restarts at the new offset */
+                            decoder->finish();
+                            decoder->reset(run.offset);
+                        }
+                        decoder->push_run(run.level, run.length);
+                        pos[d] = run.offset + run.length;
+                        if (pos[d] >= stop) {
+                            break;
+                        }
+                    }
+
+                    if (!more) {
+                        decoder->finish();
+                        total += d_nfcr[d].size();
+                        open[d] = false;
+                        running[d] = NULL;
+                    }
+                    continue;
+                }
+
+                if (d_config.format == FORMAT_WAV) {
+                    /* One channel out of the interleaved frames */
+                    size_t n = d_wav[d].read(d_config.channels[d], &samples[d][0],
+                                             SERIAL_CHUNK_SAMPLES);
+                    if (d_tap && n > 0) {
+                        d_tap->samples(d, pos[d], &samples[d][0], int(n));
+                    }
+                    stages[d]->process(&samples[d][0], int(n));
+                    pos[d] += n;
+                    total += n * d_wav[d].channels() * d_wav[d].sample_size();
+
+                    if (n < SERIAL_CHUNK_SAMPLES) {
+                        stages[d]->finish();
+                        d_wav[d].close();
+                        open[d] = false;
+                        running[d] = NULL;
+                    }
+                    continue;
+                }
+
+                if (nfcb) {
+                    const nfcb_reader &reader = d_nfcb[d];
+
+                    if (pos[d] == segment_end[d] && pos[d] < reader.nsamples()) {
+                        /* Discontinuity, the decoder restarts at the new offset */
+                        stages[d]->finish();
+                        stages[d]->reset(reader.offset_of(pos[d]));
+                        segment_end[d] = reader.segment_end(pos[d]);
+                    }
+
+                    uint64_t n = std::min(segment_end[d] - pos[d], uint64_t(SERIAL_CHUNK_SAMPLES));
+                    if (d_tap && n > 0) {
+                        d_tap->samples(d, reader.offset_of(pos[d]), reader.data() + pos[d] / 8,
+                                       int(n / 8));
+                    }
+                    stages[d]->process(reader.data() + pos[d] / 8, int(n / 8));
+                    pos[d] += n;
+                    total += n / 8;
+
+                    if (pos[d] == reader.nsamples()) {
+                        stages[d]->finish();
+                        open[d] = false;
+                        running[d] = NULL;
+                    }
+                    continue;
+                }
+
+                size_t n = d_files[d].next(&view, chunk, item_size);
+                if (d_tap && n > 0) {
+                    d_tap->samples(d, pos[d], view, int(n / item_size));
+                }
+                stages[d]->process(view, int(n / item_size));
+                pos[d] += n / item_size * item_samples;
+                total += n;
+
+                if (n < chunk) {
+                    stages[d]->finish();
+                    d_files[d].close();
+                    open[d] = false;
+                    /* Nothing more can come out of this direction */
+                    running[d] = NULL;
+                }
+            }
+
+            merge_frames(active_queues, running, &filter, false);
+        }
+
+        merge_frames(active_queues, running, &filter, true);
+
+        for (int d = 0; d < 2; d++) {
+            delete cursors[d];
+            delete stages[d];
+            delete decoders[d];
+        }
+
+        return total;
+    }
+
+    void
+    capture_job::map_views(capture_view views[2], const capture_view *present[2])
+    {
+        int item_size = format_item_size(d_config.format);
+
+        for (int d = 0; d < 2; d++) {
+            const void *data;
+
+            present[d] = NULL;
+            if (d_config.paths[d].empty()) {
+                continue;
+            }
+
+            views[d].slicer = d_config.slicers[d];
+            present[d] = &views[d];
+
+            if (d_config.format == FORMAT_WAV) {
+                views[d].nsamples = d_wav[d].map_data(&data);
+                views[d].data = (const unsigned char *) data;
+                views[d].origin = 0;
+                views[d].format = d_wav[d].format();
+                continue;
+            }
+
+            if (d_config.format == FORMAT_NFCB) {
+                views[d].data = d_nfcb[d].data();
+                views[d].nsamples = d_nfcb[d].nsamples();
+                views[d].origin = d_nfcb[d].offset_of(0);
+                views[d].format = FORMAT_NFCB;
+                continue;
+            }
+
+            /* The whole mapping at once */
+            d_files[d].seek(0);
+            size_t n = d_files[d].next(&data, size_t(d_files[d].size()), item_size);
+
+            views[d].data = (const unsigned char *) data;
+            views[d].nsamples = uint64_t(n / item_size) * format_item_samples(d_config.format);
+            views[d].origin = 0;
+            views[d].format = d_config.format;
+        }
+    }
+
+    capture_chunks
+    capture_job::chunks(uint64_t chunk_samples)
+    {
+        capture_view views[2];
+        const capture_view *present[2];
+
+        map_views(views, present);
+        return capture_chunks(present, d_config.sample_rate, chunk_samples);
+    }
+
+    capture_chunks
+    capture_job::range_chunks(uint64_t start, uint64_t end, uint64_t chunk_samples)
+    {
+        capture_view views[2];
+        const capture_view *present[2];
+        uint64_t origin;
+
+        map_views(views, present);
+
+        /* can_split() made sure both views share it */
+        origin = present[NFC_READER] ? views[NFC_READER].origin : views[NFC_TAG].origin;
+        start = start > origin ? start - origin : 0;
+        end = end > origin ? end - origin : 0;
+
+        return capture_chunks::range(present, d_config.sample_rate, start, end, chunk_samples);
+    }
+
+    capture_chunks
+    capture_job::active_chunks(uint64_t padding, uint64_t chunk_samples)
+    {
+        capture_view views[2];
+        const capture_view *present[2];
+
+        map_views(views, present);
+        return capture_chunks::active(present, d_config.sample_rate, padding, chunk_samples);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,217 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_CAPTURE_JOB_H
+#define INCLUDED_NFC_CAPTURE_JOB_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "capture_file.h"
+#include "decode_pipeline.h"
+#include "nfcb.h"
+#include "nfcr.h"
+#include "wav_capture.h"
+#include "parallel_decode.h"
+
+/* Default pre-roll of a range decoding (s): longer than a frame and the
+ * usual AGC time constants, a few ms of work at most.
+ */
+#define RANGE_PREROLL_TIME              0.025
+
+/* Capture options shared by the offline tools */
+#define CAPTURE_OPTIONS                 "r:t:f:s:R:T:a:w:"
+#define CAPTURE_USAGE \
+    "  -r FILE    reader capture (modified Miller)\n" \
+    "  -t FILE    tag capture (Manchester)\n" \
+    "  -f FORMAT  capture format: char, packed, float, short, nfcb, nfcr,\n" \
+    "             wav (default char)\n" \
+    "  -s RATE    sample rate in Hz (default 4e6, from the header for\n" \
+    "             nfcb, nfcr and wav)\n" \
+    "  -R SLICER  reader slicer, envelope formats only (default threshold:0.5)\n" \
+    "  -T SLICER  tag slicer, envelope formats only (default threshold:0.5)\n" \
+    "             threshold:T, band:LO,HI or adaptive:MIN,MAX[,WINDOW]\n" \
+    "  -a A,R,REF,AMP  envelope AGC: attack/release times (s), output\n" \
+    "             reference and amplitude\n" \
+    "  -w R[,T]   WAV channels of the reader and tag captures (default 0)\n"
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Profile of one recording: files, format, rate and slicing
+     */
+    struct capture_config
+    {
+        capture_config();
+
+        /*! Apply one of the CAPTURE_OPTIONS, false (and a message) on error */
+        bool parse_option(int opt, const char *arg);
+
+        std::string paths[2];           /* Empty when the direction is absent */
+        sample_format format;
+        double sample_rate;
+        slicer_config slicers[2];
+        agc_config agc;
+        int channels[2];                /* WAV channel of each direction */
+    };
+
+    /*!
+     * \brief One direction of a recording read sequentially, as items for
+     * a sample_stage (WAV channels are extracted). For the tools that
+     * look at the samples rather than decode them.
+     */
+    class capture_stream
+    {
+     public:
+      capture_stream();
+
+      /*! Open direction \p d of \p config, false (and a message) on error */
+      bool open(const capture_config &config, int d, bool use_mmap = true);
+
+      /*! Format of the items: the capture format, the WAV sample type,
+       * FORMAT_PACKED for .nfcb. .nfcr has no items and is refused.
+       */
+      sample_format format() const { return d_format; }
+
+      /*! Sample rate from the header, 0 for raw captures */
+      double sample_rate() const;
+
+      /*! Next items, false once the end is reached */
+      bool next(const void **items, int *nitems);
+
+      /*! True if reading failed, the end was then reached early */
+      bool failed() const { return d_file.failed() || d_wav.failed(); }
+
+     private:
+      capture_file d_file;
+      wav_reader d_wav;
+      nfcb_reader d_nfcb;
+      sample_format d_input;
+      int d_channel;
+      sample_format d_format;
+      int d_item_size;
+      size_t d_chunk;
+      uint64_t d_pos;
+      std::vector<unsigned char> d_buf;
+    };
+
+    /*!
+     * \brief Sees the capture items of a serial decoding on their way to
+     * the sample stages
+     */
+    class sample_tap
+    {
+     public:
+      virtual ~sample_tap() {}
+
+      /*!
+       * \p nitems items of direction \p d, in capture_job::item_format(d),
+       * the first one at absolute sample \p position. Successive calls of
+       * a direction follow each other unless the capture is discontinuous.
+       */
+      virtual void samples(int d, uint64_t position, const void *items, int nitems) = 0;
+    };
+
+    /*!
+     * \brief Open captures of one recording and the ways to decode them
+     */
+    class capture_job
+    {
+     public:
+      capture_job(const capture_config &config);
+
+      /*!
+       * Open the files, false (and a message) on error. The sample rate of
+       * .nfcb, .nfcr and WAV captures comes from their header.
+       */
+      bool open(bool use_mmap = true);
+
+      /*! True if the captures can be decoded in chunks */
+      bool can_split() const;
+
+      /*! Size of the captures in bytes (0 for pipes) */
+      uint64_t size() const;
+
+      /*! True if reading a capture failed during decode_serial(), its
+       * frames then stop early
+       */
+      bool failed() const;
+
+      /*!
+       * Decode in one pass, returns the bytes read.
+       *
+       * With a range, only the frames starting in [\p start, \p end)
+       * (absolute samples) are written. The captures are entered \p preroll
+       * samples before the start, directly on mapped files and through
+       * the index of .nfcb and .nfcr, so that the AGC, the slicer and the
+       * decoders have settled by then; decoding stops as soon as no frame
+       * starting in the range can come out any more.
+       */
+      uint64_t decode_serial(frame_sink *sink, uint64_t start = 0,
+                             uint64_t end = UINT64_MAX, uint64_t preroll = 0);
+
+      /*!
+       * Show the items of decode_serial to \p tap (NULL for none) before
+       * they are decoded. .nfcr captures have no items and are not shown.
+       */
+      void set_tap(sample_tap *tap) { d_tap = tap; }
+
+      /*! Format of the items of direction \p d: the capture format, the
+       * WAV sample type, FORMAT_PACKED for .nfcb
+       */
+      sample_format item_format(int d) const;
+
+      /*! Chunks of the mapped captures, only if can_split() */
+      capture_chunks chunks(uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES);
+
+      /*! Chunks covering only the activity, only if can_split() */
+      capture_chunks active_chunks(uint64_t padding,
+                                   uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES);
+
+      /*! Chunks around the range [\p start, \p end) (absolute samples),
+       * only if can_split(). The frames need a range_filter.
+       */
+      capture_chunks range_chunks(uint64_t start, uint64_t end,
+                                  uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES);
+
+      const capture_config &config() const { return d_config; }
+
+      /*! Time of the first sample from the .nfcb/.nfcr header (0 if
+       * unknown), its absolute position in \p start_sample
+       */
+      int64_t start_time_ns(uint64_t *start_sample) const;
+
+     private:
+      /*! Format of the samples the stage of direction \p d gets */
+      sample_format stage_format(int d) const;
+
+      void map_views(capture_view views[2], const capture_view *present[2]);
+
+      capture_config d_config;
+      capture_file d_files[2];
+      nfcb_reader d_nfcb[2];            /* Instead of d_files for FORMAT_NFCB */
+      nfcr_reader d_nfcr[2];            /* Instead of d_files for FORMAT_NFCR */
+      wav_reader d_wav[2];              /* Instead of d_files for FORMAT_WAV */
+      sample_tap *d_tap;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_CAPTURE_JOB_H */
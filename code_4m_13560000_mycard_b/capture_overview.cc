@@ -0,0 +1,372 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "capture_overview.h"
+#include "nfcb.h"
+
+/* Write buffer of level 0, written sequentially */
+#define OVERVIEW_WRITE_BUFFER           (1 << 20)
+
+namespace gr {
+  namespace nfc {
+
+    static void
+    put_bucket (unsigned char *p, const overview_bucket &b)
+    {
+        uint32_t v[3];
+
+        memcpy(v, &b, sizeof(v));
+        for (int i = 0; i < 3; i++) {
+            nfcb_put_le(p + 4 * i, v[i], 4);
+        }
+    }
+
+    static overview_bucket
+    get_bucket (const unsigned char *p)
+    {
+        overview_bucket b;
+        uint32_t v[3];
+
+        for (int i = 0; i < 3; i++) {
+            v[i] = uint32_t(nfcb_get_le(p + 4 * i, 4));
+        }
+        memcpy(&b, v, sizeof(b));
+        return b;
+    }
+
+    overview_builder::overview_builder()
+      : d_fp(NULL)
+    {
+    }
+
+    overview_builder::~overview_builder()
+    {
+        close();
+    }
+
+    bool
+    overview_builder::open(const char *path, double sample_rate)
+    {
+        unsigned char header[OVERVIEW_HEADER_SIZE];
+
+        d_fp = fopen(path, "wb");
+        if (!d_fp) {
+            perror(path);
+            return false;
+        }
+        setvbuf(d_fp, NULL, _IOFBF, OVERVIEW_WRITE_BUFFER);
+
+        d_sample_rate = sample_rate;
+        d_nsamples = 0;
+        d_level0 = 0;
+        d_acc.assign(OVERVIEW_MAX_LEVELS, accumulator());
+        d_levels.assign(OVERVIEW_MAX_LEVELS, std::vector<overview_bucket>());
+
+        /* Rewritten by close() */
+        memset(header, 0, sizeof(header));
+        fwrite(header, 1, sizeof(header), d_fp);
+
+        return true;
+    }
+
+    void
+    overview_builder::emit(int level)
+    {
+        accumulator &a = d_acc[level];
+        overview_bucket b;
+
+        if (a.children == 0) {
+            return;
+        }
+
+        b.min = a.min;
+        b.max = a.max;
+        b.mean = float(a.sum / a.count);
+
+        if (level == 0) {
+            unsigned char p[sizeof(overview_bucket)];
+
+            put_bucket(p, b);
+            fwrite(p, 1, sizeof(p), d_fp);
+            d_level0++;
+        } else {
+            d_levels[level].push_back(b);
+        }
+
+        if (level + 1 < OVERVIEW_MAX_LEVELS) {
+            push(level + 1, a.min, a.max, a.sum, a.count);
+        }
+        a.children = 0;
+    }
+
+    inline void
+    overview_builder::push(int level, float min, float max, double sum, uint64_t count)
+    {
+        accumulator &a = d_acc[level];
+
+        if (a.children == 0) {
+            a.min = min;
+            a.max = max;
+            a.sum = 0;
+            a.count = 0;
+        } else {
+            a.min = std::min(a.min, min);
+            a.max = std::max(a.max, max);
+        }
+        a.sum += sum;
+        a.count += count;
+
+        if (++a.children == OVERVIEW_FACTOR) {
+            emit(level);
+        }
+    }
+
+    template <typename T> void
+    overview_builder::add_samples(const T *in, int n)
+    {
+        accumulator &a = d_acc[0];
+        int i = 0;
+
+        d_nsamples += n;
+
+        /* Whole buckets at once when aligned */
+        while (i < n) {
+            if (a.children == 0 && n - i >= OVERVIEW_FACTOR) {
+                float lo = float(in[i]), hi = lo;
+                double sum = 0;
+
+                for (int j = 0; j < OVERVIEW_FACTOR; j++) {
+                    float v = float(in[i + j]);
+
+                    lo = std::min(lo, v);
+                    hi = std::max(hi, v);
+                    sum += v;
+                }
+                a.min = lo;
+                a.max = hi;
+                a.sum = sum;
+                a.count = OVERVIEW_FACTOR;
+                a.children = OVERVIEW_FACTOR;
+                emit(0);
+                i += OVERVIEW_FACTOR;
+            } else {
+                float v = float(in[i++]);
+
+                push(0, v, v, v, 1);
+            }
+        }
+    }
+
+    void
+    overview_builder::add(const float *in, int n)
+    {
+        add_samples(in, n);
+    }
+
+    void
+    overview_builder::add(const short *in, int n)
+    {
+        add_samples(in, n);
+    }
+
+    void
+    overview_builder::add(const unsigned char *in, int n)
+    {
+        add_samples(in, n);
+    }
+
+    void
+    overview_builder::add_packed(const unsigned char *in, int nbytes)
+    {
+        d_unpacked.resize(8 * size_t(nbytes));
+        for (int i = 0; i < nbytes; i++) {
+            for (int j = 0; j < 8; j++) {
+                d_unpacked[8 * i + j] = float((in[i] >> (7 - j)) & 1);
+            }
+        }
+        add_samples(d_unpacked.empty() ? NULL : &d_unpacked[0], 8 * nbytes);
+    }
+
+    bool
+    overview_builder::close()
+    {
+        unsigned char header[OVERVIEW_HEADER_SIZE];
+        unsigned char p[sizeof(overview_bucket)];
+        uint64_t offset;
+        int levels = 0;
+        bool ok;
+
+        if (!d_fp) {
+            return true;
+        }
+
+        /* Partial buckets, from the finest so that they reach the top */
+        for (int k = 0; k < OVERVIEW_MAX_LEVELS; k++) {
+            emit(k);
+        }
+
+        memset(header, 0, sizeof(header));
+        memcpy(header, OVERVIEW_MAGIC, 8);
+        nfcb_put_le(header + 8, OVERVIEW_VERSION, 4);
+        nfcb_put_le(header + 12, OVERVIEW_HEADER_SIZE, 4);
+        memcpy(p, &d_sample_rate, 8);
+        nfcb_put_le(header + 16, nfcb_get_le(p, 8), 8);
+        nfcb_put_le(header + 24, d_nsamples, 8);
+        nfcb_put_le(header + 32, OVERVIEW_FACTOR, 4);
+
+        /* Levels up to the first single bucket one */
+        offset = OVERVIEW_HEADER_SIZE;
+        for (int k = 0; k < OVERVIEW_MAX_LEVELS; k++) {
+            uint64_t count = k == 0 ? d_level0 : d_levels[k].size();
+
+            if (count == 0) {
+                break;
+            }
+            nfcb_put_le(header + 40 + 16 * k, offset, 8);
+            nfcb_put_le(header + 48 + 16 * k, count, 8);
+            levels++;
+
+            if (k > 0) {
+                for (size_t i = 0; i < d_levels[k].size(); i++) {
+                    put_bucket(p, d_levels[k][i]);
+                    fwrite(p, 1, sizeof(p), d_fp);
+                }
+            }
+            offset += count * sizeof(overview_bucket);
+
+            if (count == 1) {
+                break;
+            }
+        }
+        nfcb_put_le(header + 36, levels, 4);
+
+        fseek(d_fp, 0, SEEK_SET);
+        fwrite(header, 1, sizeof(header), d_fp);
+
+        ok = !ferror(d_fp);
+        ok = (fclose(d_fp) == 0) && ok;
+        d_fp = NULL;
+
+        return ok;
+    }
+
+    overview_reader::overview_reader()
+      : d_sample_rate(0),
+        d_nsamples(0)
+    {
+    }
+
+    bool
+    overview_reader::open(const char *path)
+    {
+        const unsigned char *p;
+        uint64_t size, rate;
+        const void *view;
+        int levels;
+
+        if (!d_file.open(path) || !d_file.mapped()) {
+            fprintf(stderr, "%s: %s\n", path, errno ? strerror(errno) : "not a regular file");
+            return false;
+        }
+
+        size = d_file.size();
+        d_file.next(&view, size_t(size));
+        p = (const unsigned char *) view;
+
+        if (size < OVERVIEW_HEADER_SIZE || memcmp(p, OVERVIEW_MAGIC, 8) != 0 ||
+            nfcb_get_le(p + 8, 4) != OVERVIEW_VERSION ||
+            nfcb_get_le(p + 32, 4) != OVERVIEW_FACTOR) {
+            fprintf(stderr, "%s: not a version %d overview\n", path, OVERVIEW_VERSION);
+            return false;
+        }
+
+        rate = nfcb_get_le(p + 16, 8);
+        memcpy(&d_sample_rate, &rate, sizeof(d_sample_rate));
+        d_nsamples = nfcb_get_le(p + 24, 8);
+        levels = int(std::min(nfcb_get_le(p + 36, 4), uint64_t(OVERVIEW_MAX_LEVELS)));
+
+        for (int k = 0; k < levels; k++) {
+            uint64_t offset = nfcb_get_le(p + 40 + 16 * k, 8);
+            uint64_t count = nfcb_get_le(p + 48 + 16 * k, 8);
+
+            if (offset > size || count > (size - offset) / sizeof(overview_bucket)) {
+                fprintf(stderr, "%s: truncated overview\n", path);
+                return false;
+            }
+            d_data.push_back(p + offset);
+            d_sizes.push_back(count);
+        }
+
+        return true;
+    }
+
+    void
+    overview_reader::query(uint64_t start, uint64_t end, int columns,
+                           std::vector<overview_bucket> *out) const
+    {
+        double per_column;
+        uint64_t bucket = OVERVIEW_FACTOR;
+        int level = 0;
+
+        out->clear();
+        end = std::min(end, d_nsamples);
+        if (columns <= 0 || start >= end || d_sizes.empty()) {
+            return;
+        }
+
+        /* Coarsest level with buckets no longer than a column */
+        per_column = double(end - start) / columns;
+        while (level + 1 < levels() && bucket * OVERVIEW_FACTOR <= per_column) {
+            bucket *= OVERVIEW_FACTOR;
+            level++;
+        }
+
+        const unsigned char *data = d_data[level];
+        uint64_t count = d_sizes[level];
+
+        out->resize(columns);
+        for (int c = 0; c < columns; c++) {
+            uint64_t s0 = start + uint64_t(c * per_column);
+            uint64_t s1 = std::max(start + uint64_t((c + 1) * per_column), s0 + 1);
+            uint64_t i0 = std::min(s0 / bucket, count - 1);
+            uint64_t i1 = std::min((s1 + bucket - 1) / bucket, count);
+            overview_bucket &o = (*out)[c];
+            double sum = 0;
+
+            o = get_bucket(data + i0 * sizeof(overview_bucket));
+            sum = o.mean;
+            for (uint64_t i = i0 + 1; i < i1; i++) {
+                overview_bucket b = get_bucket(data + i * sizeof(overview_bucket));
+
+                o.min = std::min(o.min, b.min);
+                o.max = std::max(o.max, b.max);
+                sum += b.mean;
+            }
+            o.mean = float(sum / (i1 > i0 ? i1 - i0 : 1));
+        }
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
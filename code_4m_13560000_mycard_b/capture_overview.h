@@ -0,0 +1,138 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_CAPTURE_OVERVIEW_H
+#define INCLUDED_NFC_CAPTURE_OVERVIEW_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "capture_file.h"
+
+/*
+ * .ovw overview: min/max/mean pyramid of a capture, to draw any part of
+ * it at any zoom without reading the samples.
+ *
+ *   header     OVERVIEW_HEADER_SIZE bytes, little endian:
+ *                0  magic "NFCOVW01"
+ *                8  u32 version, u32 header size
+ *               16  f64 sample rate, u64 samples
+ *               32  u32 factor (16), u32 levels
+ *               40  per level: u64 file offset, u64 buckets
+ *   levels     f32 min, f32 max, f32 mean per bucket. A bucket of level
+ *              k covers factor^(k+1) samples, the last one may be partial.
+ *
+ * Level 0 is written while the capture streams by, the coarser levels
+ * (1/15 of it) are kept in memory and appended at the end.
+ */
+#define OVERVIEW_MAGIC                  "NFCOVW01"
+#define OVERVIEW_VERSION                1
+#define OVERVIEW_FACTOR                 16
+#define OVERVIEW_MAX_LEVELS             16
+#define OVERVIEW_HEADER_SIZE            (40 + 16 * OVERVIEW_MAX_LEVELS)
+
+namespace gr {
+  namespace nfc {
+
+    struct overview_bucket
+    {
+        float min;
+        float max;
+        float mean;
+    };
+
+    /*!
+     * \brief Builds a .ovw file in one streaming pass
+     */
+    class overview_builder
+    {
+     public:
+      overview_builder();
+      ~overview_builder();
+
+      bool open(const char *path, double sample_rate);
+
+      /* Samples of any envelope or sliced type */
+      void add(const float *in, int n);
+      void add(const short *in, int n);
+      void add(const unsigned char *in, int n);
+
+      /*! 8 samples per byte, first sample in the MSB */
+      void add_packed(const unsigned char *in, int nbytes);
+
+      /*! Flush the partial buckets, append the levels, write the header */
+      bool close();
+
+     private:
+      struct accumulator
+      {
+          float min;
+          float max;
+          double sum;
+          uint64_t count;       /* Samples covered */
+          int children;         /* Samples or lower level buckets */
+      };
+
+      template <typename T> void add_samples(const T *in, int n);
+      void push(int level, float min, float max, double sum, uint64_t count);
+      void emit(int level);
+
+      FILE *d_fp;
+      double d_sample_rate;
+      uint64_t d_nsamples;
+      uint64_t d_level0;        /* Buckets of level 0 written */
+      std::vector<accumulator> d_acc;
+      std::vector<std::vector<overview_bucket> > d_levels;  /* Level 1 and up */
+      std::vector<float> d_unpacked;
+    };
+
+    /*!
+     * \brief Mapped .ovw file and its queries
+     */
+    class overview_reader
+    {
+     public:
+      overview_reader();
+
+      /*! False with a message on error */
+      bool open(const char *path);
+
+      double sample_rate() const { return d_sample_rate; }
+      uint64_t nsamples() const { return d_nsamples; }
+      int levels() const { return int(d_sizes.size()); }
+
+      /*!
+       * \p columns buckets evenly covering samples [\p start, \p end), from
+       * the coarsest level that still has at least one bucket per column.
+       * At most 2 * OVERVIEW_FACTOR buckets are read per column.
+       */
+      void query(uint64_t start, uint64_t end, int columns,
+                 std::vector<overview_bucket> *out) const;
+
+     private:
+      capture_file d_file;
+      double d_sample_rate;
+      uint64_t d_nsamples;
+      std::vector<const unsigned char *> d_data;
+      std::vector<uint64_t> d_sizes;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_CAPTURE_OVERVIEW_H */
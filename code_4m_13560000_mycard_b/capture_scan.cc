@@ -0,0 +1,255 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "capture_scan.h"
+
+namespace gr {
+  namespace nfc {
+
+    /* Level of a block of raw bytes: constant value or not */
+    static block_level
+    scan_bytes (const unsigned char *in, int n, unsigned char low, unsigned char high)
+    {
+        uint64_t pattern;
+        int i = 0;
+
+        if (in[0] != low && in[0] != high) {
+            return BLOCK_MIXED;
+        }
+
+        memset(&pattern, in[0], sizeof(pattern));
+        for (; i + 8 <= n; i += 8) {
+            uint64_t v;
+
+            memcpy(&v, in + i, sizeof(v));
+            if (v != pattern) {
+                return BLOCK_MIXED;
+            }
+        }
+        for (; i < n; i++) {
+            if (in[i] != in[0]) {
+                return BLOCK_MIXED;
+            }
+        }
+
+        return in[0] == high ? BLOCK_HIGH : BLOCK_LOW;
+    }
+
+    static block_level
+    classify (float min, float max, const slicer_config &slicer)
+    {
+        if (slicer.type == SLICER_BAND) {
+            if (min >= slicer.a && max <= slicer.b) {
+                return BLOCK_HIGH;
+            }
+            if (max < slicer.a || min > slicer.b) {
+                return BLOCK_LOW;
+            }
+            return BLOCK_MIXED;
+        }
+
+        if (min >= slicer.a) {
+            return BLOCK_HIGH;
+        }
+        if (max < slicer.a) {
+            return BLOCK_LOW;
+        }
+        return BLOCK_MIXED;
+    }
+
+    block_level
+    scan_block (const capture_view &view, uint64_t start, int nsamples)
+    {
+        float min, max, mean;
+
+        switch (view.format) {
+        case FORMAT_CHAR:
+            /* The Manchester decoder sums the raw bytes, only a constant
+             * value is quiet.
+             */
+            return scan_bytes(view.data + start, nsamples, 0, view.data[start] ? view.data[start] : 1);
+
+        case FORMAT_PACKED:
+        case FORMAT_NFCB:
+            return scan_bytes(view.data + start / 8, nsamples / 8, 0x00, 0xff);
+
+        case FORMAT_FLOAT:
+            agc_block_stats((const float *) view.data + start, nsamples, &min, &max, &mean);
+            return classify(min, max, view.slicer);
+
+        case FORMAT_SHORT:
+            agc_block_stats((const short *) view.data + start, nsamples, &min, &max, &mean);
+            /* The slicer compares with the thresholds converted to short */
+            {
+                slicer_config s = view.slicer;
+                s.a = short(s.a);
+                s.b = short(s.b);
+                return classify(min, max, s);
+            }
+
+        case FORMAT_NFCR:
+        case FORMAT_WAV:
+            /* Runs have no sample view, WAV views are short or float */
+            break;
+        }
+
+        return BLOCK_MIXED;
+    }
+
+    uint64_t
+    find_cut (const capture_view *views, const unsigned int *levels,
+              const uint64_t *margins, int nviews, uint64_t from, uint64_t limit)
+    {
+        const uint64_t block = SCAN_BLOCK_SAMPLES;
+        uint64_t margin = 0;
+        uint64_t pos;
+
+        for (int v = 0; v < nviews; v++) {
+            margin = std::max(margin, margins[v]);
+        }
+        margin = (margin + block - 1) / block * block;
+
+        /* Start of the current quiet run of each capture, the run must
+         * already hold margin samples when the scan starts at from.
+         */
+        std::vector<uint64_t> run_start(nviews);
+        std::vector<int> run_level(nviews);
+        uint64_t first = from > margin ? (from - margin) / block * block : 0;
+
+        for (int v = 0; v < nviews; v++) {
+            run_start[v] = first;
+            run_level[v] = -1;
+        }
+
+        /* The right side of a cut just before limit is past it */
+        for (pos = first; pos < limit + margin; pos += block) {
+            uint64_t end = pos + block;
+            bool ok = true;
+
+            for (int v = 0; v < nviews; v++) {
+                const capture_view &view = views[v];
+                int level;
+
+                if (pos >= view.nsamples) {
+                    /* Past the end, the decoder gets nothing more */
+                    continue;
+                }
+
+                level = scan_block(view, pos, int(std::min(block, view.nsamples - pos)));
+                if (level == BLOCK_MIXED || !(levels[v] & (1 << level))) {
+                    run_start[v] = end;
+                    run_level[v] = -1;
+                } else if (level != run_level[v]) {
+                    run_start[v] = pos;
+                    run_level[v] = level;
+                }
+            }
+
+            /* Cut margin samples back, if every run covers both sides */
+            if (end < margin || end - margin < from) {
+                continue;
+            }
+
+            uint64_t cut = end - margin;
+            if (cut >= limit) {
+                break;
+            }
+            for (int v = 0; v < nviews; v++) {
+                if (cut < views[v].nsamples && run_start[v] + margins[v] > cut) {
+                    ok = false;
+                }
+            }
+            if (ok) {
+                return cut;
+            }
+        }
+
+        return limit;
+    }
+
+    std::vector<activity_region>
+    scan_activity (const capture_view *views, const unsigned int *levels,
+                   const uint64_t *margins, int nviews, uint64_t padding)
+    {
+        const uint64_t block = SCAN_BLOCK_SAMPLES;
+        std::vector<activity_region> regions;
+        std::vector<int> previous(nviews, -1);
+        uint64_t nsamples = 0;
+        uint64_t pad = padding;
+
+        for (int v = 0; v < nviews; v++) {
+            nsamples = std::max(nsamples, views[v].nsamples);
+            pad = std::max(pad, margins[v]);
+        }
+        /* One more block: a level change may sit right at a block start */
+        pad = (pad + block - 1) / block * block + block;
+
+        for (uint64_t pos = 0; pos < nsamples; pos += block) {
+            bool active = false;
+
+            for (int v = 0; v < nviews; v++) {
+                const capture_view &view = views[v];
+
+                if (pos >= view.nsamples) {
+                    continue;
+                }
+
+                int level = scan_block(view, pos, int(std::min(block, view.nsamples - pos)));
+                if (level == BLOCK_MIXED || !(levels[v] & (1 << level)) ||
+                    (previous[v] >= 0 && level != previous[v])) {
+                    active = true;
+                }
+                previous[v] = level;
+            }
+
+            if (!active) {
+                continue;
+            }
+
+            uint64_t start = pos > pad ? pos - pad : 0;
+            uint64_t end = std::min(pos + block + pad, nsamples);
+
+            if (!regions.empty() && start <= regions.back().end) {
+                regions.back().end = end;
+            } else {
+                activity_region r = { start, end };
+                regions.push_back(r);
+            }
+        }
+
+        return regions;
+    }
+
+    void
+    write_activity (FILE *fp, const std::vector<activity_region> &regions)
+    {
+        for (size_t i = 0; i < regions.size(); i++) {
+            fprintf(fp, "%llu %llu\n", (unsigned long long) regions[i].start,
+                    (unsigned long long) regions[i].end);
+        }
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
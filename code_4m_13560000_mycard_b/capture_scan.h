@@ -0,0 +1,102 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_CAPTURE_SCAN_H
+#define INCLUDED_NFC_CAPTURE_SCAN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "decode_pipeline.h"
+
+/* Granularity of the scan, a multiple of 8 so that packed captures are
+ * scanned on byte boundaries.
+ */
+#define SCAN_BLOCK_SAMPLES              256
+
+namespace gr {
+  namespace nfc {
+
+    enum block_level {
+        BLOCK_LOW = 0,          /* Every sample slices low */
+        BLOCK_HIGH = 1,         /* Every sample slices high */
+        BLOCK_MIXED = 2,        /* Anything else */
+    };
+
+    /*!
+     * \brief One capture as seen by the scan: a memory view (usually a
+     * capture_file mapping) in a given format and with a fixed slicer.
+     */
+    struct capture_view
+    {
+        const unsigned char *data;
+        uint64_t nsamples;
+        uint64_t origin;                /* Absolute position of the first sample */
+        sample_format format;
+        slicer_config slicer;
+    };
+
+    /*!
+     * Level of the \p nsamples samples starting at sample \p start, as the
+     * decoder would see them. Exact, from block min/max (SIMD for
+     * envelopes). \p start and \p nsamples must be multiples of 8 for
+     * packed captures.
+     */
+    block_level scan_block(const capture_view &view, uint64_t start, int nsamples);
+
+    /*!
+     * First position at or after \p from where all the captures can be
+     * cut: each of them stays at one of the \p levels of its decoder for
+     * \p margin samples on both sides (past its end counts as quiet).
+     * Returns a multiple of SCAN_BLOCK_SAMPLES, or \p limit if there is
+     * no such position before it.
+     */
+    uint64_t find_cut(const capture_view *views, const unsigned int *levels,
+                      const uint64_t *margins, int nviews, uint64_t from, uint64_t limit);
+
+    /*!
+     * \brief Stretch of a capture holding some activity
+     */
+    struct activity_region
+    {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    /*!
+     * Activity index of the captures, in one pass of block min/max.
+     *
+     * A block is active when any capture changes level in it or at its
+     * start, or sits at a level its decoder cannot be cut in. Active
+     * blocks are padded with max(margin, \p padding) samples on both
+     * sides and merged, so that the region bounds are valid cuts: decoding
+     * only the regions, each with freshly reset decoders, gives the same
+     * frames as decoding everything.
+     */
+    std::vector<activity_region> scan_activity(const capture_view *views,
+                                               const unsigned int *levels,
+                                               const uint64_t *margins, int nviews,
+                                               uint64_t padding);
+
+    /*! Write the index as "START END" lines (samples) */
+    void write_activity(FILE *fp, const std::vector<activity_region> &regions);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_CAPTURE_SCAN_H */
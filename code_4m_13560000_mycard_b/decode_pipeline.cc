@@ -0,0 +1,298 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include "decode_pipeline.h"
+
+#define DEFAULT_SLICER_WINDOW           65536
+#define DEFAULT_SLICER_HYSTERESIS       0.1f
+
+namespace gr {
+  namespace nfc {
+
+    bool
+    parse_format (const char *s, sample_format *format)
+    {
+        if (!strcmp(s, "char")) {
+            *format = FORMAT_CHAR;
+        } else if (!strcmp(s, "packed")) {
+            *format = FORMAT_PACKED;
+        } else if (!strcmp(s, "float")) {
+            *format = FORMAT_FLOAT;
+        } else if (!strcmp(s, "short")) {
+            *format = FORMAT_SHORT;
+        } else if (!strcmp(s, "nfcb")) {
+            *format = FORMAT_NFCB;
+        } else if (!strcmp(s, "nfcr")) {
+            *format = FORMAT_NFCR;
+        } else if (!strcmp(s, "wav")) {
+            *format = FORMAT_WAV;
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    parse_slicer (const char *s, slicer_config *config)
+    {
+        config->window = DEFAULT_SLICER_WINDOW;
+
+        if (sscanf(s, "threshold:%f", &config->a) == 1) {
+            config->type = SLICER_THRESHOLD;
+        } else if (sscanf(s, "band:%f,%f", &config->a, &config->b) == 2) {
+            config->type = SLICER_BAND;
+        } else if (sscanf(s, "adaptive:%f,%f,%d", &config->a, &config->b, &config->window) >= 2) {
+            config->type = SLICER_ADAPTIVE;
+            if (config->window < 16) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    parse_agc (const char *s, agc_config *config)
+    {
+        config->enabled = sscanf(s, "%f,%f,%f,%f", &config->attack, &config->release,
+                                 &config->reference, &config->amplitude) == 4;
+
+        return config->enabled;
+    }
+
+    bool
+    parse_position (const char *s, double sample_rate, uint64_t *position)
+    {
+        char *end;
+        double v = strtod(s, &end);
+
+        if (end == s || v < 0) {
+            return false;
+        }
+        if (!strcmp(end, "s")) {
+            v *= sample_rate;
+        } else if (!strcmp(end, "ms")) {
+            v *= sample_rate * 1e-3;
+        } else if (!strcmp(end, "us")) {
+            v *= sample_rate * 1e-6;
+        } else if (*end) {
+            return false;
+        }
+
+        *position = uint64_t(v + 0.5);
+        return true;
+    }
+
+    bool
+    parse_range (const char *s, double sample_rate, uint64_t *start, uint64_t *end)
+    {
+        const char *colon = strchr(s, ':');
+        std::string first(s, colon ? colon - s : strlen(s));
+
+        if (!colon) {
+            return false;
+        }
+
+        *start = 0;
+        *end = UINT64_MAX;
+        if (!first.empty() && !parse_position(first.c_str(), sample_rate, start)) {
+            return false;
+        }
+        if (colon[1] && !parse_position(colon + 1, sample_rate, end)) {
+            return false;
+        }
+
+        return *start < *end;
+    }
+
+    int
+    format_item_size (sample_format format)
+    {
+        switch (format) {
+        case FORMAT_FLOAT:
+            return sizeof(float);
+        case FORMAT_SHORT:
+            return sizeof(short);
+        default:
+            return 1;
+        }
+    }
+
+    int
+    format_item_samples (sample_format format)
+    {
+        return (format == FORMAT_PACKED || format == FORMAT_NFCB) ? 8 : 1;
+    }
+
+    sample_stage::sample_stage(sample_format format, double sample_rate,
+                               const slicer_config &slicer, const agc_config &agc,
+                               frame_decoder *decoder)
+      : d_format(format),
+        d_slicer_config(slicer),
+        d_decoder(decoder),
+        d_agc(NULL),
+        d_slicer(NULL)
+    {
+        bool envelope = format == FORMAT_FLOAT || format == FORMAT_SHORT;
+
+        if (envelope && agc.enabled) {
+            d_agc = new agc_tracker(sample_rate, agc.attack, agc.release,
+                                    agc.reference, agc.amplitude);
+        }
+
+        if (envelope && slicer.type == SLICER_ADAPTIVE) {
+            d_slicer = new histogram_slicer(slicer.a, slicer.b, slicer.window,
+                                            slicer.window / 16, DEFAULT_SLICER_HYSTERESIS);
+        }
+    }
+
+    sample_stage::~sample_stage()
+    {
+        delete d_agc;
+        delete d_slicer;
+    }
+
+    void
+    sample_stage::reset(uint64_t position)
+    {
+        if (d_agc) {
+            d_agc->reset();
+        }
+        if (d_slicer) {
+            d_slicer->reset();
+        }
+
+        d_decoder->reset(position);
+    }
+
+    template <typename T> void
+    sample_stage::slice(const T *in, int n)
+    {
+        const T a = T(d_slicer_config.a), b = T(d_slicer_config.b);
+
+        d_bits.resize(n);
+
+        if (d_slicer) {
+            d_slicer->process(in, &d_bits[0], n);
+        } else if (d_slicer_config.type == SLICER_BAND) {
+            for (int i = 0; i < n; i++) {
+                d_bits[i] = in[i] >= a && in[i] <= b;
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                d_bits[i] = in[i] >= a;
+            }
+        }
+
+        d_decoder->process(&d_bits[0], n);
+    }
+
+    void
+    sample_stage::process(const void *in, int nitems)
+    {
+        if (nitems <= 0) {
+            return;
+        }
+
+        switch (d_format) {
+        case FORMAT_CHAR:
+            d_decoder->process((const unsigned char *) in, nitems);
+            break;
+
+        case FORMAT_PACKED:
+        case FORMAT_NFCB:
+            d_decoder->process_packed((const unsigned char *) in, nitems);
+            break;
+
+        case FORMAT_FLOAT:
+            if (d_agc) {
+                d_float.resize(nitems);
+                d_agc->process((const float *) in, &d_float[0], nitems);
+                in = &d_float[0];
+            }
+            slice((const float *) in, nitems);
+            break;
+
+        case FORMAT_SHORT:
+            if (d_agc) {
+                d_short.resize(nitems);
+                d_agc->process((const short *) in, &d_short[0], nitems);
+                in = &d_short[0];
+            }
+            slice((const short *) in, nitems);
+            break;
+
+        case FORMAT_NFCR:
+        case FORMAT_WAV:
+            /* capture_job hands the runs to the decoder, and the WAV
+             * channel as FORMAT_SHORT or FORMAT_FLOAT.
+             */
+            break;
+        }
+    }
+
+    void
+    sample_stage::finish()
+    {
+        d_decoder->finish();
+    }
+
+    void
+    merge_frames (frame_queue *queues[2], frame_decoder *decoders[2],
+                  frame_sink *sink, bool all)
+    {
+        for (;;) {
+            std::deque<nfc_frame> *q0 = queues[0] ? &queues[0]->d_frames : NULL;
+            std::deque<nfc_frame> *q1 = queues[1] ? &queues[1]->d_frames : NULL;
+            int pick;
+
+            if (q0 && !q0->empty() && (!q1 || q1->empty())) {
+                pick = 0;
+            } else if (q1 && !q1->empty() && (!q0 || q0->empty())) {
+                pick = 1;
+            } else if (q0 && q1 && !q0->empty()) {
+                pick = q1->front().start < q0->front().start ? 1 : 0;
+            } else {
+                return;
+            }
+
+            /* The other decoder may still output an earlier frame */
+            std::deque<nfc_frame> *other = pick ? q0 : q1;
+            if (!all && decoders[!pick] && (!other || other->empty()) &&
+                decoders[!pick]->pending_start() <= queues[pick]->d_frames.front().start) {
+                return;
+            }
+
+            sink->write(queues[pick]->d_frames.front());
+            queues[pick]->d_frames.pop_front();
+        }
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
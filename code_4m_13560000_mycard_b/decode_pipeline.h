@@ -0,0 +1,169 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_DECODE_PIPELINE_H
+#define INCLUDED_NFC_DECODE_PIPELINE_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "frame_decoder.h"
+#include "agc_tracker.h"
+#include "histogram_slicer.h"
+
+namespace gr {
+  namespace nfc {
+
+    enum sample_format {
+        FORMAT_CHAR,            /* One sliced sample per byte */
+        FORMAT_PACKED,          /* 8 sliced samples per byte, MSB first */
+        FORMAT_FLOAT,           /* Float envelope */
+        FORMAT_SHORT,           /* int16 envelope */
+        FORMAT_NFCB,            /* .nfcb file, packed with a header (nfcb.h) */
+        FORMAT_NFCR,            /* .nfcr file, runs fed to the decoder (nfcr.h) */
+        FORMAT_WAV,             /* WAV/RF64 file, read as short or float (wav_capture.h) */
+    };
+
+    enum slicer_type {
+        SLICER_THRESHOLD,       /* High at or above a */
+        SLICER_BAND,            /* High within [a, b], like tag_signal */
+        SLICER_ADAPTIVE,        /* histogram_slicer over [a, b] */
+    };
+
+    struct slicer_config
+    {
+        slicer_type type;
+        float a;
+        float b;
+        int window;
+    };
+
+    struct agc_config
+    {
+        bool enabled;
+        float attack;
+        float release;
+        float reference;
+        float amplitude;
+    };
+
+    /* Command line parsers, return false on a malformed value */
+    bool parse_format(const char *s, sample_format *format);
+    bool parse_slicer(const char *s, slicer_config *config);
+    bool parse_agc(const char *s, agc_config *config);
+
+    /*! Sample position: a count of samples, or a time with an s, ms or us
+     * suffix converted at \p sample_rate.
+     */
+    bool parse_position(const char *s, double sample_rate, uint64_t *position);
+
+    /*! Sample range START:END (positions as above), either side may be
+     * empty for the start or the end of the capture.
+     */
+    bool parse_range(const char *s, double sample_rate, uint64_t *start, uint64_t *end);
+
+    /*! Bytes per input item, an item of FORMAT_PACKED or FORMAT_NFCB
+     * holds 8 samples. The data of FORMAT_NFCB starts after its header.
+     */
+    int format_item_size(sample_format format);
+
+    /*! Samples per input item */
+    int format_item_samples(sample_format format);
+
+    /*!
+     * \brief Turns capture items into decoder input for one direction:
+     * optional AGC and slicing for envelopes, nothing for sliced input.
+     */
+    class sample_stage
+    {
+     public:
+      sample_stage(sample_format format, double sample_rate, const slicer_config &slicer,
+                   const agc_config &agc, frame_decoder *decoder);
+      ~sample_stage();
+
+      /*! Restart at absolute sample \p position */
+      void reset(uint64_t position);
+
+      /*! Feed \p nitems capture items */
+      void process(const void *in, int nitems);
+
+      void finish();
+
+      frame_decoder *decoder() const { return d_decoder; }
+
+     private:
+      template <typename T> void slice(const T *in, int n);
+
+      sample_format d_format;
+      slicer_config d_slicer_config;
+      frame_decoder *d_decoder;
+      agc_tracker *d_agc;
+      histogram_slicer *d_slicer;
+      std::vector<float> d_float;
+      std::vector<short> d_short;
+      std::vector<unsigned char> d_bits;
+    };
+
+    /*!
+     * \brief Collects the frames of one decoder
+     */
+    class frame_queue : public frame_sink
+    {
+     public:
+      void write(const nfc_frame &frame) { d_frames.push_back(frame); }
+
+      std::deque<nfc_frame> d_frames;
+    };
+
+    /*!
+     * \brief Passes on the frames starting in [start, end) only, for the
+     * decoding of a sample range with a pre-roll
+     */
+    class range_filter : public frame_sink
+    {
+     public:
+      range_filter(frame_sink *sink, uint64_t start, uint64_t end)
+        : d_sink(sink), d_start(start), d_end(end) {}
+
+      void write(const nfc_frame &frame)
+      {
+          if (frame.start >= d_start && frame.start < d_end) {
+              d_sink->write(frame);
+          }
+      }
+      void flush() { d_sink->flush(); }
+
+     private:
+      frame_sink *d_sink;
+      uint64_t d_start;
+      uint64_t d_end;
+    };
+
+    /*!
+     * Move the frames of both directions to \p sink in start order. A frame
+     * is only released once no earlier frame can come out of the other
+     * decoder; \p all releases everything (end of stream). Queues or
+     * decoders may be NULL when a direction is not decoded.
+     */
+    void merge_frames(frame_queue *queues[2], frame_decoder *decoders[2],
+                      frame_sink *sink, bool all);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_DECODE_PIPELINE_H */
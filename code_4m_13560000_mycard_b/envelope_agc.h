@@ -0,0 +1,55 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_ENVELOPE_AGC_H
+#define INCLUDED_NFC_ENVELOPE_AGC_H
+
+#include <nfc/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Adaptive baseline and gain tracking of the AM envelope
+     * \ingroup nfc
+     *
+     * Replaces the hand-tuned per-recording offsets of tag_signal: the
+     * output baseline sits at \p reference and the tracked peak deviation
+     * at \p reference +/- \p amplitude.
+     */
+    class NFC_API envelope_agc : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<envelope_agc> sptr;
+
+      /*!
+       * \param sample_rate sample rate of the envelope (Hz)
+       * \param attack_time rising time constant (s)
+       * \param release_time falling time constant (s)
+       * \param reference output baseline level
+       * \param amplitude output peak deviation
+       */
+      static sptr make(double sample_rate, float attack_time, float release_time,
+                       float reference, float amplitude);
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_ENVELOPE_AGC_H */
@@ -0,0 +1,75 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "envelope_agc_ss_impl.h"
+
+namespace gr {
+  namespace nfc {
+
+    envelope_agc_ss::sptr
+    envelope_agc_ss::make(double sample_rate, float attack_time, float release_time,
+                       float reference, float amplitude)
+    {
+      return gnuradio::get_initial_sptr
+        (new envelope_agc_ss_impl(sample_rate, attack_time, release_time, reference, amplitude));
+    }
+
+    /*
+     * The private constructor
+     */
+    envelope_agc_ss_impl::envelope_agc_ss_impl(double sample_rate, float attack_time, float release_time,
+                                         float reference, float amplitude)
+      : gr::sync_block("envelope_agc_ss",
+              gr::io_signature::make(1, 1, sizeof(short)),
+              gr::io_signature::make(1, 1, sizeof(short))),
+        d_tracker(sample_rate, attack_time, release_time, reference, amplitude)
+    {
+        /* The tracker updates once per block, only hand it whole blocks so
+         * that the output does not depend on how the scheduler cuts the stream.
+         */
+        set_output_multiple(agc_tracker::AGC_BLOCK_SIZE);
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    envelope_agc_ss_impl::~envelope_agc_ss_impl()
+    {
+    }
+
+    int
+    envelope_agc_ss_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      const short *in = (const short *) input_items[0];
+      short *out = (short *) output_items[0];
+
+      d_tracker.process(in, out, noutput_items);
+
+      // Tell runtime system how many output items we produced.
+      return noutput_items;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
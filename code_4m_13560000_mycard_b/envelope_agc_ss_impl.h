@@ -0,0 +1,47 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_ENVELOPE_AGC_SS_IMPL_H
+#define INCLUDED_NFC_ENVELOPE_AGC_SS_IMPL_H
+
+#include "envelope_agc_ss.h"
+#include "agc_tracker.h"
+
+namespace gr {
+  namespace nfc {
+
+    class envelope_agc_ss_impl : public envelope_agc_ss
+    {
+     private:
+      agc_tracker d_tracker;
+
+     public:
+      envelope_agc_ss_impl(double sample_rate, float attack_time, float release_time,
+                        float reference, float amplitude);
+      ~envelope_agc_ss_impl();
+
+      // Where all the action really happens
+      int work(int noutput_items,
+               gr_vector_const_void_star &input_items,
+               gr_vector_void_star &output_items);
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_ENVELOPE_AGC_SS_IMPL_H */
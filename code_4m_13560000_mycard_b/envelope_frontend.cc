@@ -0,0 +1,210 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <algorithm>
+#include "envelope_frontend.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Input samples handled per pass, the magnitudes of one pass stay in L1 */
+#define FRONTEND_CHUNK                  4096
+
+namespace gr {
+  namespace nfc {
+
+    void
+    frontend_magnitude (const std::complex<float> *in, float *out, int n)
+    {
+        const float *iq = (const float *) in;
+        int i = 0;
+
+#ifdef __SSE2__
+        for (; i + 4 <= n; i += 4) {
+            __m128 a = _mm_loadu_ps(iq + 2 * i);
+            __m128 b = _mm_loadu_ps(iq + 2 * i + 4);
+            a = _mm_mul_ps(a, a);
+            b = _mm_mul_ps(b, b);
+            __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_add_ps(re, im)));
+        }
+#endif
+
+        for (; i < n; i++) {
+            out[i] = std::sqrt(iq[2 * i] * iq[2 * i] + iq[2 * i + 1] * iq[2 * i + 1]);
+        }
+    }
+
+    void
+    frontend_float_to_short (const float *in, short *out, int n, float scale)
+    {
+        int i = 0;
+
+#ifdef __SSE2__
+        __m128 vscale = _mm_set1_ps(scale);
+        __m128 vmin = _mm_set1_ps(-32768.0f);
+        __m128 vmax = _mm_set1_ps(32767.0f);
+
+        for (; i + 8 <= n; i += 8) {
+            /* Clamp before converting: cvtps gives 0x80000000 for anything
+             * out of the int32 range, which packs would turn into -32768
+             * even for a large positive value
+             */
+            __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), vscale);
+            __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), vscale);
+            __m128i lo = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(a, vmin), vmax));
+            __m128i hi = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, vmin), vmax));
+
+            _mm_storeu_si128((__m128i *) (out + i), _mm_packs_epi32(lo, hi));
+        }
+#endif
+
+        for (; i < n; i++) {
+            float v = std::nearbyint(in[i] * scale);
+            out[i] = (short) std::min(std::max(v, -32768.0f), 32767.0f);
+        }
+    }
+
+    static float
+    dot_product (const float *a, const float *b, int n)
+    {
+        int i = 0;
+        float sum = 0;
+
+#ifdef __SSE2__
+        __m128 acc = _mm_setzero_ps();
+        float tmp[4];
+
+        for (; i + 4 <= n; i += 4) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+
+        _mm_storeu_ps(tmp, acc);
+        sum = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+#endif
+
+        for (; i < n; i++) {
+            sum += a[i] * b[i];
+        }
+
+        return sum;
+    }
+
+    std::vector<float>
+    envelope_frontend::design_taps(int decimation)
+    {
+        int ntaps = 8 * decimation + 1;
+        double cutoff = 0.8 * 0.5 / decimation;
+        std::vector<float> taps(ntaps);
+        double sum = 0;
+
+        for (int i = 0; i < ntaps; i++) {
+            double n = i - (ntaps - 1) / 2.0;
+            double sinc = (n == 0) ? 2 * cutoff : std::sin(2 * M_PI * cutoff * n) / (M_PI * n);
+            double window = 0.54 - 0.46 * std::cos(2 * M_PI * i / (ntaps - 1));
+
+            taps[i] = sinc * window;
+            sum += taps[i];
+        }
+
+        for (int i = 0; i < ntaps; i++) {
+            taps[i] /= sum;
+        }
+
+        return taps;
+    }
+
+    envelope_frontend::envelope_frontend(int decimation, const std::vector<float> &taps)
+      : d_decimation(std::max(decimation, 1)),
+        d_taps(taps.empty() ? design_taps(d_decimation) : taps)
+    {
+        /* Reversed, so that the filter is a plain dot product */
+        std::reverse(d_taps.begin(), d_taps.end());
+
+        d_mag.resize(d_taps.size() - 1 + FRONTEND_CHUNK + d_decimation);
+        d_scratch.resize(FRONTEND_CHUNK / d_decimation + 1);
+        reset();
+    }
+
+    void
+    envelope_frontend::reset()
+    {
+        std::fill(d_mag.begin(), d_mag.end(), 0.0f);
+    }
+
+    int
+    envelope_frontend::filter(const std::complex<float> *in, int ninput, float *out)
+    {
+        int history = d_taps.size() - 1;
+        int ntaps = d_taps.size();
+        int noutput = ninput / d_decimation;
+
+        frontend_magnitude(in, &d_mag[history], ninput);
+
+        for (int k = 0; k < noutput; k++) {
+            out[k] = dot_product(&d_taps[0], &d_mag[(k + 1) * d_decimation - 1], ntaps);
+        }
+
+        /* Keep the filter history for the next pass */
+        std::copy(d_mag.begin() + ninput, d_mag.begin() + ninput + history, d_mag.begin());
+
+        return noutput;
+    }
+
+    int
+    envelope_frontend::process(const std::complex<float> *in, float *out, int ninput)
+    {
+        int chunk = std::max(FRONTEND_CHUNK / d_decimation, 1) * d_decimation;
+        int produced = 0;
+
+        ninput -= ninput % d_decimation;
+
+        for (int i = 0; i < ninput; i += chunk) {
+            produced += filter(in + i, std::min(chunk, ninput - i), out + produced);
+        }
+
+        return produced;
+    }
+
+    int
+    envelope_frontend::process(const std::complex<float> *in, short *out, int ninput, float scale)
+    {
+        int chunk = std::max(FRONTEND_CHUNK / d_decimation, 1) * d_decimation;
+        int produced = 0;
+
+        ninput -= ninput % d_decimation;
+
+        for (int i = 0; i < ninput; i += chunk) {
+            int n = filter(in + i, std::min(chunk, ninput - i), &d_scratch[0]);
+
+            frontend_float_to_short(&d_scratch[0], out + produced, n, scale);
+            produced += n;
+        }
+
+        return produced;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
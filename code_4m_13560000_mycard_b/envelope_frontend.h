@@ -0,0 +1,85 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_ENVELOPE_FRONTEND_H
+#define INCLUDED_NFC_ENVELOPE_FRONTEND_H
+
+#include <complex>
+#include <vector>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Fused IQ to AM envelope front end, independent from the
+     * GNU Radio runtime.
+     *
+     * Computes |IQ| (SSE when available), low-pass filters it and keeps one
+     * sample out of \p decimation, in a single pass. Only the filter
+     * outputs that are kept are computed, and the magnitudes never leave
+     * a small internal buffer, so there is no round-trip through the
+     * scheduler buffers between the magnitude, filter and decimation
+     * stages.
+     */
+    class envelope_frontend
+    {
+     public:
+      /*!
+       * \param decimation integer decimation factor
+       * \param taps low-pass filter taps, empty to use design_taps()
+       */
+      envelope_frontend(int decimation, const std::vector<float> &taps);
+
+      void reset();
+
+      int decimation() const { return d_decimation; }
+
+      /*!
+       * Process \p ninput complex samples, \p ninput must be a multiple of
+       * the decimation. Returns the number of envelope samples written.
+       */
+      int process(const std::complex<float> *in, float *out, int ninput);
+
+      /*!
+       * Same as above with a saturated int16 envelope, out = env * \p scale.
+       */
+      int process(const std::complex<float> *in, short *out, int ninput, float scale);
+
+      /*!
+       * Hamming-windowed sinc low-pass with unity DC gain, cut-off at 80%
+       * of the decimated Nyquist frequency.
+       */
+      static std::vector<float> design_taps(int decimation);
+
+     private:
+      int filter(const std::complex<float> *in, int ninput, float *out);
+
+      int d_decimation;
+      std::vector<float> d_taps;
+      std::vector<float> d_mag;
+      std::vector<float> d_scratch;
+    };
+
+    /* SIMD kernels shared with the other front-end stages */
+    void frontend_magnitude(const std::complex<float> *in, float *out, int n);
+    void frontend_float_to_short(const float *in, short *out, int n, float scale);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_ENVELOPE_FRONTEND_H */
@@ -0,0 +1,50 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_ENVELOPE_FRONTEND_CF_H
+#define INCLUDED_NFC_ENVELOPE_FRONTEND_CF_H
+
+#include <nfc/api.h>
+#include <gnuradio/sync_decimator.h>
+#include <vector>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Complex IQ in, decimated float envelope out
+     * \ingroup nfc
+     *
+     * Magnitude, low-pass filter and decimation fused in one block.
+     */
+    class NFC_API envelope_frontend_cf : virtual public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<envelope_frontend_cf> sptr;
+
+      /*!
+       * \param decimation integer decimation factor
+       * \param taps low-pass filter taps, empty for the default design
+       */
+      static sptr make(int decimation, const std::vector<float> &taps);
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_ENVELOPE_FRONTEND_CF_H */
@@ -0,0 +1,70 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "envelope_frontend_cs_impl.h"
+
+namespace gr {
+  namespace nfc {
+
+    envelope_frontend_cs::sptr
+    envelope_frontend_cs::make(int decimation, const std::vector<float> &taps, float scale)
+    {
+      return gnuradio::get_initial_sptr
+        (new envelope_frontend_cs_impl(decimation, taps, scale));
+    }
+
+    /*
+     * The private constructor
+     */
+    envelope_frontend_cs_impl::envelope_frontend_cs_impl(int decimation, const std::vector<float> &taps, float scale)
+      : gr::sync_decimator("envelope_frontend_cs",
+              gr::io_signature::make(1, 1, sizeof(gr_complex)),
+              gr::io_signature::make(1, 1, sizeof(short)), decimation),
+        d_frontend(decimation, taps),
+        d_scale(scale)
+    {
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    envelope_frontend_cs_impl::~envelope_frontend_cs_impl()
+    {
+    }
+
+    int
+    envelope_frontend_cs_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      const gr_complex *in = (const gr_complex *) input_items[0];
+      short *out = (short *) output_items[0];
+
+      d_frontend.process(in, out, noutput_items * d_frontend.decimation(), d_scale);
+
+      // Tell runtime system how many output items we produced.
+      return noutput_items;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
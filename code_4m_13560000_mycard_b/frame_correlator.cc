@@ -0,0 +1,270 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <string.h>
+#include "frame_correlator.h"
+
+/* REQA and WUPA, 7-bit short frames */
+#define ISO14443_REQA                   0x26
+#define ISO14443_WUPA                   0x52
+
+namespace gr {
+  namespace nfc {
+
+    bool
+    nfc_frame_is_wakeup (const nfc_frame &frame)
+    {
+        return frame.direction == NFC_READER && (frame.flags & FRAME_SHORT) && frame.len == 1 &&
+            (frame.data[0] == ISO14443_REQA || frame.data[0] == ISO14443_WUPA);
+    }
+
+    static int
+    hex_digit (char c)
+    {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    bool
+    nfc_parse_uid (const char *hex, unsigned char *uid, unsigned int *len)
+    {
+        size_t n = strlen(hex);
+
+        if (n % 2 || (n / 2 != 4 && n / 2 != 7 && n / 2 != 10)) {
+            return false;
+        }
+        for (size_t i = 0; i < n / 2; i++) {
+            int hi = hex_digit(hex[2 * i]), lo = hex_digit(hex[2 * i + 1]);
+
+            if (hi < 0 || lo < 0) {
+                return false;
+            }
+            uid[i] = (unsigned char) (hi << 4 | lo);
+        }
+        *len = (unsigned int) (n / 2);
+
+        return true;
+    }
+
+    uid_tracker::uid_tracker()
+      : d_len(0),
+        d_level(0),
+        d_complete(false)
+    {
+    }
+
+    bool
+    uid_tracker::add(const nfc_frame &frame)
+    {
+        unsigned int level;
+
+        if (nfc_frame_is_wakeup(frame)) {
+            d_len = 0;
+            d_level = 0;
+            d_complete = false;
+            return false;
+        }
+
+        /* SELECT: command, NVB, 4 bytes of UID or cascade tag, BCC, CRC_A */
+        if (frame.direction != NFC_READER || frame.len != 9 ||
+            frame.data[1] != ISO14443_NVB_SELECT || !nfc_frame_crc_ok(frame)) {
+            return false;
+        }
+        switch (frame.data[0]) {
+        case ISO14443_SEL_CL1:
+            level = 0;
+            break;
+        case ISO14443_SEL_CL2:
+            level = 1;
+            break;
+        case ISO14443_SEL_CL3:
+            level = 2;
+            break;
+        default:
+            return false;
+        }
+
+        if (level == 0) {
+            d_len = 0;
+            d_complete = false;
+        } else if (level != d_level) {
+            /* A level was missed, the UID cannot be put together */
+            return false;
+        }
+
+        const unsigned char *part = frame.data + 2;
+        if (part[0] == ISO14443_CASCADE_TAG && level < 2) {
+            memcpy(d_uid + d_len, part + 1, 3);
+            d_len += 3;
+            d_level = level + 1;
+            return false;
+        }
+
+        memcpy(d_uid + d_len, part, 4);
+        d_len += 4;
+        d_level = 0;
+        d_complete = true;
+
+        return true;
+    }
+
+    frame_correlator::frame_correlator(exchange_sink *sink, int64_t fdt_min_ns,
+                                       int64_t fdt_max_ns)
+      : d_sink(sink),
+        d_fdt_min(fdt_min_ns),
+        d_fdt_max(fdt_max_ns),
+        d_pending(false),
+        d_session(0),
+        d_index(0),
+        d_exchanges(0),
+        d_unanswered(0),
+        d_orphans(0)
+    {
+    }
+
+    void
+    frame_correlator::emit()
+    {
+        if (!d_pending) {
+            return;
+        }
+
+        if (!d_exchange.has_command) {
+            d_orphans++;
+        } else if (d_exchange.nresponses == 0) {
+            d_unanswered++;
+        }
+        d_exchanges++;
+        d_pending = false;
+
+        d_sink->write(d_exchange);
+    }
+
+    void
+    frame_correlator::add(const nfc_frame &frame, int64_t start_ns, int64_t end_ns)
+    {
+        if (frame.direction == NFC_TAG && d_pending && d_exchange.has_command) {
+            int64_t fdt = start_ns - d_exchange.command_end_ns;
+
+            if (fdt >= d_fdt_min && fdt <= d_fdt_max) {
+                if (d_exchange.nresponses < EXCHANGE_MAX_RESPONSES) {
+                    d_exchange.responses[d_exchange.nresponses] = frame;
+                    d_exchange.response_ns[d_exchange.nresponses] = start_ns;
+                    d_exchange.nresponses++;
+                } else {
+                    d_exchange.dropped++;
+                }
+                return;
+            }
+        }
+
+        emit();
+
+        if (nfc_frame_is_wakeup(frame)) {
+            d_session++;
+            d_index = 0;
+        }
+
+        d_exchange.session = d_session;
+        d_exchange.index = d_index++;
+        d_exchange.nresponses = 0;
+        d_exchange.dropped = 0;
+        d_pending = true;
+
+        if (frame.direction == NFC_READER) {
+            d_exchange.has_command = true;
+            d_exchange.command = frame;
+            d_exchange.command_ns = start_ns;
+            d_exchange.command_end_ns = end_ns;
+        } else {
+            d_exchange.has_command = false;
+            d_exchange.responses[0] = frame;
+            d_exchange.response_ns[0] = start_ns;
+            d_exchange.nresponses = 1;
+            emit();
+        }
+    }
+
+    void
+    frame_correlator::finish()
+    {
+        emit();
+        d_sink->flush();
+    }
+
+    exchange_printer::exchange_printer(FILE *fp, bool positions)
+      : d_fp(fp),
+        d_positions(positions),
+        d_started(false),
+        d_session(0)
+    {
+    }
+
+    static void
+    print_time (FILE *fp, int64_t ns)
+    {
+        const char *sign = ns < 0 ? "-" : "";
+        uint64_t v = ns < 0 ? uint64_t(0) - uint64_t(ns) : uint64_t(ns);
+
+        fprintf(fp, "  %s%" PRIu64 ".%09" PRIu64, sign, v / 1000000000, v % 1000000000);
+    }
+
+    void
+    exchange_printer::write(const nfc_exchange &exchange)
+    {
+        if (!d_started || exchange.session != d_session) {
+            fprintf(d_fp, "Session %" PRIu64 "\n", exchange.session);
+            d_started = true;
+            d_session = exchange.session;
+        }
+
+        if (exchange.has_command) {
+            print_time(d_fp, exchange.command_ns);
+            fputs("              ", d_fp);
+            nfc_frame_print(d_fp, exchange.command, d_positions);
+        }
+
+        for (unsigned int i = 0; i < exchange.nresponses; i++) {
+            print_time(d_fp, exchange.response_ns[i]);
+            if (exchange.has_command) {
+                fprintf(d_fp, "  %+8.1fus  ",
+                        (exchange.response_ns[i] - exchange.command_end_ns) / 1e3);
+            } else {
+                fputs("  ?           ", d_fp);
+            }
+            nfc_frame_print(d_fp, exchange.responses[i], d_positions);
+        }
+
+        if (exchange.dropped) {
+            fprintf(d_fp, "  (%u more responses)\n", exchange.dropped);
+        }
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,187 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_FRAME_CORRELATOR_H
+#define INCLUDED_NFC_FRAME_CORRELATOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "nfc_frame.h"
+
+/* Default response window after the end of a command: the shortest
+ * ISO/IEC 14443-3 frame delay time (1172/fc, 86 us) less some margin for
+ * the decoder timing, up to the default frame waiting time (FWI 4, 4.8 ms)
+ * with the same margin.
+ */
+#define CORRELATE_FDT_MIN_NS            70000
+#define CORRELATE_FDT_MAX_NS            5000000
+
+/* Responses kept per exchange, anticollision may bring several */
+#define EXCHANGE_MAX_RESPONSES          4
+
+/* Anticollision and select commands of the three cascade levels */
+#define ISO14443_SEL_CL1                0x93
+#define ISO14443_SEL_CL2                0x95
+#define ISO14443_SEL_CL3                0x97
+#define ISO14443_NVB_SELECT             0x70
+#define ISO14443_CASCADE_TAG            0x88
+
+/* Longest UID, triple size */
+#define NFC_UID_MAX                     10
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief A reader command and the tag frames answering it
+     */
+    struct nfc_exchange
+    {
+        uint64_t session;               /* 0 before the first REQA/WUPA */
+        uint64_t index;                 /* Exchange number in the session */
+        bool has_command;               /* False for a tag frame nobody asked for */
+        nfc_frame command;
+        int64_t command_ns;             /* Start of the command */
+        int64_t command_end_ns;
+        unsigned int nresponses;
+        unsigned int dropped;           /* Responses beyond EXCHANGE_MAX_RESPONSES */
+        nfc_frame responses[EXCHANGE_MAX_RESPONSES];
+        int64_t response_ns[EXCHANGE_MAX_RESPONSES];
+    };
+
+    /*!
+     * \brief Receives the exchanges, in time order
+     */
+    class exchange_sink
+    {
+     public:
+      virtual ~exchange_sink() {}
+
+      virtual void write(const nfc_exchange &exchange) = 0;
+      virtual void flush() {}
+    };
+
+    /*! True for REQA (0x26) and WUPA (0x52), the frames opening a session */
+    bool nfc_frame_is_wakeup(const nfc_frame &frame);
+
+    /*! Parse a UID of 4, 7 or 10 bytes in hex, false if it is not one */
+    bool nfc_parse_uid(const char *hex, unsigned char *uid, unsigned int *len);
+
+    /*!
+     * \brief The UID a reader selects in a session, from the SELECT
+     * commands of its cascade levels: the cascade tag and 3 bytes of the
+     * UID on each level but the last, 4 bytes there. Only the reader
+     * frames are needed, so collisions in the tag answers do not matter.
+     *
+     * A REQA or WUPA forgets the UID, a SELECT of the first level starts
+     * it over.
+     */
+    class uid_tracker
+    {
+     public:
+      uid_tracker();
+
+      /*! Next frame, true if it is the SELECT completing a UID */
+      bool add(const nfc_frame &frame);
+
+      /*! The UID selected in the session so far, 0 bytes for none */
+      const unsigned char *uid() const { return d_uid; }
+      unsigned int len() const { return d_complete ? d_len : 0; }
+
+     private:
+      unsigned char d_uid[NFC_UID_MAX];
+      unsigned int d_len;
+      unsigned int d_level;             /* Next cascade level expected */
+      bool d_complete;
+    };
+
+    /*!
+     * \brief Groups a time-ordered frame stream into exchanges and sessions.
+     *
+     * A reader frame opens an exchange. Tag frames starting between
+     * \p fdt_min_ns and \p fdt_max_ns after the end of that command are its
+     * responses; any other tag frame is passed on alone, without a command.
+     * REQA and WUPA start a new session. Timing is all that pairs the
+     * frames, so a missing frame only affects its own exchange.
+     *
+     * Only the exchange being built is kept: it goes out when the next
+     * reader frame or a tag frame outside the window arrives, so memory
+     * stays flat whatever the length of the capture.
+     */
+    class frame_correlator
+    {
+     public:
+      frame_correlator(exchange_sink *sink, int64_t fdt_min_ns = CORRELATE_FDT_MIN_NS,
+                       int64_t fdt_max_ns = CORRELATE_FDT_MAX_NS);
+
+      /*! Next frame, with the times of its start and end in ns */
+      void add(const nfc_frame &frame, int64_t start_ns, int64_t end_ns);
+
+      /*! Pass on the pending exchange (end of stream) */
+      void finish();
+
+      uint64_t sessions() const { return d_session; }
+      uint64_t exchanges() const { return d_exchanges; }
+      uint64_t unanswered() const { return d_unanswered; }
+      uint64_t orphans() const { return d_orphans; }
+
+     private:
+      void emit();
+
+      exchange_sink *d_sink;
+      int64_t d_fdt_min;
+      int64_t d_fdt_max;
+      bool d_pending;
+      nfc_exchange d_exchange;
+      uint64_t d_session;
+      uint64_t d_index;
+      uint64_t d_exchanges;
+      uint64_t d_unanswered;
+      uint64_t d_orphans;
+    };
+
+    /*!
+     * \brief Exchanges as text, a header per session then one line per
+     * frame: its time in s, the frame delay of the responses and the
+     * frame as nfc_frame_print prints it.
+     *
+     *   Session 2
+     *     0.002503750            Reader -> [26]
+     *     0.002590000  +86.2us   Tag ->  44   00
+     *
+     * A tag frame without a command is marked with ? instead of its delay.
+     */
+    class exchange_printer : public exchange_sink
+    {
+     public:
+      exchange_printer(FILE *fp, bool positions);
+
+      void write(const nfc_exchange &exchange);
+      void flush() { fflush(d_fp); }
+
+     private:
+      FILE *d_fp;
+      bool d_positions;
+      bool d_started;
+      uint64_t d_session;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_FRAME_CORRELATOR_H */
@@ -0,0 +1,74 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_FRAME_DECODER_H
+#define INCLUDED_NFC_FRAME_DECODER_H
+
+#include <stdint.h>
+#include "nfc_frame.h"
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Common interface of the decoder cores (miller_decoder,
+     * manchester_decoder), so that the offline tools can drive them the
+     * same way.
+     */
+    class frame_decoder
+    {
+     public:
+      virtual ~frame_decoder() {}
+
+      /*! Forget the current frame, the next sample is at \p position */
+      virtual void reset(uint64_t position = 0) = 0;
+
+      /*! One sample per byte */
+      virtual void process(const unsigned char *in, int n) = 0;
+
+      /*! 8 samples per byte, first sample in the MSB */
+      virtual void process_packed(const unsigned char *in, int nbytes) = 0;
+
+      /*! \p length samples at \p level */
+      virtual void push_run(unsigned char level, uint64_t length) = 0;
+
+      /*! End of stream */
+      virtual void finish() = 0;
+
+      /*! Absolute position of the next sample to decode */
+      virtual uint64_t position() const = 0;
+
+      /*! Start of the frame being decoded, or position() when idle. No
+       * frame starting before this position can come out any more.
+       */
+      virtual uint64_t pending_start() const = 0;
+
+      /*!
+       * Constant levels the stream can be cut in (bit 0: low, bit 1: high)
+       * and the number of samples of that level needed on each side of the
+       * cut. Decoding both sides with separate, freshly reset decoders then
+       * gives the same frames as decoding the whole stream.
+       */
+      virtual unsigned int cut_levels() const = 0;
+      virtual uint64_t cut_margin() const = 0;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_FRAME_DECODER_H */
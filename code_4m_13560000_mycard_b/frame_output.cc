@@ -0,0 +1,1291 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cerrno>
+#include <cmath>
+#include <cstdarg>
+#include <cstdlib>
+#include <inttypes.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "frame_output.h"
+#include "nfcb.h"
+#include "frame_record.h"
+
+/* pcapng block types and options */
+#define PCAPNG_SHB                      0x0A0D0D0A
+#define PCAPNG_IDB                      0x00000001
+#define PCAPNG_EPB                      0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC         0x1A2B3C4D
+#define PCAPNG_OPT_END                  0
+#define PCAPNG_OPT_COMMENT              1
+#define PCAPNG_OPT_EPB_FLAGS            2
+#define PCAPNG_OPT_SHB_USERAPPL         4
+#define PCAPNG_OPT_IF_TSRESOL           9
+
+#define LINKTYPE_ISO_14443              264
+
+/* Events of the LINKTYPE_ISO_14443 pseudo-header */
+#define ISO14443_EVENT_PCD_TO_PICC      0xFE
+#define ISO14443_EVENT_PICC_TO_PCD      0xFF
+
+/* epb_flags: direction and link-layer errors */
+#define EPB_FLAG_INBOUND                0x00000001
+#define EPB_FLAG_OUTBOUND               0x00000002
+#define EPB_FLAG_UNALIGNED              (1U << 28)
+#define EPB_FLAG_SYMBOL_ERROR           (1U << 31)
+
+/* Proxmark3 timestamps count carrier periods */
+#define PROXMARK_TICK_RATE              13.56e6
+#define PROXMARK_TAG_FLAG               0x8000
+
+/* Longest status comment */
+#define PCAPNG_COMMENT_SIZE             64
+
+/* Digits of the file numbers of a rotating output */
+#define ROTATION_DIGITS                 6
+
+namespace gr {
+  namespace nfc {
+
+    int64_t
+    output_time_ns (const output_info &info, uint64_t sample)
+    {
+        /* Whole seconds apart, a double cannot hold ns over long captures */
+        double offset = double(int64_t(sample - info.start_sample));
+        double seconds = std::floor(offset / info.sample_rate);
+        double rest = offset - seconds * info.sample_rate;
+
+        return info.start_time_ns + int64_t(seconds) * 1000000000LL +
+            int64_t(std::floor(rest * 1e9 / info.sample_rate + 0.5));
+    }
+
+    text_output::text_output(const output_info &info)
+      : d_fp(NULL),
+        d_positions(info.positions),
+        d_sample_rate(info.sample_rate)
+    {
+    }
+
+    text_output::~text_output()
+    {
+        close();
+    }
+
+    bool
+    text_output::open(const char *path)
+    {
+        d_fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+        if (!d_fp) {
+            perror(path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    text_output::close()
+    {
+        bool ok = true;
+
+        if (d_fp) {
+            ok = fflush(d_fp) == 0 && !ferror(d_fp);
+            if (d_fp != stdout && fclose(d_fp) != 0) {
+                ok = false;
+            }
+            d_fp = NULL;
+        }
+        if (!ok) {
+            perror("text output");
+        }
+
+        return ok;
+    }
+
+    void
+    text_output::write(const nfc_frame &frame)
+    {
+        nfc_frame_print(d_fp, frame, d_positions);
+    }
+
+    void
+    text_output::flush()
+    {
+        fflush(d_fp);
+    }
+
+    bool
+    text_output::sync()
+    {
+        if (fflush(d_fp) != 0 || !sync_fd(fileno(d_fp))) {
+            perror("text output");
+            return false;
+        }
+
+        return true;
+    }
+
+    uint64_t
+    text_output::size() const
+    {
+        off_t offset = ftello(d_fp);
+
+        return offset < 0 ? 0 : uint64_t(offset);
+    }
+
+    void
+    text_output::write_run(const poll_run &run)
+    {
+        double us_per_sample = 1e6 / d_sample_rate;
+
+        if (d_positions) {
+            fprintf(d_fp, "%" PRIu64 " %" PRIu64 " ", run.first.start, run.last_end);
+        }
+
+        nfc_frame_print_data(d_fp, run.first);
+        fprintf(d_fp, " x%" PRIu64 " unanswered, every %.1f us (%.1f to %.1f, sd %.1f) over %.3f ms\n",
+                run.count, run.period_mean * us_per_sample, run.period_min * us_per_sample,
+                run.period_max * us_per_sample, run.period_sd * us_per_sample,
+                (run.last_end - run.first.start) * us_per_sample / 1e3);
+    }
+
+    static size_t
+    pad4 (size_t n)
+    {
+        return (n + 3) & ~size_t(3);
+    }
+
+    /* Option header and value, padded to 32 bits. Returns the next byte */
+    static unsigned char *
+    put_option (unsigned char *p, int code, const void *value, size_t len)
+    {
+        nfcb_put_le(p, code, 2);
+        nfcb_put_le(p + 2, len, 2);
+        memcpy(p + 4, value, len);
+        memset(p + 4 + len, 0, pad4(len) - len);
+
+        return p + 4 + pad4(len);
+    }
+
+    /* Status of the frame for the EPB comment, returns its length */
+    static size_t
+    status_comment (const nfc_frame &frame, char *out)
+    {
+        const char *parts[4];
+        size_t n = 0, len = 0;
+
+        if (nfc_frame_crc_ok(frame)) {
+            parts[n++] = "CRC_A ok";
+        }
+        if (frame.flags & FRAME_PARITY_ERROR) {
+            parts[n++] = "parity error";
+        }
+        if (frame.flags & FRAME_BROKEN) {
+            parts[n++] = "broken";
+        }
+        if (frame.flags & FRAME_NO_PARITY) {
+            parts[n++] = "no parity";
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            size_t l = strlen(parts[i]);
+
+            if (i > 0) {
+                memcpy(out + len, ", ", 2);
+                len += 2;
+            }
+            memcpy(out + len, parts[i], l);
+            len += l;
+        }
+
+        return len;
+    }
+
+    pcapng_output::pcapng_output(const output_info &info)
+      : d_info(info),
+        d_path("")
+    {
+    }
+
+    pcapng_output::~pcapng_output()
+    {
+        close();
+    }
+
+    bool
+    pcapng_output::sync()
+    {
+        if (!d_out.sync()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    pcapng_output::open(const char *path)
+    {
+        static const char userappl[] = "gr-nfc";
+        unsigned char resol = 9;        /* ns */
+        unsigned char *p, *start;
+
+        if (!d_out.open(path)) {
+            perror(path);
+            return false;
+        }
+        d_path = path;
+
+        /* Section header, section length unknown */
+        start = p = d_out.reserve(256);
+        nfcb_put_le(p, PCAPNG_SHB, 4);
+        nfcb_put_le(p + 8, PCAPNG_BYTE_ORDER_MAGIC, 4);
+        nfcb_put_le(p + 12, 1, 2);
+        nfcb_put_le(p + 14, 0, 2);
+        nfcb_put_le(p + 16, UINT64_MAX, 8);
+        p = put_option(p + 24, PCAPNG_OPT_SHB_USERAPPL, userappl, strlen(userappl));
+        p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+        nfcb_put_le(start + 4, p + 4 - start, 4);
+        nfcb_put_le(p, p + 4 - start, 4);
+        p += 4;
+
+        /* The only interface, no snap length */
+        unsigned char *idb = p;
+        nfcb_put_le(p, PCAPNG_IDB, 4);
+        nfcb_put_le(p + 8, LINKTYPE_ISO_14443, 2);
+        nfcb_put_le(p + 10, 0, 2);
+        nfcb_put_le(p + 12, 0, 4);
+        p = put_option(p + 16, PCAPNG_OPT_IF_TSRESOL, &resol, 1);
+        p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+        nfcb_put_le(idb + 4, p + 4 - idb, 4);
+        nfcb_put_le(p, p + 4 - idb, 4);
+        p += 4;
+
+        d_out.commit(p - start);
+        return true;
+    }
+
+    bool
+    pcapng_output::close()
+    {
+        if (!d_out.is_open()) {
+            return true;
+        }
+        if (!d_out.close()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    void
+    pcapng_output::write(const nfc_frame &frame)
+    {
+        char comment[PCAPNG_COMMENT_SIZE];
+        size_t comment_len = status_comment(frame, comment);
+        size_t caplen = 4 + frame.len;
+        size_t size = 28 + pad4(caplen) + 8 + (comment_len ? 4 + pad4(comment_len) : 0) + 4 + 4;
+        uint64_t ts = uint64_t(output_time_ns(d_info, frame.start));
+        uint32_t flags = 0;
+        unsigned char le_flags[4];
+        unsigned char *p = d_out.reserve(size);
+
+        if (frame.direction == NFC_READER) {
+            flags |= EPB_FLAG_OUTBOUND;
+        } else {
+            flags |= EPB_FLAG_INBOUND;
+        }
+        if (frame.flags & FRAME_PARITY_ERROR) {
+            flags |= EPB_FLAG_SYMBOL_ERROR;
+        }
+        if (frame.flags & FRAME_BROKEN) {
+            flags |= EPB_FLAG_UNALIGNED;
+        }
+
+        nfcb_put_le(p, PCAPNG_EPB, 4);
+        nfcb_put_le(p + 4, size, 4);
+        nfcb_put_le(p + 8, 0, 4);
+        nfcb_put_le(p + 12, ts >> 32, 4);
+        nfcb_put_le(p + 16, ts & 0xffffffff, 4);
+        nfcb_put_le(p + 20, caplen, 4);
+        nfcb_put_le(p + 24, caplen, 4);
+
+        /* LINKTYPE_ISO_14443 pseudo-header */
+        p[28] = 0;
+        p[29] = frame.direction == NFC_READER ? ISO14443_EVENT_PCD_TO_PICC : ISO14443_EVENT_PICC_TO_PCD;
+        p[30] = frame.len >> 8;
+        p[31] = frame.len & 0xff;
+        memcpy(p + 32, frame.data, frame.len);
+        memset(p + 28 + caplen, 0, pad4(caplen) - caplen);
+        p += 28 + pad4(caplen);
+
+        nfcb_put_le(le_flags, flags, 4);
+        p = put_option(p, PCAPNG_OPT_EPB_FLAGS, le_flags, 4);
+        if (comment_len) {
+            p = put_option(p, PCAPNG_OPT_COMMENT, comment, comment_len);
+        }
+        p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+        nfcb_put_le(p, size, 4);
+
+        d_out.commit(size);
+    }
+
+    proxmark_output::proxmark_output(const output_info &info)
+      : d_info(info),
+        d_path("")
+    {
+    }
+
+    proxmark_output::~proxmark_output()
+    {
+        close();
+    }
+
+    bool
+    proxmark_output::sync()
+    {
+        if (!d_out.sync()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    proxmark_output::open(const char *path)
+    {
+        if (!d_out.open(path)) {
+            perror(path);
+            return false;
+        }
+        d_path = path;
+
+        return true;
+    }
+
+    bool
+    proxmark_output::close()
+    {
+        if (!d_out.is_open()) {
+            return true;
+        }
+        if (!d_out.close()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    void
+    proxmark_output::write(const nfc_frame &frame)
+    {
+        double ticks_per_sample = PROXMARK_TICK_RATE / d_info.sample_rate;
+        double start = double(int64_t(frame.start - d_info.start_sample)) * ticks_per_sample;
+        double duration = double(frame.end - frame.start) * ticks_per_sample + 0.5;
+        size_t nparity = (frame.len + 7) / 8;
+        unsigned char *p = d_out.reserve(8 + frame.len + nparity);
+
+        nfcb_put_le(p, uint64_t(int64_t(std::floor(start + 0.5))) & 0xffffffff, 4);
+        nfcb_put_le(p + 4, uint64_t(std::min(duration, 65535.0)), 2);
+        nfcb_put_le(p + 6, frame.len | (frame.direction == NFC_TAG ? PROXMARK_TAG_FLAG : 0), 2);
+        memcpy(p + 8, frame.data, frame.len);
+        memcpy(p + 8 + frame.len, frame.parity, nparity);
+
+        d_out.commit(8 + frame.len + nparity);
+    }
+
+    jsonl_output::jsonl_output(const output_info &info)
+      : d_info(info),
+        d_path("")
+    {
+    }
+
+    jsonl_output::~jsonl_output()
+    {
+        close();
+    }
+
+    bool
+    jsonl_output::sync()
+    {
+        if (!d_out.sync()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    jsonl_output::open(const char *path)
+    {
+        if (!d_out.open(path)) {
+            perror(path);
+            return false;
+        }
+        d_path = path;
+
+        return true;
+    }
+
+    bool
+    jsonl_output::close()
+    {
+        if (!d_out.is_open()) {
+            return true;
+        }
+        if (!d_out.close()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    void
+    jsonl_output::write(const nfc_frame &frame)
+    {
+        char *p = (char *) d_out.reserve(FRAME_JSON_MAX);
+
+        d_out.commit(frame_json_encode(frame, output_time_ns(d_info, frame.start), p));
+    }
+
+    void
+    jsonl_output::write_run(const poll_run &run)
+    {
+        char *p = (char *) d_out.reserve(FRAME_JSON_MAX);
+
+        d_out.commit(frame_json_encode_run(run, output_time_ns(d_info, run.first.start),
+                                           output_time_ns(d_info, run.last_start),
+                                           1e9 / d_info.sample_rate, p));
+    }
+
+    record_output::record_output(const output_info &info, bool compact)
+      : d_info(info),
+        d_compact(compact),
+        d_path("")
+    {
+        d_block.reset(info.sample_rate);
+    }
+
+    record_output::~record_output()
+    {
+        close();
+    }
+
+    bool
+    record_output::sync()
+    {
+        write_block();
+        if (!d_out.sync()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    record_output::open(const char *path)
+    {
+        if (!d_out.open(path)) {
+            perror(path);
+            return false;
+        }
+        d_path = path;
+
+        frame_file_put_header(d_out.reserve(FRAME_FILE_HEADER), d_info.sample_rate,
+                              d_info.start_time_ns, d_info.start_sample, d_compact);
+        d_out.commit(FRAME_FILE_HEADER);
+
+        return true;
+    }
+
+    bool
+    record_output::close()
+    {
+        if (!d_out.is_open()) {
+            return true;
+        }
+        write_block();
+        if (!d_out.close()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    uint64_t
+    record_output::size() const
+    {
+        return d_out.offset() + (d_block.frames() ? d_block.size() : 0);
+    }
+
+    void
+    record_output::write_block()
+    {
+        if (d_block.frames()) {
+            d_out.commit(d_block.finish(d_out.reserve(d_block.size())));
+        }
+    }
+
+    void
+    record_output::write(const nfc_frame &frame)
+    {
+        if (d_compact) {
+            d_block.add(frame, output_time_ns(d_info, frame.start));
+            if (d_block.frames() == FRAME_BLOCK_FRAMES) {
+                write_block();
+            }
+            return;
+        }
+
+        unsigned char *p = d_out.reserve(FRAME_RECORD_MAX);
+
+        d_out.commit(frame_record_encode(frame, output_time_ns(d_info, frame.start), p));
+    }
+
+    exchange_output::exchange_output(const output_info &info)
+      : d_info(info),
+        d_fp(NULL),
+        d_printer(NULL),
+        d_correlator(NULL)
+    {
+    }
+
+    exchange_output::~exchange_output()
+    {
+        close();
+    }
+
+    bool
+    exchange_output::open(const char *path)
+    {
+        d_fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+        if (!d_fp) {
+            perror(path);
+            return false;
+        }
+        d_printer = new exchange_printer(d_fp, d_info.positions);
+        d_correlator = new frame_correlator(d_printer);
+
+        return true;
+    }
+
+    bool
+    exchange_output::close()
+    {
+        bool ok = true;
+
+        if (!d_fp) {
+            return true;
+        }
+
+        d_correlator->finish();
+        delete d_correlator;
+        delete d_printer;
+        d_correlator = NULL;
+        d_printer = NULL;
+
+        ok = fflush(d_fp) == 0 && !ferror(d_fp);
+        if (d_fp != stdout && fclose(d_fp) != 0) {
+            ok = false;
+        }
+        d_fp = NULL;
+        if (!ok) {
+            perror("exchange output");
+        }
+
+        return ok;
+    }
+
+    void
+    exchange_output::write(const nfc_frame &frame)
+    {
+        d_correlator->add(frame, output_time_ns(d_info, frame.start),
+                          output_time_ns(d_info, frame.end));
+    }
+
+    bool
+    exchange_output::sync()
+    {
+        if (fflush(d_fp) != 0 || !sync_fd(fileno(d_fp))) {
+            perror("exchange output");
+            return false;
+        }
+
+        return true;
+    }
+
+    uint64_t
+    exchange_output::size() const
+    {
+        off_t offset = ftello(d_fp);
+
+        return offset < 0 ? 0 : uint64_t(offset);
+    }
+
+    ring_output::ring_output(const output_info &info)
+      : d_info(info)
+    {
+    }
+
+    bool
+    ring_output::open(const char *path)
+    {
+        if (!d_ring.create(path, d_info.sample_rate, d_info.start_time_ns, d_info.start_sample)) {
+            perror(path);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool
+    ring_output::close()
+    {
+        d_ring.close();
+        return true;
+    }
+
+    void
+    ring_output::write(const nfc_frame &frame)
+    {
+        d_ring.write(frame, output_time_ns(d_info, frame.start));
+    }
+
+    store_output::store_output(const output_info &info)
+      : d_info(info),
+        d_path("")
+    {
+    }
+
+    bool
+    store_output::open(const char *path)
+    {
+        if (!d_store.create(path, d_info.sample_rate, d_info.start_time_ns, d_info.start_sample)) {
+            perror(path);
+            return false;
+        }
+        d_path = path;
+
+        return true;
+    }
+
+    bool
+    store_output::close()
+    {
+        if (!d_store.close()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    void
+    store_output::write(const nfc_frame &frame)
+    {
+        d_store.add(frame, output_time_ns(d_info, frame.start));
+    }
+
+    bool
+    store_output::sync()
+    {
+        if (!d_store.sync()) {
+            perror(d_path);
+            return false;
+        }
+
+        return true;
+    }
+
+    collapsed_output::collapsed_output(frame_output *output)
+      : d_output(output),
+        d_collapser(output, output->runs())
+    {
+    }
+
+    collapsed_output::~collapsed_output()
+    {
+        close();
+        delete d_output;
+    }
+
+    bool
+    collapsed_output::close()
+    {
+        d_collapser.finish();
+        return d_output->close();
+    }
+
+    static bool
+    parse_duration (const char *s, int64_t *ns)
+    {
+        char *end;
+        double value = strtod(s, &end);
+        double unit;
+
+        if (end == s || value <= 0) {
+            return false;
+        }
+        if (!strcmp(end, "") || !strcmp(end, "s")) {
+            unit = 1e9;
+        } else if (!strcmp(end, "ms")) {
+            unit = 1e6;
+        } else if (!strcmp(end, "m")) {
+            unit = 60e9;
+        } else if (!strcmp(end, "h")) {
+            unit = 3600e9;
+        } else if (!strcmp(end, "d")) {
+            unit = 86400e9;
+        } else {
+            return false;
+        }
+
+        *ns = int64_t(value * unit + 0.5);
+        return *ns > 0;
+    }
+
+    rotation_config::rotation_config()
+      : max_bytes(0),
+        period_ns(0),
+        sync_ns(0)
+    {
+    }
+
+    bool
+    rotation_config::parse_option(int opt, const char *arg)
+    {
+        char *end;
+        double value;
+
+        switch (opt) {
+        case 'Z':
+            value = strtod(arg, &end);
+            if (*end == 'k' || *end == 'K') {
+                value *= 1024;
+                end++;
+            } else if (*end == 'M') {
+                value *= 1024 * 1024;
+                end++;
+            } else if (*end == 'G') {
+                value *= 1024.0 * 1024 * 1024;
+                end++;
+            }
+            if (end == arg || *end || value < 1) {
+                fprintf(stderr, "Bad file size %s\n", arg);
+                return false;
+            }
+            max_bytes = uint64_t(value);
+            return true;
+        case 'Y':
+            if (!parse_duration(arg, &period_ns)) {
+                fprintf(stderr, "Bad file period %s\n", arg);
+                return false;
+            }
+            return true;
+        case 'F':
+            if (!parse_duration(arg, &sync_ns)) {
+                fprintf(stderr, "Bad sync interval %s\n", arg);
+                return false;
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    static int64_t
+    monotonic_ns ()
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+    /* Record sizes from their first bytes, 0 if malformed */
+    static size_t
+    bin_record_size (const unsigned char *p)
+    {
+        return nfcb_get_le(p, 2) > NFC_MAX_FRAME_BYTES ? 0 : frame_record_size(p);
+    }
+
+    static size_t
+    proxmark_record_size (const unsigned char *p)
+    {
+        size_t len = nfcb_get_le(p + 6, 2) & ~PROXMARK_TAG_FLAG;
+
+        return len > NFC_MAX_FRAME_BYTES ? 0 : 8 + len + (len + 7) / 8;
+    }
+
+    static size_t
+    pcapng_block_size (const unsigned char *p)
+    {
+        size_t len = nfcb_get_le(p + 4, 4);
+
+        return (len < 12 || len % 4) ? 0 : len;
+    }
+
+    /* End of the complete records from \p pos on */
+    static uint64_t
+    complete_records (int fd, uint64_t size, uint64_t pos, size_t prefix,
+                      size_t (*record_size)(const unsigned char *))
+    {
+        unsigned char head[FRAME_RECORD_HEADER];
+
+        while (pos + prefix <= size) {
+            if (pread(fd, head, prefix, off_t(pos)) != ssize_t(prefix)) {
+                break;
+            }
+
+            size_t n = record_size(head);
+            if (n < prefix || pos + n > size) {
+                break;
+            }
+            pos += n;
+        }
+
+        return pos;
+    }
+
+    /* End of the last complete line */
+    static uint64_t
+    complete_lines (int fd, uint64_t size)
+    {
+        char buf[65536];
+        uint64_t end = size;
+
+        while (end > 0) {
+            size_t n = size_t(std::min(end, uint64_t(sizeof(buf))));
+
+            if (pread(fd, buf, n, off_t(end - n)) != ssize_t(n)) {
+                return 0;
+            }
+            for (size_t i = n; i > 0; i--) {
+                if (buf[i - 1] == '\n') {
+                    return end - n + i;
+                }
+            }
+            end -= n;
+        }
+
+        return 0;
+    }
+
+    bool
+    frame_output_recover(const std::string &format, const char *path,
+                         uint64_t *before, uint64_t *after)
+    {
+        std::string base = format.substr(0, format.find('+'));
+        struct stat st;
+        uint64_t valid;
+        int fd;
+
+        *before = *after = 0;
+        if (base == "store" || base == "shm") {
+            return true;
+        }
+
+        fd = ::open(path, O_RDWR);
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            perror(path);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+        *before = uint64_t(st.st_size);
+
+        if (base == "bin") {
+            valid = *before < FRAME_FILE_HEADER ? 0 :
+                complete_records(fd, *before, FRAME_FILE_HEADER, FRAME_RECORD_HEADER,
+                                 bin_record_size);
+        } else if (base == "cbin") {
+            valid = *before < FRAME_FILE_HEADER ? 0 :
+                complete_records(fd, *before, FRAME_FILE_HEADER, 8, frame_block_size);
+        } else if (base == "proxmark") {
+            valid = complete_records(fd, *before, 0, 8, proxmark_record_size);
+        } else if (base == "pcapng") {
+            valid = complete_records(fd, *before, 0, 8, pcapng_block_size);
+        } else {
+            /* text, jsonl, exchanges */
+            valid = complete_lines(fd, *before);
+        }
+        *after = valid;
+
+        if (valid < *before && (ftruncate(fd, off_t(valid)) < 0 || !sync_fd(fd))) {
+            perror(path);
+            ::close(fd);
+            return false;
+        }
+
+        ::close(fd);
+        return true;
+    }
+
+    rotating_output::rotating_output(const std::string &format, const output_info &info,
+                                     const rotation_config &rotation)
+      : d_format(format),
+        d_info(info),
+        d_rotation(rotation),
+        d_output(NULL),
+        d_index(NULL),
+        d_segment(0),
+        d_frames(0),
+        d_first_ns(0),
+        d_last_ns(0),
+        d_period_end(0),
+        d_next_sync(0),
+        d_ok(true)
+    {
+    }
+
+    rotating_output::~rotating_output()
+    {
+        close();
+    }
+
+    std::string
+    rotating_output::segment_path(unsigned long n) const
+    {
+        char number[32];
+
+        snprintf(number, sizeof(number), ".%0*lu", ROTATION_DIGITS, n);
+        return d_base + number + d_ext;
+    }
+
+    void
+    rotating_output::log(const char *format, ...)
+    {
+        va_list args;
+
+        va_start(args, format);
+        vfprintf(d_index, format, args);
+        va_end(args);
+        fputc('\n', d_index);
+        fflush(d_index);
+    }
+
+    bool
+    rotating_output::open(const char *path)
+    {
+        std::string full(path);
+        size_t slash = full.rfind('/');
+        size_t name = slash == std::string::npos ? 0 : slash + 1;
+        size_t dot = full.rfind('.');
+
+        if (full == "-") {
+            fprintf(stderr, "Cannot split the standard output into files\n");
+            return false;
+        }
+
+        /* The extension stays last, hidden files have none */
+        if (dot != std::string::npos && dot > name) {
+            d_base = full.substr(0, dot);
+            d_ext = full.substr(dot);
+        } else {
+            d_base = full;
+            d_ext = "";
+        }
+
+        d_index = fopen((full + ".index").c_str(), "a");
+        if (!d_index) {
+            perror((full + ".index").c_str());
+            return false;
+        }
+
+        /* Continue after the files of a previous run */
+        std::string dir = name ? full.substr(0, name) : "./";
+        std::string prefix = d_base.substr(name) + ".";
+        DIR *dp = opendir(dir.c_str());
+        struct dirent *entry;
+
+        while (dp && (entry = readdir(dp)) != NULL) {
+            std::string file(entry->d_name);
+            size_t digits = file.size() - prefix.size() - d_ext.size();
+
+            if (file.size() > prefix.size() + d_ext.size() &&
+                file.compare(0, prefix.size(), prefix) == 0 &&
+                file.compare(file.size() - d_ext.size(), d_ext.size(), d_ext) == 0 &&
+                file.find_first_not_of("0123456789", prefix.size()) == prefix.size() + digits) {
+                d_segment = std::max(d_segment, strtoul(file.c_str() + prefix.size(), NULL, 10));
+            }
+        }
+        if (dp) {
+            closedir(dp);
+        }
+
+        if (d_segment) {
+            /* The last one may end in the middle of a record */
+            std::string last = segment_path(d_segment);
+            uint64_t before, after;
+
+            if (!frame_output_recover(d_format, last.c_str(), &before, &after)) {
+                return false;
+            }
+            if (after < before) {
+                log("recover %s %" PRIu64 " %" PRIu64, last.c_str() + name, after, before);
+            }
+        }
+
+        d_next_sync = monotonic_ns() + d_rotation.sync_ns;
+        return open_segment();
+    }
+
+    bool
+    rotating_output::open_segment()
+    {
+        size_t slash;
+
+        d_segment++;
+        d_path = segment_path(d_segment);
+        slash = d_path.rfind('/');
+        d_name = slash == std::string::npos ? d_path : d_path.substr(slash + 1);
+        d_frames = 0;
+
+        d_output = open_frame_output((d_format + ":" + d_path).c_str(), d_info);
+        if (!d_output) {
+            d_ok = false;
+            return false;
+        }
+        log("open %s", d_name.c_str());
+
+        return true;
+    }
+
+    bool
+    rotating_output::close_segment()
+    {
+        bool ok = true;
+        uint64_t bytes;
+
+        if (!d_output) {
+            return true;
+        }
+
+        if (d_rotation.sync_ns) {
+            ok = d_output->sync();
+        } else {
+            d_output->flush();
+        }
+        bytes = d_output->size();
+        ok = d_output->close() && ok;
+        delete d_output;
+        d_output = NULL;
+
+        log("close %s %" PRIu64 " %" PRIu64 " %" PRId64 " %" PRId64, d_name.c_str(),
+            bytes, d_frames, d_first_ns, d_last_ns);
+        if (d_rotation.sync_ns && !sync_fd(fileno(d_index))) {
+            ok = false;
+        }
+        if (!ok) {
+            d_ok = false;
+        }
+
+        return ok;
+    }
+
+    bool
+    rotating_output::close()
+    {
+        bool ok;
+
+        if (!d_index) {
+            return true;
+        }
+
+        close_segment();
+        ok = d_ok && fclose(d_index) == 0;
+        d_index = NULL;
+
+        return ok;
+    }
+
+    void
+    rotating_output::write(const nfc_frame &frame)
+    {
+        int64_t t = output_time_ns(d_info, frame.start);
+
+        if (d_output && d_frames &&
+            ((d_rotation.period_ns && t >= d_period_end) ||
+             (d_rotation.max_bytes && d_output->size() >= d_rotation.max_bytes))) {
+            close_segment();
+            open_segment();
+        }
+        if (!d_output) {
+            return;
+        }
+
+        if (d_frames == 0) {
+            d_first_ns = t;
+            if (d_rotation.period_ns) {
+                /* Next multiple of the period */
+                int64_t q = t / d_rotation.period_ns;
+
+                if (t % d_rotation.period_ns < 0) {
+                    q--;
+                }
+                d_period_end = (q + 1) * d_rotation.period_ns;
+            }
+        }
+
+        d_output->write(frame);
+        d_frames++;
+        d_last_ns = t;
+
+        if (d_rotation.sync_ns && monotonic_ns() >= d_next_sync) {
+            sync();
+        }
+    }
+
+    void
+    rotating_output::flush()
+    {
+        if (d_output) {
+            d_output->flush();
+        }
+        /* Between frames too, for the outputs of a quiet capture */
+        if (d_output && d_rotation.sync_ns && monotonic_ns() >= d_next_sync) {
+            sync();
+        }
+    }
+
+    bool
+    rotating_output::sync()
+    {
+        bool ok;
+
+        if (!d_output) {
+            return false;
+        }
+
+        ok = d_output->sync();
+        log("sync %s %" PRIu64 " %" PRIu64 " %" PRId64, d_name.c_str(), d_output->size(),
+            d_frames, d_last_ns);
+        if (!sync_fd(fileno(d_index))) {
+            perror("index");
+            ok = false;
+        }
+        d_next_sync = monotonic_ns() + d_rotation.sync_ns;
+        if (!ok) {
+            d_ok = false;
+        }
+
+        return ok;
+    }
+
+    void
+    frame_tee::write(const nfc_frame &frame)
+    {
+        for (size_t i = 0; i < d_sinks.size(); i++) {
+            d_sinks[i]->write(frame);
+        }
+    }
+
+    void
+    frame_tee::flush()
+    {
+        for (size_t i = 0; i < d_sinks.size(); i++) {
+            d_sinks[i]->flush();
+        }
+    }
+
+    frame_output *
+    open_frame_output(const char *spec, const output_info &info,
+                      const rotation_config &rotation)
+    {
+        const char *colon = strchr(spec, ':');
+        std::string format(spec, colon ? colon - spec : strlen(spec));
+        const char *path = colon ? colon + 1 : "-";
+        bool collapse = false;
+        frame_output *out;
+
+        if (rotation.active() && format.compare(0, 3, "shm") != 0) {
+            /* Opens the files of each part with this function */
+            out = new rotating_output(format, info, rotation);
+            if (!out->open(path)) {
+                delete out;
+                return NULL;
+            }
+            return out;
+        }
+
+        if (format.size() > 9 && format.compare(format.size() - 9, 9, "+collapse") == 0) {
+            format.erase(format.size() - 9);
+            collapse = true;
+        }
+
+        if (format == "text") {
+            out = new text_output(info);
+        } else if (format == "pcapng") {
+            out = new pcapng_output(info);
+        } else if (format == "proxmark") {
+            out = new proxmark_output(info);
+        } else if (format == "jsonl") {
+            out = new jsonl_output(info);
+        } else if (format == "bin") {
+            out = new record_output(info);
+        } else if (format == "cbin") {
+            out = new record_output(info, true);
+        } else if (format == "exchanges") {
+            out = new exchange_output(info);
+        } else if (format == "shm") {
+            out = new ring_output(info);
+        } else if (format == "store") {
+            out = new store_output(info);
+        } else {
+            fprintf(stderr, "Unknown output format %s\n", format.c_str());
+            return NULL;
+        }
+
+        if (collapse) {
+            if (!out->runs()) {
+                fprintf(stderr, "The %s output cannot collapse polls\n", format.c_str());
+                delete out;
+                return NULL;
+            }
+            out = new collapsed_output(out);
+        }
+
+        if (!out->open(path)) {
+            delete out;
+            return NULL;
+        }
+
+        return out;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
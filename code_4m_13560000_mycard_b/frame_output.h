@@ -0,0 +1,446 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_FRAME_OUTPUT_H
+#define INCLUDED_NFC_FRAME_OUTPUT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "nfc_frame.h"
+#include "buffered_writer.h"
+#include "frame_correlator.h"
+#include "frame_ring.h"
+#include "frame_store.h"
+#include "poll_collapser.h"
+
+/* Output options shared by the offline tools */
+#define OUTPUT_USAGE \
+    "  -o FORMAT:PATH  write the frames to PATH (\"-\" for stdout) as text,\n" \
+    "             pcapng (LINKTYPE_ISO_14443), proxmark (.trace), jsonl (JSON\n" \
+    "             Lines), bin (frame records), cbin (bin delta coded in blocks,\n" \
+    "             several times smaller) or exchanges (commands paired with\n" \
+    "             their responses by time, in sessions); shm:NAME publishes\n" \
+    "             them in a shared memory ring for nfc_tail, store:DIR writes a\n" \
+    "             columnar store for nfc_query. May be repeated (default text:-)\n" \
+    "             text+collapse and jsonl+collapse fold unanswered repeated\n" \
+    "             polls (REQA/WUPA) into one summary line per run\n"
+
+/* Long-run options of the tools writing outputs */
+#define ROTATION_OPTIONS                "Z:Y:F:"
+#define ROTATION_USAGE \
+    "  -Z SIZE    start a new file for every output past SIZE bytes (k, M or\n" \
+    "             G suffix): PATH.000001.EXT, PATH.000002.EXT... listed with\n" \
+    "             their sync points in PATH.index. On a restart the last file\n" \
+    "             is cut after its last complete record and numbering goes on\n" \
+    "  -Y TIME    likewise every TIME of frame time (s, m, h or d suffix),\n" \
+    "             on multiples of TIME\n" \
+    "  -F TIME    write out and fsync the outputs every TIME (s or ms suffix)\n"
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief What the outputs know about the capture
+     */
+    struct output_info
+    {
+        double sample_rate;
+        int64_t start_time_ns;          /* Time of start_sample, 0 if unknown */
+        uint64_t start_sample;
+        bool positions;                 /* Text: prefix the sample positions */
+    };
+
+    /*! Time of \p sample in ns, exact whatever the length of the capture */
+    int64_t output_time_ns(const output_info &info, uint64_t sample);
+
+    /*!
+     * \brief Long-run settings of the file outputs, all off by default
+     */
+    struct rotation_config
+    {
+        rotation_config();
+
+        /*! Apply one of the ROTATION_OPTIONS, false (and a message) on error */
+        bool parse_option(int opt, const char *arg);
+
+        bool active() const { return max_bytes || period_ns || sync_ns; }
+
+        uint64_t max_bytes;             /* New file past this size */
+        int64_t period_ns;              /* New file on each multiple of this frame time */
+        int64_t sync_ns;                /* fsync interval (monotonic clock) */
+    };
+
+    /*!
+     * \brief A frame_sink writing to a file
+     */
+    class frame_output : public frame_sink
+    {
+     public:
+      virtual bool open(const char *path) = 0;
+
+      /*! Write everything out, false (and a message) if anything failed */
+      virtual bool close() = 0;
+
+      /*! Where poll runs go, NULL when the format cannot show them */
+      virtual poll_run_sink *runs() { return NULL; }
+
+      /*! Write out and fsync the file, false (and a message) on error */
+      virtual bool sync() { flush(); return true; }
+
+      /*! Bytes written so far, buffered ones included, 0 if unknown */
+      virtual uint64_t size() const { return 0; }
+    };
+
+    /*!
+     * \brief The text of nfc_frame_print
+     */
+    class text_output : public frame_output, public poll_run_sink
+    {
+     public:
+      text_output(const output_info &info);
+      ~text_output();
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      void flush();
+
+      /*! "Reader -> [52] x1001 unanswered, every 100.0 us (99.8 to 100.3,
+       * sd 0.1) over 100.000 ms", with the start of the first poll and the
+       * end of the last one in front for the positions.
+       */
+      void write_run(const poll_run &run);
+      poll_run_sink *runs() { return this; }
+
+      bool sync();
+      uint64_t size() const;
+
+     private:
+      FILE *d_fp;
+      bool d_positions;
+      double d_sample_rate;
+    };
+
+    /*!
+     * \brief pcapng capture for Wireshark, LINKTYPE_ISO_14443 (264).
+     *
+     * One Enhanced Packet Block per frame, timestamped in ns from its start
+     * sample (if_tsresol 9). The packet holds the pseudo-header of the
+     * link type (version 0, event 0xFE for the reader and 0xFF for the
+     * tag, length on 2 bytes big-endian) and the bytes as received, CRC
+     * included. The block flags mark the direction, parity errors (symbol
+     * error) and broken frames (unaligned frame), a comment sums up the
+     * status with the CRC_A check. The blocks are formatted in place in
+     * a buffered_writer.
+     */
+    class pcapng_output : public frame_output
+    {
+     public:
+      pcapng_output(const output_info &info);
+      ~pcapng_output();
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      void flush() { d_out.flush(); }
+      bool sync();
+      uint64_t size() const { return d_out.offset(); }
+
+     private:
+      output_info d_info;
+      buffered_writer d_out;
+      const char *d_path;
+    };
+
+    /*!
+     * \brief Proxmark3 trace, the records LogTrace() appends to the trace
+     * buffer of the device, as saved by the client ("trace load").
+     *
+     * Each record: start time (u32) and duration (u16) in carrier ticks
+     * (1/13.56 MHz) from the start of the capture, data length (u16, bit
+     * 15 set for the tag), the bytes, then the received parity bits, one
+     * byte per 8 data bytes, first byte in the MSB. The start time wraps
+     * after 316 s like on the device. Records go through a buffered_writer.
+     */
+    class proxmark_output : public frame_output
+    {
+     public:
+      proxmark_output(const output_info &info);
+      ~proxmark_output();
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      void flush() { d_out.flush(); }
+      bool sync();
+      uint64_t size() const { return d_out.offset(); }
+
+     private:
+      output_info d_info;
+      buffered_writer d_out;
+      const char *d_path;
+    };
+
+    /*!
+     * \brief One JSON object per line, see frame_json_encode. The lines
+     * are formatted in place in a buffered_writer.
+     */
+    class jsonl_output : public frame_output, public poll_run_sink
+    {
+     public:
+      jsonl_output(const output_info &info);
+      ~jsonl_output();
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      void flush() { d_out.flush(); }
+
+      /*! See frame_json_encode_run */
+      void write_run(const poll_run &run);
+      poll_run_sink *runs() { return this; }
+
+      bool sync();
+      uint64_t size() const { return d_out.offset(); }
+
+     private:
+      output_info d_info;
+      buffered_writer d_out;
+      const char *d_path;
+    };
+
+    /*!
+     * \brief Binary frame file: FRAME_FILE_HEADER with the sample rate and
+     * the start time, then one frame_record_encode record per frame,
+     * formatted in place in a buffered_writer.
+     *
+     * A \p compact file holds frame_block_encoder blocks of
+     * FRAME_BLOCK_FRAMES frames instead. A block is written when full, on
+     * sync() and on close(), so a crash loses the frames of the block
+     * being built.
+     */
+    class record_output : public frame_output
+    {
+     public:
+      record_output(const output_info &info, bool compact = false);
+      ~record_output();
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      void flush() { d_out.flush(); }
+      bool sync();
+      uint64_t size() const;
+
+     private:
+      void write_block();
+
+      output_info d_info;
+      bool d_compact;
+      frame_block_encoder d_block;
+      buffered_writer d_out;
+      const char *d_path;
+    };
+
+    /*!
+     * \brief The frames grouped into exchanges and sessions by a
+     * frame_correlator with its default response window, as printed by
+     * exchange_printer.
+     */
+    class exchange_output : public frame_output
+    {
+     public:
+      exchange_output(const output_info &info);
+      ~exchange_output();
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      bool sync();
+      uint64_t size() const;
+
+     private:
+      output_info d_info;
+      FILE *d_fp;
+      exchange_printer *d_printer;
+      frame_correlator *d_correlator;
+    };
+
+    /*!
+     * \brief Publishes the frames in the shared memory ring \p path for
+     * any number of local consumers (frame_ring_writer).
+     */
+    class ring_output : public frame_output
+    {
+     public:
+      ring_output(const output_info &info);
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+
+     private:
+      output_info d_info;
+      frame_ring_writer d_ring;
+    };
+
+    /*!
+     * \brief Columnar frame store in the directory \p path
+     * (frame_store_writer)
+     */
+    class store_output : public frame_output
+    {
+     public:
+      store_output(const output_info &info);
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      bool sync();
+      uint64_t size() const { return d_store.size(); }
+
+     private:
+      output_info d_info;
+      frame_store_writer d_store;
+      const char *d_path;
+    };
+
+    /*!
+     * \brief An output behind a poll_collapser ("FORMAT+collapse"), owns
+     * the output.
+     */
+    class collapsed_output : public frame_output
+    {
+     public:
+      collapsed_output(frame_output *output);
+      ~collapsed_output();
+
+      bool open(const char *path) { return d_output->open(path); }
+      bool close();
+      void write(const nfc_frame &frame) { d_collapser.write(frame); }
+      void flush() { d_output->flush(); }
+      bool sync() { return d_output->sync(); }
+      uint64_t size() const { return d_output->size(); }
+
+     private:
+      frame_output *d_output;
+      poll_collapser d_collapser;
+    };
+
+    /*!
+     * \brief An output of \p format split into numbered files, for
+     * captures running for days ("-Z", "-Y", "-F").
+     *
+     * PATH is cut before its extension: trace.bin gives trace.000001.bin,
+     * trace.000002.bin... each a complete file of the format (header
+     * included), or a complete store for the store format. A new one
+     * starts once the current one reaches max_bytes or once the frame
+     * time reaches the next multiple of period_ns. What a format carries
+     * from frame to frame (exchange sessions, poll runs) starts over with
+     * each file.
+     *
+     * Every sync_ns (checked at each frame) the file is written out and
+     * fsync'd. PATH.index is an append-only log of the files, fsync'd
+     * along:
+     *
+     *   open NAME
+     *   sync NAME BYTES FRAMES LAST_NS     the first BYTES hold FRAMES
+     *                                      frames, the last one at LAST_NS
+     *   close NAME BYTES FRAMES FIRST_NS LAST_NS
+     *   recover NAME BYTES FROM            cut from FROM to BYTES bytes
+     *
+     * so the sync lines are an index from time to file offset. On open,
+     * the highest numbered existing file is cut after its last complete
+     * record (frame_output_recover) and numbering continues after it.
+     */
+    class rotating_output : public frame_output
+    {
+     public:
+      rotating_output(const std::string &format, const output_info &info,
+                      const rotation_config &rotation);
+      ~rotating_output();
+
+      bool open(const char *path);
+      bool close();
+      void write(const nfc_frame &frame);
+      void flush();
+      bool sync();
+      uint64_t size() const { return d_output ? d_output->size() : 0; }
+
+     private:
+      std::string segment_path(unsigned long n) const;
+      bool open_segment();
+      bool close_segment();
+      void log(const char *format, ...);
+
+      std::string d_format;
+      output_info d_info;
+      rotation_config d_rotation;
+      std::string d_base;               /* PATH up to the extension */
+      std::string d_ext;                /* Extension with its dot, may be empty */
+      std::string d_path;               /* Current file */
+      std::string d_name;               /* Its name in the index */
+      frame_output *d_output;
+      FILE *d_index;
+      unsigned long d_segment;
+      uint64_t d_frames;
+      int64_t d_first_ns;
+      int64_t d_last_ns;
+      int64_t d_period_end;             /* Frame time starting the next file */
+      int64_t d_next_sync;              /* Monotonic time of the next fsync */
+      bool d_ok;
+    };
+
+    /*!
+     * \brief Same frames to several sinks
+     */
+    class frame_tee : public frame_sink
+    {
+     public:
+      void add(frame_sink *sink) { d_sinks.push_back(sink); }
+
+      void write(const nfc_frame &frame);
+      void flush();
+
+     private:
+      std::vector<frame_sink *> d_sinks;
+    };
+
+    /*!
+     * Cut the file \p path of \p format (as given to open_frame_output)
+     * after its last complete record or line: what a crash in the middle
+     * of a write leaves behind. The sizes before and after go to
+     * \p before and \p after. Stores need nothing, their reader already
+     * stops at the last complete row. False (and a message) on error.
+     */
+    bool frame_output_recover(const std::string &format, const char *path,
+                              uint64_t *before, uint64_t *after);
+
+    /*!
+     * Open the output of \p spec, "FORMAT:PATH" (see OUTPUT_USAGE), split
+     * into files if \p rotation is active. NULL with a message on error.
+     */
+    frame_output *open_frame_output(const char *spec, const output_info &info,
+                                    const rotation_config &rotation = rotation_config());
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_FRAME_OUTPUT_H */
@@ -0,0 +1,793 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include "frame_record.h"
+#include "nfcb.h"
+
+namespace gr {
+  namespace nfc {
+
+    static const char hex_digits[] = "0123456789abcdef";
+
+    /* "00" to "99", two digits per division */
+    static const char decimal_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    static char *
+    put_uint (char *p, uint64_t v)
+    {
+        char tmp[20];
+        char *t = tmp + sizeof(tmp);
+
+        while (v >= 100) {
+            unsigned int r = unsigned(v % 100);
+
+            v /= 100;
+            *--t = decimal_pairs[2 * r + 1];
+            *--t = decimal_pairs[2 * r];
+        }
+        if (v >= 10) {
+            *--t = decimal_pairs[2 * v + 1];
+            *--t = decimal_pairs[2 * v];
+        } else {
+            *--t = char('0' + v);
+        }
+
+        memcpy(p, t, tmp + sizeof(tmp) - t);
+        return p + (tmp + sizeof(tmp) - t);
+    }
+
+    static char *
+    put_int (char *p, int64_t v)
+    {
+        if (v < 0) {
+            *p++ = '-';
+            return put_uint(p, uint64_t(0) - uint64_t(v));
+        }
+
+        return put_uint(p, uint64_t(v));
+    }
+
+    static char *
+    put_hex (char *p, const unsigned char *data, unsigned int len)
+    {
+        for (unsigned int i = 0; i < len; i++) {
+            *p++ = hex_digits[data[i] >> 4];
+            *p++ = hex_digits[data[i] & 15];
+        }
+
+        return p;
+    }
+
+    /* Literal, sizeof() - 1 bytes */
+    #define PUT(p, s)       (memcpy(p, s, sizeof(s) - 1), (p) + sizeof(s) - 1)
+
+    static char *
+    put_bool (char *p, bool v)
+    {
+        return v ? PUT(p, "true") : PUT(p, "false");
+    }
+
+    size_t
+    frame_json_encode (const nfc_frame &frame, int64_t time_ns, char *out)
+    {
+        static const char status_letters[] = "opbs";        /* nfc_byte_status */
+        char *p = out;
+
+        p = PUT(p, "{\"start\":");
+        p = put_uint(p, frame.start);
+        p = PUT(p, ",\"end\":");
+        p = put_uint(p, frame.end);
+        p = PUT(p, ",\"time_ns\":");
+        p = put_int(p, time_ns);
+        p = frame.direction == NFC_READER ? PUT(p, ",\"dir\":\"reader\"") : PUT(p, ",\"dir\":\"tag\"");
+        p = PUT(p, ",\"nbits\":");
+        p = put_uint(p, frame.nbits);
+        p = PUT(p, ",\"data\":\"");
+        p = put_hex(p, frame.data, frame.len);
+        p = PUT(p, "\",\"status\":\"");
+        for (unsigned int i = 0; i < frame.len; i++) {
+            *p++ = status_letters[frame.status[i] & 3];
+        }
+        p = PUT(p, "\",\"parity\":\"");
+        p = put_hex(p, frame.parity, (frame.len + 7) / 8);
+        p = PUT(p, "\",\"crc_ok\":");
+        p = put_bool(p, nfc_frame_crc_ok(frame));
+        p = PUT(p, ",\"short\":");
+        p = put_bool(p, frame.flags & FRAME_SHORT);
+        p = PUT(p, ",\"broken\":");
+        p = put_bool(p, frame.flags & FRAME_BROKEN);
+        p = PUT(p, ",\"parity_error\":");
+        p = put_bool(p, frame.flags & FRAME_PARITY_ERROR);
+        p = PUT(p, ",\"no_parity\":");
+        p = put_bool(p, frame.flags & FRAME_NO_PARITY);
+        p = PUT(p, "}\n");
+
+        return p - out;
+    }
+
+    size_t
+    frame_json_encode_run (const poll_run &run, int64_t time_ns, int64_t last_time_ns,
+                           double ns_per_sample, char *out)
+    {
+        const nfc_frame &poll = run.first;
+        char *p = out;
+
+        p = PUT(p, "{\"type\":\"poll_run\",\"start\":");
+        p = put_uint(p, poll.start);
+        p = PUT(p, ",\"end\":");
+        p = put_uint(p, run.last_end);
+        p = PUT(p, ",\"time_ns\":");
+        p = put_int(p, time_ns);
+        p = PUT(p, ",\"last_time_ns\":");
+        p = put_int(p, last_time_ns);
+        p = poll.direction == NFC_READER ? PUT(p, ",\"dir\":\"reader\"") : PUT(p, ",\"dir\":\"tag\"");
+        p = PUT(p, ",\"nbits\":");
+        p = put_uint(p, poll.nbits);
+        p = PUT(p, ",\"data\":\"");
+        p = put_hex(p, poll.data, poll.len);
+        p = PUT(p, "\",\"count\":");
+        p = put_uint(p, run.count);
+        p = PUT(p, ",\"period_ns\":");
+        p = put_uint(p, uint64_t(run.period_mean * ns_per_sample + 0.5));
+        p = PUT(p, ",\"period_min_ns\":");
+        p = put_uint(p, uint64_t(run.period_min * ns_per_sample + 0.5));
+        p = PUT(p, ",\"period_max_ns\":");
+        p = put_uint(p, uint64_t(run.period_max * ns_per_sample + 0.5));
+        p = PUT(p, ",\"period_sd_ns\":");
+        p = put_uint(p, uint64_t(run.period_sd * ns_per_sample + 0.5));
+        p = PUT(p, "}\n");
+
+        return p - out;
+    }
+
+    size_t
+    frame_record_encode (const nfc_frame &frame, int64_t time_ns, unsigned char *out)
+    {
+        unsigned int nparity = (frame.len + 7) / 8;
+        unsigned char flags = frame.flags | (nfc_frame_crc_ok(frame) ? FRAME_RECORD_CRC_OK : 0);
+
+        nfcb_put_le(out, frame.len, 2);
+        nfcb_put_le(out + 2, frame.nbits, 2);
+        out[4] = frame.direction;
+        out[5] = flags;
+        nfcb_put_le(out + 6, 0, 2);
+        nfcb_put_le(out + 8, frame.start, 8);
+        nfcb_put_le(out + 16, frame.end, 8);
+        nfcb_put_le(out + 24, uint64_t(time_ns), 8);
+        memcpy(out + FRAME_RECORD_HEADER, frame.data, frame.len);
+        memcpy(out + FRAME_RECORD_HEADER + frame.len, frame.status, frame.len);
+        memcpy(out + FRAME_RECORD_HEADER + 2 * frame.len, frame.parity, nparity);
+
+        return FRAME_RECORD_HEADER + 2 * frame.len + nparity;
+    }
+
+    size_t
+    frame_record_size (const unsigned char *in)
+    {
+        unsigned int len = unsigned(nfcb_get_le(in, 2));
+
+        return FRAME_RECORD_HEADER + 2 * len + (len + 7) / 8;
+    }
+
+    bool
+    frame_record_decode (const unsigned char *in, size_t avail, nfc_frame *frame,
+                         int64_t *time_ns)
+    {
+        unsigned int len, nparity;
+
+        if (avail < FRAME_RECORD_HEADER) {
+            return false;
+        }
+        len = unsigned(nfcb_get_le(in, 2));
+        nparity = (len + 7) / 8;
+        if (len > NFC_MAX_FRAME_BYTES || avail < frame_record_size(in) || in[4] > NFC_TAG) {
+            return false;
+        }
+
+        frame->len = len;
+        frame->nbits = (unsigned short) nfcb_get_le(in + 2, 2);
+        frame->direction = in[4];
+        frame->flags = in[5] & ~FRAME_RECORD_CRC_OK;
+        frame->start = nfcb_get_le(in + 8, 8);
+        frame->end = nfcb_get_le(in + 16, 8);
+        *time_ns = int64_t(nfcb_get_le(in + 24, 8));
+        memcpy(frame->data, in + FRAME_RECORD_HEADER, len);
+        memcpy(frame->status, in + FRAME_RECORD_HEADER + len, len);
+        memset(frame->parity, 0, sizeof(frame->parity));
+        memcpy(frame->parity, in + FRAME_RECORD_HEADER + 2 * len, nparity);
+
+        return true;
+    }
+
+    void
+    frame_file_put_header (unsigned char *out, double sample_rate, int64_t start_time_ns,
+                           uint64_t start_sample, bool compact)
+    {
+        uint64_t rate;
+
+        memcpy(&rate, &sample_rate, sizeof(rate));
+        memcpy(out, compact ? FRAME_FILE_MAGIC_COMPACT : FRAME_FILE_MAGIC, 8);
+        nfcb_put_le(out + 8, rate, 8);
+        nfcb_put_le(out + 16, uint64_t(start_time_ns), 8);
+        nfcb_put_le(out + 24, start_sample, 8);
+    }
+
+    bool
+    frame_file_get_header (const unsigned char *in, size_t avail, double *sample_rate,
+                           int64_t *start_time_ns, uint64_t *start_sample, bool *compact)
+    {
+        uint64_t rate;
+
+        if (avail < FRAME_FILE_HEADER ||
+            (memcmp(in, FRAME_FILE_MAGIC, 8) &&
+             (!compact || memcmp(in, FRAME_FILE_MAGIC_COMPACT, 8)))) {
+            return false;
+        }
+        if (compact) {
+            *compact = memcmp(in, FRAME_FILE_MAGIC_COMPACT, 8) == 0;
+        }
+
+        rate = nfcb_get_le(in + 8, 8);
+        memcpy(sample_rate, &rate, sizeof(rate));
+        *start_time_ns = int64_t(nfcb_get_le(in + 16, 8));
+        *start_sample = nfcb_get_le(in + 24, 8);
+        return true;
+    }
+
+    /* Varint columns of a compact block */
+    enum block_column {
+        BLOCK_LEN,
+        BLOCK_START,
+        BLOCK_DURATION,
+        BLOCK_TIME,
+        BLOCK_NBITS,
+    };
+
+    /* form bits of a compact frame */
+    enum block_form {
+        FORM_TAG = 0x01,
+        FORM_STATUS = 0x02,
+        FORM_PARITY = 0x04,
+        FORM_NBITS = 0x08,
+    };
+
+    static void
+    put_varint (std::vector<unsigned char> &out, uint64_t v)
+    {
+        while (v >= 0x80) {
+            out.push_back((unsigned char) (v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((unsigned char) v);
+    }
+
+    static inline uint64_t
+    zigzag (int64_t v)
+    {
+        return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+    }
+
+    static inline int64_t
+    unzigzag (uint64_t v)
+    {
+        return int64_t(v >> 1) ^ -int64_t(v & 1);
+    }
+
+    /*
+     * Decode \p n varints of \p in (\p avail bytes) to \p out, returns the
+     * bytes used, 0 if malformed. Polls and short frames make most values
+     * fit in one byte: 8 such bytes are checked with one mask and widened
+     * in a loop the compiler vectorizes.
+     */
+    static size_t
+    get_varints (const unsigned char *in, size_t avail, uint64_t *out, size_t n)
+    {
+        size_t pos = 0, i = 0;
+
+        while (i < n) {
+            if (i + 8 <= n && pos + 8 <= avail) {
+                uint64_t word;
+
+                memcpy(&word, in + pos, 8);
+                if (!(word & 0x8080808080808080ULL)) {
+                    for (int k = 0; k < 8; k++) {
+                        out[i + k] = in[pos + k];
+                    }
+                    i += 8;
+                    pos += 8;
+                    continue;
+                }
+            }
+
+            uint64_t v = 0;
+            unsigned char b;
+            int shift = 0;
+
+            do {
+                if (pos == avail || shift > 63) {
+                    return 0;
+                }
+                b = in[pos++];
+                v |= uint64_t(b & 0x7f) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            out[i++] = v;
+        }
+
+        return pos;
+    }
+
+    /* Start delta in ns, what the time delta is coded against */
+    static inline int64_t
+    predicted_ns (int64_t samples, double ns_per_sample)
+    {
+        double ns = samples * ns_per_sample;
+
+        return (ns > -9e18 && ns < 9e18) ? int64_t(std::floor(ns + 0.5)) : 0;
+    }
+
+    /* nbits of a frame whose last byte is complete */
+    static inline unsigned int
+    usual_nbits (unsigned int len, unsigned int flags)
+    {
+        if (flags & FRAME_SHORT) {
+            return 7;
+        }
+        return len * ((flags & FRAME_NO_PARITY) ? 8 : 9);
+    }
+
+    /* Odd parity of the data, what the decoders receive from a sound frame */
+    static void
+    usual_parity (const unsigned char *data, unsigned int len, unsigned int flags,
+                  unsigned char *parity)
+    {
+        memset(parity, 0, (len + 7) / 8);
+        if (flags & (FRAME_SHORT | FRAME_NO_PARITY)) {
+            return;
+        }
+        for (unsigned int i = 0; i < len; i++) {
+            if (!(__builtin_popcount(data[i]) & 1)) {
+                parity[i / 8] |= 0x80 >> (i % 8);
+            }
+        }
+    }
+
+    frame_block_encoder::frame_block_encoder()
+    {
+        reset(1);
+    }
+
+    void
+    frame_block_encoder::reset(double sample_rate)
+    {
+        d_ns_per_sample = 1e9 / sample_rate;
+        d_frames = 0;
+        d_form.clear();
+        d_flags.clear();
+        for (int c = 0; c < FRAME_BLOCK_COLUMNS; c++) {
+            d_columns[c].clear();
+        }
+        d_payload.clear();
+    }
+
+    void
+    frame_block_encoder::add(const nfc_frame &frame, int64_t time_ns)
+    {
+        unsigned char parity[NFC_MAX_FRAME_BYTES / 8];
+        unsigned int nparity = (frame.len + 7) / 8;
+        int d = frame.direction == NFC_TAG;
+        unsigned char form = d ? FORM_TAG : 0;
+
+        if (d_frames == 0) {
+            /* Keyframe: the deltas of both directions start from it */
+            d_key_time = time_ns;
+            d_key_start = frame.start;
+            d_prev_start[0] = d_prev_start[1] = frame.start;
+            d_prev_time[0] = d_prev_time[1] = time_ns;
+        }
+
+        /* Modulo 2^64 like the decoder, whatever the times are */
+        int64_t ds = int64_t(frame.start - d_prev_start[d]);
+        int64_t dt = int64_t(uint64_t(time_ns) - uint64_t(d_prev_time[d]) -
+                             uint64_t(predicted_ns(ds, d_ns_per_sample)));
+        d_prev_start[d] = frame.start;
+        d_prev_time[d] = time_ns;
+
+        usual_parity(frame.data, frame.len, frame.flags, parity);
+        for (unsigned int i = 0; i < frame.len; i++) {
+            if (frame.status[i] != BYTE_OK) {
+                form |= FORM_STATUS;
+                break;
+            }
+        }
+        if (memcmp(parity, frame.parity, nparity)) {
+            form |= FORM_PARITY;
+        }
+        if (frame.nbits != usual_nbits(frame.len, frame.flags)) {
+            form |= FORM_NBITS;
+            put_varint(d_columns[BLOCK_NBITS], frame.nbits);
+        }
+
+        d_form.push_back(form);
+        d_flags.push_back(frame.flags | (nfc_frame_crc_ok(frame) ? FRAME_RECORD_CRC_OK : 0));
+        put_varint(d_columns[BLOCK_LEN], frame.len);
+        put_varint(d_columns[BLOCK_START], zigzag(ds));
+        put_varint(d_columns[BLOCK_DURATION], frame.end - frame.start);
+        put_varint(d_columns[BLOCK_TIME], zigzag(dt));
+
+        d_payload.insert(d_payload.end(), frame.data, frame.data + frame.len);
+        if (form & FORM_STATUS) {
+            d_payload.insert(d_payload.end(), frame.status, frame.status + frame.len);
+        }
+        if (form & FORM_PARITY) {
+            d_payload.insert(d_payload.end(), frame.parity, frame.parity + nparity);
+        }
+
+        d_frames++;
+    }
+
+    size_t
+    frame_block_encoder::size() const
+    {
+        size_t size = FRAME_BLOCK_HEADER + 2 * d_frames + d_payload.size();
+
+        for (int c = 0; c < FRAME_BLOCK_COLUMNS; c++) {
+            size += d_columns[c].size();
+        }
+
+        return size;
+    }
+
+    size_t
+    frame_block_encoder::finish(unsigned char *out)
+    {
+        size_t size = this->size();
+        unsigned char *p = out + FRAME_BLOCK_HEADER;
+
+        memset(out, 0, FRAME_BLOCK_HEADER);
+        nfcb_put_le(out, FRAME_BLOCK_MAGIC, 4);
+        nfcb_put_le(out + 4, size, 4);
+        nfcb_put_le(out + 8, d_frames, 4);
+        nfcb_put_le(out + 12, d_payload.size(), 4);
+        nfcb_put_le(out + 16, uint64_t(d_frames ? d_key_time : 0), 8);
+        nfcb_put_le(out + 24, d_frames ? d_key_start : 0, 8);
+
+        memcpy(p, d_form.data(), d_frames);
+        memcpy(p + d_frames, d_flags.data(), d_frames);
+        p += 2 * d_frames;
+        for (int c = 0; c < FRAME_BLOCK_COLUMNS; c++) {
+            nfcb_put_le(out + 32 + 4 * c, d_columns[c].size(), 4);
+            if (!d_columns[c].empty()) {
+                memcpy(p, d_columns[c].data(), d_columns[c].size());
+            }
+            p += d_columns[c].size();
+        }
+        if (!d_payload.empty()) {
+            memcpy(p, &d_payload[0], d_payload.size());
+        }
+
+        reset(1e9 / d_ns_per_sample);
+        return size;
+    }
+
+    size_t
+    frame_block_size (const unsigned char *in)
+    {
+        size_t size = size_t(nfcb_get_le(in + 4, 4));
+
+        if (nfcb_get_le(in, 4) != FRAME_BLOCK_MAGIC || size < FRAME_BLOCK_HEADER) {
+            return 0;
+        }
+
+        return size;
+    }
+
+    frame_block::frame_block()
+      : d_frames(0)
+    {
+    }
+
+    bool
+    frame_block::decode(const unsigned char *in, size_t avail, double sample_rate)
+    {
+        double ns_per_sample = 1e9 / sample_rate;
+        size_t size, n, payload, nbits = 0;
+        size_t columns[FRAME_BLOCK_COLUMNS];
+        const unsigned char *p;
+
+        d_frames = 0;
+        if (avail < FRAME_BLOCK_HEADER || !(size = frame_block_size(in)) || size > avail) {
+            return false;
+        }
+        n = size_t(nfcb_get_le(in + 8, 4));
+        payload = size_t(nfcb_get_le(in + 12, 4));
+
+        size_t used = FRAME_BLOCK_HEADER + 2 * n + payload;
+        for (int c = 0; c < FRAME_BLOCK_COLUMNS; c++) {
+            columns[c] = size_t(nfcb_get_le(in + 32 + 4 * c, 4));
+            used += columns[c];
+        }
+        if (used != size || n > size) {
+            return false;
+        }
+        if (n == 0) {
+            return size == FRAME_BLOCK_HEADER;
+        }
+
+        p = in + FRAME_BLOCK_HEADER;
+        d_form.assign(p, p + n);
+        d_flags.assign(p + n, p + 2 * n);
+        p += 2 * n;
+        for (size_t i = 0; i < n; i++) {
+            nbits += (d_form[i] & FORM_NBITS) != 0;
+        }
+
+        /* One column after the other, each in its own tight loop */
+        d_len.resize(n);
+        d_start.resize(n);
+        d_end.resize(n);
+        d_time.resize(n);
+        d_nbits.resize(n);
+        d_offset.resize(n);
+        d_tmp.resize(n);
+        if (get_varints(p, columns[BLOCK_LEN], &d_len[0], n) != columns[BLOCK_LEN]) {
+            return false;
+        }
+        p += columns[BLOCK_LEN];
+
+        if (get_varints(p, columns[BLOCK_START], &d_tmp[0], n) != columns[BLOCK_START]) {
+            return false;
+        }
+        p += columns[BLOCK_START];
+        uint64_t key_start = nfcb_get_le(in + 24, 8);
+        uint64_t prev_start[2] = { key_start, key_start };
+        for (size_t i = 0; i < n; i++) {
+            int d = d_form[i] & FORM_TAG;
+
+            /* The start delta, kept for the time prediction */
+            d_tmp[i] = uint64_t(unzigzag(d_tmp[i]));
+            d_start[i] = prev_start[d] += d_tmp[i];
+        }
+
+        if (get_varints(p, columns[BLOCK_DURATION], &d_end[0], n) != columns[BLOCK_DURATION]) {
+            return false;
+        }
+        p += columns[BLOCK_DURATION];
+        for (size_t i = 0; i < n; i++) {
+            d_end[i] += d_start[i];
+        }
+
+        std::vector<uint64_t> &times = d_nbits;      /* Free until the nbits */
+        if (get_varints(p, columns[BLOCK_TIME], &times[0], n) != columns[BLOCK_TIME]) {
+            return false;
+        }
+        p += columns[BLOCK_TIME];
+        uint64_t key_time = nfcb_get_le(in + 16, 8);
+        uint64_t prev_time[2] = { key_time, key_time };
+        for (size_t i = 0; i < n; i++) {
+            int d = d_form[i] & FORM_TAG;
+
+            prev_time[d] += uint64_t(unzigzag(times[i])) +
+                uint64_t(predicted_ns(int64_t(d_tmp[i]), ns_per_sample));
+            d_time[i] = int64_t(prev_time[d]);
+        }
+
+        /* Stored nbits in place, then the usual ones around them */
+        if (get_varints(p, columns[BLOCK_NBITS], &d_tmp[0], nbits) != columns[BLOCK_NBITS]) {
+            return false;
+        }
+        p += columns[BLOCK_NBITS];
+
+        size_t k = 0, pos = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t len = d_len[i];
+
+            if (len > NFC_MAX_FRAME_BYTES) {
+                return false;
+            }
+            d_nbits[i] = (d_form[i] & FORM_NBITS) ? d_tmp[k++] : usual_nbits(unsigned(len), d_flags[i]);
+            d_offset[i] = pos;
+            pos += len;
+            if (d_form[i] & FORM_STATUS) {
+                pos += len;
+            }
+            if (d_form[i] & FORM_PARITY) {
+                pos += (len + 7) / 8;
+            }
+        }
+        if (pos != payload) {
+            return false;
+        }
+        d_payload.assign(p, p + payload);
+        d_frames = n;
+
+        return true;
+    }
+
+    void
+    frame_block::frame(size_t i, nfc_frame *frame, int64_t *time_ns) const
+    {
+        unsigned int len = unsigned(d_len[i]);
+        const unsigned char *p = d_payload.data() + d_offset[i];
+
+        frame->start = d_start[i];
+        frame->end = d_end[i];
+        frame->direction = (d_form[i] & FORM_TAG) ? NFC_TAG : NFC_READER;
+        frame->flags = d_flags[i] & ~FRAME_RECORD_CRC_OK;
+        frame->nbits = (unsigned short) d_nbits[i];
+        frame->len = (unsigned short) len;
+        *time_ns = d_time[i];
+
+        memcpy(frame->data, p, len);
+        p += len;
+        if (d_form[i] & FORM_STATUS) {
+            memcpy(frame->status, p, len);
+            p += len;
+        } else {
+            memset(frame->status, BYTE_OK, len);
+        }
+        memset(frame->parity, 0, sizeof(frame->parity));
+        if (d_form[i] & FORM_PARITY) {
+            memcpy(frame->parity, p, (len + 7) / 8);
+        } else {
+            usual_parity(frame->data, len, frame->flags, frame->parity);
+        }
+    }
+
+    frame_record_reader::frame_record_reader()
+      : d_view(NULL),
+        d_len(0),
+        d_pos(0),
+        d_truncated(false),
+        d_sample_rate(0),
+        d_start_time_ns(0),
+        d_start_sample(0),
+        d_compact(false),
+        d_block_pos(0)
+    {
+    }
+
+    bool
+    frame_record_reader::open(const char *path)
+    {
+        const unsigned char *header;
+
+        if (!d_file.open(path)) {
+            perror(path);
+            return false;
+        }
+
+        header = peek(FRAME_FILE_HEADER);
+        if (!header || !frame_file_get_header(header, FRAME_FILE_HEADER, &d_sample_rate,
+                                              &d_start_time_ns, &d_start_sample, &d_compact)) {
+            fprintf(stderr, "%s: not a frame file\n", path);
+            return false;
+        }
+        consume(FRAME_FILE_HEADER);
+
+        return true;
+    }
+
+    const unsigned char *
+    frame_record_reader::peek(size_t n)
+    {
+        if (d_carry.empty() && d_len - d_pos >= n) {
+            return d_view + d_pos;
+        }
+
+        /* Across views: gather the bytes not consumed yet */
+        while (d_carry.size() < n) {
+            if (d_pos == d_len) {
+                const void *view;
+
+                d_len = d_file.next(&view, FRAME_READ_SIZE);
+                d_view = (const unsigned char *) view;
+                d_pos = 0;
+                if (d_len == 0) {
+                    return NULL;
+                }
+            }
+
+            size_t take = std::min(n - d_carry.size(), d_len - d_pos);
+            d_carry.insert(d_carry.end(), d_view + d_pos, d_view + d_pos + take);
+            d_pos += take;
+        }
+
+        return &d_carry[0];
+    }
+
+    void
+    frame_record_reader::consume(size_t n)
+    {
+        /* The carry holds exactly the n bytes of the last peek() */
+        if (!d_carry.empty()) {
+            d_carry.clear();
+        } else {
+            d_pos += n;
+        }
+    }
+
+    bool
+    frame_record_reader::next_block()
+    {
+        const unsigned char *p = peek(FRAME_BLOCK_HEADER);
+        size_t size;
+
+        if (!p) {
+            d_truncated = !d_carry.empty() || d_file.failed();
+            return false;
+        }
+
+        size = frame_block_size(p);
+        p = size ? peek(size) : NULL;
+        if (!p || !d_block.decode(p, size, d_sample_rate)) {
+            d_truncated = true;
+            return false;
+        }
+        consume(size);
+        d_block_pos = 0;
+
+        return true;
+    }
+
+    bool
+    frame_record_reader::next(nfc_frame *frame, int64_t *time_ns)
+    {
+        if (d_compact) {
+            /* Empty blocks are valid, skip them */
+            while (d_block_pos == d_block.frames()) {
+                if (!next_block()) {
+                    return false;
+                }
+            }
+            d_block.frame(d_block_pos++, frame, time_ns);
+            return true;
+        }
+
+        const unsigned char *p = peek(FRAME_RECORD_HEADER);
+        size_t size;
+
+        if (!p) {
+            d_truncated = !d_carry.empty() || d_file.failed();
+            return false;
+        }
+
+        size = frame_record_size(p);
+        p = peek(size);
+        if (!p || !frame_record_decode(p, size, frame, time_ns)) {
+            d_truncated = true;
+            return false;
+        }
+        consume(size);
+
+        return true;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
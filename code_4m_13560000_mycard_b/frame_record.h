@@ -0,0 +1,294 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_FRAME_RECORD_H
+#define INCLUDED_NFC_FRAME_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "nfc_frame.h"
+#include "capture_file.h"
+#include "poll_collapser.h"
+
+/* Largest JSON line of a frame, newline included */
+#define FRAME_JSON_MAX                  (256 + 5 * NFC_MAX_FRAME_BYTES)
+
+/* Binary record: fixed header, then the payload */
+#define FRAME_RECORD_HEADER             32
+#define FRAME_RECORD_MAX                (FRAME_RECORD_HEADER + 2 * NFC_MAX_FRAME_BYTES + NFC_MAX_FRAME_BYTES / 8)
+
+/* Record flag on top of nfc_frame_flags: the frame ends with its CRC_A */
+#define FRAME_RECORD_CRC_OK             0x80
+
+/* Binary frame file: header, then the records back to back */
+#define FRAME_FILE_MAGIC                "NFCFRM01"
+#define FRAME_FILE_HEADER               32
+
+/* Compact frame file: same header, then blocks of delta coded frames */
+#define FRAME_FILE_MAGIC_COMPACT        "NFCFRM02"
+#define FRAME_BLOCK_MAGIC               0x4b4c4246      /* "FBLK" */
+#define FRAME_BLOCK_HEADER              64
+
+/* Frames of a block: the distance between two keyframes */
+#define FRAME_BLOCK_FRAMES              4096
+
+/* Varint columns of a block */
+#define FRAME_BLOCK_COLUMNS             5
+
+/* Bytes asked from the file at once by frame_record_reader */
+#define FRAME_READ_SIZE                 (1 << 20)
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * Format \p frame as one JSON line into \p out (FRAME_JSON_MAX bytes),
+     * returns its length. Numbers and hex are formatted by hand, nothing
+     * is allocated:
+     *
+     *   {"start":2000,"end":2779,"time_ns":500000,"dir":"reader",
+     *    "nbits":18,"data":"9320","status":"oo","parity":"00",
+     *    "crc_ok":false,"short":false,"broken":false,
+     *    "parity_error":false,"no_parity":false}
+     *
+     * "status" has one letter per byte: o ok, p parity error, b broken,
+     * s short. "parity" is the received parity bits, first byte in the MSB.
+     */
+    size_t frame_json_encode(const nfc_frame &frame, int64_t time_ns, char *out);
+
+    /*!
+     * Format \p run as one JSON line into \p out (FRAME_JSON_MAX bytes),
+     * the times of its first and last polls in ns, the periods converted
+     * with \p ns_per_sample:
+     *
+     *   {"type":"poll_run","start":2000,"end":402363,"time_ns":500000,
+     *    "last_time_ns":100500000,"dir":"reader","nbits":7,"data":"52",
+     *    "count":1001,"period_ns":100000,"period_min_ns":99750,
+     *    "period_max_ns":100250,"period_sd_ns":120}
+     *
+     * "start" is the first poll, "end" the end of the last one. Frames have
+     * no "type".
+     */
+    size_t frame_json_encode_run(const poll_run &run, int64_t time_ns, int64_t last_time_ns,
+                                 double ns_per_sample, char *out);
+
+    /*!
+     * Binary record of \p frame into \p out (FRAME_RECORD_MAX bytes),
+     * returns its size. Little-endian header:
+     *
+     *   0  u16  payload bytes (len)
+     *   2  u16  nbits
+     *   4  u8   direction
+     *   5  u8   flags (nfc_frame_flags, FRAME_RECORD_CRC_OK)
+     *   6  u16  0
+     *   8  u64  start sample
+     *   16 u64  end sample
+     *   24 i64  time in ns
+     *
+     * then data[len], status[len] and the parity bits ((len + 7) / 8 bytes).
+     */
+    size_t frame_record_encode(const nfc_frame &frame, int64_t time_ns, unsigned char *out);
+
+    /*! Size of the record starting at \p in, from its header */
+    size_t frame_record_size(const unsigned char *in);
+
+    /*!
+     * Decode the record at \p in (\p avail bytes left), false if it is
+     * truncated or malformed.
+     */
+    bool frame_record_decode(const unsigned char *in, size_t avail, nfc_frame *frame,
+                             int64_t *time_ns);
+
+    /*! File header: magic, sample rate, start time and its sample. The
+     * magic tells the compact files (frame_block_encoder) apart.
+     */
+    void frame_file_put_header(unsigned char *out, double sample_rate, int64_t start_time_ns,
+                               uint64_t start_sample, bool compact = false);
+    bool frame_file_get_header(const unsigned char *in, size_t avail, double *sample_rate,
+                               int64_t *start_time_ns, uint64_t *start_sample,
+                               bool *compact = NULL);
+
+    /*!
+     * \brief Builds one block of a compact frame file.
+     *
+     * Frames are split into columns, so that the values of a kind follow
+     * each other. Block header (little-endian):
+     *
+     *   0  u32  FRAME_BLOCK_MAGIC
+     *   4  u32  block bytes, header included
+     *   8  u32  frames
+     *   12 u32  payload bytes
+     *   16 i64  time in ns of the first frame (keyframe)
+     *   24 u64  start sample of the first frame
+     *   32 u32  bytes of each varint column (FRAME_BLOCK_COLUMNS)
+     *   52      0 up to FRAME_BLOCK_HEADER
+     *
+     * then the columns:
+     *
+     *   form[frames]   bit 0 tag, 1 status stored, 2 parity stored,
+     *                  3 nbits stored
+     *   flags[frames]  nfc_frame_flags, FRAME_RECORD_CRC_OK
+     *   len            varint
+     *   start          zigzag varint, delta from the previous frame of the
+     *                  same direction (the keyframe for the first one)
+     *   duration       varint, end - start
+     *   time           zigzag varint, delta from the previous frame of the
+     *                  same direction less the start delta in ns
+     *   nbits          varint, only when it is not the usual 7, 8 * len
+     *                  or 9 * len
+     *
+     * and the payload: data[len] of each frame, followed by its status and
+     * parity bits only if they differ from all BYTE_OK and from the odd
+     * parity of the data. A block decodes on its own, so seeking is a walk
+     * over block headers.
+     */
+    class frame_block_encoder
+    {
+     public:
+      frame_block_encoder();
+
+      /*! Start an empty block, the times are predicted at \p sample_rate */
+      void reset(double sample_rate);
+
+      void add(const nfc_frame &frame, int64_t time_ns);
+
+      unsigned int frames() const { return d_frames; }
+
+      /*! Bytes of the block as it is */
+      size_t size() const;
+
+      /*! Write the block to \p out (size() bytes), returns its size and
+       * starts the next one
+       */
+      size_t finish(unsigned char *out);
+
+     private:
+      double d_ns_per_sample;
+      unsigned int d_frames;
+      int64_t d_key_time;
+      uint64_t d_key_start;
+      uint64_t d_prev_start[2];
+      int64_t d_prev_time[2];
+      std::vector<unsigned char> d_form;
+      std::vector<unsigned char> d_flags;
+      std::vector<unsigned char> d_columns[FRAME_BLOCK_COLUMNS];
+      std::vector<unsigned char> d_payload;
+    };
+
+    /*! Size of the block starting at \p in, from its header, 0 if it is
+     * not a block
+     */
+    size_t frame_block_size(const unsigned char *in);
+
+    /*!
+     * \brief Bulk decoder of a compact block.
+     *
+     * decode() turns every column into an array in one pass each: runs of
+     * one-byte varints are taken 8 at a time, and the deltas are summed
+     * per direction in a separate loop. Scans can then look at the arrays
+     * directly; frame() builds a whole frame.
+     */
+    class frame_block
+    {
+     public:
+      frame_block();
+
+      /*! Decode the block at \p in (\p avail bytes), false if it is
+       * truncated or malformed
+       */
+      bool decode(const unsigned char *in, size_t avail, double sample_rate);
+
+      size_t frames() const { return d_frames; }
+
+      const int64_t *time_ns() const { return &d_time[0]; }
+      const uint64_t *start() const { return &d_start[0]; }
+      const uint64_t *end() const { return &d_end[0]; }
+      const unsigned char *flags() const { return &d_flags[0]; }
+
+      /*! Frame \p i and its time */
+      void frame(size_t i, nfc_frame *frame, int64_t *time_ns) const;
+
+     private:
+      size_t d_frames;
+      std::vector<unsigned char> d_form;
+      std::vector<unsigned char> d_flags;
+      std::vector<uint64_t> d_len;
+      std::vector<uint64_t> d_start;
+      std::vector<uint64_t> d_end;
+      std::vector<int64_t> d_time;
+      std::vector<uint64_t> d_nbits;      /* One per frame, filled in */
+      std::vector<size_t> d_offset;       /* Payload of each frame */
+      std::vector<unsigned char> d_payload;
+      std::vector<uint64_t> d_tmp;
+    };
+
+    /*!
+     * \brief Sequential reader of a binary frame file (record_output),
+     * fixed records or compact blocks.
+     *
+     * The records are decoded straight from the capture_file views; only
+     * a record straddling two views is copied, so the memory used does not
+     * depend on the length of the file. Compact blocks are decoded whole
+     * by a frame_block, then handed out frame by frame.
+     */
+    class frame_record_reader
+    {
+     public:
+      frame_record_reader();
+
+      /*! Open \p path ("-" is stdin) and read its header, false with a
+       * message on error.
+       */
+      bool open(const char *path);
+
+      /*! Next frame and its time in ns, false at the end of the file or
+       * on a malformed record (see truncated()).
+       */
+      bool next(nfc_frame *frame, int64_t *time_ns);
+
+      /*! The file ended inside a record or a record was malformed */
+      bool truncated() const { return d_truncated; }
+
+      double sample_rate() const { return d_sample_rate; }
+      int64_t start_time_ns() const { return d_start_time_ns; }
+      uint64_t start_sample() const { return d_start_sample; }
+
+     private:
+      const unsigned char *peek(size_t n);
+      void consume(size_t n);
+      bool next_block();
+
+      capture_file d_file;
+      const unsigned char *d_view;
+      size_t d_len;
+      size_t d_pos;
+      std::vector<unsigned char> d_carry;
+      bool d_truncated;
+      double d_sample_rate;
+      int64_t d_start_time_ns;
+      uint64_t d_start_sample;
+      bool d_compact;
+      frame_block d_block;
+      size_t d_block_pos;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_FRAME_RECORD_H */
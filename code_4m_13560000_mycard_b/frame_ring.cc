@@ -0,0 +1,267 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <new>
+#include "frame_ring.h"
+
+/* Room for the header, the slots start on their own cache line */
+#define FRAME_RING_HEADER_SIZE          ((sizeof(frame_ring_header) + 63) & ~size_t(63))
+
+namespace gr {
+  namespace nfc {
+
+    std::string
+    frame_ring_name (const char *name)
+    {
+        return name[0] == '/' ? std::string(name) : "/" + std::string(name);
+    }
+
+    static std::atomic<uint64_t> *
+    slot_stamp (const unsigned char *slot)
+    {
+        return (std::atomic<uint64_t> *) slot;
+    }
+
+    frame_ring_writer::frame_ring_writer()
+      : d_header(NULL),
+        d_slots(NULL),
+        d_size(0),
+        d_head(0)
+    {
+    }
+
+    frame_ring_writer::~frame_ring_writer()
+    {
+        close();
+    }
+
+    bool
+    frame_ring_writer::create(const char *name, double sample_rate, int64_t start_time_ns,
+                              uint64_t start_sample, uint32_t nslots)
+    {
+        std::string path = frame_ring_name(name);
+        void *map;
+        int fd;
+
+        if (nslots == 0 || (nslots & (nslots - 1))) {
+            errno = EINVAL;
+            return false;
+        }
+
+        /* A fresh segment: consumers still attached to the old one keep it */
+        shm_unlink(path.c_str());
+        fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            return false;
+        }
+
+        d_size = FRAME_RING_HEADER_SIZE + size_t(nslots) * FRAME_RING_SLOT_SIZE;
+        if (ftruncate(fd, d_size) < 0) {
+            int err = errno;
+            ::close(fd);
+            shm_unlink(path.c_str());
+            errno = err;
+            return false;
+        }
+
+        map = mmap(NULL, d_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            shm_unlink(path.c_str());
+            return false;
+        }
+
+        /* The segment is zeroed, slot stamps 0 mean never written */
+        d_header = new (map) frame_ring_header;
+        d_header->slot_size = FRAME_RING_SLOT_SIZE;
+        d_header->nslots = nslots;
+        d_header->sample_rate = sample_rate;
+        d_header->start_time_ns = start_time_ns;
+        d_header->start_sample = start_sample;
+        d_header->closed.store(0, std::memory_order_relaxed);
+        d_header->head.store(0, std::memory_order_relaxed);
+        d_slots = (unsigned char *) map + FRAME_RING_HEADER_SIZE;
+        d_head = 0;
+
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(d_header->magic, FRAME_RING_MAGIC, sizeof(d_header->magic));
+
+        return true;
+    }
+
+    void
+    frame_ring_writer::write(const nfc_frame &frame, int64_t time_ns)
+    {
+        unsigned char *slot = d_slots + (d_head & (d_header->nslots - 1)) * FRAME_RING_SLOT_SIZE;
+        std::atomic<uint64_t> *stamp = slot_stamp(slot);
+
+        stamp->store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        frame_record_encode(frame, time_ns, slot + 8);
+        stamp->store(d_head + 1, std::memory_order_release);
+
+        d_head++;
+        d_header->head.store(d_head, std::memory_order_release);
+    }
+
+    void
+    frame_ring_writer::close()
+    {
+        if (!d_header) {
+            return;
+        }
+
+        d_header->closed.store(1, std::memory_order_release);
+        munmap(d_header, d_size);
+        d_header = NULL;
+        d_slots = NULL;
+    }
+
+    frame_ring_reader::frame_ring_reader()
+      : d_header(NULL),
+        d_slots(NULL),
+        d_size(0),
+        d_cursor(0),
+        d_dropped(0)
+    {
+    }
+
+    frame_ring_reader::~frame_ring_reader()
+    {
+        if (d_header) {
+            munmap((void *) d_header, d_size);
+        }
+    }
+
+    bool
+    frame_ring_reader::open(const char *name, bool oldest)
+    {
+        std::string path = frame_ring_name(name);
+        struct stat st;
+        void *map;
+        int fd;
+
+        fd = shm_open(path.c_str(), O_RDONLY, 0);
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            perror(path.c_str());
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+
+        d_size = st.st_size;
+        map = d_size >= FRAME_RING_HEADER_SIZE ?
+            mmap(NULL, d_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "%s: cannot map the ring\n", path.c_str());
+            return false;
+        }
+        d_header = (const frame_ring_header *) map;
+        d_slots = (const unsigned char *) map + FRAME_RING_HEADER_SIZE;
+
+        if (memcmp(d_header->magic, FRAME_RING_MAGIC, sizeof(d_header->magic)) != 0 ||
+            d_header->slot_size != FRAME_RING_SLOT_SIZE ||
+            d_size < FRAME_RING_HEADER_SIZE + size_t(d_header->nslots) * FRAME_RING_SLOT_SIZE) {
+            fprintf(stderr, "%s: not a frame ring (or not ready yet)\n", path.c_str());
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        uint64_t head = d_header->head.load(std::memory_order_acquire);
+        d_cursor = head;
+        if (oldest) {
+            d_cursor = head >= d_header->nslots ? head - d_header->nslots + 1 : 0;
+        }
+
+        return true;
+    }
+
+    void
+    frame_ring_reader::resync(uint64_t head)
+    {
+        /* Oldest frame that is not being overwritten right now */
+        uint64_t oldest = head >= d_header->nslots ? head - d_header->nslots + 1 : 0;
+
+        if (oldest > d_cursor) {
+            d_dropped += oldest - d_cursor;
+            d_cursor = oldest;
+        } else {
+            d_dropped++;
+            d_cursor++;
+        }
+    }
+
+    frame_ring_reader::ring_status
+    frame_ring_reader::next(nfc_frame *frame, int64_t *time_ns)
+    {
+        for (;;) {
+            bool closed = d_header->closed.load(std::memory_order_acquire);
+            uint64_t head = d_header->head.load(std::memory_order_acquire);
+
+            if (d_cursor >= head) {
+                return closed ? RING_CLOSED : RING_EMPTY;
+            }
+            if (head - d_cursor >= d_header->nslots) {
+                resync(head);
+                continue;
+            }
+
+            const unsigned char *slot =
+                d_slots + (d_cursor & (d_header->nslots - 1)) * FRAME_RING_SLOT_SIZE;
+            const std::atomic<uint64_t> *stamp = slot_stamp(slot);
+
+            if (stamp->load(std::memory_order_acquire) != d_cursor + 1) {
+                resync(head);
+                continue;
+            }
+
+            /* Copy, then check the producer did not start over the slot meanwhile */
+            size_t size = frame_record_size(slot + 8);
+            memcpy(d_record, slot + 8, std::min(size, sizeof(d_record)));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (stamp->load(std::memory_order_relaxed) != d_cursor + 1) {
+                resync(d_header->head.load(std::memory_order_acquire));
+                continue;
+            }
+
+            d_cursor++;
+            if (!frame_record_decode(d_record, sizeof(d_record), frame, time_ns)) {
+                d_dropped++;
+                continue;
+            }
+
+            return RING_FRAME;
+        }
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
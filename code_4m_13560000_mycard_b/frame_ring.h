@@ -0,0 +1,148 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_FRAME_RING_H
+#define INCLUDED_NFC_FRAME_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include "nfc_frame.h"
+#include "frame_record.h"
+
+#define FRAME_RING_MAGIC                "NFCRING1"
+
+/* Slots of the ring, a power of two */
+#define FRAME_RING_SLOTS                8192
+
+/* Slot: sequence stamp, then a frame record (frame_record_encode) */
+#define FRAME_RING_SLOT_SIZE            ((8 + FRAME_RECORD_MAX + 63) & ~63)
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Head of the shared memory segment, followed by the slots.
+     *
+     * Only the producer writes to the segment. Frame n goes to slot
+     * n % nslots; the slot stamp is 0 while it is written and n + 1 once
+     * complete (a seqlock), then head moves to n + 1. The consumers keep
+     * their cursor to themselves, so any number of them attach, lag or go
+     * away without the producer noticing.
+     */
+    struct frame_ring_header
+    {
+        char magic[8];                  /* Written last, once the rest is set */
+        uint32_t slot_size;
+        uint32_t nslots;
+        double sample_rate;
+        int64_t start_time_ns;
+        uint64_t start_sample;
+        std::atomic<uint32_t> closed;   /* The producer is done */
+        alignas(64) std::atomic<uint64_t> head;       /* Frames published */
+    };
+
+    /*!
+     * \brief Producer side: creates the segment and publishes frames
+     * without ever waiting for the consumers.
+     */
+    class frame_ring_writer
+    {
+     public:
+      frame_ring_writer();
+      ~frame_ring_writer();
+
+      /*!
+       * Create the segment \p name (a leading / is added if missing),
+       * replacing any previous one. False with errno set on error.
+       */
+      bool create(const char *name, double sample_rate, int64_t start_time_ns,
+                  uint64_t start_sample, uint32_t nslots = FRAME_RING_SLOTS);
+
+      void write(const nfc_frame &frame, int64_t time_ns);
+
+      /*! Tell the consumers no frame will follow. The segment stays so
+       * they can drain it, the next create() replaces it.
+       */
+      void close();
+
+     private:
+      frame_ring_writer(const frame_ring_writer &);
+      frame_ring_writer &operator=(const frame_ring_writer &);
+
+      frame_ring_header *d_header;
+      unsigned char *d_slots;
+      size_t d_size;
+      uint64_t d_head;
+    };
+
+    /*!
+     * \brief Consumer side, with its own cursor. When the producer laps
+     * it, the lost frames are counted and reading resumes at the oldest
+     * frame still in the ring.
+     */
+    class frame_ring_reader
+    {
+     public:
+      enum ring_status {
+          RING_FRAME,           /* A frame was read */
+          RING_EMPTY,           /* Nothing new yet */
+          RING_CLOSED,          /* Nothing new and the producer is done */
+      };
+
+      frame_ring_reader();
+      ~frame_ring_reader();
+
+      /*!
+       * Attach to the segment \p name, from the next frame published or
+       * with \p oldest from the oldest one still in the ring. False with a
+       * message on error.
+       */
+      bool open(const char *name, bool oldest = false);
+
+      ring_status next(nfc_frame *frame, int64_t *time_ns);
+
+      /*! Frames overwritten before this consumer could read them */
+      uint64_t dropped() const { return d_dropped; }
+
+      double sample_rate() const { return d_header->sample_rate; }
+      int64_t start_time_ns() const { return d_header->start_time_ns; }
+      uint64_t start_sample() const { return d_header->start_sample; }
+
+     private:
+      frame_ring_reader(const frame_ring_reader &);
+      frame_ring_reader &operator=(const frame_ring_reader &);
+
+      void resync(uint64_t head);
+
+      const frame_ring_header *d_header;
+      const unsigned char *d_slots;
+      size_t d_size;
+      uint64_t d_cursor;
+      uint64_t d_dropped;
+      unsigned char d_record[FRAME_RECORD_MAX];
+    };
+
+    /*! POSIX name of the segment \p name, with its leading / */
+    std::string frame_ring_name(const char *name);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_FRAME_RING_H */
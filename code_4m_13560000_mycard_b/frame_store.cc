@@ -0,0 +1,601 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <limits>
+#include "frame_store.h"
+#include "frame_record.h"
+#include "frame_correlator.h"
+#include "nfcb.h"
+
+namespace gr {
+  namespace nfc {
+
+    static const struct {
+        const char *name;
+        size_t size;
+    } store_columns[STORE_COLUMNS] = {
+        { "time.i64", 8 },
+        { "start.u64", 8 },
+        { "end.u64", 8 },
+        { "session.u32", 4 },
+        { "uid.u32", 4 },
+        { "offset.u64", 8 },
+        { "len.u16", 2 },
+        { "nbits.u16", 2 },
+        { "dir.u8", 1 },
+        { "flags.u8", 1 },
+    };
+
+    store_filter::store_filter()
+      : time_min(std::numeric_limits<int64_t>::min()),
+        time_max(std::numeric_limits<int64_t>::max()),
+        session_min(0),
+        session_max(std::numeric_limits<uint32_t>::max()),
+        uid_min(0),
+        uid_max(std::numeric_limits<uint32_t>::max()),
+        len_min(0),
+        len_max(std::numeric_limits<uint16_t>::max()),
+        dir_mask(3),
+        flags_all(0),
+        flags_none(0)
+    {
+    }
+
+    frame_store_writer::frame_store_writer()
+      : d_uid_entry(0),
+        d_sample_rate(0),
+        d_start_time_ns(0),
+        d_start_sample(0),
+        d_rows(0),
+        d_session(0),
+        d_chunk_fill(0),
+        d_open(false)
+    {
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            d_columns[c] = new buffered_writer(FRAME_STORE_BUFFER);
+        }
+    }
+
+    frame_store_writer::~frame_store_writer()
+    {
+        close();
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            delete d_columns[c];
+        }
+    }
+
+    bool
+    frame_store_writer::create(const char *dir, double sample_rate, int64_t start_time_ns,
+                               uint64_t start_sample)
+    {
+        if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+            return false;
+        }
+
+        d_dir = dir;
+        d_sample_rate = sample_rate;
+        d_start_time_ns = start_time_ns;
+        d_start_sample = start_sample;
+        d_rows = 0;
+        d_session = 0;
+        d_chunk_fill = 0;
+        d_uid = uid_tracker();
+        d_uid_entries.clear();
+        d_uid_entry = 0;
+
+        /* meta last: a store without one is not a store yet */
+        unlink((d_dir + "/meta").c_str());
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            if (!d_columns[c]->open((d_dir + "/" + store_columns[c].name).c_str())) {
+                return false;
+            }
+        }
+        if (!d_payload.open((d_dir + "/payload").c_str()) ||
+            !d_uids.open((d_dir + "/uids").c_str()) ||
+            !d_zones.open((d_dir + "/zones").c_str()) || !write_meta()) {
+            return false;
+        }
+        d_open = true;
+
+        return true;
+    }
+
+    template <typename T> void
+    frame_store_writer::put(store_column column, T value)
+    {
+        memcpy(d_columns[column]->reserve(sizeof(T)), &value, sizeof(T));
+        d_columns[column]->commit(sizeof(T));
+    }
+
+    void
+    frame_store_writer::add(const nfc_frame &frame, int64_t time_ns)
+    {
+        uint8_t flags = frame.flags | (nfc_frame_crc_ok(frame) ? FRAME_RECORD_CRC_OK : 0);
+        size_t nparity = (frame.len + 7) / 8;
+
+        if (nfc_frame_is_wakeup(frame)) {
+            d_session++;
+            d_uid_entry = 0;
+        }
+        if (d_uid.add(frame)) {
+            std::string key((const char *) d_uid.uid(), d_uid.len());
+            std::map<std::string, uint32_t>::const_iterator it = d_uid_entries.find(key);
+
+            if (it != d_uid_entries.end()) {
+                d_uid_entry = it->second;
+            } else {
+                store_uid entry;
+
+                memset(&entry, 0, sizeof(entry));
+                entry.len = uint8_t(d_uid.len());
+                memcpy(entry.uid, d_uid.uid(), d_uid.len());
+                d_uids.write(&entry, sizeof(entry));
+                d_uid_entry = uint32_t(d_uid_entries.size() + 1);
+                d_uid_entries[key] = d_uid_entry;
+            }
+        }
+
+        put<int64_t>(COL_TIME, time_ns);
+        put<uint64_t>(COL_START, frame.start);
+        put<uint64_t>(COL_END, frame.end);
+        put<uint32_t>(COL_SESSION, d_session);
+        put<uint32_t>(COL_UID, d_uid_entry);
+        put<uint64_t>(COL_OFFSET, d_payload.offset());
+        put<uint16_t>(COL_LEN, frame.len);
+        put<uint16_t>(COL_NBITS, frame.nbits);
+        put<uint8_t>(COL_DIR, frame.direction);
+        put<uint8_t>(COL_FLAGS, flags);
+
+        unsigned char *p = d_payload.reserve(2 * frame.len + nparity);
+        memcpy(p, frame.data, frame.len);
+        memcpy(p + frame.len, frame.status, frame.len);
+        memcpy(p + 2 * frame.len, frame.parity, nparity);
+        d_payload.commit(2 * frame.len + nparity);
+
+        if (d_chunk_fill == 0) {
+            d_zone.time_min = d_zone.time_max = time_ns;
+            d_zone.session_min = d_zone.session_max = d_session;
+            d_zone.uid_min = d_zone.uid_max = d_uid_entry;
+            d_zone.len_min = d_zone.len_max = frame.len;
+            d_zone.dir_mask = 0;
+            d_zone.flags_or = 0;
+            d_zone.flags_and = 0xff;
+            d_zone.pad = 0;
+        }
+        d_zone.time_min = std::min(d_zone.time_min, time_ns);
+        d_zone.time_max = std::max(d_zone.time_max, time_ns);
+        d_zone.session_max = d_session;
+        d_zone.uid_min = std::min(d_zone.uid_min, d_uid_entry);
+        d_zone.uid_max = std::max(d_zone.uid_max, d_uid_entry);
+        d_zone.len_min = std::min(d_zone.len_min, frame.len);
+        d_zone.len_max = std::max(d_zone.len_max, frame.len);
+        d_zone.dir_mask |= 1 << frame.direction;
+        d_zone.flags_or |= flags;
+        d_zone.flags_and &= flags;
+
+        d_rows++;
+        if (++d_chunk_fill == FRAME_STORE_CHUNK_ROWS) {
+            write_zone();
+        }
+    }
+
+    void
+    frame_store_writer::write_zone()
+    {
+        d_zones.write(&d_zone, sizeof(d_zone));
+        d_chunk_fill = 0;
+    }
+
+    bool
+    frame_store_writer::write_meta()
+    {
+        buffered_writer meta(FRAME_STORE_META_SIZE);
+        std::string path = d_dir + "/meta";
+        unsigned char *p;
+        uint64_t rate;
+
+        /* Replaced in one step, a crash leaves the old one or the new one */
+        if (!meta.open((path + ".tmp").c_str())) {
+            return false;
+        }
+
+        memcpy(&rate, &d_sample_rate, sizeof(rate));
+        p = meta.reserve(FRAME_STORE_META_SIZE);
+        memcpy(p, FRAME_STORE_MAGIC, 8);
+        nfcb_put_le(p + 8, rate, 8);
+        nfcb_put_le(p + 16, uint64_t(d_start_time_ns), 8);
+        nfcb_put_le(p + 24, d_start_sample, 8);
+        nfcb_put_le(p + 32, FRAME_STORE_CHUNK_ROWS, 4);
+        nfcb_put_le(p + 36, 0, 4);
+        nfcb_put_le(p + 40, d_rows, 8);
+        meta.commit(FRAME_STORE_META_SIZE);
+
+        return meta.sync() && meta.close() &&
+            rename((path + ".tmp").c_str(), path.c_str()) == 0;
+    }
+
+    bool
+    frame_store_writer::close()
+    {
+        bool ok = true;
+
+        if (!d_open) {
+            return true;
+        }
+        d_open = false;
+
+        if (d_chunk_fill) {
+            write_zone();
+        }
+        ok = d_uids.close() && ok;
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            ok = d_columns[c]->close() && ok;
+        }
+        ok = d_payload.close() && ok;
+        ok = d_zones.close() && ok;
+
+        return write_meta() && ok;
+    }
+
+    bool
+    frame_store_writer::sync()
+    {
+        bool ok = true;
+
+        if (!d_open) {
+            return true;
+        }
+
+        /* The UIDs first, the rows refer to them */
+        ok = d_uids.sync() && ok;
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            ok = d_columns[c]->sync() && ok;
+        }
+        ok = d_payload.sync() && ok;
+        ok = d_zones.sync() && ok;
+
+        return write_meta() && ok;
+    }
+
+    uint64_t
+    frame_store_writer::size() const
+    {
+        uint64_t bytes = d_payload.offset() + d_uids.offset() + d_zones.offset();
+
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            bytes += d_columns[c]->offset();
+        }
+
+        return bytes;
+    }
+
+    frame_store_reader::frame_store_reader()
+      : d_payload(NULL),
+        d_payload_size(0),
+        d_uids(NULL),
+        d_uids_size(0),
+        d_nuids(0),
+        d_zones(NULL),
+        d_zones_size(0),
+        d_nzones(0),
+        d_rows(0),
+        d_sample_rate(0),
+        d_start_time_ns(0),
+        d_start_sample(0),
+        d_mask(FRAME_STORE_CHUNK_ROWS)
+    {
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            d_maps[c] = NULL;
+            d_sizes[c] = 0;
+        }
+    }
+
+    frame_store_reader::~frame_store_reader()
+    {
+        /* Empty files were never mapped (size 0) */
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            if (d_sizes[c]) {
+                munmap((void *) d_maps[c], d_sizes[c]);
+            }
+        }
+        if (d_payload_size) {
+            munmap((void *) d_payload, d_payload_size);
+        }
+        if (d_uids_size) {
+            munmap((void *) d_uids, d_uids_size);
+        }
+        if (d_zones_size) {
+            munmap((void *) d_zones, d_zones_size);
+        }
+    }
+
+    const uint8_t *
+    frame_store_reader::map(const std::string &path, size_t *size)
+    {
+        struct stat st;
+        void *p;
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        *size = 0;
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            perror(path.c_str());
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return NULL;
+        }
+
+        /* Empty store: nothing to map, but not an error */
+        if (st.st_size == 0) {
+            ::close(fd);
+            return (const uint8_t *) "";
+        }
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            perror(path.c_str());
+            return NULL;
+        }
+        *size = st.st_size;
+
+        return (const uint8_t *) p;
+    }
+
+    bool
+    frame_store_reader::open(const char *dir)
+    {
+        std::string base(dir);
+        unsigned char meta[FRAME_STORE_META_SIZE];
+        uint64_t rate;
+        FILE *fp;
+
+        fp = fopen((base + "/meta").c_str(), "rb");
+        if (!fp || fread(meta, 1, sizeof(meta), fp) != sizeof(meta) ||
+            memcmp(meta, FRAME_STORE_MAGIC, 8) != 0 ||
+            nfcb_get_le(meta + 32, 4) != FRAME_STORE_CHUNK_ROWS) {
+            fprintf(stderr, "%s: not a frame store\n", dir);
+            if (fp) {
+                fclose(fp);
+            }
+            return false;
+        }
+        fclose(fp);
+
+        rate = nfcb_get_le(meta + 8, 8);
+        memcpy(&d_sample_rate, &rate, sizeof(rate));
+        d_start_time_ns = int64_t(nfcb_get_le(meta + 16, 8));
+        d_start_sample = nfcb_get_le(meta + 24, 8);
+
+        /* Rows every column has, whatever the meta says of an unclosed store */
+        d_rows = std::numeric_limits<uint64_t>::max();
+        for (int c = 0; c < STORE_COLUMNS; c++) {
+            d_maps[c] = map(base + "/" + store_columns[c].name, &d_sizes[c]);
+            if (!d_maps[c]) {
+                return false;
+            }
+            d_rows = std::min(d_rows, uint64_t(d_sizes[c] / store_columns[c].size));
+        }
+        if (!(d_payload = map(base + "/payload", &d_payload_size)) ||
+            !(d_uids = (const store_uid *) map(base + "/uids", &d_uids_size)) ||
+            !(d_zones = (const store_zone *) map(base + "/zones", &d_zones_size))) {
+            return false;
+        }
+        d_nzones = d_zones_size / sizeof(store_zone);
+        d_nuids = uint32_t(d_uids_size / sizeof(store_uid));
+
+        /* And whose payload is complete */
+        const uint64_t *offset = (const uint64_t *) d_maps[COL_OFFSET];
+        const uint16_t *len = this->len();
+        while (d_rows > 0 && offset[d_rows - 1] + 2 * len[d_rows - 1] +
+               (len[d_rows - 1] + 7) / 8 > d_payload_size) {
+            d_rows--;
+        }
+
+        return true;
+    }
+
+    size_t
+    frame_store_reader::filter(const store_filter &f, uint64_t chunk, bool *all)
+    {
+        uint64_t first = chunk * FRAME_STORE_CHUNK_ROWS;
+        size_t n = std::min(uint64_t(FRAME_STORE_CHUNK_ROWS), d_rows - first);
+        bool need_time = true, need_session = true, need_uid = true, need_len = true;
+        bool need_dir = f.dir_mask != 3, need_flags = f.flags_all || f.flags_none;
+        uint8_t *mask = &d_mask[0];
+        size_t i;
+
+        if (chunk < d_nzones) {
+            const store_zone &z = d_zones[chunk];
+
+            if (z.time_max < f.time_min || z.time_min >= f.time_max ||
+                z.session_max < f.session_min || z.session_min > f.session_max ||
+                z.uid_max < f.uid_min || z.uid_min > f.uid_max ||
+                z.len_max < f.len_min || z.len_min > f.len_max ||
+                !(z.dir_mask & f.dir_mask) ||
+                (z.flags_or & f.flags_all) != f.flags_all || (z.flags_and & f.flags_none)) {
+                return 0;
+            }
+
+            /* Conditions the zone proves for every row */
+            need_time = z.time_min < f.time_min || z.time_max >= f.time_max;
+            need_session = z.session_min < f.session_min || z.session_max > f.session_max;
+            need_uid = z.uid_min < f.uid_min || z.uid_max > f.uid_max;
+            need_len = z.len_min < f.len_min || z.len_max > f.len_max;
+            need_dir = (z.dir_mask & ~f.dir_mask) != 0;
+            need_flags = (z.flags_and & f.flags_all) != f.flags_all || (z.flags_or & f.flags_none);
+        }
+
+        *all = !(need_time || need_session || need_uid || need_len || need_dir || need_flags);
+        if (*all) {
+            return n;
+        }
+
+        memset(mask, 1, n);
+
+        if (need_time) {
+            const int64_t *t = time() + first;
+            for (i = 0; i < n; i++) {
+                mask[i] &= (t[i] >= f.time_min) & (t[i] < f.time_max);
+            }
+        }
+        if (need_session) {
+            const uint32_t *s = session() + first;
+            for (i = 0; i < n; i++) {
+                mask[i] &= (s[i] >= f.session_min) & (s[i] <= f.session_max);
+            }
+        }
+        if (need_uid) {
+            const uint32_t *u = uid() + first;
+            for (i = 0; i < n; i++) {
+                mask[i] &= (u[i] >= f.uid_min) & (u[i] <= f.uid_max);
+            }
+        }
+        if (need_len) {
+            const uint16_t *l = len() + first;
+            for (i = 0; i < n; i++) {
+                mask[i] &= (l[i] >= f.len_min) & (l[i] <= f.len_max);
+            }
+        }
+        if (need_dir) {
+            /* A single direction is left: a compare, which vectorizes */
+            const uint8_t *d = dir() + first;
+            uint8_t want = f.dir_mask == (1 << NFC_TAG) ? NFC_TAG : NFC_READER;
+
+            if (!(f.dir_mask & (1 << want))) {
+                memset(mask, 0, n);
+            }
+            for (i = 0; i < n; i++) {
+                mask[i] &= d[i] == want;
+            }
+        }
+        if (need_flags) {
+            const uint8_t *fl = flags() + first;
+            for (i = 0; i < n; i++) {
+                mask[i] &= ((fl[i] & f.flags_all) == f.flags_all) & ((fl[i] & f.flags_none) == 0);
+            }
+        }
+
+        return n;
+    }
+
+    size_t
+    frame_store_reader::select(const store_filter &filter, uint64_t chunk, uint64_t *rows)
+    {
+        uint64_t first = chunk * FRAME_STORE_CHUNK_ROWS;
+        const uint8_t *mask = &d_mask[0];
+        bool all;
+        size_t n = this->filter(filter, chunk, &all);
+        size_t count = 0;
+
+        if (all) {
+            for (size_t i = 0; i < n; i++) {
+                rows[i] = first + i;
+            }
+            return n;
+        }
+
+        /* Branch-free compaction of the surviving rows */
+        for (size_t i = 0; i < n; i++) {
+            rows[count] = first + i;
+            count += mask[i];
+        }
+
+        return count;
+    }
+
+    uint64_t
+    frame_store_reader::count(const store_filter &filter)
+    {
+        const uint8_t *mask = &d_mask[0];
+        uint64_t total = 0;
+
+        for (uint64_t c = 0; c < chunks(); c++) {
+            bool all;
+            size_t n = this->filter(filter, c, &all);
+            uint32_t sum = 0;
+
+            if (all) {
+                total += n;
+                continue;
+            }
+            for (size_t i = 0; i < n; i++) {
+                sum += mask[i];
+            }
+            total += sum;
+        }
+
+        return total;
+    }
+
+    uint32_t
+    frame_store_reader::find_uid(const unsigned char *uid, unsigned int len) const
+    {
+        for (uint32_t i = 0; i < d_nuids; i++) {
+            if (d_uids[i].len == len && !memcmp(d_uids[i].uid, uid, len)) {
+                return i + 1;
+            }
+        }
+
+        return 0;
+    }
+
+    const store_uid *
+    frame_store_reader::uid_entry(uint32_t entry) const
+    {
+        /* An unclosed store may have the row and not its UID yet */
+        if (entry == 0 || entry > d_nuids) {
+            return NULL;
+        }
+
+        return &d_uids[entry - 1];
+    }
+
+    void
+    frame_store_reader::frame(uint64_t row, nfc_frame *frame, int64_t *time_ns) const
+    {
+        const uint8_t *payload = d_payload + ((const uint64_t *) d_maps[COL_OFFSET])[row];
+        unsigned int len = this->len()[row];
+
+        *time_ns = time()[row];
+        frame->start = ((const uint64_t *) d_maps[COL_START])[row];
+        frame->end = ((const uint64_t *) d_maps[COL_END])[row];
+        frame->direction = dir()[row];
+        frame->flags = flags()[row] & ~FRAME_RECORD_CRC_OK;
+        frame->nbits = ((const uint16_t *) d_maps[COL_NBITS])[row];
+        frame->len = len;
+        memcpy(frame->data, payload, len);
+        memcpy(frame->status, payload + len, len);
+        memset(frame->parity, 0, sizeof(frame->parity));
+        memcpy(frame->parity, payload + 2 * len, (len + 7) / 8);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,256 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_FRAME_STORE_H
+#define INCLUDED_NFC_FRAME_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "nfc_frame.h"
+#include "buffered_writer.h"
+#include "frame_correlator.h"
+
+#define FRAME_STORE_MAGIC               "NFCSTOR1"
+#define FRAME_STORE_META_SIZE           48
+
+/* Rows per chunk, one zone map each */
+#define FRAME_STORE_CHUNK_ROWS          65536
+
+/* Buffer of each column writer */
+#define FRAME_STORE_BUFFER              (256 << 10)
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Columns of a frame store, one file each in the store
+     * directory, arrays in host byte order that are mapped as they are.
+     */
+    enum store_column {
+        COL_TIME,               /* time.i64: start of the frame in ns */
+        COL_START,              /* start.u64: start sample */
+        COL_END,                /* end.u64: end sample */
+        COL_SESSION,            /* session.u32: REQA/WUPA seen before the frame */
+        COL_UID,                /* uid.u32: entry in "uids" of the UID selected so far
+                                   in the session, 0 for none */
+        COL_OFFSET,             /* offset.u64: payload of the frame in "payload" */
+        COL_LEN,                /* len.u16: data bytes */
+        COL_NBITS,              /* nbits.u16: bits on air */
+        COL_DIR,                /* dir.u8: nfc_direction */
+        COL_FLAGS,              /* flags.u8: nfc_frame_flags, FRAME_RECORD_CRC_OK */
+        STORE_COLUMNS
+    };
+
+    /*!
+     * \brief UID of the "uids" file, entry n of the uid column is the
+     * (n - 1)th one. Each UID is stored once, in the order they are seen.
+     */
+    struct store_uid
+    {
+        uint8_t len;                    /* 4, 7 or 10 */
+        uint8_t uid[NFC_UID_MAX];
+        uint8_t pad;
+    };
+
+    /*!
+     * \brief Zone map of a chunk, in the "zones" file, one per
+     * FRAME_STORE_CHUNK_ROWS rows
+     */
+    struct store_zone
+    {
+        int64_t time_min;
+        int64_t time_max;
+        uint32_t session_min;
+        uint32_t session_max;
+        uint32_t uid_min;
+        uint32_t uid_max;
+        uint16_t len_min;
+        uint16_t len_max;
+        uint8_t dir_mask;               /* 1 << direction of the rows */
+        uint8_t flags_or;               /* Flags set on some row */
+        uint8_t flags_and;              /* Flags set on every row */
+        uint8_t pad;
+    };
+
+    /*!
+     * \brief Writes a frame store: the columns, the payloads (data, status
+     * and parity bytes of each frame back to back in "payload"), the UIDs
+     * selected, the zone map of each chunk as it fills and the "meta" file.
+     *
+     * A frame gets the UID of its session from the SELECT that completes
+     * it on: the REQA, ATQA and anticollision frames before it have none,
+     * and neither do sessions the reader never finished selecting.
+     */
+    class frame_store_writer
+    {
+     public:
+      frame_store_writer();
+      ~frame_store_writer();
+
+      /*! Create (or overwrite) the store \p dir, false with errno set */
+      bool create(const char *dir, double sample_rate, int64_t start_time_ns,
+                  uint64_t start_sample);
+
+      void add(const nfc_frame &frame, int64_t time_ns);
+
+      /*! Write the last zone and the meta file, false if anything failed */
+      bool close();
+
+      /*!
+       * Write out and fsync the columns, then the meta file with the rows
+       * so far: a store left unclosed reads back up to there at least.
+       */
+      bool sync();
+
+      /*! Bytes written so far, buffered ones included */
+      uint64_t size() const;
+
+     private:
+      frame_store_writer(const frame_store_writer &);
+      frame_store_writer &operator=(const frame_store_writer &);
+
+      template <typename T> void put(store_column column, T value);
+      void write_zone();
+      bool write_meta();
+
+      std::string d_dir;
+      buffered_writer *d_columns[STORE_COLUMNS];
+      buffered_writer d_payload;
+      buffered_writer d_uids;
+      buffered_writer d_zones;
+      uid_tracker d_uid;
+      std::map<std::string, uint32_t> d_uid_entries;
+      uint32_t d_uid_entry;             /* Of the session so far */
+      double d_sample_rate;
+      int64_t d_start_time_ns;
+      uint64_t d_start_sample;
+      uint64_t d_rows;
+      uint32_t d_session;
+      uint32_t d_chunk_fill;
+      store_zone d_zone;
+      bool d_open;
+    };
+
+    /*!
+     * \brief Row filter of a query, every condition must hold. Times are
+     * in ns like the time column, ranges are [min, max) for the time and
+     * [min, max] otherwise.
+     */
+    struct store_filter
+    {
+        int64_t time_min;
+        int64_t time_max;
+        uint32_t session_min;
+        uint32_t session_max;
+        uint32_t uid_min;               /* Entries of the uid column */
+        uint32_t uid_max;
+        uint16_t len_min;
+        uint16_t len_max;
+        uint8_t dir_mask;               /* 1 << direction accepted */
+        uint8_t flags_all;              /* Flags that must be set */
+        uint8_t flags_none;             /* Flags that must be clear */
+
+        store_filter();                 /* Everything passes */
+    };
+
+    /*!
+     * \brief Query side of a frame store, every file mapped read-only.
+     *
+     * select() handles one chunk: its zone map first, which may rule the
+     * whole chunk out or make some conditions true for every row, then one
+     * tight pass per remaining condition over that column only, and the
+     * rows left are listed. A store that was not closed (still being
+     * written, or the writer died) is read up to the last complete row,
+     * the chunk without a zone map is simply scanned.
+     */
+    class frame_store_reader
+    {
+     public:
+      frame_store_reader();
+      ~frame_store_reader();
+
+      /*! Map the store \p dir, false with a message on error */
+      bool open(const char *dir);
+
+      uint64_t rows() const { return d_rows; }
+      uint64_t chunks() const { return (d_rows + FRAME_STORE_CHUNK_ROWS - 1) / FRAME_STORE_CHUNK_ROWS; }
+
+      /*!
+       * Rows of chunk \p chunk matching \p filter, stored in \p rows
+       * (room for FRAME_STORE_CHUNK_ROWS) as absolute row numbers.
+       */
+      size_t select(const store_filter &filter, uint64_t chunk, uint64_t *rows);
+
+      /*! Number of rows matching \p filter */
+      uint64_t count(const store_filter &filter);
+
+      /*! Entry of the UID \p uid of \p len bytes, 0 if the store has not seen it */
+      uint32_t find_uid(const unsigned char *uid, unsigned int len) const;
+
+      /*! UID of entry \p entry of the uid column, NULL for none */
+      const store_uid *uid_entry(uint32_t entry) const;
+
+      /*! Rebuild the frame of \p row */
+      void frame(uint64_t row, nfc_frame *frame, int64_t *time_ns) const;
+
+      const int64_t *time() const { return (const int64_t *) d_maps[COL_TIME]; }
+      const uint32_t *session() const { return (const uint32_t *) d_maps[COL_SESSION]; }
+      const uint32_t *uid() const { return (const uint32_t *) d_maps[COL_UID]; }
+      const uint16_t *len() const { return (const uint16_t *) d_maps[COL_LEN]; }
+      const uint8_t *dir() const { return d_maps[COL_DIR]; }
+      const uint8_t *flags() const { return d_maps[COL_FLAGS]; }
+
+      double sample_rate() const { return d_sample_rate; }
+      int64_t start_time_ns() const { return d_start_time_ns; }
+      uint64_t start_sample() const { return d_start_sample; }
+
+     private:
+      frame_store_reader(const frame_store_reader &);
+      frame_store_reader &operator=(const frame_store_reader &);
+
+      const uint8_t *map(const std::string &path, size_t *size);
+
+      /*! Rows in \p chunk, d_mask set to 1 on the matching ones, or
+       * \p all when the zone map proves they all match.
+       */
+      size_t filter(const store_filter &filter, uint64_t chunk, bool *all);
+
+      const uint8_t *d_maps[STORE_COLUMNS];
+      size_t d_sizes[STORE_COLUMNS];
+      const uint8_t *d_payload;
+      size_t d_payload_size;
+      const store_uid *d_uids;
+      size_t d_uids_size;
+      uint32_t d_nuids;
+      const store_zone *d_zones;
+      size_t d_zones_size;
+      uint64_t d_nzones;
+      uint64_t d_rows;
+      double d_sample_rate;
+      int64_t d_start_time_ns;
+      uint64_t d_start_sample;
+      std::vector<uint8_t> d_mask;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_FRAME_STORE_H */
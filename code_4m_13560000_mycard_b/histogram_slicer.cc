@@ -0,0 +1,192 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include "histogram_slicer.h"
+
+namespace gr {
+  namespace nfc {
+
+    histogram_slicer::histogram_slicer(float min, float max, int window, int update_interval,
+                                       float hysteresis)
+      : d_min(min),
+        d_scale(HIST_BINS / (max - min)),
+        d_bin_width((max - min) / HIST_BINS),
+        d_window(std::max(window, 1)),
+        d_update_interval(std::max(update_interval, 1)),
+        d_hysteresis(hysteresis),
+        d_hist(HIST_BINS),
+        d_ring(d_window)
+    {
+        reset();
+    }
+
+    void
+    histogram_slicer::reset()
+    {
+        std::fill(d_hist.begin(), d_hist.end(), 0);
+        d_ring_pos = 0;
+        d_count = 0;
+        d_since_update = 0;
+
+        /* Until the first histogram is ready, slice in the middle */
+        d_threshold = d_min + d_bin_width * HIST_BINS / 2;
+        d_high = d_threshold;
+        d_low = d_threshold;
+        d_state = 0;
+    }
+
+    void
+    histogram_slicer::update_threshold()
+    {
+        unsigned int total = 0;
+        double sum = 0, sum_low = 0;
+        unsigned int count_low = 0;
+        double best = -1;
+        double mean_low = 0, mean_high = 0;
+        int best_bin = -1, best_end = -1;
+
+        for (int i = 0; i < HIST_BINS; i++) {
+            total += d_hist[i];
+            sum += double(i) * d_hist[i];
+        }
+
+        /* Otsu: maximize the between-class variance */
+        for (int i = 0; i < HIST_BINS - 1; i++) {
+            count_low += d_hist[i];
+            sum_low += double(i) * d_hist[i];
+
+            if (count_low == 0) {
+                continue;
+            }
+            if (count_low == total) {
+                break;
+            }
+
+            unsigned int count_high = total - count_low;
+            double m0 = sum_low / count_low;
+            double m1 = (sum - sum_low) / count_high;
+            double between = double(count_low) * count_high * (m1 - m0) * (m1 - m0);
+
+            if (between > best) {
+                best = between;
+                best_bin = i;
+                best_end = i;
+                mean_low = m0;
+                mean_high = m1;
+            } else if (between == best && best_end == i - 1) {
+                /* Empty bins between the classes, extend the plateau */
+                best_end = i;
+            }
+        }
+
+        if (best_bin < 0 || (mean_high - mean_low) < MIN_SEPARATION) {
+            /* Unimodal window, keep the last threshold */
+            return;
+        }
+
+        float h = float(d_hysteresis * (mean_high - mean_low)) * d_bin_width;
+
+        /* Slice in the middle of the gap between the two classes */
+        d_threshold = d_min + ((best_bin + best_end) / 2.0f + 1) * d_bin_width;
+        d_high = d_threshold + h;
+        d_low = d_threshold - h;
+    }
+
+    template <typename T> inline unsigned char
+    histogram_slicer::slice(T x)
+    {
+        int bin = int((x - d_min) * d_scale);
+
+        bin = std::min(std::max(bin, 0), HIST_BINS - 1);
+
+        /* Slide the window */
+        if (d_count == d_window) {
+            d_hist[d_ring[d_ring_pos]]--;
+        } else {
+            d_count++;
+        }
+        d_hist[bin]++;
+        d_ring[d_ring_pos] = bin;
+        if (++d_ring_pos == d_window) {
+            d_ring_pos = 0;
+        }
+
+        if (++d_since_update == d_update_interval) {
+            update_threshold();
+            d_since_update = 0;
+        }
+
+        if (d_state) {
+            d_state = (x >= d_low);
+        } else {
+            d_state = (x > d_high);
+        }
+
+        return d_state;
+    }
+
+    template <typename T> void
+    histogram_slicer::slice_packed(const T *in, unsigned char *out, int n)
+    {
+        for (int i = 0; i < n / 8; i++) {
+            unsigned char byte = 0;
+
+            for (int j = 0; j < 8; j++) {
+                byte = (byte << 1) | slice(in[j]);
+            }
+
+            out[i] = byte;
+            in += 8;
+        }
+    }
+
+    void
+    histogram_slicer::process(const float *in, unsigned char *out, int n)
+    {
+        for (int i = 0; i < n; i++) {
+            out[i] = slice(in[i]);
+        }
+    }
+
+    void
+    histogram_slicer::process_packed(const float *in, unsigned char *out, int n)
+    {
+        slice_packed(in, out, n);
+    }
+
+    void
+    histogram_slicer::process(const short *in, unsigned char *out, int n)
+    {
+        for (int i = 0; i < n; i++) {
+            out[i] = slice(in[i]);
+        }
+    }
+
+    void
+    histogram_slicer::process_packed(const short *in, unsigned char *out, int n)
+    {
+        slice_packed(in, out, n);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,100 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_HISTOGRAM_SLICER_H
+#define INCLUDED_NFC_HISTOGRAM_SLICER_H
+
+#include <vector>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Adaptive slicer, independent from the GNU Radio runtime.
+     *
+     * The threshold is picked by Otsu's method from a rolling histogram
+     * of the last \p window samples, recomputed every \p update_interval
+     * samples. The histogram covers [\p min, \p max] with HIST_BINS bins,
+     * samples outside are clamped to the first/last bin.
+     *
+     * The decision has hysteresis: a sample goes high above
+     * threshold + h and low below threshold - h, with h the
+     * \p hysteresis fraction of the distance between the two class means.
+     * When the two classes are closer than MIN_SEPARATION bins (idle
+     * field, only noise in the window) the previous threshold is kept.
+     */
+    class histogram_slicer
+    {
+     public:
+      enum { HIST_BINS = 256, MIN_SEPARATION = 8 };
+
+      histogram_slicer(float min, float max, int window, int update_interval,
+                       float hysteresis);
+
+      void reset();
+
+      /*!
+       * Slice \p n samples into one byte (0 or 1) per sample.
+       */
+      void process(const float *in, unsigned char *out, int n);
+
+      /*!
+       * Slice \p n samples into n/8 bytes, 8 samples per byte, first
+       * sample in the MSB (same packing as unpack_k_bits_bb expects).
+       * \p n must be a multiple of 8.
+       */
+      void process_packed(const float *in, unsigned char *out, int n);
+
+      /*!
+       * Fixed-point variants, \p min and \p max are then in int16 units.
+       * The histogram and the decisions are the same as on float samples
+       * scaled by the same factor.
+       */
+      void process(const short *in, unsigned char *out, int n);
+      void process_packed(const short *in, unsigned char *out, int n);
+
+      float threshold() const { return d_threshold; }
+
+     private:
+      template <typename T> inline unsigned char slice(T x);
+      template <typename T> void slice_packed(const T *in, unsigned char *out, int n);
+      void update_threshold();
+
+      float d_min;
+      float d_scale;
+      float d_bin_width;
+      int d_window;
+      int d_update_interval;
+      float d_hysteresis;
+
+      std::vector<unsigned int> d_hist;
+      std::vector<unsigned char> d_ring;
+      int d_ring_pos;
+      int d_count;
+      int d_since_update;
+
+      float d_threshold;
+      float d_high;
+      float d_low;
+      unsigned char d_state;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_HISTOGRAM_SLICER_H */
@@ -0,0 +1,71 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "histogram_slicer_fb_impl.h"
+
+namespace gr {
+  namespace nfc {
+
+    histogram_slicer_fb::sptr
+    histogram_slicer_fb::make(float min, float max, int window, int update_interval,
+                              float hysteresis)
+    {
+      return gnuradio::get_initial_sptr
+        (new histogram_slicer_fb_impl(min, max, window, update_interval, hysteresis));
+    }
+
+    /*
+     * The private constructor
+     */
+    histogram_slicer_fb_impl::histogram_slicer_fb_impl(float min, float max, int window,
+                                                       int update_interval, float hysteresis)
+      : gr::sync_decimator("histogram_slicer_fb",
+              gr::io_signature::make(1, 1, sizeof(float)),
+              gr::io_signature::make(1, 1, sizeof(unsigned char)), 8),
+        d_slicer(min, max, window, update_interval, hysteresis)
+    {
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    histogram_slicer_fb_impl::~histogram_slicer_fb_impl()
+    {
+    }
+
+    int
+    histogram_slicer_fb_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      const float *in = (const float *) input_items[0];
+      unsigned char *out = (unsigned char *) output_items[0];
+
+      d_slicer.process_packed(in, out, noutput_items * 8);
+
+      // Tell runtime system how many output items we produced.
+      return noutput_items;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
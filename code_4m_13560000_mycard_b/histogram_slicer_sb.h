@@ -0,0 +1,58 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_HISTOGRAM_SLICER_SB_H
+#define INCLUDED_NFC_HISTOGRAM_SLICER_SB_H
+
+#include <nfc/api.h>
+#include <gnuradio/sync_decimator.h>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Adaptive slicer with hysteresis on the int16 envelope,
+     * packed bits out
+     * \ingroup nfc
+     *
+     * Fixed-point version of histogram_slicer_fb, to be used behind
+     * envelope_frontend_cs and envelope_agc_ss. Same packing, 8 samples
+     * per byte, first sample in the MSB.
+     */
+    class NFC_API histogram_slicer_sb : virtual public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<histogram_slicer_sb> sptr;
+
+      /*!
+       * \param min lowest input level covered by the histogram (int16 units)
+       * \param max highest input level covered by the histogram (int16 units)
+       * \param window length of the rolling histogram (samples)
+       * \param update_interval samples between two threshold updates
+       * \param hysteresis fraction of the class separation
+       */
+      static sptr make(float min, float max, int window, int update_interval,
+                       float hysteresis);
+
+      virtual float threshold() const = 0;
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_HISTOGRAM_SLICER_SB_H */
@@ -0,0 +1,49 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_HISTOGRAM_SLICER_SB_IMPL_H
+#define INCLUDED_NFC_HISTOGRAM_SLICER_SB_IMPL_H
+
+#include "histogram_slicer_sb.h"
+#include "histogram_slicer.h"
+
+namespace gr {
+  namespace nfc {
+
+    class histogram_slicer_sb_impl : public histogram_slicer_sb
+    {
+     private:
+      histogram_slicer d_slicer;
+
+     public:
+      histogram_slicer_sb_impl(float min, float max, int window, int update_interval,
+                               float hysteresis);
+      ~histogram_slicer_sb_impl();
+
+      float threshold() const { return d_slicer.threshold(); }
+
+      // Where all the action really happens
+      int work(int noutput_items,
+               gr_vector_const_void_star &input_items,
+               gr_vector_void_star &output_items);
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_HISTOGRAM_SLICER_SB_IMPL_H */
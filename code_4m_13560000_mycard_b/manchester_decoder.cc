@@ -0,0 +1,435 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 Jean-Christophe Rona <jc@rona.fr>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include "manchester_decoder.h"
+
+#define MANCHESTER_GAP                              4.5 // us 
+#define MANCHESTER_GAP_WIDTH 						((d_sample_rate/1000000) * MANCHESTER_GAP)
+#define MANCHESTER_MEAN                             2.5
+#define MANCHESTER_MEAN_WIDTH						((d_sample_rate/1000000) * MANCHESTER_MEAN)
+#define MANCHESTER_START_MIN                        4
+#define MANCHESTER_START_MAX                        5
+#define MANCHESTER_START_MIN_WIDTH					((d_sample_rate/1000000) * MANCHESTER_START_MIN)
+#define MANCHESTER_START_MAX_WIDTH					((d_sample_rate/1000000) * MANCHESTER_START_MAX)
+
+/* Samples appended per pass when feeding runs */
+#define MANCHESTER_RUN_CHUNK                        65536
+
+
+/* Enable this to display the decoding process */
+//#define DEBUG
+
+
+namespace gr {
+	namespace nfc {
+
+		manchester_decoder::manchester_decoder(double sample_rate, frame_sink *sink)
+		: d_sample_rate(sample_rate),
+		d_sink(sink)
+		{
+			/* Start pattern window, plus the longest jump of the pre-decoding */
+			d_lookahead = int(ceil(MANCHESTER_GAP_WIDTH * 14)) + 2 * int(ceil(MANCHESTER_GAP_WIDTH)) + 2;
+			reset(0);
+#ifdef DEBUG
+			std::cout << " MANCHESTER_GAP = " << MANCHESTER_GAP << std::endl;
+			std::cout << " MANCHESTER_GAP_WIDTH = " << MANCHESTER_GAP_WIDTH << std::endl;
+			std::cout << " MANCHESTER_START_MIN = " << MANCHESTER_START_MIN << std::endl;
+			std::cout << " MANCHESTER_START_MIN_WIDTH = " << MANCHESTER_START_MIN_WIDTH << std::endl;
+			std::cout << " MANCHESTER_START_MAX = " << MANCHESTER_START_MAX << std::endl;
+			std::cout << " MANCHESTER_START_MAX_WIDTH = " << MANCHESTER_START_MAX_WIDTH << std::endl;
+			std::cout << " MANCHESTER_MEAN = " << MANCHESTER_MEAN << std::endl;
+			std::cout << " MANCHESTER_MEAN_WIDTH = " << MANCHESTER_MEAN_WIDTH << std::endl;
+#endif
+		}
+
+		void
+		manchester_decoder::reset(uint64_t position)
+		{
+			d_buf.clear();
+			d_buf_start = position;
+			d_next = 0;
+			d_state = WAIT_FOR_START;
+			d_frame_start = position;
+			d_decoded_bit_num = 0;
+			d_no_parity_mode = 0;
+			clear_tmp();
+		}
+
+		uint64_t
+		manchester_decoder::pending_start() const
+		{
+			if (d_state != WAIT_FOR_START) {
+				return d_frame_start;
+			}
+
+			return position();
+		}
+
+		uint64_t
+		manchester_decoder::cut_margin() const
+		{
+			/* A frame in progress gives up within a few symbol periods of
+			 * constant level (two zeros end it, three ones abort it), the
+			 * start pattern window and the lookahead must then fit in.
+			 */
+			return 20 * uint64_t(ceil(MANCHESTER_GAP_WIDTH)) + d_lookahead;
+		}
+
+		void
+		manchester_decoder::set_next_bit (unsigned char bit)
+		{
+			if (d_decoded_bit_num < NFC_MAX_FRAME_BITS) {
+				d_bits[d_decoded_bit_num++] = bit ? 1 : 0;
+			}
+		}
+
+		void
+		manchester_decoder::clear_frame (void)
+		{
+			d_decoded_bit_num = 0;
+		}
+
+		unsigned char
+		manchester_decoder::last_two_bit_zero (void)
+		{
+			if (d_pre_decoded_bit_num > 2) {
+				return !d_tmp[d_pre_decoded_bit_num - 1] && !d_tmp[d_pre_decoded_bit_num - 2];
+			} else {
+				return false;
+			}
+		}
+
+		unsigned char
+		manchester_decoder::last_two_bit_one (void)
+		{
+			if (d_pre_decoded_bit_num > 2) {
+				return d_tmp[d_pre_decoded_bit_num - 1] && d_tmp[d_pre_decoded_bit_num - 2];
+			} else {
+				return false;
+			}
+		}
+
+		void 
+		manchester_decoder::set_tmp (unsigned char bit)
+		{
+			if (d_pre_decoded_bit_num < sizeof(d_tmp)) {
+				d_tmp[d_pre_decoded_bit_num++] = bit ? 1 : 0;
+			}
+		}
+
+		void
+		manchester_decoder::clear_tmp (void)
+		{
+			/* The decoding only looks at the first two bits before rewriting them */
+			d_tmp[0] = 0;
+			d_tmp[1] = 0;
+			d_pre_decoded_bit_num = 0;
+		}
+
+		void 
+		manchester_decoder::remove_last_bit_tmp (void)
+		{
+			d_pre_decoded_bit_num--;
+			d_tmp[d_pre_decoded_bit_num] = 0;
+		}
+
+		void 
+		manchester_decoder::remove_last_two_bit_tmp (void)
+		{
+			remove_last_bit_tmp();
+			remove_last_bit_tmp();
+		}
+
+		/*
+		 * Decode the buffered samples from d_next up to (excluding) limit,
+		 * the samples up to limit + d_lookahead must be in the buffer.
+		 */
+		void
+		manchester_decoder::decode(long limit)
+		{
+			const unsigned char *in = &d_buf[0];
+			const int window = int(ceil(MANCHESTER_GAP_WIDTH * 14));
+			const int window_next = int(ceil(MANCHESTER_GAP_WIDTH));
+			int sum = 0;
+			int start_sum = 0;
+			int start_sum_next = 0;
+			int queue_start = 1;
+			long i;
+
+			if (d_next >= limit) {
+				return;
+			}
+
+			for (i = d_next; i < limit; i++) {
+				if (d_state == WAIT_FOR_START ) {
+					if (queue_start == 1) {
+						start_sum = 0;
+						start_sum_next = 0;
+						for (int j = 0; j < window; j++) {
+							start_sum += in[(i+j)];
+							if (j < window_next) {
+								start_sum_next += in[(i+j)];
+							}
+						}
+					queue_start = 0;
+					} else {
+						/* Slide both windows by one sample */
+						start_sum = start_sum - in[(i-1)] + in[(i + window - 1)];
+						start_sum_next = start_sum_next - in[(i-1)] + in[(i + window_next - 1)];
+					}
+
+					if ((start_sum >= MANCHESTER_START_MIN_WIDTH * 7 && start_sum <= MANCHESTER_START_MAX_WIDTH * 7) && (start_sum_next >= MANCHESTER_START_MIN_WIDTH && start_sum_next <= MANCHESTER_START_MAX_WIDTH)) {
+						if ( int(in[i]) == 1) {
+#ifdef DEBUG
+							std::cout << " start_sum = " << start_sum << std::endl;
+							std::cout << " start_sum_next = " << start_sum_next << std::endl;
+							for (int j = 0; j < window; j++) {
+								std::cout << int(in[(i+j)]);
+							}
+#endif
+							d_frame_start = d_buf_start + i;
+							i = i + (MANCHESTER_GAP_WIDTH * 2) - 1;   
+							d_state = PRE_DECODE;
+						}
+					} 
+				} else if (d_state == PRE_DECODE) {
+					for (int j = 0; j < MANCHESTER_GAP_WIDTH; j++) {
+						sum += in[(i+j)];
+#ifdef DEBUG
+						std::cout << int(in[(i+j)]);
+#endif
+					}
+#ifdef DEBUG
+					std::cout << " " << std::endl;
+					std::cout << " sum = " << sum << std::endl;
+#endif
+					if (sum >= MANCHESTER_MEAN_WIDTH && sum < MANCHESTER_START_MAX_WIDTH) {
+						if (last_two_bit_one()) {
+                        // There is something wrong. 
+#ifdef DEBUG
+							std::cout << " 1, 1, 1 wrong" << std::endl;
+#endif 
+							clear_frame();
+							clear_tmp();
+							d_state = WAIT_FOR_START;
+							queue_start = 1;
+							i = i + (MANCHESTER_GAP_WIDTH - 1);
+						} else {
+#ifdef DEBUG
+							std::cout << " set_tmp(1) " << std::endl;
+#endif
+							if (sum < MANCHESTER_GAP_WIDTH) {
+								for (int x = 0; x < (MANCHESTER_GAP_WIDTH + 1 - sum); x++) {
+									if ( int(in[(i + x + int(MANCHESTER_GAP_WIDTH))]) == 0) {
+										i = i + x + MANCHESTER_GAP_WIDTH;
+										break;
+									} else if ((x = (MANCHESTER_GAP_WIDTH - sum))) {
+										i = i + x + MANCHESTER_GAP_WIDTH;
+										break;
+									}
+								}
+							} else {
+								i = i + (MANCHESTER_GAP_WIDTH - 1);
+							}
+							set_tmp(1);
+						}
+					} else {
+						if (last_two_bit_zero()) {
+							if ((d_pre_decoded_bit_num % 2) == 0) {
+#ifdef DEBUG
+								std::cout << " even, remove last two bit" << std::endl;
+#endif
+								remove_last_two_bit_tmp();
+								d_state = DECODE;
+							} else {
+#ifdef DEBUG
+								std::cout << " odd, remove last bit" << std::endl;
+#endif
+								remove_last_bit_tmp();
+								d_state = DECODE;
+							}
+							i = i + (MANCHESTER_GAP_WIDTH - 1);
+						} else {
+#ifdef DEBUG
+							std::cout << " set_tmp(0) " << std::endl;
+#endif
+							if (sum > 3) {
+								for (int x = 0; x < (sum+1); x++) {
+									if ( int(in[(i + x + int(MANCHESTER_GAP_WIDTH))]) == 1) {
+										i = i + x + MANCHESTER_GAP_WIDTH;
+										break;
+									} else if ((x = sum)) {
+										i = i + x + MANCHESTER_GAP_WIDTH;
+										break;
+									}
+								}
+							} else{
+								i = i + (MANCHESTER_GAP_WIDTH - 1);
+							}
+							set_tmp(0);
+						}
+					}
+					if (d_state == PRE_DECODE && d_pre_decoded_bit_num == sizeof(d_tmp)) {
+						/* Too long to be a frame, cut it */
+						d_state = DECODE;
+					}
+					start_sum_next = 0;
+					start_sum = 0; 
+					sum = 0;   
+				} else if (d_state == DECODE) {
+					if (d_tmp[0] != d_tmp[1]) {
+						for (unsigned int j = 0; j < d_pre_decoded_bit_num; j += 2) {
+							if (d_tmp[j]) {
+
+#ifdef DEBUG
+								std::cout << " set next bit 1" << std::endl;
+#endif
+								set_next_bit(1);
+							} else {
+#ifdef DEBUG
+								std::cout << " set next bit 0" << std::endl;
+#endif
+								set_next_bit(0);
+
+							}
+						}
+						d_state = END_OF_FRAME;
+					} else {
+#ifdef DEBUG
+						std::cout << " tmp[0] = tmp[1], wrong" << std::endl;
+#endif
+						d_state = WAIT_FOR_START;
+						queue_start = 1;
+					}
+					clear_tmp();
+
+				}
+
+				if (d_state == END_OF_FRAME) {
+					if (d_decoded_bit_num > 0) {
+						nfc_frame_assemble(&d_frame, d_bits, d_decoded_bit_num, &d_no_parity_mode);
+						d_frame.start = d_frame_start;
+						d_frame.end = d_buf_start + i;
+						d_frame.direction = NFC_TAG;
+						d_sink->write(d_frame);
+						clear_frame();
+					}
+
+					d_state = WAIT_FOR_START;
+					queue_start = 1;
+				}
+			}
+
+			d_next = i;
+		}
+
+		void
+		manchester_decoder::compact()
+		{
+			long n = std::min(d_next, long(d_buf.size()));
+
+			d_buf.erase(d_buf.begin(), d_buf.begin() + n);
+			d_buf_start += n;
+			d_next -= n;
+		}
+
+		void
+		manchester_decoder::process(const unsigned char *in, int n)
+		{
+			d_buf.insert(d_buf.end(), in, in + n);
+			decode(long(d_buf.size()) - d_lookahead);
+			compact();
+		}
+
+		void
+		manchester_decoder::process_packed(const unsigned char *in, int nbytes)
+		{
+			size_t n = d_buf.size();
+
+			d_buf.resize(n + 8 * size_t(nbytes));
+			for (int i = 0; i < nbytes; i++) {
+				for (int j = 0; j < 8; j++) {
+					d_buf[n++] = (in[i] >> (7 - j)) & 1;
+				}
+			}
+
+			decode(long(d_buf.size()) - d_lookahead);
+			compact();
+		}
+
+		void
+		manchester_decoder::push_run(unsigned char level, uint64_t length)
+		{
+			uint64_t margin = cut_margin();
+
+			if (length > 2 * margin + MANCHESTER_RUN_CHUNK) {
+				/* Long constant run, a cut point (see cut_margin()): decode
+				 * up to margin samples into it, then restart margin samples
+				 * before its end. Nothing starts in between, and only the
+				 * parity mode goes across.
+				 */
+				unsigned char mode = d_no_parity_mode;
+
+				push_run(level, margin);
+				finish();
+				reset(position() + length - 2 * margin);
+				d_no_parity_mode = mode;
+				length = margin;
+			}
+
+			/* Runs are expanded, the start pattern window needs the samples */
+			while (length > 0) {
+				uint64_t n = std::min(length, uint64_t(MANCHESTER_RUN_CHUNK));
+
+				d_buf.insert(d_buf.end(), n, level ? 1 : 0);
+				decode(long(d_buf.size()) - d_lookahead);
+				compact();
+				length -= n;
+			}
+		}
+
+		void
+		manchester_decoder::finish()
+		{
+			long n = d_buf.size();
+
+			if (n == 0) {
+				return;
+			}
+
+			/* Extend the stream with its last level to give the lookahead */
+			d_buf.insert(d_buf.end(), d_lookahead, d_buf.back());
+			decode(n);
+
+			d_buf.clear();
+			d_buf_start += n;
+			d_next = 0;
+		}
+
+	} /* namespace nfc */
+} /* namespace gr */
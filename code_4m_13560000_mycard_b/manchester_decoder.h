@@ -0,0 +1,122 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 Jean-Christophe Rona <jc@rona.fr>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_MANCHESTER_DECODER_H
+#define INCLUDED_NFC_MANCHESTER_DECODER_H
+
+#include <stdint.h>
+#include <vector>
+#include "frame_decoder.h"
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Manchester (tag to reader) decoder core, independent from the
+     * GNU Radio runtime.
+     *
+     * Holds all the decoding state, so several instances can run side by
+     * side. The decoder looks ahead of the current sample (start pattern
+     * window), input is kept in an internal buffer until enough
+     * samples are available, so it can be fed with any amount of samples.
+     */
+    class manchester_decoder : public frame_decoder
+    {
+     public:
+      manchester_decoder(double sample_rate, frame_sink *sink);
+
+      /*!
+       * Forget the current frame and the buffered samples, the next sample
+       * is at absolute position \p position.
+       */
+      void reset(uint64_t position = 0);
+
+      /*! One sample per byte, 0 or 1 */
+      void process(const unsigned char *in, int n);
+
+      /*! 8 samples per byte, first sample in the MSB */
+      void process_packed(const unsigned char *in, int nbytes);
+
+      /*!
+       * \p length samples at \p level. Runs are expanded, but the middle
+       * of a run longer than twice cut_margin() is skipped.
+       */
+      void push_run(unsigned char level, uint64_t length);
+
+      /*!
+       * End of stream: decode the samples still waiting for their
+       * lookahead, the stream is extended with its last level.
+       */
+      void finish();
+
+      /*! Absolute position of the next sample to decode */
+      uint64_t position() const { return d_buf_start + d_next; }
+
+      /*! Start of the frame being decoded, or position() when idle */
+      uint64_t pending_start() const;
+
+      unsigned int cut_levels() const { return 0x3; }
+      uint64_t cut_margin() const;
+
+      /*! Samples the decoder needs past the one it decodes */
+      int lookahead() const { return d_lookahead; }
+
+     private:
+      enum manchester_state {
+          WAIT_FOR_START,
+          PRE_DECODE,
+          DECODE,
+          END_OF_FRAME,
+      };
+
+      void decode(long limit);
+      void compact();
+
+      void set_next_bit(unsigned char bit);
+      void clear_frame();
+      unsigned char last_two_bit_zero();
+      unsigned char last_two_bit_one();
+      void set_tmp(unsigned char bit);
+      void clear_tmp();
+      void remove_last_bit_tmp();
+      void remove_last_two_bit_tmp();
+
+      double d_sample_rate;
+      frame_sink *d_sink;
+      int d_lookahead;
+
+      std::vector<unsigned char> d_buf;
+      uint64_t d_buf_start;
+      long d_next;
+
+      enum manchester_state d_state;
+      uint64_t d_frame_start;
+      unsigned int d_decoded_bit_num;
+      unsigned int d_pre_decoded_bit_num;
+      unsigned char d_no_parity_mode;
+      unsigned char d_bits[NFC_MAX_FRAME_BITS];
+      unsigned char d_tmp[2 * NFC_MAX_FRAME_BITS];
+      nfc_frame d_frame;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_MANCHESTER_DECODER_H */
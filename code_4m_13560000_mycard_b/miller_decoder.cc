@@ -0,0 +1,410 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 Jean-Christophe Rona <jc@rona.fr>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include "miller_decoder.h"
+
+/* Reader pause (samples). This used to read "2,5 // us" scaled by the
+ * sample rate, a comma expression worth 5 samples at any rate: the
+ * decoder has always been tuned with that width, keep it as a count.
+ */
+#define MILLER_PULSE_WIDTH				5
+#define MILLER_PULSE_WIDTH_MIN				(MILLER_PULSE_WIDTH - MILLER_PULSE_WIDTH/2)
+#define MILLER_PULSE_WIDTH_MAX				(MILLER_PULSE_WIDTH + MILLER_PULSE_WIDTH/2)
+
+#define MILLER_GAP_LONG_DURATION			16 // us
+#define MILLER_GAP_MEDIUM_DURATION			11 // us
+#define MILLER_GAP_SHORT_DURATION			6 // us
+#define MILLER_GAP_LONG_WIDTH				((d_sample_rate/1000000) * MILLER_GAP_LONG_DURATION)
+#define MILLER_GAP_MEDIUM_WIDTH				((d_sample_rate/1000000) * MILLER_GAP_MEDIUM_DURATION)
+#define MILLER_GAP_SHORT_WIDTH				((d_sample_rate/1000000) * MILLER_GAP_SHORT_DURATION)
+#define MILLER_GAP_START_WIDTH_THRESHOLD		(MILLER_GAP_LONG_WIDTH * 2)
+#define MILLER_GAP_LONG_WIDTH_THRESHOLD			(MILLER_GAP_LONG_WIDTH - MILLER_GAP_LONG_WIDTH/8)
+#define MILLER_GAP_MEDIUM_WIDTH_THRESHOLD		(MILLER_GAP_MEDIUM_WIDTH - MILLER_GAP_MEDIUM_WIDTH/8)
+#define MILLER_GAP_SHORT_WIDTH_THRESHOLD		(MILLER_GAP_SHORT_WIDTH - MILLER_GAP_SHORT_WIDTH/8)
+
+/* Enable this to display the decoding process */
+//#define DEBUG
+
+
+namespace gr {
+  namespace nfc {
+
+    miller_decoder::miller_decoder(double sample_rate, frame_sink *sink)
+      : d_sample_rate(sample_rate),
+        d_sink(sink)
+    {
+        reset(0);
+#ifdef DEBUG
+       std::cout << "MILLER_PULSE_WIDTH_MIN = " << MILLER_PULSE_WIDTH_MIN << std::endl;
+       std::cout << "MILLER_PULSE_WIDTH_MAX = " << MILLER_PULSE_WIDTH_MAX << std::endl;
+       std::cout << "MILLER_GAP_START_WIDTH_THRESHOLD = " << MILLER_GAP_START_WIDTH_THRESHOLD << std::endl;
+       std::cout << "MILLER_GAP_SHORT_WIDTH_THRESHOLD = " << MILLER_GAP_SHORT_WIDTH_THRESHOLD << std::endl;
+       std::cout << "MILLER_GAP_MEDIUM_WIDTH_THRESHOLD = " << MILLER_GAP_MEDIUM_WIDTH_THRESHOLD << std::endl;
+       std::cout << "MILLER_GAP_LONG_WIDTH_THRESHOLD = " << MILLER_GAP_LONG_WIDTH_THRESHOLD << std::endl;
+#endif
+    }
+
+    void
+    miller_decoder::reset(uint64_t position)
+    {
+        d_state = WAIT_FOR_START;
+        d_count_one = 0;
+        d_count_zero = 0;
+        d_position = position;
+        d_frame_start = position;
+        d_decoded_bit_num = 0;
+        d_no_parity_mode = 0;
+    }
+
+    uint64_t
+    miller_decoder::pending_start() const
+    {
+        if (d_state != WAIT_FOR_START) {
+            return d_frame_start;
+        }
+
+        /* A start pulse may be in progress */
+        return d_position - d_count_zero;
+    }
+
+    uint64_t
+    miller_decoder::cut_margin() const
+    {
+        /* Any frame has ended after that much carrier */
+        return uint64_t(MILLER_GAP_START_WIDTH_THRESHOLD) + 2;
+    }
+
+    void
+    miller_decoder::set_next_bit (unsigned char bit)
+    {
+        if (d_decoded_bit_num < NFC_MAX_FRAME_BITS) {
+            d_bits[d_decoded_bit_num++] = bit ? 1 : 0;
+        }
+    }
+
+    void
+    miller_decoder::remove_last_bit (void)
+    {
+        d_decoded_bit_num--;
+    }
+
+    void
+    miller_decoder::rising_edge()
+    {
+        /* The modified Miller code (LSB first) is :
+         *  - Start -> _---
+         *  - 1 -> --_-
+         *  - 0 -> _--- if the previous bit was 0 or a Start
+         *  - 0 -> ---- if the previous bit was 1
+         *  - End -> logical 0 then ----
+         * 
+         * In order to ease the decoding work, we will measure the time between one pulse and the next one,
+         * using this equivalent table of truth :
+         *  - Short Gap --> 0 or a Start if the previous bit was 0, a Start, or nothing
+         *  - Short Gap --> 1 if the previous bit was 1
+         *  - Medium Gap --> 1 if the previous bit was 0 or a Start
+         *  - Medium Gap --> 00 if the previous bit was 1
+         *  - Long Gap --> 01 (the previous bit is always 1)
+         */
+
+        /* A valid pulse is 2,5us +-50% */
+        if (d_count_zero >= MILLER_PULSE_WIDTH_MIN && d_count_zero <= MILLER_PULSE_WIDTH_MAX) {
+            /* Rising edge (end of pulse), lookup the previous bit(s) */
+
+            if (d_count_one > MILLER_GAP_START_WIDTH_THRESHOLD) {
+                if (d_state == WAIT_FOR_START) {
+                    /* This is the first pulse of a frame (START) */
+                    d_state = LAST_BIT_ZERO_OR_START;
+                    /* The frame starts on the falling edge of the pulse */
+                    d_frame_start = d_position - d_count_zero;
+#ifdef DEBUG
+                    std::cout << "    Start" << std::endl;
+#endif
+                }
+            } else if (d_count_one > MILLER_GAP_LONG_WIDTH_THRESHOLD) {
+                if (d_state == LAST_BIT_ONE) {
+                    /* 01 */
+                    set_next_bit(0);
+                    set_next_bit(1);
+#ifdef DEBUG
+                    std::cout << "    01 (Long)" << std::endl;
+#endif
+
+                    d_state = LAST_BIT_ONE;
+                } else if (d_state == LAST_BIT_ZERO_OR_START) {
+                    /* Invalid */
+#ifdef DEBUG
+                    std::cout << "    Invalid (Long after 0)" << std::endl;
+#endif
+                    d_state = END_OF_FRAME;
+                }
+            } else if (d_count_one > MILLER_GAP_MEDIUM_WIDTH_THRESHOLD) {
+                if (d_state == LAST_BIT_ONE) {
+                    /* 00 */
+                    set_next_bit(0);
+                    set_next_bit(0);
+#ifdef DEBUG
+                    std::cout << "    00 (Medium)" << std::endl;
+#endif
+
+                    d_state = LAST_BIT_ZERO_OR_START;
+                } else if (d_state == LAST_BIT_ZERO_OR_START) {
+                    /* 1 */
+                    set_next_bit(1);
+#ifdef DEBUG
+                    std::cout << "    1 (Medium)" << std::endl;
+#endif
+
+                    d_state = LAST_BIT_ONE;
+                }
+            } else if (d_count_one > MILLER_GAP_SHORT_WIDTH_THRESHOLD) {
+                if (d_state == LAST_BIT_ONE) {
+                    /* 1 */
+                    set_next_bit(1);
+#ifdef DEBUG
+                    std::cout << "    1 (Short)" << std::endl;
+#endif
+
+                    d_state = LAST_BIT_ONE;
+                } else if (d_state == LAST_BIT_ZERO_OR_START) {
+                    /* 0 */
+                    set_next_bit(0);
+#ifdef DEBUG
+                    std::cout << "    0 (Short)" << std::endl;
+#endif
+
+                    d_state = LAST_BIT_ZERO_OR_START;
+                }
+            } else {
+                /* Shorter gaps (invalid)
+                 * If this is noise somehow, it means that a valid pulse has been
+                 * successfully divided into two valid pulses ! This should not happen,
+                 * but if it does, let's stop the frame.
+                 */
+#ifdef DEBUG
+                std::cout << "    Invalid (Gap too short)" << std::endl;
+#endif
+                d_state = END_OF_FRAME;
+            }
+
+            d_count_one = 0;
+        } else if (d_count_zero < MILLER_PULSE_WIDTH_MIN) {
+            /* Consider the zeros as ones (noise) */
+            d_count_one += d_count_zero;
+        }
+
+        d_count_zero = 0;
+
+        if (d_decoded_bit_num >= NFC_MAX_FRAME_BITS) {
+            /* Too long to be a frame, cut it */
+            d_state = END_OF_FRAME;
+        }
+    }
+
+    double
+    miller_decoder::end_threshold() const
+    {
+        if (d_decoded_bit_num == 0 || d_bits[d_decoded_bit_num - 1]) {
+            return MILLER_GAP_START_WIDTH_THRESHOLD;
+        }
+
+        return MILLER_GAP_LONG_WIDTH_THRESHOLD;
+    }
+
+    void
+    miller_decoder::check_end()
+    {
+        if (d_state != WAIT_FOR_START && d_decoded_bit_num == 0 &&
+            d_count_one > MILLER_GAP_START_WIDTH_THRESHOLD) {
+            /* Lone start pulse, without this the start of the next frame
+             * would be taken from it.
+             */
+            d_state = WAIT_FOR_START;
+        }
+
+        if (d_state != WAIT_FOR_START && d_decoded_bit_num > 0) {
+            if (d_bits[d_decoded_bit_num - 1]) {
+                if (d_count_one > MILLER_GAP_START_WIDTH_THRESHOLD) {
+                    /* End of frame */
+#ifdef DEBUG
+                    std::cout << "    End" << std::endl;
+#endif
+                    d_state = END_OF_FRAME;
+                }
+            } else {
+                if (d_count_one > MILLER_GAP_LONG_WIDTH_THRESHOLD) {
+                    /* End of frame */
+                    /* Remove the last 0 which is part of the end marker */
+                    remove_last_bit();
+#ifdef DEBUG
+                    std::cout << "    End (-0)" << std::endl;
+#endif
+                    d_state = END_OF_FRAME;
+                }
+            }
+        }
+    }
+
+    void
+    miller_decoder::end_of_frame()
+    {
+        if (d_state != END_OF_FRAME) {
+            return;
+        }
+
+        if (d_decoded_bit_num > 0) {
+            nfc_frame_assemble(&d_frame, d_bits, d_decoded_bit_num, &d_no_parity_mode);
+            d_frame.start = d_frame_start;
+            d_frame.end = d_position;
+            d_frame.direction = NFC_READER;
+            d_sink->write(d_frame);
+            d_decoded_bit_num = 0;
+        }
+
+        d_state = WAIT_FOR_START;
+    }
+
+    void
+    miller_decoder::push_run(unsigned char level, uint64_t length)
+    {
+        if (length == 0) {
+            return;
+        }
+
+        if (!level) {
+            d_count_zero += length;
+            d_position += length;
+            return;
+        }
+
+        /* First high sample, ends the pulse if there was one */
+        if (d_count_zero > 0) {
+            rising_edge();
+        }
+
+        d_count_one++;
+        check_end();
+        end_of_frame();
+        d_position++;
+        length--;
+
+        /* The rest of the run only counts, the frame can end at most once
+         * within it, at a position known in advance.
+         */
+        if (length > 0 && d_state != WAIT_FOR_START) {
+            uint64_t need = (uint64_t) floor(end_threshold()) + 1 - d_count_one;
+
+            if (need <= length) {
+                d_count_one += need;
+                d_position += need - 1;
+                check_end();
+                end_of_frame();
+                d_position++;
+                length -= need;
+            }
+        }
+
+        d_count_one += length;
+        d_position += length;
+    }
+
+    static inline uint64_t
+    load64 (const unsigned char *p)
+    {
+        uint64_t v;
+
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    void
+    miller_decoder::process(const unsigned char *in, int n)
+    {
+        int i = 0;
+
+        while (i < n) {
+            unsigned char level = in[i] > 0;
+            int j = i + 1;
+
+            if (level) {
+                /* Skip 8 samples at once while none of them is zero */
+                while (j + 8 <= n) {
+                    uint64_t v = load64(in + j);
+                    if (((v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL) != 0) {
+                        break;
+                    }
+                    j += 8;
+                }
+                while (j < n && in[j] > 0) {
+                    j++;
+                }
+            } else {
+                while (j + 8 <= n && load64(in + j) == 0) {
+                    j += 8;
+                }
+                while (j < n && in[j] == 0) {
+                    j++;
+                }
+            }
+
+            push_run(level, j - i);
+            i = j;
+        }
+    }
+
+    void
+    miller_decoder::process_packed(const unsigned char *in, int nbytes)
+    {
+        unsigned char level = 0;
+        uint64_t length = 0;
+
+        for (int i = 0; i < nbytes; i++) {
+            unsigned char byte = in[i];
+
+            if (byte == (level ? 0xff : 0x00)) {
+                /* 8 samples continuing the current run */
+                length += 8;
+                continue;
+            }
+
+            for (int j = 7; j >= 0; j--) {
+                unsigned char bit = (byte >> j) & 1;
+
+                if (bit != level) {
+                    push_run(level, length);
+                    level = bit;
+                    length = 0;
+                }
+                length++;
+            }
+        }
+
+        push_run(level, length);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,104 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 Jean-Christophe Rona <jc@rona.fr>.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_MILLER_DECODER_H
+#define INCLUDED_NFC_MILLER_DECODER_H
+
+#include <stdint.h>
+#include "frame_decoder.h"
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Modified Miller (reader to tag) decoder core, independent from
+     * the GNU Radio runtime.
+     *
+     * Holds all the decoding state, so several instances can run side by
+     * side. The decoder only measures the length of the high (carrier) and
+     * low (pause) periods, so it natively consumes runs; per-sample and
+     * packed input are turned into runs on the fly.
+     */
+    class miller_decoder : public frame_decoder
+    {
+     public:
+      miller_decoder(double sample_rate, frame_sink *sink);
+
+      /*!
+       * Forget the current frame, the next sample is at absolute
+       * position \p position.
+       */
+      void reset(uint64_t position = 0);
+
+      /*! One sample per byte, high if > 0 */
+      void process(const unsigned char *in, int n);
+
+      /*! 8 samples per byte, first sample in the MSB */
+      void process_packed(const unsigned char *in, int nbytes);
+
+      /*! \p length samples at \p level */
+      void push_run(unsigned char level, uint64_t length);
+
+      /*! End of stream, nothing is pending in this decoder */
+      void finish() {}
+
+      /*! Absolute position of the next sample */
+      uint64_t position() const { return d_position; }
+
+      /*! Start of the frame being decoded, or position() when idle */
+      uint64_t pending_start() const;
+
+      /*! Only within the carrier, field off periods keep the gap count */
+      unsigned int cut_levels() const { return 0x2; }
+      uint64_t cut_margin() const;
+
+     private:
+      enum miller_state {
+          WAIT_FOR_START,
+          LAST_BIT_ZERO_OR_START,
+          LAST_BIT_ONE,
+          END_OF_FRAME,
+      };
+
+      void rising_edge();
+      void check_end();
+      void end_of_frame();
+      void set_next_bit(unsigned char bit);
+      void remove_last_bit();
+      double end_threshold() const;
+
+      double d_sample_rate;
+      frame_sink *d_sink;
+
+      enum miller_state d_state;
+      uint64_t d_count_one;
+      uint64_t d_count_zero;
+      uint64_t d_position;
+      uint64_t d_frame_start;
+      unsigned int d_decoded_bit_num;
+      unsigned char d_no_parity_mode;
+      unsigned char d_bits[NFC_MAX_FRAME_BITS];
+      nfc_frame d_frame;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_MILLER_DECODER_H */
@@ -0,0 +1,49 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2017 Jean-Christophe Rona <jc@rona.fr>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_MODIFIED_MILLER_DECODER_H
+#define INCLUDED_NFC_MODIFIED_MILLER_DECODER_H
+
+#include <nfc/api.h>
+#include <gnuradio/block.h>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Modified Miller (reader to tag) decoder
+     * \ingroup nfc
+     *
+     * Input is the sliced signal, one sample per byte. Decoded frames are
+     * printed, and their bytes are output with 'frame_start' and
+     * 'frame_end' tags (absolute input sample positions) on the first byte.
+     */
+    class NFC_API modified_miller_decoder : virtual public gr::block
+    {
+     public:
+      typedef boost::shared_ptr<modified_miller_decoder> sptr;
+
+      static sptr make(double sample_rate);
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_MODIFIED_MILLER_DECODER_H */
@@ -23,44 +23,21 @@
 #endif
 
 #include <gnuradio/io_signature.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "modified_miller_decoder_impl.h"
 
-#define MILLER_PULSE_DURATION				2,5 // us
-#define MILLER_PULSE_WIDTH				((d_sample_rate/1000000) * MILLER_PULSE_DURATION)
-#define MILLER_PULSE_WIDTH_MIN				(MILLER_PULSE_WIDTH - MILLER_PULSE_WIDTH/2)
-#define MILLER_PULSE_WIDTH_MAX				(MILLER_PULSE_WIDTH + MILLER_PULSE_WIDTH/2)
-
-#define MILLER_GAP_LONG_DURATION			16 // us
-#define MILLER_GAP_MEDIUM_DURATION			11 // us
-#define MILLER_GAP_SHORT_DURATION			6 // us
-#define MILLER_GAP_LONG_WIDTH				((d_sample_rate/1000000) * MILLER_GAP_LONG_DURATION)
-#define MILLER_GAP_MEDIUM_WIDTH				((d_sample_rate/1000000) * MILLER_GAP_MEDIUM_DURATION)
-#define MILLER_GAP_SHORT_WIDTH				((d_sample_rate/1000000) * MILLER_GAP_SHORT_DURATION)
-#define MILLER_GAP_START_WIDTH_THRESHOLD		(MILLER_GAP_LONG_WIDTH * 2)
-#define MILLER_GAP_LONG_WIDTH_THRESHOLD			(MILLER_GAP_LONG_WIDTH - MILLER_GAP_LONG_WIDTH/8)
-#define MILLER_GAP_MEDIUM_WIDTH_THRESHOLD		(MILLER_GAP_MEDIUM_WIDTH - MILLER_GAP_MEDIUM_WIDTH/8)
-#define MILLER_GAP_SHORT_WIDTH_THRESHOLD		(MILLER_GAP_SHORT_WIDTH - MILLER_GAP_SHORT_WIDTH/8)
-
-/* Enable this to display the decoding process */
-//#define DEBUG
-
+/* Frames waiting for output space; at this many the input is left alone
+ * until downstream has taken some, so a stalled consumer cannot make the
+ * queue grow without bound
+ */
+#define MAX_PENDING_FRAMES              64
 
 namespace gr {
   namespace nfc {
 
-    enum miller_state {
-        WAIT_FOR_START,
-        LAST_BIT_ZERO_OR_START,
-        LAST_BIT_ONE,
-        END_OF_FRAME,
-    };
-
-    static enum miller_state current_state = WAIT_FOR_START;
-    static unsigned int count_one = 0;
-    static unsigned int count_zero = 0;
-    static unsigned int decoded_bit_num = 0;
-    static unsigned char current_frame[1000] = { 0 };
-
     modified_miller_decoder::sptr
     modified_miller_decoder::make(double sample_rate)
     {
@@ -75,16 +52,11 @@ namespace gr {
       : gr::block("modified_miller_decoder",
               gr::io_signature::make(1, 1, sizeof(char)),
               gr::io_signature::make(1, 1, sizeof(char))),
-        d_sample_rate(sample_rate)
+        d_sample_rate(sample_rate),
+        d_decoder(sample_rate, this),
+        d_out(NULL),
+        d_pending_pos(0)
     {
-#ifdef DEBUG
-       std::cout << "MILLER_PULSE_WIDTH_MIN = " << MILLER_PULSE_WIDTH_MIN << std::endl;
-       std::cout << "MILLER_PULSE_WIDTH_MAX = " << MILLER_PULSE_WIDTH_MAX << std::endl;
-       std::cout << "MILLER_GAP_START_WIDTH_THRESHOLD = " << MILLER_GAP_START_WIDTH_THRESHOLD << std::endl;
-       std::cout << "MILLER_GAP_SHORT_WIDTH_THRESHOLD = " << MILLER_GAP_SHORT_WIDTH_THRESHOLD << std::endl;
-       std::cout << "MILLER_GAP_MEDIUM_WIDTH_THRESHOLD = " << MILLER_GAP_MEDIUM_WIDTH_THRESHOLD << std::endl;
-       std::cout << "MILLER_GAP_LONG_WIDTH_THRESHOLD = " << MILLER_GAP_LONG_WIDTH_THRESHOLD << std::endl;
-#endif
     }
 
     /*
@@ -97,60 +69,54 @@ namespace gr {
     void
     modified_miller_decoder_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
-        ninput_items_required[0] = (noutput_items * 8 * d_sample_rate)/1000000;
+        /* Frames left from the previous calls go out without new input */
+        ninput_items_required[0] = d_pending.empty() ? (noutput_items * 8 * d_sample_rate)/1000000 : 0;
     }
 
-    static unsigned char
-    compute_even_parity (unsigned char c)
+    void
+    modified_miller_decoder_impl::flush_pending()
     {
-            unsigned int i;
-            unsigned char parity = 0;
-
-            for (i = 0; i < 8; i++) {
-                parity ^= (c & (0x1 << i)) >> i;
+        while (!d_pending.empty() && d_produced < d_noutput) {
+            const nfc_frame &frame = d_pending.front();
+            int n = std::min(int(frame.len) - d_pending_pos, d_noutput - d_produced);
+
+            if (d_pending_pos == 0) {
+                /* Timestamp the frame on its first output byte */
+                add_item_tag(0, d_out_offset + d_produced,
+                             pmt::intern("frame_start"), pmt::from_uint64(frame.start));
+                add_item_tag(0, d_out_offset + d_produced,
+                             pmt::intern("frame_end"), pmt::from_uint64(frame.end));
             }
 
-            return parity;
-    }
-
-    static void
-    set_next_bit (unsigned char bit)
-    {
-        if (bit) {
-            /* 1 */
-            current_frame[decoded_bit_num] = 1;
-        } else {
-            /* 0 */
-            current_frame[decoded_bit_num] = 0;
+            memcpy(d_out + d_produced, frame.data + d_pending_pos, n);
+            d_produced += n;
+            d_pending_pos += n;
+            if (d_pending_pos == frame.len) {
+                d_pending.pop_front();
+                d_pending_pos = 0;
+            }
         }
-
-        decoded_bit_num++;
-    }
-
-    static unsigned char
-    get_bit (unsigned int n)
-    {
-        return current_frame[n];
     }
 
-    static unsigned char
-    get_last_bit (void)
+    void
+    modified_miller_decoder_impl::write(const nfc_frame &frame)
     {
-        return get_bit(decoded_bit_num - 1);
-    }
+        nfc_frame_print(stdout, frame, false);
 
-    static void
-    remove_last_bit (void)
-    {
-            decoded_bit_num--;
-            current_frame[decoded_bit_num] = 0;
-    }
+        if (frame.len == 0) {
+            /* No byte to carry the tags */
+            return;
+        }
+        if (!d_out) {
+            /* Flushed by stop(): the frame is printed above, the stream
+             * has ended
+             */
+            return;
+        }
 
-    static void
-    clear_frame (void)
-    {
-            memset(current_frame, 0, sizeof(current_frame));
-            decoded_bit_num = 0;
+        /* Whatever does not fit goes out on the next calls */
+        d_pending.push_back(frame);
+        flush_pending();
     }
 
     int
@@ -160,219 +126,43 @@ namespace gr {
                        gr_vector_void_star &output_items)
     {
         const unsigned char *in = (const unsigned char *) input_items[0];
-        unsigned char *out = (unsigned char *) output_items[0];
-        int decoded_bytes_num = 0;
-        unsigned char no_parity_mode = 0;
-
-        /* The modified Miller code (LSB first) is :
-         *  - Start -> _---
-         *  - 1 -> --_-
-         *  - 0 -> _--- if the previous bit was 0 or a Start
-         *  - 0 -> ---- if the previous bit was 1
-         *  - End -> logical 0 then ----
-         * 
-         * In order to ease the decoding work, we will measure the time between one pulse and the next one,
-         * using this equivalent table of truth :
-         *  - Short Gap --> 0 or a Start if the previous bit was 0, a Start, or nothing
-         *  - Short Gap --> 1 if the previous bit was 1
-         *  - Medium Gap --> 1 if the previous bit was 0 or a Start
-         *  - Medium Gap --> 00 if the previous bit was 1
-         *  - Long Gap --> 01 (the previous bit is always 1)
-         */
-
-        //std::cout << "noutput_items " << noutput_items << ", ninput_items[0] " << ninput_items[0] << std::endl;
-        for (int i = 0; i < ninput_items[0]; i++) {
-            if (in[i] > 0) {
-                if (count_zero > 0) {
-                    /* A valid pulse is 2,5us +-50% */
-                    if (count_zero >= MILLER_PULSE_WIDTH_MIN && count_zero <= MILLER_PULSE_WIDTH_MAX) {
-                        /* Rising edge (end of pulse), lookup the previous bit(s) */
-
-                        if (count_one > MILLER_GAP_START_WIDTH_THRESHOLD) {
-                            if (current_state == WAIT_FOR_START) {
-                                /* This is the first pulse of a frame (START) */
-                                current_state = LAST_BIT_ZERO_OR_START;
-#ifdef DEBUG
-                                std::cout << "    Start" << std::endl;
-#endif
-                            }
-                        } else if (count_one > MILLER_GAP_LONG_WIDTH_THRESHOLD) {
-                            if (current_state == LAST_BIT_ONE) {
-                                /* 01 */
-                                set_next_bit(0);
-                                set_next_bit(1);
-#ifdef DEBUG
-                                std::cout << "    01 (Long)" << std::endl;
-#endif
-
-                                current_state = LAST_BIT_ONE;
-                            } else if (current_state == LAST_BIT_ZERO_OR_START) {
-                                /* Invalid */
-#ifdef DEBUG
-                                std::cout << "    Invalid (Long after 0)" << std::endl;
-#endif
-                                current_state = END_OF_FRAME;
-                            }
-                        } else if (count_one > MILLER_GAP_MEDIUM_WIDTH_THRESHOLD) {
-                            if (current_state == LAST_BIT_ONE) {
-                                /* 00 */
-                                set_next_bit(0);
-                                set_next_bit(0);
-#ifdef DEBUG
-                                std::cout << "    00 (Medium)" << std::endl;
-#endif
 
-                                current_state = LAST_BIT_ZERO_OR_START;
-                            } else if (current_state == LAST_BIT_ZERO_OR_START) {
-                                /* 1 */
-                                set_next_bit(1);
-#ifdef DEBUG
-                                std::cout << "    1 (Medium)" << std::endl;
-#endif
-
-                                current_state = LAST_BIT_ONE;
-                            }
-                        } else if (count_one > MILLER_GAP_SHORT_WIDTH_THRESHOLD) {
-                            if (current_state == LAST_BIT_ONE) {
-                                /* 1 */
-                                set_next_bit(1);
-#ifdef DEBUG
-                                std::cout << "    1 (Short)" << std::endl;
-#endif
-
-                                current_state = LAST_BIT_ONE;
-                            } else if (current_state == LAST_BIT_ZERO_OR_START) {
-                                /* 0 */
-                                set_next_bit(0);
-#ifdef DEBUG
-                                std::cout << "    0 (Short)" << std::endl;
-#endif
-
-                                current_state = LAST_BIT_ZERO_OR_START;
-                            }
-                        } else {
-                            /* Shorter gaps (invalid)
-                             * If this is noise somehow, it means that a valid pulse has been
-                             * successfully divided into two valid pulses ! This should not happen,
-                             * but if it does, let's stop the frame.
-                             */
-#ifdef DEBUG
-                            std::cout << "    Invalid (Gap too short)" << std::endl;
-#endif
-                            current_state = END_OF_FRAME;
-                        }
-
-                        count_one = 0;
-                    } else if (count_zero < MILLER_PULSE_WIDTH_MIN) {
-                        /* Consider the zeros as ones (noise) */
-                        count_one += count_zero;
-                    }
-
-                    count_zero = 0;
-                }
-
-                count_one++;
-
-                if (current_state != WAIT_FOR_START && decoded_bit_num > 0) {
-                    if (get_last_bit()) {
-                        if (count_one > MILLER_GAP_START_WIDTH_THRESHOLD) {
-                            /* End of frame */
-#ifdef DEBUG
-                            std::cout << "    End" << std::endl;
-#endif
-                            current_state = END_OF_FRAME;
-                        }
-                    } else {
-                        if (count_one > MILLER_GAP_LONG_WIDTH_THRESHOLD) {
-                            /* End of frame */
-                            /* Remove the last 0 which is part of the end marker */
-                            remove_last_bit();
-#ifdef DEBUG
-                            std::cout << "    End (-0)" << std::endl;
-#endif
-                            current_state = END_OF_FRAME;
-                        }
-                    }
-                }
-            } else {
-                count_zero++;
-            }
-
-            if (current_state == END_OF_FRAME) {
-                unsigned char tmp_byte = 0;
-                unsigned int in_bit = 0, out_bit = 0;
-                unsigned char parity_ok;
-
-                if (decoded_bit_num > 0) {
-                    /* Assume that the frame is in no parity mode if its length
-                     * is valid in no parity mode, and not in Standard mode.
-                     * NOTE: For a length of 9x8xN, the last known mode is used.
-                     */
-                    if ((decoded_bit_num % 72) != 0) {
-                        no_parity_mode = (((decoded_bit_num % 9) != 0) && ((decoded_bit_num % 8) == 0));
-                    }
+        d_out = (unsigned char *) output_items[0];
+        d_noutput = noutput_items;
+        d_produced = 0;
+        d_out_offset = nitems_written(0);
+        flush_pending();
 
-                    /* Decode and print the frame */
-                    printf("Reader ->");
-#ifdef DEBUG
-                    printf(" ");
-#endif
-                    while (in_bit < decoded_bit_num) {
-                        out[decoded_bytes_num] |= get_bit(in_bit) << out_bit;
-#ifdef DEBUG
-                        printf("%u", get_bit(in_bit));
-#endif
-                        in_bit++;
-                        out_bit++;
-
-                        if (!no_parity_mode && (out_bit == 8 && in_bit < decoded_bit_num)) {
-                            /* Check parity if needed */
-                            parity_ok = (compute_even_parity(out[decoded_bytes_num]) == !get_bit(in_bit));
-#ifdef DEBUG
-                            printf("-%u", get_bit(in_bit));
-#endif
-                            in_bit++;
-                        }
-
-                        if (out_bit == 8 || in_bit == decoded_bit_num) {
-                            /* Print the byte */
-                            if (decoded_bit_num == 7) {
-                                /* Short command */
-                                printf(" [%02X]", out[decoded_bytes_num]);
-                            } else if (out_bit < 8 || (decoded_bit_num == 8 && !no_parity_mode)) {
-                                /* Broken */
-                                printf(" /%02X\\", out[decoded_bytes_num]);
-                            } else if (parity_ok || no_parity_mode) {
-                                printf("  %02X ", out[decoded_bytes_num]);
-                            } else {
-                                printf(" (%02X)", out[decoded_bytes_num]);
-                            }
-#ifdef DEBUG
-                            printf(" ");
-#endif
+        if (d_pending.size() >= MAX_PENDING_FRAMES) {
+            /* Downstream is behind, nothing consumed until it catches up */
+            d_out = NULL;
+            return d_produced;
+        }
 
-                            decoded_bytes_num++;
-                            out_bit = 0;
-                        }
-                    }
+        /* The decoder positions follow nitems_read(0), it sees every sample */
+        d_decoder.process(in, ninput_items[0]);
+        d_out = NULL;
 
-                    if (no_parity_mode) {
-                        printf(" (No parity)");
-                    }
+        consume_each (ninput_items[0]);
 
-                    printf("\n");
-                    clear_frame();
-                }
+        // Tell runtime system how many output items we produced.
+        return d_produced;
+    }
 
-                current_state = WAIT_FOR_START;
-            }
+    bool
+    modified_miller_decoder_impl::stop()
+    {
+        d_decoder.finish();
+        d_out = NULL;
+
+        if (!d_pending.empty()) {
+            fprintf(stderr, "modified_miller_decoder: %u frames not output at stop\n",
+                    unsigned(d_pending.size()));
+            d_pending.clear();
+            d_pending_pos = 0;
         }
 
-        consume_each (ninput_items[0]);
-
-        // Tell runtime system how many output items we produced.
-        return decoded_bytes_num;
+        return true;
     }
   } /* namespace nfc */
 } /* namespace gr */
-
@@ -0,0 +1,523 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * nfc_batch: decode many recordings at once, e.g. after a threshold
+ * change. The recordings come from a manifest (one per line: a name and
+ * its nfc_decode capture options) or from a directory of NAME.conf files
+ * (the options of one recording each). Relative paths are relative to
+ * the manifest or .conf file.
+ *
+ * Every recording is cut into chunks when it can be (see nfc_decode -j),
+ * the biggest first, and all the chunks of all the recordings share one
+ * work-stealing pool. Each recording gets OUTDIR/NAME.txt, and
+ * OUTDIR/summary.txt sums everything up.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "capture_job.h"
+#include "work_pool.h"
+
+using namespace gr::nfc;
+
+static double
+now (void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Writes the frames of one recording and counts them */
+class counting_sink : public frame_sink
+{
+ public:
+  counting_sink() : d_out(NULL), d_positions(false)
+  {
+      memset(d_frames, 0, sizeof(d_frames));
+      d_parity_errors = 0;
+      d_broken = 0;
+  }
+
+  void write(const nfc_frame &frame)
+  {
+      d_frames[frame.direction]++;
+      d_parity_errors += (frame.flags & FRAME_PARITY_ERROR) != 0;
+      d_broken += (frame.flags & FRAME_BROKEN) != 0;
+      nfc_frame_print(d_out, frame, d_positions);
+  }
+
+  FILE *d_out;
+  bool d_positions;
+  unsigned long d_frames[2];
+  unsigned long d_parity_errors;
+  unsigned long d_broken;
+};
+
+/* One recording of the batch */
+struct recording
+{
+    recording(const std::string &n, const capture_config &c)
+      : name(n), job(c), merger(&sink), chunks(NULL), written(0), size(0),
+        done(0), ok(false)
+    {
+        pthread_mutex_init(&lock, NULL);
+    }
+
+    ~recording()
+    {
+        delete chunks;
+        pthread_mutex_destroy(&lock);
+    }
+
+    std::string name;
+    capture_job job;
+    counting_sink sink;
+    chunk_merger merger;
+    capture_chunks *chunks;             /* NULL when decoded serially */
+
+    /* Chunks decoded out of order, written once all before are */
+    pthread_mutex_t lock;
+    std::vector<frame_queue *> results;
+    uint64_t written;
+
+    uint64_t size;
+    double done;
+    bool ok;
+};
+
+static bool
+bigger (const recording *a, const recording *b)
+{
+    return a->size > b->size;
+}
+
+/* Whole recording, when it cannot be cut */
+class serial_task : public work_task
+{
+ public:
+  serial_task(recording *rec, double start) : d_rec(rec), d_start(start) {}
+
+  void run()
+  {
+      d_rec->job.decode_serial(&d_rec->sink);
+      if (d_rec->job.failed()) {
+          d_rec->ok = false;
+      }
+      fclose(d_rec->sink.d_out);
+      d_rec->done = now() - d_start;
+  }
+
+ private:
+  recording *d_rec;
+  double d_start;
+};
+
+/* One chunk of a recording */
+class chunk_task : public work_task
+{
+ public:
+  chunk_task(recording *rec, uint64_t k, double start) : d_rec(rec), d_k(k), d_start(start) {}
+
+  void run()
+  {
+      frame_queue *queues = new frame_queue[2];
+      recording *rec = d_rec;
+
+      rec->chunks->decode(d_k, queues);
+
+      pthread_mutex_lock(&rec->lock);
+      rec->results[d_k] = queues;
+      while (rec->written < rec->results.size() && rec->results[rec->written]) {
+          rec->merger.write(rec->results[rec->written]);
+          delete [] rec->results[rec->written];
+          rec->results[rec->written] = NULL;
+          rec->written++;
+      }
+      if (rec->written == rec->results.size()) {
+          fclose(rec->sink.d_out);
+          rec->done = now() - d_start;
+      }
+      pthread_mutex_unlock(&rec->lock);
+  }
+
+ private:
+  recording *d_rec;
+  uint64_t d_k;
+  double d_start;
+};
+
+static std::string
+resolve (const std::string &base, const std::string &path)
+{
+    if (path.empty() || path[0] == '/' || base.empty()) {
+        return path;
+    }
+
+    return base + "/" + path;
+}
+
+/*
+ * Capture options from whitespace separated tokens ("-f float -t x.f32")
+ */
+static bool
+parse_tokens (const std::vector<std::string> &tokens, size_t first, const std::string &base,
+              const capture_config &defaults, capture_config *config)
+{
+    *config = defaults;
+
+    for (size_t i = first; i < tokens.size(); i += 2) {
+        const std::string &opt = tokens[i];
+
+        if (opt.size() != 2 || opt[0] != '-' || !strchr(CAPTURE_OPTIONS, opt[1]) ||
+            i + 1 >= tokens.size()) {
+            fprintf(stderr, "Bad option %s\n", opt.c_str());
+            return false;
+        }
+        if (!config->parse_option(opt[1], tokens[i + 1].c_str())) {
+            return false;
+        }
+    }
+
+    for (int d = 0; d < 2; d++) {
+        config->paths[d] = resolve(base, config->paths[d]);
+    }
+
+    return !config->paths[NFC_READER].empty() || !config->paths[NFC_TAG].empty();
+}
+
+static std::vector<std::string>
+split (const std::string &line)
+{
+    std::vector<std::string> tokens;
+    size_t i = 0;
+
+    while (i < line.size()) {
+        size_t j;
+
+        while (i < line.size() && isspace((unsigned char) line[i])) {
+            i++;
+        }
+        if (i >= line.size() || line[i] == '#') {
+            break;
+        }
+        for (j = i; j < line.size() && !isspace((unsigned char) line[j]); j++);
+        tokens.push_back(line.substr(i, j - i));
+        i = j;
+    }
+
+    return tokens;
+}
+
+static std::string
+dirname_of (const std::string &path)
+{
+    size_t slash = path.rfind('/');
+
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+static bool
+read_lines (const std::string &path, std::vector<std::string> *lines)
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    char buf[4096];
+
+    if (!fp) {
+        perror(path.c_str());
+        return false;
+    }
+
+    while (fgets(buf, sizeof(buf), fp)) {
+        lines->push_back(buf);
+    }
+    fclose(fp);
+
+    return true;
+}
+
+/* Manifest: "NAME OPTIONS..." per line */
+static bool
+load_manifest (const std::string &path, const capture_config &defaults,
+               std::vector<recording *> *recs)
+{
+    std::vector<std::string> lines;
+
+    if (!read_lines(path, &lines)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        std::vector<std::string> tokens = split(lines[i]);
+        capture_config config;
+
+        if (tokens.empty()) {
+            continue;
+        }
+        if (!parse_tokens(tokens, 1, dirname_of(path), defaults, &config)) {
+            fprintf(stderr, "%s:%zu: bad recording\n", path.c_str(), i + 1);
+            return false;
+        }
+
+        recs->push_back(new recording(tokens[0], config));
+    }
+
+    return true;
+}
+
+/* Directory: one NAME.conf per recording */
+static bool
+load_directory (const std::string &path, const capture_config &defaults,
+                std::vector<recording *> *recs)
+{
+    DIR *dir = opendir(path.c_str());
+    std::vector<std::string> names;
+    struct dirent *e;
+
+    if (!dir) {
+        perror(path.c_str());
+        return false;
+    }
+    while ((e = readdir(dir)) != NULL) {
+        std::string name = e->d_name;
+
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".conf") == 0) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    for (size_t i = 0; i < names.size(); i++) {
+        std::string conf = path + "/" + names[i];
+        std::vector<std::string> lines, tokens;
+        capture_config config;
+
+        if (!read_lines(conf, &lines)) {
+            return false;
+        }
+        for (size_t l = 0; l < lines.size(); l++) {
+            std::vector<std::string> t = split(lines[l]);
+            tokens.insert(tokens.end(), t.begin(), t.end());
+        }
+        if (!parse_tokens(tokens, 0, path, defaults, &config)) {
+            fprintf(stderr, "%s: bad recording\n", conf.c_str());
+            return false;
+        }
+
+        recs->push_back(new recording(names[i].substr(0, names[i].size() - 5), config));
+    }
+
+    return true;
+}
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] MANIFEST|DIRECTORY\n"
+            "  -o DIR     output directory (default .)\n"
+            "  -j N       threads (default: online CPUs)\n"
+            "  -C N       nominal chunk length in samples\n"
+            "  -p         prefix the frames with their start/end sample\n"
+            "  -i         only decode the active regions of the recordings\n"
+            "  -P N       extra samples decoded around the activity for -i\n"
+            "Defaults for the recordings:\n"
+            CAPTURE_USAGE,
+            name);
+}
+
+int
+main (int argc, char **argv)
+{
+    capture_config defaults;
+    std::string outdir = ".";
+    int threads = int(sysconf(_SC_NPROCESSORS_ONLN));
+    uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES;
+    bool positions = false;
+    bool skip_idle = false;
+    uint64_t padding = 0;
+    std::vector<recording *> recs;
+    int opt;
+
+    while ((opt = getopt(argc, argv, CAPTURE_OPTIONS "o:j:C:piP:h")) != -1) {
+        switch (opt) {
+        case 'o':
+            outdir = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'C':
+            chunk_samples = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            positions = true;
+            break;
+        case 'i':
+            skip_idle = true;
+            break;
+        case 'P':
+            padding = strtoull(optarg, NULL, 0);
+            break;
+        case 'h':
+        case '?':
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        default:
+            if (!defaults.parse_option(opt, optarg)) {
+                return 1;
+            }
+            break;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::string input = argv[optind];
+    DIR *dir = opendir(input.c_str());
+    bool loaded;
+
+    if (dir) {
+        closedir(dir);
+        loaded = load_directory(input, defaults, &recs);
+    } else {
+        loaded = load_manifest(input, defaults, &recs);
+    }
+    if (!loaded) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < recs.size(); i++) {
+        recording *rec = recs[i];
+        std::string out = outdir + "/" + rec->name + ".txt";
+
+        rec->ok = rec->job.open();
+        if (!rec->ok) {
+            continue;
+        }
+        rec->sink.d_out = fopen(out.c_str(), "w");
+        if (!rec->sink.d_out) {
+            perror(out.c_str());
+            return 1;
+        }
+        rec->sink.d_positions = positions;
+        rec->size = rec->job.size();
+        if (rec->job.can_split() && skip_idle) {
+            rec->chunks = new capture_chunks(rec->job.active_chunks(padding, chunk_samples));
+            rec->results.assign(rec->chunks->nchunks(), NULL);
+        } else if (rec->job.can_split()) {
+            rec->chunks = new capture_chunks(rec->job.chunks(chunk_samples));
+            rec->results.assign(rec->chunks->nchunks(), NULL);
+        }
+    }
+
+    /* Biggest first, so that the small ones fill the end of the batch */
+    std::stable_sort(recs.begin(), recs.end(), bigger);
+
+    double start = now();
+    {
+        work_pool pool(threads);
+
+        for (size_t i = 0; i < recs.size(); i++) {
+            recording *rec = recs[i];
+
+            if (!rec->ok) {
+                continue;
+            }
+            if (!rec->chunks) {
+                pool.submit(new serial_task(rec, start));
+                continue;
+            }
+            if (rec->chunks->nchunks() == 0) {
+                /* Nothing but idle field */
+                fclose(rec->sink.d_out);
+                continue;
+            }
+            for (uint64_t k = 0; k < rec->chunks->nchunks(); k++) {
+                pool.submit(new chunk_task(rec, k, start));
+            }
+        }
+
+        pool.wait();
+    }
+    double elapsed = now() - start;
+
+    std::string summary_path = outdir + "/summary.txt";
+    FILE *summary = fopen(summary_path.c_str(), "w");
+    unsigned long totals[4] = { 0, 0, 0, 0 };
+    uint64_t total_size = 0;
+    int failed = 0;
+
+    if (!summary) {
+        perror(summary_path.c_str());
+        return 1;
+    }
+
+    fprintf(summary, "# name bytes chunks reader_frames tag_frames parity_errors broken done_s\n");
+    for (size_t i = 0; i < recs.size(); i++) {
+        recording *rec = recs[i];
+
+        if (!rec->ok) {
+            fprintf(summary, "%s FAILED\n", rec->name.c_str());
+            failed++;
+            continue;
+        }
+
+        fprintf(summary, "%s %llu %llu %lu %lu %lu %lu %.3f\n", rec->name.c_str(),
+                (unsigned long long) rec->size,
+                (unsigned long long) (rec->chunks ? rec->chunks->nchunks() : 1),
+                rec->sink.d_frames[NFC_READER], rec->sink.d_frames[NFC_TAG],
+                rec->sink.d_parity_errors, rec->sink.d_broken, rec->done);
+
+        totals[0] += rec->sink.d_frames[NFC_READER];
+        totals[1] += rec->sink.d_frames[NFC_TAG];
+        totals[2] += rec->sink.d_parity_errors;
+        totals[3] += rec->sink.d_broken;
+        total_size += rec->size;
+    }
+    fprintf(summary, "# total %zu recordings, %d failed, %llu bytes, %lu reader frames, "
+            "%lu tag frames, %lu parity errors, %lu broken, %.3f s, %d threads\n",
+            recs.size(), failed, (unsigned long long) total_size, totals[0], totals[1],
+            totals[2], totals[3], elapsed, threads);
+    fclose(summary);
+
+    for (size_t i = 0; i < recs.size(); i++) {
+        delete recs[i];
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * nfc_correlate: pairs the reader commands with the tag responses by
+ * time and groups them into sessions, from the frame files written by
+ * nfc_decode -o bin:FILE (or cbin:FILE). Several files (reader and tag
+ * decoded apart) are merged by time on the fly; only one frame per file
+ * and the exchange being built are held, so days-long captures stream
+ * through.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <inttypes.h>
+#include <unistd.h>
+#include "decode_pipeline.h"
+#include "frame_record.h"
+#include "frame_correlator.h"
+
+using namespace gr::nfc;
+
+/* One frame file and its next frame */
+struct record_input
+{
+    frame_record_reader reader;
+    nfc_frame frame;
+    int64_t time_ns;
+    bool valid;
+    const char *path;
+
+    void advance() { valid = reader.next(&frame, &time_ns); }
+};
+
+static bool
+parse_window (const char *s, int64_t *min_ns, int64_t *max_ns)
+{
+    const char *comma = strchr(s, ',');
+    std::string lo(s, comma ? comma - s : strlen(s));
+    uint64_t a, b;
+
+    /* Times in ns, or with a suffix: parse_position at 1 GHz */
+    if (!comma || !parse_position(lo.c_str(), 1e9, &a) || !parse_position(comma + 1, 1e9, &b) ||
+        a > b) {
+        return false;
+    }
+    *min_ns = int64_t(a);
+    *max_ns = int64_t(b);
+
+    return true;
+}
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] FILE...\n"
+            "  FILE       frames written by nfc_decode -o bin:FILE or cbin:FILE,\n"
+            "             \"-\" for stdin; several files are merged by time\n"
+            "  -F MIN,MAX  response window after the end of a command, in ns or\n"
+            "             with an s, ms or us suffix (default 70us,5ms)\n"
+            "  -o PATH    output file (default stdout)\n"
+            "  -p         prefix the frames with their start/end sample\n"
+            "  -v         report the counts on stderr\n",
+            name);
+}
+
+int
+main (int argc, char **argv)
+{
+    int64_t fdt_min = CORRELATE_FDT_MIN_NS;
+    int64_t fdt_max = CORRELATE_FDT_MAX_NS;
+    const char *out_path = NULL;
+    bool positions = false, verbose = false;
+    FILE *out = stdout;
+    int opt, status = 0;
+
+    while ((opt = getopt(argc, argv, "F:o:pvh")) != -1) {
+        switch (opt) {
+        case 'F':
+            if (!parse_window(optarg, &fdt_min, &fdt_max)) {
+                fprintf(stderr, "Bad response window %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'p':
+            positions = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'h':
+        case '?':
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int ninputs = argc - optind;
+    record_input *inputs = new record_input[ninputs];
+
+    for (int i = 0; i < ninputs; i++) {
+        inputs[i].path = argv[optind + i];
+        if (!inputs[i].reader.open(inputs[i].path)) {
+            delete[] inputs;
+            return 1;
+        }
+        inputs[i].advance();
+    }
+
+    if (out_path && !(out = fopen(out_path, "w"))) {
+        perror(out_path);
+        delete[] inputs;
+        return 1;
+    }
+
+    exchange_printer printer(out, positions);
+    frame_correlator correlator(&printer, fdt_min, fdt_max);
+
+    for (;;) {
+        record_input *next = NULL;
+
+        /* Earliest frame, the reader first on a tie */
+        for (int i = 0; i < ninputs; i++) {
+            if (inputs[i].valid &&
+                (!next || inputs[i].time_ns < next->time_ns ||
+                 (inputs[i].time_ns == next->time_ns &&
+                  inputs[i].frame.direction < next->frame.direction))) {
+                next = &inputs[i];
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        const nfc_frame &frame = next->frame;
+        int64_t duration = int64_t(std::floor((frame.end - frame.start) * 1e9 /
+                                              next->reader.sample_rate() + 0.5));
+
+        correlator.add(frame, next->time_ns, next->time_ns + duration);
+        next->advance();
+    }
+    correlator.finish();
+
+    for (int i = 0; i < ninputs; i++) {
+        if (inputs[i].reader.truncated()) {
+            fprintf(stderr, "%s: truncated or malformed record, stopped there\n",
+                    inputs[i].path);
+            status = 1;
+        }
+    }
+    delete[] inputs;
+
+    if (fflush(out) != 0 || ferror(out) || (out != stdout && fclose(out) != 0)) {
+        perror(out_path ? out_path : "stdout");
+        status = 1;
+    }
+
+    if (verbose) {
+        fprintf(stderr, "%" PRIu64 " sessions, %" PRIu64 " exchanges, %" PRIu64
+                " unanswered, %" PRIu64 " tag frames without a command\n",
+                correlator.sessions(), correlator.exchanges(), correlator.unanswered(),
+                correlator.orphans());
+    }
+
+    return status;
+}
@@ -0,0 +1,299 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * nfc_decode: offline decoder for recorded captures, without the GNU Radio
+ * runtime. Decodes the reader (modified Miller) and/or the tag (Manchester)
+ * capture and prints the frames in the same text format as the blocks,
+ * both directions merged in time order.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <ctime>
+#include <unistd.h>
+#include <vector>
+#include "capture_job.h"
+#include "frame_output.h"
+#include "snippet_recorder.h"
+
+using namespace gr::nfc;
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [-r READER_FILE] [-t TAG_FILE]\n"
+            CAPTURE_USAGE
+            OUTPUT_USAGE
+            ROTATION_USAGE
+            "  -p         prefix the text frames with their start/end sample\n"
+            "  -M         read() the captures instead of mapping them\n"
+            "  -B         report the decoding speed on stderr\n"
+            "  -j N       decode on N threads, in chunks cut at quiet periods\n"
+            "             (mapped captures, threshold or band slicers, no AGC)\n"
+            "  -C N       nominal chunk length in samples for -j\n"
+            "  -i         only decode the active regions, skip the idle field\n"
+            "             (same conditions as -j)\n"
+            "  -P N       extra samples decoded around the activity for -i\n"
+            "  -x FILE    write the activity index (START END per line) for -i\n"
+            "  -e START:END  only the frames starting in the range (absolute\n"
+            "             samples, or times with an s, ms or us suffix), the\n"
+            "             captures are entered close to it instead of read through\n"
+            "  -W N       pre-roll before the range when it cannot start at a\n"
+            "             quiet period (samples or time, default 25ms)\n"
+            SNIPPET_USAGE,
+            name);
+}
+
+int
+main (int argc, char **argv)
+{
+    capture_config config;
+    bool positions = false;
+    bool use_mmap = true;
+    bool bench = false;
+    int threads = 1;
+    uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES;
+    bool skip_idle = false;
+    uint64_t padding = 0;
+    const char *index_path = NULL;
+    const char *range_arg = NULL;
+    const char *preroll_arg = NULL;
+    const char *window_arg = NULL;
+    snippet_config snippets;
+    rotation_config rotation;
+    std::vector<const char *> output_specs;
+    int opt;
+
+    while ((opt = getopt(argc, argv, CAPTURE_OPTIONS ROTATION_OPTIONS "o:pMBj:C:iP:x:e:W:S:L:D:N:h")) != -1) {
+        switch (opt) {
+        case 'o':
+            output_specs.push_back(optarg);
+            break;
+        case 'p':
+            positions = true;
+            break;
+        case 'M':
+            use_mmap = false;
+            break;
+        case 'B':
+            bench = true;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'C':
+            chunk_samples = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            skip_idle = true;
+            break;
+        case 'P':
+            padding = strtoull(optarg, NULL, 0);
+            break;
+        case 'x':
+            index_path = optarg;
+            break;
+        case 'e':
+            range_arg = optarg;
+            break;
+        case 'W':
+            preroll_arg = optarg;
+            break;
+        case 'S':
+            if (!snippets.parse_events(optarg)) {
+                return 1;
+            }
+            break;
+        case 'L':
+            window_arg = optarg;
+            break;
+        case 'D':
+            snippets.dir = optarg;
+            break;
+        case 'N':
+            snippets.max_snippets = strtoul(optarg, NULL, 0);
+            break;
+        case 'Z':
+        case 'Y':
+        case 'F':
+            if (!rotation.parse_option(opt, optarg)) {
+                return 1;
+            }
+            break;
+        case 'h':
+        case '?':
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        default:
+            if (!config.parse_option(opt, optarg)) {
+                return 1;
+            }
+            break;
+        }
+    }
+
+    if ((config.paths[NFC_READER].empty() && config.paths[NFC_TAG].empty()) || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    frame_tee out;
+    std::vector<frame_output *> outputs;
+    output_info info;
+    capture_job job(config);
+    bool parallel;
+    uint64_t total = 0;
+    uint64_t range_start = 0, range_end = UINT64_MAX, preroll;
+    struct timespec t0, t1;
+
+    if (!job.open(use_mmap)) {
+        return 1;
+    }
+
+    /* Times need the rate, which may come from the headers */
+    double rate = job.config().sample_rate;
+    preroll = uint64_t(RANGE_PREROLL_TIME * rate);
+    if ((range_arg && !parse_range(range_arg, rate, &range_start, &range_end)) ||
+        (preroll_arg && !parse_position(preroll_arg, rate, &preroll))) {
+        fprintf(stderr, "Bad range or pre-roll\n");
+        return 1;
+    }
+    if (window_arg && !snippets.parse_window(window_arg, rate)) {
+        return 1;
+    }
+    if (snippets.events && job.config().format == FORMAT_NFCR) {
+        fprintf(stderr, "nfc_decode: no snippets of .nfcr captures, they hold no samples\n");
+        return 1;
+    }
+
+    /* Timestamps need the rate and the start time of the headers too */
+    info.sample_rate = rate;
+    info.start_time_ns = job.start_time_ns(&info.start_sample);
+    info.positions = positions;
+    if (output_specs.empty()) {
+        output_specs.push_back("text:-");
+    }
+    for (size_t i = 0; i < output_specs.size(); i++) {
+        frame_output *output = open_frame_output(output_specs[i], info, rotation);
+
+        if (!output) {
+            return 1;
+        }
+        outputs.push_back(output);
+        out.add(output);
+    }
+
+    snippet_recorder recorder(snippets, job);
+
+    if (snippets.events) {
+        /* The recorder sees the samples of the serial decoding only */
+        if (!recorder.open()) {
+            return 1;
+        }
+        job.set_tap(&recorder);
+        out.add(&recorder);
+        parallel = false;
+    } else if (range_arg) {
+        /* Cut at quiet periods if possible, exact without any pre-roll */
+        parallel = job.can_split();
+    } else {
+        parallel = (threads > 1 || skip_idle) && job.can_split();
+    }
+    if ((threads > 1 || skip_idle) && !parallel) {
+        fprintf(stderr, "nfc_decode: serial decoding (pipe, read(), AGC, adaptive slicer,\n"
+                "            discontinuous nfcb or nfcr, snippets)\n");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (range_arg) {
+        range_filter in_range(&out, range_start, range_end);
+
+        if (parallel) {
+            capture_chunks chunks = job.range_chunks(range_start, range_end, chunk_samples);
+            uint64_t covered = 0;
+
+            decode_parallel(chunks, threads, &in_range);
+            for (size_t i = 0; i < chunks.regions().size(); i++) {
+                covered += chunks.regions()[i].end - chunks.regions()[i].start;
+            }
+            /* The part of the captures actually read */
+            total = uint64_t(double(job.size()) * covered / std::max(chunks.nsamples(), uint64_t(1)));
+        } else {
+            total = job.decode_serial(&out, range_start, range_end, preroll);
+        }
+    } else if (parallel && skip_idle) {
+        capture_chunks chunks = job.active_chunks(padding, chunk_samples);
+
+        if (index_path) {
+            FILE *fp = fopen(index_path, "w");
+
+            if (!fp) {
+                perror(index_path);
+                return 1;
+            }
+            write_activity(fp, chunks.regions());
+            fclose(fp);
+        }
+
+        decode_parallel(chunks, threads, &out);
+        total = job.size();
+    } else if (parallel) {
+        decode_parallel(job.chunks(chunk_samples), threads, &out);
+        total = job.size();
+    } else {
+        total = job.decode_serial(&out);
+    }
+    int status = job.failed() ? 1 : 0;
+
+    if (snippets.events) {
+        if (!recorder.finish()) {
+            status = 1;
+        }
+        if (recorder.skipped()) {
+            fprintf(stderr, "nfc_decode: %lu snippets written, %lu more past -N\n",
+                    recorder.written(), recorder.skipped());
+        }
+    }
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (!outputs[i]->close()) {
+            status = 1;
+        }
+        delete outputs[i];
+    }
+
+    if (bench) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+        fprintf(stderr, "nfc_decode: %llu bytes in %.3f s, %.3f s/GB, %.1f MB/s (%s, %d threads)\n",
+                (unsigned long long) total, seconds, seconds * 1e9 / std::max(total, uint64_t(1)),
+                total / std::max(seconds, 1e-9) * 1e-6, use_mmap ? "mmap" : "read",
+                parallel ? std::max(threads, 1) : 1);
+    }
+
+    return status;
+}
@@ -0,0 +1,213 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <inttypes.h>
+#include "nfc_frame.h"
+
+namespace gr {
+  namespace nfc {
+
+    static unsigned char
+    compute_even_parity (unsigned char c)
+    {
+            unsigned int i;
+            unsigned char parity = 0;
+
+            for (i = 0; i < 8; i++) {
+                parity ^= (c & (0x1 << i)) >> i;
+            }
+
+            return parity;
+    }
+
+    void
+    nfc_frame_assemble (nfc_frame *frame, const unsigned char *bits, unsigned int nbits,
+                        unsigned char *no_parity_mode)
+    {
+        unsigned int in_bit = 0, out_bit = 0;
+        unsigned char parity_ok = 0;
+        unsigned char parity_bit = 0;
+        unsigned int n = 0;
+
+        if (nbits > NFC_MAX_FRAME_BITS) {
+            nbits = NFC_MAX_FRAME_BITS;
+        }
+
+        /* Assume that the frame is in no parity mode if its length
+         * is valid in no parity mode, and not in Standard mode.
+         * NOTE: For a length of 9x8xN, the last known mode is used.
+         */
+        if ((nbits % 72) != 0) {
+            *no_parity_mode = (((nbits % 9) != 0) && ((nbits % 8) == 0));
+        }
+
+        memset(frame->data, 0, sizeof(frame->data));
+        memset(frame->parity, 0, sizeof(frame->parity));
+        frame->flags = *no_parity_mode ? FRAME_NO_PARITY : 0;
+        frame->nbits = nbits;
+
+        while (in_bit < nbits) {
+            frame->data[n] |= bits[in_bit] << out_bit;
+            in_bit++;
+            out_bit++;
+
+            if (!*no_parity_mode && (out_bit == 8 && in_bit < nbits)) {
+                /* Check parity if needed */
+                parity_bit = bits[in_bit];
+                parity_ok = (compute_even_parity(frame->data[n]) == !parity_bit);
+                in_bit++;
+            }
+
+            if (out_bit == 8 || in_bit == nbits) {
+                if (nbits == 7) {
+                    /* Short command */
+                    frame->status[n] = BYTE_SHORT;
+                    frame->flags |= FRAME_SHORT;
+                } else if (out_bit < 8 || (nbits == 8 && !*no_parity_mode)) {
+                    /* Broken */
+                    frame->status[n] = BYTE_BROKEN;
+                    frame->flags |= FRAME_BROKEN;
+                } else if (parity_ok || *no_parity_mode) {
+                    frame->status[n] = BYTE_OK;
+                } else {
+                    frame->status[n] = BYTE_PARITY_ERROR;
+                    frame->flags |= FRAME_PARITY_ERROR;
+                }
+
+                if (parity_bit) {
+                    frame->parity[n / 8] |= 0x80 >> (n % 8);
+                    parity_bit = 0;
+                }
+
+                n++;
+                out_bit = 0;
+            }
+        }
+
+        frame->len = n;
+    }
+
+    unsigned int
+    nfc_frame_bits (const nfc_frame &frame, unsigned char *bits)
+    {
+        unsigned int in_bit = 0;
+        bool parity = !(frame.flags & FRAME_NO_PARITY);
+
+        for (unsigned int n = 0; n < frame.len && in_bit < frame.nbits; n++) {
+            for (int j = 0; j < 8 && in_bit < frame.nbits; j++) {
+                bits[in_bit++] = (frame.data[n] >> j) & 1;
+            }
+
+            if (parity && in_bit < frame.nbits) {
+                bits[in_bit++] = (frame.parity[n / 8] >> (7 - n % 8)) & 1;
+            }
+        }
+
+        return in_bit;
+    }
+
+    void
+    nfc_frame_apply_mode (nfc_frame *frame, unsigned char *no_parity_mode)
+    {
+        unsigned char bits[NFC_MAX_FRAME_BITS];
+        unsigned char mode = (frame->flags & FRAME_NO_PARITY) != 0;
+
+        if ((frame->nbits % 72) != 0) {
+            /* The frame decided the mode itself */
+            *no_parity_mode = mode;
+            return;
+        }
+
+        if (mode != *no_parity_mode) {
+            nfc_frame_assemble(frame, bits, nfc_frame_bits(*frame, bits), no_parity_mode);
+        }
+    }
+
+    uint16_t
+    nfc_crc_a (const unsigned char *data, unsigned int len)
+    {
+        uint16_t crc = 0x6363;
+
+        for (unsigned int i = 0; i < len; i++) {
+            unsigned char c = data[i] ^ (unsigned char) (crc & 0xff);
+
+            c ^= c << 4;
+            crc = (crc >> 8) ^ (uint16_t(c) << 8) ^ (uint16_t(c) << 3) ^ (c >> 4);
+        }
+
+        return crc;
+    }
+
+    bool
+    nfc_frame_crc_ok (const nfc_frame &frame)
+    {
+        uint16_t crc;
+
+        if (frame.len < 3 || (frame.flags & (FRAME_SHORT | FRAME_BROKEN))) {
+            return false;
+        }
+
+        crc = nfc_crc_a(frame.data, frame.len - 2);
+        return frame.data[frame.len - 2] == (crc & 0xff) && frame.data[frame.len - 1] == (crc >> 8);
+    }
+
+    void
+    nfc_frame_print_data (FILE *fp, const nfc_frame &frame)
+    {
+        fputs(frame.direction == NFC_READER ? "Reader ->" : "Tag ->", fp);
+
+        for (unsigned int i = 0; i < frame.len; i++) {
+            switch (frame.status[i]) {
+            case BYTE_SHORT:
+                fprintf(fp, " [%02X]", frame.data[i]);
+                break;
+            case BYTE_BROKEN:
+                fprintf(fp, " /%02X\\", frame.data[i]);
+                break;
+            case BYTE_OK:
+                fprintf(fp, "  %02X ", frame.data[i]);
+                break;
+            default:
+                fprintf(fp, " (%02X)", frame.data[i]);
+                break;
+            }
+        }
+
+        if (frame.flags & FRAME_NO_PARITY) {
+            fputs(" (No parity)", fp);
+        }
+    }
+
+    void
+    nfc_frame_print (FILE *fp, const nfc_frame &frame, bool positions)
+    {
+        if (positions) {
+            fprintf(fp, "%" PRIu64 " %" PRIu64 " ", frame.start, frame.end);
+        }
+
+        nfc_frame_print_data(fp, frame);
+        fputc('\n', fp);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
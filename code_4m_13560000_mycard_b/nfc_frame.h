@@ -0,0 +1,127 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_FRAME_H
+#define INCLUDED_NFC_FRAME_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Longest frame accepted by the decoders, longer ones are cut and
+ * flagged broken so that the decoder memory stays bounded.
+ */
+#define NFC_MAX_FRAME_BITS                  4096
+#define NFC_MAX_FRAME_BYTES                 (NFC_MAX_FRAME_BITS / 8)
+
+namespace gr {
+  namespace nfc {
+
+    enum nfc_direction {
+        NFC_READER = 0,
+        NFC_TAG = 1,
+    };
+
+    enum nfc_frame_flags {
+        FRAME_SHORT = 0x01,             /* 7-bit short frame (REQA, WUPA) */
+        FRAME_NO_PARITY = 0x02,         /* Decoded in no parity mode */
+        FRAME_BROKEN = 0x04,            /* Last byte incomplete */
+        FRAME_PARITY_ERROR = 0x08,      /* At least one parity error */
+    };
+
+    enum nfc_byte_status {
+        BYTE_OK,
+        BYTE_PARITY_ERROR,
+        BYTE_BROKEN,
+        BYTE_SHORT,
+    };
+
+    /*!
+     * \brief One decoded frame, with absolute sample positions.
+     *
+     * Fixed size, the decoders fill the same instance for every frame.
+     */
+    struct nfc_frame
+    {
+        uint64_t start;                 /* Absolute sample of the first pulse */
+        uint64_t end;                   /* Absolute sample of the end of frame */
+        unsigned char direction;        /* nfc_direction */
+        unsigned char flags;            /* nfc_frame_flags */
+        unsigned short nbits;           /* Bits on air, parity included */
+        unsigned short len;             /* Bytes in data[] */
+        unsigned char data[NFC_MAX_FRAME_BYTES];
+        unsigned char status[NFC_MAX_FRAME_BYTES];          /* nfc_byte_status */
+        unsigned char parity[NFC_MAX_FRAME_BYTES / 8];      /* Received parity bits, MSB first */
+    };
+
+    /*!
+     * \brief Receives the decoded frames
+     */
+    class frame_sink
+    {
+     public:
+      virtual ~frame_sink() {}
+
+      virtual void write(const nfc_frame &frame) = 0;
+      virtual void flush() {}
+    };
+
+    /*!
+     * Build \p frame data bytes from \p nbits bits (one per byte, LSB first
+     * on air, a parity bit after each byte unless in no parity mode).
+     * \p no_parity_mode keeps the last known mode between frames.
+     */
+    void nfc_frame_assemble(nfc_frame *frame, const unsigned char *bits, unsigned int nbits,
+                            unsigned char *no_parity_mode);
+
+    /*!
+     * Rebuild the bits on air of \p frame (inverse of nfc_frame_assemble),
+     * \p bits must hold frame.nbits entries. Returns frame.nbits.
+     */
+    unsigned int nfc_frame_bits(const nfc_frame &frame, unsigned char *bits);
+
+    /*!
+     * Replay the parity mode tracking of nfc_frame_assemble on a frame
+     * decoded without knowing the mode of the previous frames: frames whose
+     * length is valid in both modes are assembled again with
+     * \p no_parity_mode, the others update it. Used to stitch the frames of
+     * separately decoded chunks.
+     */
+    void nfc_frame_apply_mode(nfc_frame *frame, unsigned char *no_parity_mode);
+
+    /*! CRC_A of ISO/IEC 14443-3 (initial value 0x6363), sent low byte first */
+    uint16_t nfc_crc_a(const unsigned char *data, unsigned int len);
+
+    /*! True if \p frame ends with the CRC_A of its other bytes. Frames
+     * sent without a CRC (REQA, ATQA, UID...) give false as well.
+     */
+    bool nfc_frame_crc_ok(const nfc_frame &frame);
+
+    /*!
+     * Print \p frame the way the decoder blocks always did
+     * ("Reader -> [52]", "Tag -> 44  00 "...), optionally prefixed with the
+     * start and end sample positions.
+     */
+    void nfc_frame_print(FILE *fp, const nfc_frame &frame, bool positions);
+
+    /*! The direction and bytes of nfc_frame_print, without the newline */
+    void nfc_frame_print_data(FILE *fp, const nfc_frame &frame);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_FRAME_H */
@@ -0,0 +1,281 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * nfc_overview: builds the min/max/mean overview (.ovw) of a capture in
+ * one pass, and queries it: any range at any zoom in time proportional
+ * to the number of columns, with the decoded frames (nfc_decode -p
+ * output) marked on the columns they overlap.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include "capture_job.h"
+#include "capture_overview.h"
+
+using namespace gr::nfc;
+
+/* One line of nfc_decode -p */
+struct frame_marker
+{
+    uint64_t start;
+    uint64_t end;
+    char direction;             /* 'R' or 'T' */
+    std::string text;
+};
+
+static bool
+by_start (const frame_marker &a, const frame_marker &b)
+{
+    return a.start < b.start;
+}
+
+static bool
+load_markers (const char *path, std::vector<frame_marker> *markers, uint64_t *longest)
+{
+    FILE *fp = fopen(path, "r");
+    char line[4096];
+
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+
+    *longest = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long long start, end;
+        char dir[16];
+        frame_marker m;
+
+        if (sscanf(line, "%llu %llu %15s", &start, &end, dir) != 3) {
+            continue;
+        }
+        m.start = start;
+        m.end = end;
+        m.direction = dir[0] == 'T' ? 'T' : 'R';
+        m.text = line;
+        markers->push_back(m);
+        *longest = std::max(*longest, m.end - m.start);
+    }
+    fclose(fp);
+
+    /* nfc_decode output is already in start order, merged files may not be */
+    std::stable_sort(markers->begin(), markers->end(), by_start);
+
+    return true;
+}
+
+static int
+build (const capture_config &config, const char *out_path)
+{
+    int d = config.paths[NFC_READER].empty() ? NFC_TAG : NFC_READER;
+    std::string path = out_path ? out_path : config.paths[d] + ".ovw";
+    capture_stream in;
+    overview_builder overview;
+    const void *items;
+    int nitems;
+    bool more;
+
+    if (!in.open(config, d)) {
+        return 1;
+    }
+    if (!overview.open(path.c_str(), in.sample_rate() ? in.sample_rate() : config.sample_rate)) {
+        return 1;
+    }
+
+    do {
+        more = in.next(&items, &nitems);
+
+        switch (in.format()) {
+        case FORMAT_FLOAT:
+            overview.add((const float *) items, nitems);
+            break;
+        case FORMAT_SHORT:
+            overview.add((const short *) items, nitems);
+            break;
+        case FORMAT_PACKED:
+            overview.add_packed((const unsigned char *) items, nitems);
+            break;
+        default:
+            overview.add((const unsigned char *) items, nitems);
+            break;
+        }
+    } while (more);
+
+    if (!overview.close()) {
+        perror(path.c_str());
+        return 1;
+    }
+
+    return in.failed() ? 1 : 0;
+}
+
+static int
+query (const char *path, const char *start_arg, const char *end_arg, int columns,
+       const char *markers_path)
+{
+    overview_reader overview;
+    std::vector<overview_bucket> buckets;
+    std::vector<frame_marker> markers;
+    uint64_t start = 0, end, longest = 0;
+    size_t first = 0;
+
+    if (!overview.open(path)) {
+        return 1;
+    }
+
+    end = overview.nsamples();
+    if ((start_arg && !parse_position(start_arg, overview.sample_rate(), &start)) ||
+        (end_arg && !parse_position(end_arg, overview.sample_rate(), &end))) {
+        fprintf(stderr, "Bad range\n");
+        return 1;
+    }
+    end = std::min(end, overview.nsamples());
+
+    if (markers_path && !load_markers(markers_path, &markers, &longest)) {
+        return 1;
+    }
+
+    overview.query(start, end, columns, &buckets);
+    if (buckets.empty()) {
+        return 0;
+    }
+
+    /* First frame that can overlap the range, then a sweep along the columns */
+    frame_marker key;
+    key.start = start > longest ? start - longest : 0;
+    first = std::lower_bound(markers.begin(), markers.end(), key, by_start) - markers.begin();
+
+    printf("# %llu samples at %g Hz, %llu to %llu in %d columns\n",
+           (unsigned long long) overview.nsamples(), overview.sample_rate(),
+           (unsigned long long) start, (unsigned long long) end, columns);
+    for (size_t i = first; i < markers.size() && markers[i].start < end; i++) {
+        if (markers[i].end >= start) {
+            printf("# %s", markers[i].text.c_str());
+        }
+    }
+
+    double per_column = double(end - start) / columns;
+    for (int c = 0; c < columns; c++) {
+        uint64_t s0 = start + uint64_t(c * per_column);
+        uint64_t s1 = std::max(start + uint64_t((c + 1) * per_column), s0 + 1);
+        bool reader = false, tag = false;
+
+        while (first < markers.size() && markers[first].start + longest < s0) {
+            first++;
+        }
+        for (size_t i = first; i < markers.size() && markers[i].start < s1; i++) {
+            if (markers[i].end >= s0) {
+                reader |= markers[i].direction == 'R';
+                tag |= markers[i].direction == 'T';
+            }
+        }
+
+        printf("%llu %g %g %g %s\n", (unsigned long long) s0,
+               buckets[c].min, buckets[c].max, buckets[c].mean,
+               reader ? (tag ? "RT" : "R") : (tag ? "T" : "-"));
+    }
+
+    return 0;
+}
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] -r FILE|-t FILE [-o OUT.ovw]\n"
+            "       %s -q OVERVIEW [-S START] [-E END] [-W COLUMNS] [-m FRAMES]\n"
+            "Build (default output FILE.ovw):\n"
+            CAPTURE_USAGE
+            "Query, one line per column: first sample, min, max, mean and the\n"
+            "directions of the frames overlapping it (R, T, RT or -):\n"
+            "  -S, -E     range in samples, or time with an s, ms or us suffix\n"
+            "  -W N       number of columns (default 100)\n"
+            "  -m FILE    frames to mark, as printed by nfc_decode -p\n",
+            name, name);
+}
+
+int
+main (int argc, char **argv)
+{
+    capture_config config;
+    const char *out_path = NULL;
+    const char *query_path = NULL;
+    const char *start_arg = NULL;
+    const char *end_arg = NULL;
+    const char *markers_path = NULL;
+    int columns = 100;
+    int opt;
+
+    while ((opt = getopt(argc, argv, CAPTURE_OPTIONS "o:q:S:E:W:m:h")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'q':
+            query_path = optarg;
+            break;
+        case 'S':
+            start_arg = optarg;
+            break;
+        case 'E':
+            end_arg = optarg;
+            break;
+        case 'W':
+            columns = atoi(optarg);
+            break;
+        case 'm':
+            markers_path = optarg;
+            break;
+        case 'h':
+        case '?':
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        default:
+            if (!config.parse_option(opt, optarg)) {
+                return 1;
+            }
+            break;
+        }
+    }
+
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (query_path) {
+        return query(query_path, start_arg, end_arg, columns, markers_path);
+    }
+
+    if (config.paths[NFC_READER].empty() == config.paths[NFC_TAG].empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return build(config, out_path);
+}
@@ -0,0 +1,199 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * nfc_pack: converts one capture (any capture format, envelopes through
+ * the slicer and AGC) to a .nfcb packed capture, 1 bit per sample, or to
+ * a .nfcr run-length capture when the output name ends in .nfcr. The
+ * result decodes like the original with nfc_decode -f nfcb or -f nfcr.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include "capture_job.h"
+#include "nfcb.h"
+#include "nfcr.h"
+
+using namespace gr::nfc;
+
+/* Takes the place of the decoder behind the sample stage */
+template <typename W>
+class capture_recorder : public frame_decoder
+{
+ public:
+  capture_recorder(W *writer) : d_writer(writer), d_position(0) {}
+
+  void reset(uint64_t position)
+  {
+      if (position != d_position) {
+          d_writer->discontinuity(position);
+          d_position = position;
+      }
+  }
+
+  void process(const unsigned char *in, int n)
+  {
+      d_writer->write(in, n);
+      d_position += n;
+  }
+
+  void process_packed(const unsigned char *in, int nbytes)
+  {
+      d_writer->write_packed(in, nbytes);
+      d_position += 8 * uint64_t(nbytes);
+  }
+
+  void push_run(unsigned char level, uint64_t length)
+  {
+      d_writer->write_run(level, length);
+      d_position += length;
+  }
+
+  void finish() {}
+  uint64_t position() const { return d_position; }
+  uint64_t pending_start() const { return d_position; }
+  unsigned int cut_levels() const { return 0; }
+  uint64_t cut_margin() const { return 0; }
+
+ private:
+  W *d_writer;
+  uint64_t d_position;
+};
+
+template <typename W>
+static bool
+pack (capture_stream *in, const capture_config &config, int d, const char *out_path,
+      const nfcb_info &info, uint64_t origin)
+{
+    W writer;
+
+    if (!writer.open(out_path, info, origin)) {
+        return false;
+    }
+
+    capture_recorder<W> recorder(&writer);
+    sample_stage stage(in->format(), info.sample_rate, config.slicers[d], config.agc, &recorder);
+    const void *items;
+    int nitems;
+    bool more;
+
+    stage.reset(origin);
+    do {
+        more = in->next(&items, &nitems);
+        stage.process(items, nitems);
+    } while (more);
+    stage.finish();
+
+    if (!writer.close()) {
+        perror(out_path);
+        return false;
+    }
+
+    return !in->failed();
+}
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] -r READER_FILE|-t TAG_FILE -o OUT\n"
+            CAPTURE_USAGE
+            "  -o FILE    output .nfcb file, or .nfcr if the name ends in .nfcr\n"
+            "  -c FREQ    center frequency in Hz (default 13.56e6)\n"
+            "  -S TIME    start time of the capture, seconds since the epoch\n"
+            "  -O N       absolute position of the first sample (default 0)\n"
+            "  -I N       index interval (.nfcb) or block length (.nfcr) in\n"
+            "             samples (default %d, %d)\n",
+            name, NFCB_INDEX_INTERVAL, NFCR_BLOCK_SAMPLES);
+}
+
+int
+main (int argc, char **argv)
+{
+    capture_config config;
+    const char *out_path = NULL;
+    nfcb_info info;
+    uint64_t origin = 0;
+    int opt;
+
+    memset(&info, 0, sizeof(info));
+    info.center_freq = 13.56e6;
+
+    while ((opt = getopt(argc, argv, CAPTURE_OPTIONS "o:c:S:O:I:h")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'c':
+            info.center_freq = atof(optarg);
+            break;
+        case 'S':
+            info.start_time_ns = int64_t(llround(atof(optarg) * 1e9));
+            break;
+        case 'O':
+            origin = strtoull(optarg, NULL, 0);
+            break;
+        case 'I':
+            info.index_interval = uint32_t(strtoul(optarg, NULL, 0));
+            break;
+        case 'h':
+        case '?':
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        default:
+            if (!config.parse_option(opt, optarg)) {
+                return 1;
+            }
+            break;
+        }
+    }
+
+    if (config.paths[NFC_READER].empty() == config.paths[NFC_TAG].empty() ||
+        !out_path || optind != argc ||
+        config.format == FORMAT_NFCB || config.format == FORMAT_NFCR) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int d = config.paths[NFC_READER].empty() ? NFC_TAG : NFC_READER;
+    size_t len = strlen(out_path);
+    bool runs = len >= 5 && !strcmp(out_path + len - 5, ".nfcr");
+    capture_stream in;
+
+    if (!in.open(config, d)) {
+        return 1;
+    }
+
+    info.sample_rate = in.sample_rate() ? in.sample_rate() : config.sample_rate;
+    info.direction = (unsigned char) d;
+    info.slicer = config.slicers[d];
+
+    if (runs ? !pack<nfcr_writer>(&in, config, d, out_path, info, origin)
+             : !pack<nfcb_writer>(&in, config, d, out_path, info, origin)) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,378 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * nfc_query: filters the frames of a columnar store (nfc_decode -o
+ * store:DIR) and counts them, counts them per UID and/or time bucket or
+ * writes them to any of the frame outputs. Only the columns a filter
+ * needs are read, and chunks whose zone map rules them out are skipped.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <inttypes.h>
+#include <unistd.h>
+#include "decode_pipeline.h"
+#include "frame_output.h"
+#include "frame_record.h"
+#include "frame_store.h"
+
+using namespace gr::nfc;
+
+static bool
+parse_flags (const char *s, uint8_t *flags)
+{
+    static const struct {
+        const char *name;
+        uint8_t flag;
+    } names[] = {
+        { "short", FRAME_SHORT },
+        { "noparity", FRAME_NO_PARITY },
+        { "broken", FRAME_BROKEN },
+        { "parity", FRAME_PARITY_ERROR },
+        { "crc", FRAME_RECORD_CRC_OK },
+    };
+    std::string list(s);
+    size_t pos = 0;
+
+    *flags = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        std::string name = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        bool found = false;
+
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (name == names[i].name) {
+                *flags |= names[i].flag;
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+
+    return true;
+}
+
+/* MIN:MAX of plain integers, either side may be empty */
+static bool
+parse_bounds (const char *s, uint64_t *min, uint64_t *max)
+{
+    const char *colon = strchr(s, ':');
+    char *end;
+
+    if (!colon) {
+        return false;
+    }
+    if (colon != s) {
+        *min = strtoull(s, &end, 0);
+        if (end != colon) {
+            return false;
+        }
+    }
+    if (colon[1]) {
+        *max = strtoull(colon + 1, &end, 0);
+        if (*end) {
+            return false;
+        }
+    }
+
+    return *min <= *max;
+}
+
+/* UID of a uid column entry in hex, - for none */
+static void
+print_uid (const frame_store_reader &store, uint32_t entry)
+{
+    const store_uid *uid = store.uid_entry(entry);
+
+    if (!uid) {
+        fputs("-", stdout);
+        return;
+    }
+    for (unsigned int i = 0; i < uid->len; i++) {
+        printf("%02X", uid->uid[i]);
+    }
+}
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] DIR\n"
+            "  DIR        store written by nfc_decode -o store:DIR\n"
+            "Filters, all must hold:\n"
+            "  -e START:END  time range from the start of the capture, in ns or\n"
+            "             with an s, ms or us suffix, either side may be empty\n"
+            "  -d DIR     reader or tag\n"
+            "  -f FLAGS   frames with all of FLAGS, a comma separated list of\n"
+            "             short, noparity, broken, parity (parity error), crc\n"
+            "             (ends with a valid CRC_A)\n"
+            "  -F FLAGS   frames with none of FLAGS\n"
+            "  -l MIN:MAX  data bytes\n"
+            "  -s MIN:MAX  sessions (REQA/WUPA seen before the frame)\n"
+            "  -u UID     frames of the sessions that selected UID (4, 7 or 10\n"
+            "             bytes in hex), from the SELECT completing it on\n"
+            "Results (default: the frames as text):\n"
+            "  -c         the number of matching frames\n"
+            "  -G TIME    the number of matching frames per TIME bucket, in ns\n"
+            "             or with a suffix: bucket start (s from the start of\n"
+            "             the capture) and count\n"
+            "  -U         the number of matching frames per UID, - for the\n"
+            "             frames before a UID was selected; with -G, per UID\n"
+            "             and bucket\n"
+            OUTPUT_USAGE
+            "  -p         prefix the text frames with their start/end sample\n"
+            "  -B         report the scan speed on stderr\n",
+            name);
+}
+
+int
+main (int argc, char **argv)
+{
+    std::vector<const char *> output_specs;
+    const char *range_arg = NULL;
+    const char *bucket_arg = NULL;
+    const char *uid_arg = NULL;
+    bool count_only = false, per_uid = false, positions = false, bench = false;
+    store_filter filter;
+    frame_store_reader store;
+    int opt, status = 0;
+    uint64_t lo, hi;
+
+    while ((opt = getopt(argc, argv, "e:d:f:F:l:s:u:cG:Uo:pBh")) != -1) {
+        switch (opt) {
+        case 'e':
+            range_arg = optarg;
+            break;
+        case 'd':
+            if (!strcmp(optarg, "reader")) {
+                filter.dir_mask = 1 << NFC_READER;
+            } else if (!strcmp(optarg, "tag")) {
+                filter.dir_mask = 1 << NFC_TAG;
+            } else {
+                fprintf(stderr, "Bad direction %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+        case 'F':
+            if (!parse_flags(optarg, opt == 'f' ? &filter.flags_all : &filter.flags_none)) {
+                fprintf(stderr, "Bad flags %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'l':
+            lo = filter.len_min;
+            hi = filter.len_max;
+            if (!parse_bounds(optarg, &lo, &hi) || hi > filter.len_max) {
+                fprintf(stderr, "Bad length range %s\n", optarg);
+                return 1;
+            }
+            filter.len_min = uint16_t(lo);
+            filter.len_max = uint16_t(hi);
+            break;
+        case 's':
+            lo = filter.session_min;
+            hi = filter.session_max;
+            if (!parse_bounds(optarg, &lo, &hi) || hi > filter.session_max) {
+                fprintf(stderr, "Bad session range %s\n", optarg);
+                return 1;
+            }
+            filter.session_min = uint32_t(lo);
+            filter.session_max = uint32_t(hi);
+            break;
+        case 'u':
+            uid_arg = optarg;
+            break;
+        case 'c':
+            count_only = true;
+            break;
+        case 'G':
+            bucket_arg = optarg;
+            break;
+        case 'U':
+            per_uid = true;
+            break;
+        case 'o':
+            output_specs.push_back(optarg);
+            break;
+        case 'p':
+            positions = true;
+            break;
+        case 'B':
+            bench = true;
+            break;
+        case 'h':
+        case '?':
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!store.open(argv[optind])) {
+        return 1;
+    }
+
+    /* Times are ns from the start of the capture, parse_position at 1 GHz */
+    if (range_arg) {
+        uint64_t start, end;
+
+        if (!parse_range(range_arg, 1e9, &start, &end)) {
+            fprintf(stderr, "Bad range %s\n", range_arg);
+            return 1;
+        }
+        filter.time_min = store.start_time_ns() + int64_t(start);
+        if (end < uint64_t(INT64_MAX - store.start_time_ns())) {
+            filter.time_max = store.start_time_ns() + int64_t(end);
+        }
+    }
+
+    if (uid_arg) {
+        unsigned char uid[NFC_UID_MAX];
+        unsigned int len;
+
+        if (!nfc_parse_uid(uid_arg, uid, &len)) {
+            fprintf(stderr, "Bad UID %s, 4, 7 or 10 bytes in hex\n", uid_arg);
+            return 1;
+        }
+        filter.uid_min = filter.uid_max = store.find_uid(uid, len);
+        if (filter.uid_min == 0) {
+            /* Never selected, nothing matches */
+            filter.uid_min = 1;
+        }
+    }
+
+    uint64_t bucket = 0;
+    if (bucket_arg && (!parse_position(bucket_arg, 1e9, &bucket) || bucket == 0)) {
+        fprintf(stderr, "Bad bucket %s\n", bucket_arg);
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    uint64_t matched = 0;
+
+    if (count_only) {
+        matched = store.count(filter);
+        printf("%" PRIu64 "\n", matched);
+    } else if (bucket || per_uid) {
+        /* Counts per (uid entry, bucket), either left 0 when not asked for */
+        typedef std::pair<uint32_t, int64_t> group;
+        std::vector<uint64_t> rows(FRAME_STORE_CHUNK_ROWS);
+        std::map<group, uint64_t> groups;
+        const int64_t *time = store.time();
+        const uint32_t *uid = store.uid();
+
+        for (uint64_t c = 0; c < store.chunks(); c++) {
+            size_t n = store.select(filter, c, &rows[0]);
+
+            for (size_t i = 0; i < n; i++) {
+                int64_t b = 0;
+
+                if (bucket) {
+                    int64_t t = time[rows[i]] - store.start_time_ns();
+                    b = t >= 0 ? t / int64_t(bucket) : -((-t + int64_t(bucket) - 1) / int64_t(bucket));
+                }
+                groups[group(per_uid ? uid[rows[i]] : 0, b)]++;
+            }
+            matched += n;
+        }
+        for (std::map<group, uint64_t>::const_iterator it = groups.begin();
+             it != groups.end(); ++it) {
+            if (per_uid) {
+                print_uid(store, it->first.first);
+                fputs(" ", stdout);
+            }
+            if (bucket) {
+                printf("%.9f ", double(it->first.second) * bucket / 1e9);
+            }
+            printf("%" PRIu64 "\n", it->second);
+        }
+    } else {
+        std::vector<frame_output *> outputs;
+        std::vector<uint64_t> rows(FRAME_STORE_CHUNK_ROWS);
+        frame_tee out;
+        output_info info;
+
+        info.sample_rate = store.sample_rate();
+        info.start_time_ns = store.start_time_ns();
+        info.start_sample = store.start_sample();
+        info.positions = positions;
+
+        if (output_specs.empty()) {
+            output_specs.push_back("text:-");
+        }
+        for (size_t i = 0; i < output_specs.size(); i++) {
+            frame_output *output = open_frame_output(output_specs[i], info);
+
+            if (!output) {
+                return 1;
+            }
+            outputs.push_back(output);
+            out.add(output);
+        }
+
+        for (uint64_t c = 0; c < store.chunks(); c++) {
+            size_t n = store.select(filter, c, &rows[0]);
+
+            for (size_t i = 0; i < n; i++) {
+                nfc_frame frame;
+                int64_t time_ns;
+
+                store.frame(rows[i], &frame, &time_ns);
+                out.write(frame);
+            }
+            matched += n;
+        }
+
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (!outputs[i]->close()) {
+                status = 1;
+            }
+            delete outputs[i];
+        }
+    }
+
+    if (bench) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        fprintf(stderr, "%" PRIu64 " of %" PRIu64 " frames in %.3f s, %.0f Mframes/s\n",
+                matched, store.rows(), elapsed, store.rows() / elapsed / 1e6);
+    }
+
+    return status;
+}
@@ -0,0 +1,168 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * nfc_tail: follows the frames nfc_decode -o shm:NAME publishes and
+ * writes them to any of the frame outputs. Each nfc_tail has its own
+ * cursor in the ring; one that falls behind loses the oldest frames
+ * (reported with -v) and never slows the decoder down.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <inttypes.h>
+#include <unistd.h>
+#include "frame_output.h"
+#include "frame_ring.h"
+
+/* Wait between two polls of an empty ring */
+#define TAIL_POLL_US                    1000
+
+using namespace gr::nfc;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void
+request_stop (int)
+{
+    stop_requested = 1;
+}
+
+static void
+usage (const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] NAME\n"
+            "  NAME       ring published by nfc_decode -o shm:NAME\n"
+            OUTPUT_USAGE
+            ROTATION_USAGE
+            "  -p         prefix the text frames with their start/end sample\n"
+            "  -a         start from the oldest frame still in the ring instead\n"
+            "             of the next one published\n"
+            "  -v         report the frames lost to overruns on stderr\n",
+            name);
+}
+
+int
+main (int argc, char **argv)
+{
+    std::vector<const char *> output_specs;
+    std::vector<frame_output *> outputs;
+    bool positions = false, oldest = false, verbose = false;
+    frame_ring_reader ring;
+    frame_tee out;
+    rotation_config rotation;
+    uint64_t frames = 0;
+    int opt, status = 0;
+
+    while ((opt = getopt(argc, argv, ROTATION_OPTIONS "o:pavh")) != -1) {
+        switch (opt) {
+        case 'o':
+            output_specs.push_back(optarg);
+            break;
+        case 'p':
+            positions = true;
+            break;
+        case 'a':
+            oldest = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'Z':
+        case 'Y':
+        case 'F':
+            if (!rotation.parse_option(opt, optarg)) {
+                return 1;
+            }
+            break;
+        case 'h':
+        case '?':
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!ring.open(argv[optind], oldest)) {
+        return 1;
+    }
+
+    output_info info;
+    info.sample_rate = ring.sample_rate();
+    info.start_time_ns = ring.start_time_ns();
+    info.start_sample = ring.start_sample();
+    info.positions = positions;
+
+    if (output_specs.empty()) {
+        output_specs.push_back("text:-");
+    }
+    for (size_t i = 0; i < output_specs.size(); i++) {
+        frame_output *output = open_frame_output(output_specs[i], info, rotation);
+
+        if (!output) {
+            return 1;
+        }
+        outputs.push_back(output);
+        out.add(output);
+    }
+
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+
+    while (!stop_requested) {
+        nfc_frame frame;
+        int64_t time_ns;
+        frame_ring_reader::ring_status s = ring.next(&frame, &time_ns);
+
+        if (s == frame_ring_reader::RING_FRAME) {
+            out.write(frame);
+            frames++;
+        } else if (s == frame_ring_reader::RING_CLOSED) {
+            break;
+        } else {
+            /* Caught up: let the readers of the outputs see it */
+            out.flush();
+            usleep(TAIL_POLL_US);
+        }
+    }
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (!outputs[i]->close()) {
+            status = 1;
+        }
+        delete outputs[i];
+    }
+
+    if (verbose) {
+        fprintf(stderr, "%" PRIu64 " frames, %" PRIu64 " lost to overruns\n",
+                frames, ring.dropped());
+    }
+
+    return status;
+}
@@ -0,0 +1,455 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "nfcb.h"
+
+/* Write buffer of the file, the data is written sequentially */
+#define NFCB_WRITE_BUFFER               (1 << 20)
+
+namespace gr {
+  namespace nfc {
+
+    void
+    nfcb_put_le (unsigned char *p, uint64_t v, int n)
+    {
+        for (int i = 0; i < n; i++) {
+            p[i] = (unsigned char) (v >> (8 * i));
+        }
+    }
+
+    uint64_t
+    nfcb_get_le (const unsigned char *p, int n)
+    {
+        uint64_t v = 0;
+
+        for (int i = n - 1; i >= 0; i--) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    static uint64_t
+    double_bits (double d)
+    {
+        uint64_t v;
+
+        memcpy(&v, &d, sizeof(v));
+        return v;
+    }
+
+    static double
+    bits_double (uint64_t v)
+    {
+        double d;
+
+        memcpy(&d, &v, sizeof(d));
+        return d;
+    }
+
+    static uint32_t
+    float_bits (float f)
+    {
+        uint32_t v;
+
+        memcpy(&v, &f, sizeof(v));
+        return v;
+    }
+
+    static float
+    bits_float (uint32_t v)
+    {
+        float f;
+
+        memcpy(&f, &v, sizeof(f));
+        return f;
+    }
+
+    void
+    nfcb_put_header (unsigned char *out, const char *magic, const nfcb_header &header)
+    {
+        const nfcb_info &info = header.info;
+
+        memset(out, 0, NFCB_HEADER_SIZE);
+        memcpy(out, magic, 8);
+        nfcb_put_le(out + 8, NFCB_VERSION, 4);
+        nfcb_put_le(out + 12, NFCB_HEADER_SIZE, 4);
+        nfcb_put_le(out + 16, double_bits(info.sample_rate), 8);
+        nfcb_put_le(out + 24, double_bits(info.center_freq), 8);
+        nfcb_put_le(out + 32, uint64_t(info.start_time_ns), 8);
+        nfcb_put_le(out + 40, header.nsamples, 8);
+        nfcb_put_le(out + 48, header.data_offset, 8);
+        nfcb_put_le(out + 56, header.index_offset, 8);
+        nfcb_put_le(out + 64, header.index_count, 8);
+        nfcb_put_le(out + 72, info.index_interval, 4);
+        out[76] = info.direction;
+        out[77] = (unsigned char) info.slicer.type;
+        nfcb_put_le(out + 80, float_bits(info.slicer.a), 4);
+        nfcb_put_le(out + 84, float_bits(info.slicer.b), 4);
+        nfcb_put_le(out + 88, uint32_t(info.slicer.window), 4);
+    }
+
+    bool
+    nfcb_get_header (const unsigned char *in, uint64_t size, const char *magic,
+                     nfcb_header *header)
+    {
+        nfcb_info &info = header->info;
+
+        if (size < NFCB_HEADER_SIZE || memcmp(in, magic, 8) != 0 ||
+            nfcb_get_le(in + 8, 4) != NFCB_VERSION) {
+            return false;
+        }
+
+        info.sample_rate = bits_double(nfcb_get_le(in + 16, 8));
+        info.center_freq = bits_double(nfcb_get_le(in + 24, 8));
+        info.start_time_ns = int64_t(nfcb_get_le(in + 32, 8));
+        header->nsamples = nfcb_get_le(in + 40, 8);
+        header->data_offset = nfcb_get_le(in + 48, 8);
+        header->index_offset = nfcb_get_le(in + 56, 8);
+        header->index_count = nfcb_get_le(in + 64, 8);
+        info.index_interval = uint32_t(nfcb_get_le(in + 72, 4));
+        info.direction = in[76];
+        info.slicer.type = slicer_type(in[77]);
+        info.slicer.a = bits_float(uint32_t(nfcb_get_le(in + 80, 4)));
+        info.slicer.b = bits_float(uint32_t(nfcb_get_le(in + 84, 4)));
+        info.slicer.window = int(nfcb_get_le(in + 88, 4));
+
+        return header->data_offset <= size && header->index_offset <= size;
+    }
+
+    nfcb_writer::nfcb_writer()
+      : d_fp(NULL),
+        d_nsamples(0),
+        d_byte(0),
+        d_last(0)
+    {
+    }
+
+    nfcb_writer::~nfcb_writer()
+    {
+        close();
+    }
+
+    bool
+    nfcb_writer::open(const char *path, const nfcb_info &info, uint64_t offset)
+    {
+        unsigned char header[NFCB_HEADER_SIZE];
+        nfcb_index_entry first = { 0, offset };
+
+        d_fp = fopen(path, "wb");
+        if (!d_fp) {
+            perror(path);
+            return false;
+        }
+        setvbuf(d_fp, NULL, _IOFBF, NFCB_WRITE_BUFFER);
+
+        d_info = info;
+        if (d_info.index_interval == 0) {
+            d_info.index_interval = NFCB_INDEX_INTERVAL;
+        }
+        d_segments.assign(1, first);
+        d_nsamples = 0;
+        d_byte = 0;
+        d_last = 0;
+
+        /* Rewritten by close() */
+        memset(header, 0, sizeof(header));
+        fwrite(header, 1, sizeof(header), d_fp);
+
+        return true;
+    }
+
+    inline void
+    nfcb_writer::put_byte(unsigned char byte)
+    {
+        putc(byte, d_fp);
+        d_nsamples += 8;
+        d_last = byte & 1;
+    }
+
+    inline void
+    nfcb_writer::put_bit(unsigned char bit)
+    {
+        int n = int(d_nsamples & 7);
+
+        d_byte |= bit << (7 - n);
+        d_nsamples++;
+        d_last = bit;
+
+        if (n == 7) {
+            putc(d_byte, d_fp);
+            d_byte = 0;
+        }
+    }
+
+    void
+    nfcb_writer::write(const unsigned char *in, int n)
+    {
+        int i = 0;
+
+        while (i < n && (d_nsamples & 7) != 0) {
+            put_bit(in[i++] > 0);
+        }
+        for (; i + 8 <= n; i += 8) {
+            unsigned char byte = 0;
+
+            for (int j = 0; j < 8; j++) {
+                byte = (byte << 1) | (in[i + j] > 0);
+            }
+            put_byte(byte);
+        }
+        while (i < n) {
+            put_bit(in[i++] > 0);
+        }
+    }
+
+    void
+    nfcb_writer::write_packed(const unsigned char *in, int nbytes)
+    {
+        if ((d_nsamples & 7) == 0) {
+            if (nbytes > 0) {
+                fwrite(in, 1, nbytes, d_fp);
+                d_nsamples += 8 * uint64_t(nbytes);
+                d_last = in[nbytes - 1] & 1;
+            }
+            return;
+        }
+
+        for (int i = 0; i < nbytes; i++) {
+            for (int j = 7; j >= 0; j--) {
+                put_bit((in[i] >> j) & 1);
+            }
+        }
+    }
+
+    void
+    nfcb_writer::write_run(unsigned char level, uint64_t length)
+    {
+        level = level ? 1 : 0;
+
+        while (length > 0 && (d_nsamples & 7) != 0) {
+            put_bit(level);
+            length--;
+        }
+        for (; length >= 8; length -= 8) {
+            put_byte(level ? 0xff : 0x00);
+        }
+        while (length > 0) {
+            put_bit(level);
+            length--;
+        }
+    }
+
+    void
+    nfcb_writer::discontinuity(uint64_t offset)
+    {
+        nfcb_index_entry entry;
+
+        /* Segments start on a byte, extend the last one with its level */
+        write_run(d_last, (8 - (d_nsamples & 7)) & 7);
+
+        entry.sample = d_nsamples;
+        entry.offset = offset;
+        if (d_segments.back().sample == d_nsamples) {
+            d_segments.back() = entry;
+        } else {
+            d_segments.push_back(entry);
+        }
+    }
+
+    bool
+    nfcb_writer::close()
+    {
+        unsigned char out[NFCB_HEADER_SIZE];
+        unsigned char entry[16];
+        nfcb_header header;
+        uint64_t data_offset = NFCB_HEADER_SIZE;
+        uint64_t index_offset, count = 0;
+        bool ok;
+
+        if (!d_fp) {
+            return true;
+        }
+
+        write_run(d_last, (8 - (d_nsamples & 7)) & 7);
+        index_offset = data_offset + d_nsamples / 8;
+
+        /* Segment starts, plus every interval within the segments */
+        for (size_t s = 0; s < d_segments.size(); s++) {
+            uint64_t end = s + 1 < d_segments.size() ? d_segments[s + 1].sample : d_nsamples;
+            uint64_t sample = d_segments[s].sample;
+
+            do {
+                nfcb_put_le(entry, sample, 8);
+                nfcb_put_le(entry + 8, d_segments[s].offset + (sample - d_segments[s].sample), 8);
+                fwrite(entry, 1, sizeof(entry), d_fp);
+                count++;
+                sample = (sample / d_info.index_interval + 1) * d_info.index_interval;
+            } while (sample < end);
+        }
+
+        header.info = d_info;
+        header.nsamples = d_nsamples;
+        header.data_offset = data_offset;
+        header.index_offset = index_offset;
+        header.index_count = count;
+        nfcb_put_header(out, NFCB_MAGIC, header);
+
+        fseek(d_fp, 0, SEEK_SET);
+        fwrite(out, 1, sizeof(out), d_fp);
+
+        ok = !ferror(d_fp);
+        ok = (fclose(d_fp) == 0) && ok;
+        d_fp = NULL;
+
+        return ok;
+    }
+
+    nfcb_reader::nfcb_reader()
+      : d_nsamples(0),
+        d_data(NULL)
+    {
+        memset(&d_info, 0, sizeof(d_info));
+    }
+
+    bool
+    nfcb_reader::open(const char *path)
+    {
+        const unsigned char *p;
+        uint64_t size, data_offset, index_offset, count;
+        const void *view;
+        nfcb_header header;
+
+        if (!d_file.open(path) || !d_file.mapped()) {
+            fprintf(stderr, "%s: %s\n", path, errno ? strerror(errno) : "not a regular file");
+            return false;
+        }
+
+        size = d_file.size();
+        d_file.next(&view, size_t(size));
+        p = (const unsigned char *) view;
+
+        if (!nfcb_get_header(p, size, NFCB_MAGIC, &header)) {
+            fprintf(stderr, "%s: not a version %d .nfcb file\n", path, NFCB_VERSION);
+            return false;
+        }
+
+        d_info = header.info;
+        d_nsamples = header.nsamples;
+        data_offset = header.data_offset;
+        index_offset = header.index_offset;
+        count = header.index_count;
+
+        if ((d_nsamples & 7) || d_nsamples / 8 > size - data_offset ||
+            count == 0 || count > (size - index_offset) / 16) {
+            fprintf(stderr, "%s: truncated .nfcb file\n", path);
+            return false;
+        }
+
+        d_data = p + data_offset;
+        d_index.resize(count);
+        for (uint64_t i = 0; i < count; i++) {
+            d_index[i].sample = nfcb_get_le(p + index_offset + 16 * i, 8);
+            d_index[i].offset = nfcb_get_le(p + index_offset + 16 * i + 8, 8);
+        }
+
+        return true;
+    }
+
+    bool
+    nfcb_reader::contiguous() const
+    {
+        for (size_t i = 1; i < d_index.size(); i++) {
+            if (d_index[i].offset - d_index[0].offset != d_index[i].sample - d_index[0].sample) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static bool
+    by_sample (const nfcb_index_entry &a, const nfcb_index_entry &b)
+    {
+        return a.sample < b.sample;
+    }
+
+    uint64_t
+    nfcb_reader::offset_of(uint64_t sample) const
+    {
+        nfcb_index_entry key = { sample, 0 };
+        std::vector<nfcb_index_entry>::const_iterator it =
+            std::upper_bound(d_index.begin(), d_index.end(), key, by_sample);
+
+        --it;
+        return it->offset + (sample - it->sample);
+    }
+
+    uint64_t
+    nfcb_reader::segment_end(uint64_t sample) const
+    {
+        nfcb_index_entry key = { sample, 0 };
+        std::vector<nfcb_index_entry>::const_iterator it =
+            std::upper_bound(d_index.begin(), d_index.end(), key, by_sample);
+
+        for (; it != d_index.end(); ++it) {
+            const nfcb_index_entry &prev = *(it - 1);
+
+            if (it->offset - prev.offset != it->sample - prev.sample) {
+                return it->sample;
+            }
+        }
+
+        return d_nsamples;
+    }
+
+    uint64_t
+    nfcb_reader::sample_at(uint64_t offset) const
+    {
+        /* Offsets only grow along the file, first entry past offset */
+        size_t lo = 0, hi = d_index.size();
+
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+
+            if (d_index[mid].offset <= offset) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo == 0) {
+            return 0;
+        }
+
+        /* Within the segment of the entry before, or at the next entry */
+        const nfcb_index_entry &e = d_index[lo - 1];
+        uint64_t end = lo < d_index.size() ? d_index[lo].sample : d_nsamples;
+
+        return std::min(e.sample + (offset - e.offset), end);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,181 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_NFCB_H
+#define INCLUDED_NFC_NFCB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "capture_file.h"
+#include "decode_pipeline.h"
+
+/*
+ * .nfcb packed capture: the sliced samples, one bit each.
+ *
+ *   header     NFCB_HEADER_SIZE bytes, little endian:
+ *                0  magic "NFCBITS1"
+ *                8  u32 version, u32 header size
+ *               16  f64 sample rate, f64 center frequency (Hz)
+ *               32  i64 start time (ns since the epoch of absolute offset 0,
+ *                   0 if unknown)
+ *               40  u64 samples, u64 data offset, u64 index offset,
+ *                   u64 index entries
+ *               72  u32 index interval (samples)
+ *               76  u8 direction, u8 slicer type, u16 reserved
+ *               80  f32 slicer a, f32 slicer b, i32 slicer window
+ *   data       samples / 8 bytes, first sample in the MSB
+ *   index      (u64 sample, u64 absolute offset) pairs, sorted: the first
+ *              sample, every index interval and every discontinuity
+ *
+ * The absolute offset of a sample is the one of the last index entry at
+ * or before it, plus the distance to it. Discontinuities (a recording
+ * restarted, an excerpt) and the end are always on a byte boundary: the
+ * writer extends the last sample before them.
+ */
+#define NFCB_MAGIC                      "NFCBITS1"
+#define NFCB_VERSION                    1
+#define NFCB_HEADER_SIZE                128
+#define NFCB_INDEX_INTERVAL             (1 << 20)
+
+namespace gr {
+  namespace nfc {
+
+    struct nfcb_info
+    {
+        double sample_rate;
+        double center_freq;
+        int64_t start_time_ns;
+        unsigned char direction;        /* nfc_direction */
+        slicer_config slicer;           /* How the samples were sliced */
+        uint32_t index_interval;
+    };
+
+    /*! The header fields, .nfcr uses the same header with its own magic */
+    struct nfcb_header
+    {
+        nfcb_info info;
+        uint64_t nsamples;
+        uint64_t data_offset;
+        uint64_t index_offset;
+        uint64_t index_count;
+    };
+
+    /*! Serialize \p header in NFCB_HEADER_SIZE bytes */
+    void nfcb_put_header(unsigned char *out, const char *magic, const nfcb_header &header);
+
+    /*! Parse and check the header of a \p size bytes file, false if invalid */
+    bool nfcb_get_header(const unsigned char *in, uint64_t size, const char *magic,
+                         nfcb_header *header);
+
+    /* Little endian fields of \p n bytes */
+    void nfcb_put_le(unsigned char *p, uint64_t v, int n);
+    uint64_t nfcb_get_le(const unsigned char *p, int n);
+
+    struct nfcb_index_entry
+    {
+        uint64_t sample;
+        uint64_t offset;
+    };
+
+    /*!
+     * \brief Streaming .nfcb writer, the index is kept in memory (16 bytes
+     * per interval) and written by close().
+     */
+    class nfcb_writer
+    {
+     public:
+      nfcb_writer();
+      ~nfcb_writer();
+
+      /*! Create \p path, the first sample is at absolute \p offset */
+      bool open(const char *path, const nfcb_info &info, uint64_t offset = 0);
+
+      /*! One sample per byte, high if > 0 */
+      void write(const unsigned char *in, int n);
+
+      /*! 8 samples per byte, first sample in the MSB */
+      void write_packed(const unsigned char *in, int nbytes);
+
+      /*! \p length samples at \p level */
+      void write_run(unsigned char level, uint64_t length);
+
+      /*! The next sample is at absolute \p offset */
+      void discontinuity(uint64_t offset);
+
+      /*! Pad to a byte, write the index and the final header */
+      bool close();
+
+      uint64_t nsamples() const { return d_nsamples; }
+
+     private:
+      void put_bit(unsigned char bit);
+      void put_byte(unsigned char byte);
+
+      FILE *d_fp;
+      nfcb_info d_info;
+      std::vector<nfcb_index_entry> d_segments;
+      uint64_t d_nsamples;
+      unsigned char d_byte;
+      unsigned char d_last;
+    };
+
+    /*!
+     * \brief .nfcb reader, the data is a view of the mapped file
+     */
+    class nfcb_reader
+    {
+     public:
+      nfcb_reader();
+
+      /*! False with a message on error */
+      bool open(const char *path);
+
+      const nfcb_info &info() const { return d_info; }
+      uint64_t nsamples() const { return d_nsamples; }
+      uint64_t size() const { return d_file.size(); }
+      const unsigned char *data() const { return d_data; }
+      const std::vector<nfcb_index_entry> &index() const { return d_index; }
+
+      /*! True if the samples have consecutive absolute offsets */
+      bool contiguous() const;
+
+      /*! Absolute offset of \p sample, by binary search in the index */
+      uint64_t offset_of(uint64_t sample) const;
+
+      /*!
+       * First sample at or after absolute \p offset (nsamples() if none),
+       * by binary search in the index.
+       */
+      uint64_t sample_at(uint64_t offset) const;
+
+      /*! First sample after the segment holding \p sample */
+      uint64_t segment_end(uint64_t sample) const;
+
+     private:
+      capture_file d_file;
+      nfcb_info d_info;
+      uint64_t d_nsamples;
+      const unsigned char *d_data;
+      std::vector<nfcb_index_entry> d_index;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_NFCB_H */
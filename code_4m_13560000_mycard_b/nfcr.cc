@@ -0,0 +1,427 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "nfcr.h"
+
+/* Write buffer of the file, the data is written sequentially */
+#define NFCR_WRITE_BUFFER               (1 << 20)
+
+namespace gr {
+  namespace nfc {
+
+    nfcr_writer::nfcr_writer()
+      : d_fp(NULL),
+        d_nsamples(0),
+        d_offset(0),
+        d_bytes(0),
+        d_length(0),
+        d_level(0),
+        d_new_block(true)
+    {
+    }
+
+    nfcr_writer::~nfcr_writer()
+    {
+        close();
+    }
+
+    bool
+    nfcr_writer::open(const char *path, const nfcb_info &info, uint64_t offset)
+    {
+        unsigned char header[NFCB_HEADER_SIZE];
+
+        d_fp = fopen(path, "wb");
+        if (!d_fp) {
+            perror(path);
+            return false;
+        }
+        setvbuf(d_fp, NULL, _IOFBF, NFCR_WRITE_BUFFER);
+
+        d_info = info;
+        if (d_info.index_interval == 0) {
+            d_info.index_interval = NFCR_BLOCK_SAMPLES;
+        }
+        d_blocks.clear();
+        d_nsamples = 0;
+        d_offset = offset;
+        d_bytes = 0;
+        d_length = 0;
+        d_level = 0;
+        d_new_block = true;
+
+        /* Rewritten by close() */
+        memset(header, 0, sizeof(header));
+        fwrite(header, 1, sizeof(header), d_fp);
+
+        return true;
+    }
+
+    void
+    nfcr_writer::emit()
+    {
+        unsigned char buf[10];
+        uint64_t v = d_length;
+        int n = 0;
+
+        if (d_length == 0) {
+            return;
+        }
+
+        if (d_new_block || d_nsamples - d_blocks.back().sample >= d_info.index_interval) {
+            nfcr_block block;
+
+            block.sample = d_nsamples;
+            block.offset = d_offset;
+            block.byte = d_bytes;
+            block.level = d_level;
+            d_blocks.push_back(block);
+            d_new_block = false;
+        }
+
+        do {
+            buf[n++] = (unsigned char) ((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+            v >>= 7;
+        } while (v);
+        fwrite(buf, 1, n, d_fp);
+
+        d_bytes += n;
+        d_nsamples += d_length;
+        d_offset += d_length;
+        d_length = 0;
+    }
+
+    void
+    nfcr_writer::write_run(unsigned char level, uint64_t length)
+    {
+        level = level ? 1 : 0;
+
+        if (length == 0) {
+            return;
+        }
+        if (level != d_level) {
+            emit();
+            d_level = level;
+        }
+        d_length += length;
+    }
+
+    void
+    nfcr_writer::write(const unsigned char *in, int n)
+    {
+        int i = 0;
+
+        while (i < n) {
+            unsigned char level = in[i] > 0;
+            int j = i + 1;
+
+            while (j < n && (in[j] > 0) == level) {
+                j++;
+            }
+            write_run(level, j - i);
+            i = j;
+        }
+    }
+
+    void
+    nfcr_writer::write_packed(const unsigned char *in, int nbytes)
+    {
+        for (int i = 0; i < nbytes; i++) {
+            unsigned char byte = in[i];
+
+            if (byte == 0x00 || byte == 0xff) {
+                write_run(byte & 1, 8);
+                continue;
+            }
+
+            for (int j = 7; j >= 0; j--) {
+                write_run((byte >> j) & 1, 1);
+            }
+        }
+    }
+
+    void
+    nfcr_writer::discontinuity(uint64_t offset)
+    {
+        emit();
+        d_offset = offset;
+        d_new_block = true;
+    }
+
+    bool
+    nfcr_writer::close()
+    {
+        unsigned char out[NFCB_HEADER_SIZE];
+        unsigned char entry[NFCR_INDEX_ENTRY_SIZE];
+        nfcb_header header;
+        bool ok;
+
+        if (!d_fp) {
+            return true;
+        }
+
+        emit();
+
+        memset(entry, 0, sizeof(entry));
+        for (size_t b = 0; b < d_blocks.size(); b++) {
+            nfcb_put_le(entry, d_blocks[b].sample, 8);
+            nfcb_put_le(entry + 8, d_blocks[b].offset, 8);
+            nfcb_put_le(entry + 16, d_blocks[b].byte, 8);
+            entry[24] = d_blocks[b].level;
+            fwrite(entry, 1, sizeof(entry), d_fp);
+        }
+
+        header.info = d_info;
+        header.nsamples = d_nsamples;
+        header.data_offset = NFCB_HEADER_SIZE;
+        header.index_offset = NFCB_HEADER_SIZE + d_bytes;
+        header.index_count = d_blocks.size();
+        nfcb_put_header(out, NFCR_MAGIC, header);
+
+        fseek(d_fp, 0, SEEK_SET);
+        fwrite(out, 1, sizeof(out), d_fp);
+
+        ok = !ferror(d_fp);
+        ok = (fclose(d_fp) == 0) && ok;
+        d_fp = NULL;
+
+        return ok;
+    }
+
+    nfcr_reader::nfcr_reader()
+      : d_nsamples(0),
+        d_data_size(0),
+        d_data(NULL)
+    {
+        memset(&d_info, 0, sizeof(d_info));
+    }
+
+    bool
+    nfcr_reader::open(const char *path)
+    {
+        const unsigned char *p;
+        uint64_t size;
+        const void *view;
+        nfcb_header header;
+
+        if (!d_file.open(path) || !d_file.mapped()) {
+            fprintf(stderr, "%s: %s\n", path, errno ? strerror(errno) : "not a regular file");
+            return false;
+        }
+
+        size = d_file.size();
+        d_file.next(&view, size_t(size));
+        p = (const unsigned char *) view;
+
+        if (!nfcb_get_header(p, size, NFCR_MAGIC, &header)) {
+            fprintf(stderr, "%s: not a version %d .nfcr file\n", path, NFCB_VERSION);
+            return false;
+        }
+
+        if (header.index_offset < header.data_offset ||
+            header.index_count > (size - header.index_offset) / NFCR_INDEX_ENTRY_SIZE) {
+            fprintf(stderr, "%s: truncated .nfcr file\n", path);
+            return false;
+        }
+
+        d_info = header.info;
+        d_nsamples = header.nsamples;
+        d_data = p + header.data_offset;
+        d_data_size = header.index_offset - header.data_offset;
+
+        d_blocks.resize(header.index_count);
+        for (size_t b = 0; b < d_blocks.size(); b++) {
+            const unsigned char *e = p + header.index_offset + NFCR_INDEX_ENTRY_SIZE * b;
+
+            d_blocks[b].sample = nfcb_get_le(e, 8);
+            d_blocks[b].offset = nfcb_get_le(e + 8, 8);
+            d_blocks[b].byte = std::min(nfcb_get_le(e + 16, 8), d_data_size);
+            d_blocks[b].level = e[24] ? 1 : 0;
+        }
+
+        return true;
+    }
+
+    static bool
+    by_sample (const nfcr_block &a, const nfcr_block &b)
+    {
+        return a.sample < b.sample;
+    }
+
+    size_t
+    nfcr_reader::block_of(uint64_t sample) const
+    {
+        nfcr_block key;
+
+        key.sample = sample;
+        size_t b = std::upper_bound(d_blocks.begin(), d_blocks.end(), key, by_sample) - d_blocks.begin();
+
+        return b > 0 ? b - 1 : 0;
+    }
+
+    uint64_t
+    nfcr_reader::offset_of(uint64_t sample) const
+    {
+        if (d_blocks.empty()) {
+            return sample;
+        }
+
+        const nfcr_block &b = d_blocks[block_of(sample)];
+        return b.offset + (sample - b.sample);
+    }
+
+    uint64_t
+    nfcr_reader::sample_at(uint64_t offset) const
+    {
+        /* Blocks are contiguous inside, same search as nfcb_reader */
+        size_t lo = 0, hi = d_blocks.size();
+
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+
+            if (d_blocks[mid].offset <= offset) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        if (lo == 0) {
+            return 0;
+        }
+
+        const nfcr_block &b = d_blocks[lo - 1];
+        uint64_t end = lo < d_blocks.size() ? d_blocks[lo].sample : d_nsamples;
+
+        return std::min(b.sample + (offset - b.offset), end);
+    }
+
+    const unsigned char *
+    nfcr_reader::block_end(size_t b) const
+    {
+        uint64_t end = b + 1 < d_blocks.size() ? d_blocks[b + 1].byte : d_data_size;
+
+        return d_data + std::max(end, d_blocks[b].byte);
+    }
+
+    nfcr_cursor::nfcr_cursor(const nfcr_reader &reader)
+      : d_reader(reader)
+    {
+        seek(0);
+    }
+
+    bool
+    nfcr_cursor::load(size_t block)
+    {
+        d_block = block;
+        if (block >= d_reader.blocks().size()) {
+            d_p = d_end = NULL;
+            d_sample = d_reader.nsamples();
+            return false;
+        }
+
+        const nfcr_block &b = d_reader.blocks()[block];
+        d_p = d_reader.block_data(block);
+        d_end = d_reader.block_end(block);
+        d_sample = b.sample;
+        d_offset = b.offset;
+        d_level = b.level;
+
+        return true;
+    }
+
+    inline bool
+    nfcr_cursor::read_length(uint64_t *length)
+    {
+        uint64_t v = 0;
+        int shift = 0;
+
+        while (d_p < d_end && shift < 64) {
+            unsigned char c = *d_p++;
+
+            v |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80)) {
+                *length = v;
+                return v > 0;
+            }
+            shift += 7;
+        }
+
+        /* Truncated or corrupted block, skip its end */
+        d_p = d_end;
+        return false;
+    }
+
+    void
+    nfcr_cursor::seek(uint64_t sample)
+    {
+        d_skip = 0;
+        if (!load(d_reader.block_of(sample))) {
+            return;
+        }
+
+        /* Skip the whole runs before the sample */
+        while (d_p < d_end) {
+            const unsigned char *p = d_p;
+            uint64_t length;
+
+            if (!read_length(&length)) {
+                break;
+            }
+            if (d_sample + length > sample) {
+                d_p = p;
+                d_skip = std::max(sample, d_sample) - d_sample;
+                return;
+            }
+            d_sample += length;
+            d_offset += length;
+            d_level ^= 1;
+        }
+    }
+
+    bool
+    nfcr_cursor::next(nfcr_run *run)
+    {
+        uint64_t length;
+
+        while (d_p == d_end || !read_length(&length)) {
+            if (!load(d_block + 1)) {
+                return false;
+            }
+        }
+
+        run->offset = d_offset + d_skip;
+        run->length = length - d_skip;
+        run->level = d_level;
+
+        d_sample += length;
+        d_offset += length;
+        d_level ^= 1;
+        d_skip = 0;
+
+        return true;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
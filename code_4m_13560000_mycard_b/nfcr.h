@@ -0,0 +1,183 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_NFCR_H
+#define INCLUDED_NFC_NFCR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "capture_file.h"
+#include "nfcb.h"
+
+/*
+ * .nfcr run-length capture: the sliced samples as runs of constant level.
+ *
+ *   header     the .nfcb header (nfcb.h) with the "NFCRUNS1" magic, the
+ *              index interval is the block length in samples
+ *   data       blocks of run lengths, LEB128 varints. Levels alternate
+ *              within a block, the index gives the first one.
+ *   index      one 32-byte entry per block, sorted: u64 first sample,
+ *              u64 its absolute offset, u64 data byte offset (from the
+ *              data start), u8 level of the first run, 7 reserved bytes
+ *
+ * A block starts at the first run boundary past the block length, and
+ * at every discontinuity. Reading can then start at any block, and a
+ * 20 ms idle field is one byte or three.
+ */
+#define NFCR_MAGIC                      "NFCRUNS1"
+#define NFCR_BLOCK_SAMPLES              (1 << 20)
+#define NFCR_INDEX_ENTRY_SIZE           32
+
+namespace gr {
+  namespace nfc {
+
+    struct nfcr_block
+    {
+        uint64_t sample;
+        uint64_t offset;
+        uint64_t byte;
+        unsigned char level;
+    };
+
+    /*! One run, \p offset is the absolute position of its first sample */
+    struct nfcr_run
+    {
+        uint64_t offset;
+        uint64_t length;
+        unsigned char level;
+    };
+
+    /*!
+     * \brief Streaming .nfcr encoder, same interface as nfcb_writer. The
+     * run in progress is held until the level changes, the block index is
+     * kept in memory and written by close().
+     */
+    class nfcr_writer
+    {
+     public:
+      nfcr_writer();
+      ~nfcr_writer();
+
+      /*! Create \p path, the first sample is at absolute \p offset */
+      bool open(const char *path, const nfcb_info &info, uint64_t offset = 0);
+
+      /*! One sample per byte, high if > 0 */
+      void write(const unsigned char *in, int n);
+
+      /*! 8 samples per byte, first sample in the MSB */
+      void write_packed(const unsigned char *in, int nbytes);
+
+      /*! \p length samples at \p level */
+      void write_run(unsigned char level, uint64_t length);
+
+      /*! The next sample is at absolute \p offset */
+      void discontinuity(uint64_t offset);
+
+      /*! Write the last run, the index and the final header */
+      bool close();
+
+      uint64_t nsamples() const { return d_nsamples + d_length; }
+
+     private:
+      void emit();
+
+      FILE *d_fp;
+      nfcb_info d_info;
+      std::vector<nfcr_block> d_blocks;
+      uint64_t d_nsamples;      /* Samples of the emitted runs */
+      uint64_t d_offset;        /* Absolute offset of the run in progress */
+      uint64_t d_bytes;         /* Data bytes written */
+      uint64_t d_length;        /* Run in progress */
+      unsigned char d_level;
+      bool d_new_block;
+    };
+
+    /*!
+     * \brief .nfcr reader, the data is a view of the mapped file
+     */
+    class nfcr_reader
+    {
+     public:
+      nfcr_reader();
+
+      /*! False with a message on error */
+      bool open(const char *path);
+
+      const nfcb_info &info() const { return d_info; }
+      uint64_t nsamples() const { return d_nsamples; }
+      uint64_t size() const { return d_file.size(); }
+      const std::vector<nfcr_block> &blocks() const { return d_blocks; }
+
+      /*! Block holding \p sample, by binary search in the index */
+      size_t block_of(uint64_t sample) const;
+
+      /*! Absolute offset of \p sample */
+      uint64_t offset_of(uint64_t sample) const;
+
+      /*! First sample at or after absolute \p offset (nsamples() if none) */
+      uint64_t sample_at(uint64_t offset) const;
+
+      /*! Data of block \p b and its end */
+      const unsigned char *block_data(size_t b) const { return d_data + d_blocks[b].byte; }
+      const unsigned char *block_end(size_t b) const;
+
+     private:
+      capture_file d_file;
+      nfcb_info d_info;
+      uint64_t d_nsamples;
+      uint64_t d_data_size;
+      const unsigned char *d_data;
+      std::vector<nfcr_block> d_blocks;
+    };
+
+    /*!
+     * \brief Walks the runs of a .nfcr reader from any sample
+     */
+    class nfcr_cursor
+    {
+     public:
+      nfcr_cursor(const nfcr_reader &reader);
+
+      /*! Next run starts at \p sample, possibly within a run */
+      void seek(uint64_t sample);
+
+      /*! False at the end of the data */
+      bool next(nfcr_run *run);
+
+      /*! Sample the next run starts at */
+      uint64_t sample() const { return d_sample + d_skip; }
+
+     private:
+      bool load(size_t block);
+      bool read_length(uint64_t *length);
+
+      const nfcr_reader &d_reader;
+      size_t d_block;
+      const unsigned char *d_p;
+      const unsigned char *d_end;
+      uint64_t d_sample;
+      uint64_t d_offset;
+      uint64_t d_skip;          /* Samples of the next run before the seek point */
+      unsigned char d_level;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_NFCR_H */
@@ -0,0 +1,65 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_PACKED_CAPTURE_SOURCE_H
+#define INCLUDED_NFC_PACKED_CAPTURE_SOURCE_H
+
+#include <nfc/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Plays back a .nfcb packed capture (see nfcb.h)
+     * \ingroup nfc
+     *
+     * Outputs one sliced sample per byte (0 or 1), or the packed bytes
+     * (8 samples, first sample in the MSB) when \p packed is set. An
+     * "abs_offset" tag gives the absolute position of the sample at the
+     * start and at every index entry, so that discontinuities of the
+     * recording can be followed downstream. Stops at the end of the file,
+     * or of the range [\p start, \p end) of absolute offsets, found through
+     * the index so that a short stretch of a long recording plays at once.
+     */
+    class NFC_API packed_capture_source : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<packed_capture_source> sptr;
+
+      /*!
+       * \param filename .nfcb file
+       * \param packed output 8 samples per byte instead of 1
+       * \param start absolute offset to start at (rounded down to a byte),
+       *        include the pre-roll the decoders need
+       * \param end absolute offset to stop at, 0 for the end of the file
+       */
+      static sptr make(const char *filename, bool packed,
+                       uint64_t start = 0, uint64_t end = 0);
+
+      /* From the file header */
+      virtual double sample_rate() const = 0;
+      virtual double center_freq() const = 0;
+      virtual int64_t start_time_ns() const = 0;
+      virtual int direction() const = 0;
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_PACKED_CAPTURE_SOURCE_H */
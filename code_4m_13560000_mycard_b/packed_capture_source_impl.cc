@@ -0,0 +1,129 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <gnuradio/io_signature.h>
+#include "packed_capture_source_impl.h"
+
+namespace gr {
+  namespace nfc {
+
+    packed_capture_source::sptr
+    packed_capture_source::make(const char *filename, bool packed,
+                                uint64_t start, uint64_t end)
+    {
+      return gnuradio::get_initial_sptr
+        (new packed_capture_source_impl(filename, packed, start, end));
+    }
+
+    /*
+     * The private constructor
+     */
+    packed_capture_source_impl::packed_capture_source_impl(const char *filename, bool packed,
+                                                           uint64_t start, uint64_t end)
+      : gr::sync_block("packed_capture_source",
+              gr::io_signature::make(0, 0, 0),
+              gr::io_signature::make(1, 1, sizeof(unsigned char))),
+        d_packed(packed),
+        d_first(0),
+        d_sample(0),
+        d_end(0),
+        d_next_entry(0)
+    {
+        if (!d_reader.open(filename)) {
+            throw std::runtime_error("packed_capture_source: cannot open capture");
+        }
+
+        /* Segments start on a byte, the range does too */
+        const std::vector<nfcb_index_entry> &index = d_reader.index();
+        d_first = d_sample = start ? d_reader.sample_at(start) & ~uint64_t(7) : 0;
+        d_end = end ? (d_reader.sample_at(end) + 7) & ~uint64_t(7) : d_reader.nsamples();
+        d_end = std::max(std::min(d_end, d_reader.nsamples()), d_sample);
+
+        while (d_next_entry < index.size() && index[d_next_entry].sample < d_sample) {
+            d_next_entry++;
+        }
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    packed_capture_source_impl::~packed_capture_source_impl()
+    {
+    }
+
+    int
+    packed_capture_source_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      unsigned char *out = (unsigned char *) output_items[0];
+      int spi = d_packed ? 8 : 1;
+      uint64_t n = std::min(uint64_t(noutput_items) * spi, d_end - d_sample);
+      const std::vector<nfcb_index_entry> &index = d_reader.index();
+
+      if (n == 0) {
+          return WORK_DONE;
+      }
+
+      if (d_sample == d_first && d_first > 0 &&
+          (d_next_entry == index.size() || index[d_next_entry].sample != d_first)) {
+          /* Start of a range within a segment */
+          add_item_tag(0, 0, pmt::intern("abs_offset"),
+                       pmt::from_uint64(d_reader.offset_of(d_first)));
+      }
+
+      /* Index entries are on byte boundaries, so on items in both modes */
+      while (d_next_entry < index.size() && index[d_next_entry].sample < d_sample + n) {
+          add_item_tag(0, (index[d_next_entry].sample - d_first) / spi,
+                       pmt::intern("abs_offset"), pmt::from_uint64(index[d_next_entry].offset));
+          d_next_entry++;
+      }
+
+      const unsigned char *data = d_reader.data();
+      if (d_packed) {
+          size_t nbytes = size_t((n + 7) / 8);
+
+          memcpy(out, data + d_sample / 8, nbytes);
+          if (n & 7) {
+              /* The reader only opens whole bytes today; should the end
+               * fall within a byte, send it with the rest set to zero
+               * rather than drop its samples
+               */
+              out[nbytes - 1] &= (unsigned char) (0xff << (8 - (n & 7)));
+          }
+      } else {
+          /* The output buffer may end within a byte */
+          for (uint64_t s = d_sample; s < d_sample + n; s++) {
+              *out++ = (data[s / 8] >> (7 - (s & 7))) & 1;
+          }
+      }
+      d_sample += n;
+
+      // Tell runtime system how many output items we produced.
+      return int((n + spi - 1) / spi);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,57 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_PACKED_CAPTURE_SOURCE_IMPL_H
+#define INCLUDED_NFC_PACKED_CAPTURE_SOURCE_IMPL_H
+
+#include "packed_capture_source.h"
+#include "nfcb.h"
+
+namespace gr {
+  namespace nfc {
+
+    class packed_capture_source_impl : public packed_capture_source
+    {
+     private:
+      nfcb_reader d_reader;
+      bool d_packed;
+      uint64_t d_first;         /* First sample output */
+      uint64_t d_sample;        /* Next sample to output */
+      uint64_t d_end;           /* Sample to stop at */
+      size_t d_next_entry;      /* Next index entry to tag */
+
+     public:
+      packed_capture_source_impl(const char *filename, bool packed,
+                                 uint64_t start, uint64_t end);
+      ~packed_capture_source_impl();
+
+      double sample_rate() const { return d_reader.info().sample_rate; }
+      double center_freq() const { return d_reader.info().center_freq; }
+      int64_t start_time_ns() const { return d_reader.info().start_time_ns; }
+      int direction() const { return d_reader.info().direction; }
+
+      // Where all the action really happens
+      int work(int noutput_items,
+               gr_vector_const_void_star &input_items,
+               gr_vector_void_star &output_items);
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_PACKED_CAPTURE_SOURCE_IMPL_H */
@@ -0,0 +1,347 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <algorithm>
+#include <vector>
+#include "parallel_decode.h"
+#include "miller_decoder.h"
+#include "manchester_decoder.h"
+
+/* Samples handed to the decoder stage at once */
+#define PARALLEL_FEED_SAMPLES           65536
+
+/* Chunks decoded ahead of the output, per thread */
+#define PARALLEL_CHUNKS_AHEAD           4
+
+namespace gr {
+  namespace nfc {
+
+    static frame_decoder *
+    make_decoder (int direction, double sample_rate, frame_sink *sink)
+    {
+        if (direction == NFC_READER) {
+            return new miller_decoder(sample_rate, sink);
+        }
+
+        return new manchester_decoder(sample_rate, sink);
+    }
+
+    capture_chunks::capture_chunks(const capture_view *views[2], double sample_rate,
+                                   uint64_t chunk_samples)
+      : d_sample_rate(sample_rate),
+        d_chunk(std::max(chunk_samples / SCAN_BLOCK_SAMPLES, uint64_t(1)) * SCAN_BLOCK_SAMPLES),
+        d_nsamples(0),
+        d_skip_idle(false)
+    {
+        for (int d = 0; d < 2; d++) {
+            d_present[d] = views[d] != NULL;
+            d_levels[d] = 0;
+            d_margins[d] = 0;
+
+            if (!d_present[d]) {
+                continue;
+            }
+
+            frame_decoder *decoder = make_decoder(d, sample_rate, NULL);
+
+            d_views[d] = *views[d];
+            d_levels[d] = decoder->cut_levels();
+            d_margins[d] = decoder->cut_margin();
+            d_nsamples = std::max(d_nsamples, d_views[d].nsamples);
+            delete decoder;
+        }
+
+        d_nchunks = std::max((d_nsamples + d_chunk - 1) / d_chunk, uint64_t(1));
+    }
+
+    capture_chunks
+    capture_chunks::active(const capture_view *views[2], double sample_rate, uint64_t padding,
+                           uint64_t chunk_samples)
+    {
+        capture_chunks chunks(views, sample_rate, chunk_samples);
+        capture_view present[2];
+        unsigned int levels[2];
+        uint64_t margins[2];
+        int n = 0;
+
+        for (int d = 0; d < 2; d++) {
+            if (chunks.d_present[d]) {
+                present[n] = chunks.d_views[d];
+                levels[n] = chunks.d_levels[d];
+                margins[n] = chunks.d_margins[d];
+                n++;
+            }
+        }
+
+        std::vector<activity_region> regions = scan_activity(present, levels, margins, n, padding);
+
+        for (size_t i = 0; i < regions.size(); i++) {
+            chunks.add_region(regions[i]);
+        }
+        chunks.d_nchunks = chunks.d_regions.size();
+        chunks.d_skip_idle = true;
+
+        return chunks;
+    }
+
+    capture_chunks
+    capture_chunks::range(const capture_view *views[2], double sample_rate,
+                          uint64_t start, uint64_t end, uint64_t chunk_samples)
+    {
+        capture_chunks chunks(views, sample_rate, chunk_samples);
+
+        end = std::min(end, chunks.d_nsamples);
+        if (start < end) {
+            activity_region r = { chunks.cut_before(start), chunks.cut_at(end, chunks.d_nsamples) };
+
+            chunks.add_region(r);
+        }
+        chunks.d_nchunks = chunks.d_regions.size();
+        chunks.d_skip_idle = true;
+
+        return chunks;
+    }
+
+    void
+    capture_chunks::add_region(activity_region r)
+    {
+        /* Long bursts are cut further like whole captures */
+        while (r.end - r.start > d_chunk) {
+            uint64_t cut = cut_at(r.start + d_chunk, r.end);
+            activity_region head = { r.start, cut };
+
+            if (cut >= r.end) {
+                break;
+            }
+            d_regions.push_back(head);
+            r.start = cut;
+        }
+        d_regions.push_back(r);
+    }
+
+    bool
+    capture_chunks::can_split(const slicer_config &slicer, const agc_config &agc)
+    {
+        return !agc.enabled && slicer.type != SLICER_ADAPTIVE;
+    }
+
+    uint64_t
+    capture_chunks::cut_at(uint64_t target, uint64_t limit) const
+    {
+        capture_view views[2];
+        unsigned int levels[2];
+        uint64_t margins[2];
+        int n = 0;
+
+        for (int d = 0; d < 2; d++) {
+            if (d_present[d]) {
+                views[n] = d_views[d];
+                levels[n] = d_levels[d];
+                margins[n] = d_margins[d];
+                n++;
+            }
+        }
+
+        return find_cut(views, levels, margins, n, target, limit);
+    }
+
+    uint64_t
+    capture_chunks::cut_before(uint64_t target) const
+    {
+        /* Windows doubling backwards, the start of the captures is a cut */
+        for (uint64_t back = 16 * SCAN_BLOCK_SAMPLES; back < target; back *= 2) {
+            uint64_t cut = cut_at(target - back, target);
+
+            if (cut < target) {
+                return cut;
+            }
+        }
+
+        return 0;
+    }
+
+    void
+    capture_chunks::decode(uint64_t k, frame_queue queues[2]) const
+    {
+        uint64_t start = 0, end = d_nsamples;
+
+        if (d_skip_idle) {
+            start = d_regions[k].start;
+            end = d_regions[k].end;
+        } else if (k > 0) {
+            uint64_t next = std::min((k + 1) * d_chunk, d_nsamples);
+
+            /* No cut in this chunk: the previous one covers it */
+            start = cut_at(k * d_chunk, next);
+            if (start >= next) {
+                return;
+            }
+        }
+        if (!d_skip_idle && k + 1 < d_nchunks) {
+            /* Same search as the start of the next chunk, but unbounded */
+            end = cut_at((k + 1) * d_chunk, d_nsamples);
+        }
+
+        for (int d = 0; d < 2; d++) {
+            if (!d_present[d]) {
+                continue;
+            }
+
+            const capture_view &view = d_views[d];
+            int item_size = format_item_size(view.format);
+            int item_samples = format_item_samples(view.format);
+            agc_config agc = agc_config();
+            frame_decoder *decoder = make_decoder(d, d_sample_rate, &queues[d]);
+            sample_stage stage(view.format, d_sample_rate, view.slicer, agc, decoder);
+            uint64_t stop = std::min(end, view.nsamples);
+
+            stage.reset(view.origin + start);
+            for (uint64_t pos = start; pos < stop; pos += PARALLEL_FEED_SAMPLES) {
+                uint64_t n = std::min(stop - pos, uint64_t(PARALLEL_FEED_SAMPLES));
+
+                stage.process(view.data + pos / item_samples * item_size, int(n / item_samples));
+            }
+            stage.finish();
+
+            delete decoder;
+        }
+    }
+
+    chunk_merger::chunk_merger(frame_sink *sink)
+      : d_sink(sink)
+    {
+        d_no_parity_mode[0] = 0;
+        d_no_parity_mode[1] = 0;
+    }
+
+    void
+    chunk_merger::write(frame_queue queues[2])
+    {
+        frame_queue *q[2] = { &queues[0], &queues[1] };
+        frame_decoder *none[2] = { NULL, NULL };
+
+        for (int d = 0; d < 2; d++) {
+            std::deque<nfc_frame> &frames = queues[d].d_frames;
+
+            for (size_t i = 0; i < frames.size(); i++) {
+                nfc_frame_apply_mode(&frames[i], &d_no_parity_mode[d]);
+            }
+        }
+
+        merge_frames(q, none, d_sink, true);
+    }
+
+    /* Shared state of the decoding threads */
+    struct parallel_state
+    {
+        const capture_chunks *chunks;
+        std::vector<frame_queue *> results;
+        uint64_t next;          /* Next chunk to decode */
+        uint64_t written;       /* Chunks already written out */
+        uint64_t ahead;
+        pthread_mutex_t lock;
+        pthread_cond_t done;
+        pthread_cond_t room;
+    };
+
+    static void *
+    parallel_worker (void *arg)
+    {
+        parallel_state *s = (parallel_state *) arg;
+
+        pthread_mutex_lock(&s->lock);
+        for (;;) {
+            while (s->next < s->chunks->nchunks() && s->next >= s->written + s->ahead) {
+                pthread_cond_wait(&s->room, &s->lock);
+            }
+            if (s->next >= s->chunks->nchunks()) {
+                break;
+            }
+
+            uint64_t k = s->next++;
+            pthread_mutex_unlock(&s->lock);
+
+            frame_queue *queues = new frame_queue[2];
+            s->chunks->decode(k, queues);
+
+            pthread_mutex_lock(&s->lock);
+            s->results[k] = queues;
+            pthread_cond_broadcast(&s->done);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        return NULL;
+    }
+
+    void
+    decode_parallel (const capture_chunks &chunks, int nthreads, frame_sink *sink)
+    {
+        parallel_state s;
+        std::vector<pthread_t> threads(std::max(nthreads, 1));
+        chunk_merger merger(sink);
+
+        s.chunks = &chunks;
+        s.results.assign(chunks.nchunks(), NULL);
+        s.next = 0;
+        s.written = 0;
+        s.ahead = PARALLEL_CHUNKS_AHEAD * threads.size();
+        pthread_mutex_init(&s.lock, NULL);
+        pthread_cond_init(&s.done, NULL);
+        pthread_cond_init(&s.room, NULL);
+
+        for (size_t t = 0; t < threads.size(); t++) {
+            pthread_create(&threads[t], NULL, parallel_worker, &s);
+        }
+
+        /* Write the chunks out in order as they complete */
+        for (uint64_t k = 0; k < chunks.nchunks(); k++) {
+            frame_queue *queues;
+
+            pthread_mutex_lock(&s.lock);
+            while (!s.results[k]) {
+                pthread_cond_wait(&s.done, &s.lock);
+            }
+            queues = s.results[k];
+            s.results[k] = NULL;
+            pthread_mutex_unlock(&s.lock);
+
+            merger.write(queues);
+            delete [] queues;
+
+            pthread_mutex_lock(&s.lock);
+            s.written = k + 1;
+            pthread_cond_broadcast(&s.room);
+            pthread_mutex_unlock(&s.lock);
+        }
+
+        for (size_t t = 0; t < threads.size(); t++) {
+            pthread_join(threads[t], NULL);
+        }
+
+        pthread_cond_destroy(&s.room);
+        pthread_cond_destroy(&s.done);
+        pthread_mutex_destroy(&s.lock);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
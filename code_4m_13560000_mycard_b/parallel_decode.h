@@ -0,0 +1,130 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_PARALLEL_DECODE_H
+#define INCLUDED_NFC_PARALLEL_DECODE_H
+
+#include <stdint.h>
+#include "capture_scan.h"
+
+/* Nominal chunk length, the actual cuts are moved to the next quiet
+ * period. 2^24 samples is about 4 s at 4 Msps.
+ */
+#define PARALLEL_CHUNK_SAMPLES          (1ULL << 24)
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Reader and/or tag captures split into independently
+     * decodable chunks.
+     *
+     * Chunk k nominally starts at k * chunk_samples; its actual start is
+     * the first position from there where both captures are quiet long
+     * enough (see frame_decoder::cut_margin), found by scan. A chunk
+     * without any such position before the next one is empty and the
+     * previous chunk extends over it. Every chunk computes its own bounds,
+     * so chunks can be decoded in any order and on any thread.
+     */
+    class capture_chunks
+    {
+     public:
+      /*! \p views[d] is NULL when direction d is not decoded */
+      capture_chunks(const capture_view *views[2], double sample_rate,
+                     uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES);
+
+      /*!
+       * Chunks limited to the active regions of the captures (see
+       * scan_activity), extra \p padding samples around the activity.
+       * Everything else is skipped.
+       */
+      static capture_chunks active(const capture_view *views[2], double sample_rate,
+                                   uint64_t padding,
+                                   uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES);
+
+      /*!
+       * Chunks covering the samples [\p start, \p end) of the views: from
+       * the last cut found before the start to the first one after the
+       * end, so decoding them gives every frame starting in the range
+       * exactly as decoding everything would (the parity mode aside,
+       * like for active()). Frames around the range come out too, see
+       * range_filter.
+       */
+      static capture_chunks range(const capture_view *views[2], double sample_rate,
+                                  uint64_t start, uint64_t end,
+                                  uint64_t chunk_samples = PARALLEL_CHUNK_SAMPLES);
+
+      /*! True if the slicing has no state, otherwise only serial decoding
+       * gives the right result.
+       */
+      static bool can_split(const slicer_config &slicer, const agc_config &agc);
+
+      uint64_t nchunks() const { return d_nchunks; }
+      const std::vector<activity_region> &regions() const { return d_regions; }
+      uint64_t nsamples() const { return d_nsamples; }
+
+      /*! Decode chunk \p k, frames of direction d go to \p queues[d] */
+      void decode(uint64_t k, frame_queue queues[2]) const;
+
+     private:
+      uint64_t cut_at(uint64_t target, uint64_t limit) const;
+      uint64_t cut_before(uint64_t target) const;
+      void add_region(activity_region r);
+
+      capture_view d_views[2];
+      bool d_present[2];
+      unsigned int d_levels[2];
+      uint64_t d_margins[2];
+      double d_sample_rate;
+      uint64_t d_chunk;
+      uint64_t d_nsamples;
+      uint64_t d_nchunks;
+      std::vector<activity_region> d_regions;   /* Explicit bounds, if not empty */
+      bool d_skip_idle;
+    };
+
+    /*!
+     * \brief Writes the frames of consecutive chunks to a sink, in time
+     * order, exactly as a serial decoding would.
+     *
+     * The parity mode carried from frame to frame is replayed across the
+     * chunk boundaries (see nfc_frame_apply_mode).
+     */
+    class chunk_merger
+    {
+     public:
+      chunk_merger(frame_sink *sink);
+
+      /*! Frames of the next chunk, the queues are emptied */
+      void write(frame_queue queues[2]);
+
+     private:
+      frame_sink *d_sink;
+      unsigned char d_no_parity_mode[2];
+    };
+
+    /*!
+     * Decode all the chunks on \p nthreads threads and write the frames to
+     * \p sink in order. At most a few chunks per thread are kept in memory.
+     */
+    void decode_parallel(const capture_chunks &chunks, int nthreads, frame_sink *sink);
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_PARALLEL_DECODE_H */
@@ -0,0 +1,129 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "poll_collapser.h"
+
+namespace gr {
+  namespace nfc {
+
+    poll_collapser::poll_collapser(frame_sink *frames, poll_run_sink *runs)
+      : d_frames(frames),
+        d_runs(runs),
+        d_active(false),
+        d_m2(0),
+        d_collapsed(0)
+    {
+    }
+
+    bool
+    poll_collapser::extends(const nfc_frame &frame) const
+    {
+        const nfc_frame &poll = d_pending;
+
+        return frame.direction == poll.direction && frame.flags == poll.flags &&
+            frame.nbits == poll.nbits && frame.len == poll.len &&
+            memcmp(frame.data, poll.data, frame.len) == 0 &&
+            memcmp(frame.status, poll.status, frame.len) == 0;
+    }
+
+    void
+    poll_collapser::commit()
+    {
+        if (d_run.count == 0) {
+            d_run.first = d_pending;
+        } else {
+            /* Welford over the periods between poll starts */
+            uint64_t period = d_pending.start - d_run.last_start;
+            uint64_t n = d_run.count;           /* Periods including this one */
+            double delta = period - d_run.period_mean;
+
+            d_run.period_min = n == 1 ? period : std::min(d_run.period_min, period);
+            d_run.period_max = n == 1 ? period : std::max(d_run.period_max, period);
+            d_run.period_mean += delta / n;
+            d_m2 += delta * (period - d_run.period_mean);
+        }
+
+        d_run.last_start = d_pending.start;
+        d_run.last_end = d_pending.end;
+        d_run.count++;
+    }
+
+    void
+    poll_collapser::end_run()
+    {
+        if (d_run.count == 1) {
+            d_frames->write(d_run.first);
+        } else if (d_run.count > 1) {
+            d_run.period_sd = d_run.count > 2 ? std::sqrt(d_m2 / (d_run.count - 2)) : 0;
+            d_collapsed += d_run.count;
+            d_runs->write_run(d_run);
+        }
+
+        d_active = false;
+    }
+
+    void
+    poll_collapser::write(const nfc_frame &frame)
+    {
+        if (d_active && extends(frame)) {
+            commit();
+            d_pending = frame;
+            return;
+        }
+
+        if (d_active) {
+            if (frame.direction == NFC_TAG) {
+                end_run();
+                d_frames->write(d_pending);
+            } else {
+                commit();
+                end_run();
+            }
+        }
+
+        if (frame.direction == NFC_READER && (frame.flags & FRAME_SHORT)) {
+            d_run.count = 0;
+            d_run.period_min = d_run.period_max = 0;
+            d_run.period_mean = d_run.period_sd = 0;
+            d_m2 = 0;
+            d_pending = frame;
+            d_active = true;
+            return;
+        }
+
+        d_frames->write(frame);
+    }
+
+    void
+    poll_collapser::finish()
+    {
+        if (d_active) {
+            commit();
+            end_run();
+        }
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,93 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_POLL_COLLAPSER_H
+#define INCLUDED_NFC_POLL_COLLAPSER_H
+
+#include <stdint.h>
+#include "nfc_frame.h"
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Consecutive identical short frames nobody answered
+     */
+    struct poll_run
+    {
+        nfc_frame first;                /* The first poll of the run */
+        uint64_t count;
+        uint64_t last_start;            /* Samples of the last poll */
+        uint64_t last_end;
+        uint64_t period_min;            /* Between poll starts, in samples */
+        uint64_t period_max;
+        double period_mean;
+        double period_sd;
+    };
+
+    /*!
+     * \brief Receives the poll runs, next to a frame_sink for the frames
+     */
+    class poll_run_sink
+    {
+     public:
+      virtual ~poll_run_sink() {}
+
+      virtual void write_run(const poll_run &run) = 0;
+    };
+
+    /*!
+     * \brief Collapses the polling of an idle field.
+     *
+     * Identical short reader frames (REQA, WUPA) following each other with
+     * nothing in between make a run. When a tag frame comes, the last poll
+     * of the run was answered and goes out as a frame; the polls before it
+     * and the runs ended by another reader frame were not, and go out as
+     * one poll_run when there are at least two of them. Every other frame
+     * passes through unchanged, in order.
+     */
+    class poll_collapser : public frame_sink
+    {
+     public:
+      poll_collapser(frame_sink *frames, poll_run_sink *runs);
+
+      void write(const nfc_frame &frame);
+
+      /*! Pass on the run in progress (end of stream) */
+      void finish();
+
+      uint64_t collapsed() const { return d_collapsed; }
+
+     private:
+      bool extends(const nfc_frame &frame) const;
+      void commit();
+      void end_run();
+
+      frame_sink *d_frames;
+      poll_run_sink *d_runs;
+      poll_run d_run;                   /* Polls known to be unanswered */
+      nfc_frame d_pending;              /* Latest poll, answered or not yet known */
+      bool d_active;
+      double d_m2;                      /* Welford sum of squared deviations */
+      uint64_t d_collapsed;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_POLL_COLLAPSER_H */
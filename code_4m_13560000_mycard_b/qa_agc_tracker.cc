@@ -0,0 +1,243 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * qa_agc_tracker: the same tag modulation received with a weak and a
+ * strong coupling, on different carrier levels, must come out of
+ * agc_tracker the same and sliced right at the reference, and the
+ * output must not depend on how the stream is cut into process() calls.
+ *
+ * The int16 path must follow the float one on the same capture: activity
+ * at 8192, a DC of 100 long enough for the level to reach its floor,
+ * then a weak burst of 20 LSB. The int16 output must keep tracking the
+ * scaled float output instead of saturating, and an adaptive slicer
+ * must take the same decisions on both.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include "agc_tracker.h"
+#include "histogram_slicer.h"
+
+using namespace gr::nfc;
+
+#define QA_SAMPLE_RATE                  4e6
+#define QA_ATTACK                       1e-5f
+#define QA_RELEASE                      1e-3f
+#define QA_REFERENCE                    0.5f
+#define QA_AMPLITUDE                    0.25f
+
+/* Bursts of subcarrier modulation (2 samples on, 2 off) between idle
+ * carrier periods
+ */
+#define QA_BURST                        2048
+#define QA_IDLE                         6144
+#define QA_BURSTS                       40
+
+/* Samples of a burst left for the trackers to settle */
+#define QA_SETTLE                       256
+
+/* Largest difference between the outputs of the two couplings */
+#define QA_MAX_ERROR                    1e-3f
+
+/* Int16 capture: float samples are the int16 ones over QA_SCALE */
+#define QA_SCALE                        16384.0f
+#define QA_INT16_BURST                  400000
+#define QA_INT16_DC                     1600000
+#define QA_INT16_WEAK                   400000
+#define QA_DC_LEVEL                     100
+#define QA_WEAK_DEPTH                   20
+
+/* Largest difference of the int16 and scaled float outputs: rounding
+ * of the fixed-point gain on the edges of the bursts
+ */
+#define QA_MAX_ERROR_INT16              256
+
+static int failures = 0;
+
+static bool
+modulated (int i)
+{
+    return i % (QA_BURST + QA_IDLE) < QA_BURST && (i / 2) % 2 == 0;
+}
+
+static bool
+settled (int i)
+{
+    int k = i % (QA_BURST + QA_IDLE);
+
+    return k >= QA_SETTLE && k < QA_BURST;
+}
+
+/* Carrier \p carrier, the tag adds \p depth while modulating */
+static std::vector<float>
+make_envelope (float carrier, float depth)
+{
+    std::vector<float> in((QA_BURST + QA_IDLE) * QA_BURSTS);
+
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = carrier + (modulated(int(i)) ? depth : 0.0f);
+    }
+
+    return in;
+}
+
+/* Output of the tracker for one coupling, checks its decisions */
+static std::vector<float>
+track (float carrier, float depth)
+{
+    std::vector<float> in = make_envelope(carrier, depth), out(in.size());
+    agc_tracker agc(QA_SAMPLE_RATE, QA_ATTACK, QA_RELEASE, QA_REFERENCE, QA_AMPLITUDE);
+    int decisions = 0;
+
+    agc.process(&in[0], &out[0], int(in.size()));
+
+    for (size_t i = 0; i < in.size(); i++) {
+        if (settled(int(i)) && (out[i] >= QA_REFERENCE) != modulated(int(i))) {
+            decisions++;
+        }
+    }
+    if (decisions) {
+        fprintf(stderr, "carrier %g, depth %g: %d wrong decisions\n", carrier, depth, decisions);
+        failures++;
+    }
+
+    return out;
+}
+
+/* Weak and strong coupling come out the same */
+static void
+check_couplings ()
+{
+    std::vector<float> weak = track(0.8f, 0.02f), strong = track(3.0f, 0.6f);
+    float max_error = 0;
+
+    for (size_t i = 0; i < weak.size(); i++) {
+        max_error = std::max(max_error, std::fabs(weak[i] - strong[i]));
+    }
+    if (max_error > QA_MAX_ERROR) {
+        fprintf(stderr, "the outputs of the two couplings differ by up to %g\n", max_error);
+        failures++;
+    }
+}
+
+/* Calls of varying lengths (multiples of the block) give the same output */
+static void
+check_cuts ()
+{
+    std::vector<float> in = make_envelope(1.0f, 0.1f), whole(in.size()), cut(in.size());
+    agc_tracker a(QA_SAMPLE_RATE, QA_ATTACK, QA_RELEASE, QA_REFERENCE, QA_AMPLITUDE);
+    agc_tracker b(QA_SAMPLE_RATE, QA_ATTACK, QA_RELEASE, QA_REFERENCE, QA_AMPLITUDE);
+    size_t pos = 0;
+    int k = 0;
+
+    a.process(&in[0], &whole[0], int(in.size()));
+    while (pos < in.size()) {
+        int n = int(std::min(in.size() - pos, size_t(agc_tracker::AGC_BLOCK_SIZE) * (1 + k++ % 37)));
+
+        b.process(&in[pos], &cut[pos], n);
+        pos += n;
+    }
+
+    if (memcmp(&whole[0], &cut[0], in.size() * sizeof(float)) != 0) {
+        fprintf(stderr, "the output depends on the process() calls\n");
+        failures++;
+    }
+}
+
+static void
+check_int16 ()
+{
+    int n = QA_INT16_BURST + QA_INT16_DC + QA_INT16_WEAK;
+    std::vector<short> in_short(n), out_short(n);
+    std::vector<float> in_float(n), out_float(n);
+    uint32_t seed = 1;
+
+    /* Modulation with runs of 37 samples and random pauses */
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        bool high = (i / 37) % 3 != 0 && ((seed >> 20) & 7) != 0;
+
+        if (i < QA_INT16_BURST) {
+            in_short[i] = high ? 8192 : 0;
+        } else if (i < QA_INT16_BURST + QA_INT16_DC) {
+            in_short[i] = QA_DC_LEVEL;
+        } else {
+            in_short[i] = QA_DC_LEVEL + (high ? QA_WEAK_DEPTH : 0);
+        }
+        in_float[i] = in_short[i] / QA_SCALE;
+    }
+
+    agc_tracker agc_float(QA_SAMPLE_RATE, QA_ATTACK, QA_RELEASE, QA_REFERENCE, QA_AMPLITUDE);
+    agc_tracker agc_short(QA_SAMPLE_RATE, QA_ATTACK, QA_RELEASE, QA_REFERENCE * QA_SCALE,
+                          QA_AMPLITUDE * QA_SCALE);
+
+    agc_float.process(&in_float[0], &out_float[0], n);
+    agc_short.process(&in_short[0], &out_short[0], n);
+
+    histogram_slicer slicer_float(0, 1, 4096, 256, 0.1f);
+    histogram_slicer slicer_short(0, QA_SCALE, 4096, 256, 0.1f);
+    std::vector<unsigned char> bits_float(n), bits_short(n);
+
+    slicer_float.process(&out_float[0], &bits_float[0], n);
+    slicer_short.process(&out_short[0], &bits_short[0], n);
+
+    int decisions = 0, first = -1, saturated = 0;
+    float max_error = 0;
+
+    for (int i = 0; i < n; i++) {
+        float expected = std::min(std::max(out_float[i] * QA_SCALE, -32768.0f), 32767.0f);
+
+        if (bits_float[i] != bits_short[i]) {
+            decisions++;
+            if (first < 0) {
+                first = i;
+            }
+        }
+        if (i >= QA_INT16_BURST && i < QA_INT16_BURST + QA_INT16_DC &&
+            (out_short[i] == -32768 || out_short[i] == 32767)) {
+            saturated++;
+        }
+        max_error = std::max(max_error, std::fabs(expected - out_short[i]));
+    }
+
+    if (decisions || saturated || max_error > QA_MAX_ERROR_INT16) {
+        fprintf(stderr, "int16: %d decisions differ (first at %d), %d saturated samples on the "
+                "DC, largest output difference %.1f\n", decisions, first, saturated, max_error);
+        failures++;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+    check_couplings();
+    check_cuts();
+    check_int16();
+
+    if (failures) {
+        fprintf(stderr, "%s: %d failures\n", argv[0], failures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,642 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * qa_decode_equivalence: synthetic reader (modified Miller) and tag
+ * (Manchester) captures in every input format, decoded serially the way
+ * nfc_decode does and in chunks on several threads, in memory and from
+ * files through capture_job. Every decoding must give the frames of the
+ * char capture, and those must be the frames that were modulated.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "capture_job.h"
+#include "manchester_decoder.h"
+#include "miller_decoder.h"
+#include "qa_util.h"
+
+using namespace gr::nfc;
+
+#define QA_SAMPLE_RATE                  4e6
+#define QA_FRAMES                       120
+
+/* Samples per bit at 4 MHz, 128 carrier periods */
+#define QA_BIT_SAMPLES                  (128 / 13.56e6 * QA_SAMPLE_RATE)
+
+/* Items fed to the stages per call, as nfc_decode reads them */
+#define QA_CHUNK                        4096
+
+/* Level of the int16 captures */
+#define QA_SHORT_LEVEL                  8192
+
+struct qa_frame
+{
+    std::vector<unsigned char> data;
+    bool is_short;
+};
+
+/* Small deterministic generator, the captures are the same on every run */
+static uint32_t qa_seed = 1;
+
+static int
+qa_rand (int lo, int hi)
+{
+    qa_seed = qa_seed * 1103515245 + 12345;
+    return lo + int((qa_seed >> 8) % uint32_t(hi - lo + 1));
+}
+
+/* Bits on air, LSB first, odd parity after each byte */
+static std::vector<int>
+frame_bits (const qa_frame &f)
+{
+    std::vector<int> bits;
+
+    if (f.is_short) {
+        for (int i = 0; i < 7; i++) {
+            bits.push_back((f.data[0] >> i) & 1);
+        }
+        return bits;
+    }
+    for (size_t k = 0; k < f.data.size(); k++) {
+        int ones = 0;
+
+        for (int i = 0; i < 8; i++) {
+            bits.push_back((f.data[k] >> i) & 1);
+            ones += bits.back();
+        }
+        bits.push_back(!(ones & 1));
+    }
+
+    return bits;
+}
+
+/* Sequence X (pause mid-bit), Y (no pause) or Z (pause at the start) */
+static void
+miller (std::vector<unsigned char> &out, const std::vector<int> &bits, int pulse)
+{
+    std::vector<char> seq;
+    int prev = 0;
+    double t = 0;
+
+    seq.push_back('Z');
+    for (size_t i = 0; i < bits.size(); i++) {
+        seq.push_back(bits[i] ? 'X' : (prev ? 'Y' : 'Z'));
+        prev = bits[i];
+    }
+    seq.push_back(prev ? 'Y' : 'Z');
+    seq.push_back('Y');
+
+    for (size_t i = 0; i < seq.size(); i++) {
+        int n0 = int(t + 0.5), n1 = int((t += QA_BIT_SAMPLES) + 0.5);
+        int len = n1 - n0, half = len / 2;
+        int pause = seq[i] == 'X' ? half : seq[i] == 'Z' ? 0 : len;
+
+        for (int j = 0; j < len; j++) {
+            out.push_back(!(j >= pause && j < pause + pulse));
+        }
+    }
+}
+
+/* Start bit, then the bits: 1 is modulated in the first half */
+static void
+manchester (std::vector<unsigned char> &out, const std::vector<int> &bits)
+{
+    double t = 0;
+
+    for (size_t i = 0; i <= bits.size(); i++) {
+        int b = i == 0 ? 1 : bits[i - 1];
+        int n0 = int(t + 0.5), n1 = int((t += QA_BIT_SAMPLES) + 0.5);
+        int len = n1 - n0, half = len / 2;
+
+        for (int j = 0; j < len; j++) {
+            out.push_back((j < half) == (b == 1));
+        }
+    }
+}
+
+static qa_frame
+make_frame (const unsigned char *data, size_t len, bool is_short)
+{
+    qa_frame f;
+
+    f.data.assign(data, data + len);
+    f.is_short = is_short;
+    return f;
+}
+
+/* Reader capture (idle high) and the frames it holds */
+static void
+make_reader (std::vector<unsigned char> &out, std::vector<qa_frame> &frames)
+{
+    static const unsigned char reqa[] = { 0x26 };
+    static const unsigned char anticoll[] = { 0x93, 0x20 };
+    static const unsigned char select[] = { 0x93, 0x70, 0x88, 0x04, 0x72, 0x56, 0xa8, 0x00, 0xe0 };
+    static const unsigned char wupa[] = { 0x52 };
+    static const unsigned char read[] = { 0x30, 0x04, 0x26, 0xee };
+    qa_frame choices[] = {
+        make_frame(reqa, sizeof(reqa), true),
+        make_frame(anticoll, sizeof(anticoll), false),
+        make_frame(select, sizeof(select), false),
+        make_frame(wupa, sizeof(wupa), true),
+        make_frame(read, sizeof(read), false),
+    };
+
+    out.assign(2000, 1);
+    for (int k = 0; k < QA_FRAMES; k++) {
+        const qa_frame &f = choices[qa_rand(0, 4)];
+
+        miller(out, frame_bits(f), qa_rand(4, 6));
+        out.insert(out.end(), qa_rand(300, 5000), 1);
+        frames.push_back(f);
+    }
+}
+
+/* Tag capture (idle low) and the frames it holds */
+static void
+make_tag (std::vector<unsigned char> &out, std::vector<qa_frame> &frames)
+{
+    static const unsigned char atqa[] = { 0x44, 0x00 };
+    static const unsigned char uid[] = { 0x88, 0x04, 0x72, 0x56, 0xa8 };
+    static const unsigned char sak[] = { 0x04, 0xda, 0x17 };
+    static const unsigned char ats[] = { 0x20, 0xfc, 0x70 };
+    static const unsigned char block[] = { 0x0c, 0x75, 0x77, 0x80, 0x02, 0xc1, 0x05, 0x2f,
+                                           0x2f, 0x00, 0x35, 0xc7, 0x60, 0xd3 };
+    qa_frame choices[] = {
+        make_frame(atqa, sizeof(atqa), false),
+        make_frame(uid, sizeof(uid), false),
+        make_frame(sak, sizeof(sak), false),
+        make_frame(ats, sizeof(ats), false),
+        make_frame(block, sizeof(block), false),
+    };
+
+    out.assign(3000, 0);
+    for (int k = 0; k < QA_FRAMES; k++) {
+        const qa_frame &f = choices[qa_rand(0, 4)];
+
+        manchester(out, frame_bits(f));
+        out.insert(out.end(), qa_rand(400, 6000), 0);
+        frames.push_back(f);
+    }
+}
+
+class frame_list : public frame_sink
+{
+ public:
+  void write(const nfc_frame &frame) { frames.push_back(frame); }
+
+  std::vector<nfc_frame> frames;
+};
+
+static bool
+same_frame (const nfc_frame &a, const nfc_frame &b)
+{
+    return a.start == b.start && a.end == b.end && a.direction == b.direction &&
+        a.flags == b.flags && a.nbits == b.nbits && a.len == b.len &&
+        memcmp(a.data, b.data, a.len) == 0 && memcmp(a.status, b.status, a.len) == 0 &&
+        memcmp(a.parity, b.parity, (a.len + 7) / 8) == 0;
+}
+
+/* Index of the first difference, -1 if the lists are the same */
+static int
+compare_frames (const std::vector<nfc_frame> &a, const std::vector<nfc_frame> &b)
+{
+    size_t n = std::min(a.size(), b.size());
+
+    for (size_t i = 0; i < n; i++) {
+        if (!same_frame(a[i], b[i])) {
+            return int(i);
+        }
+    }
+
+    return a.size() == b.size() ? -1 : int(n);
+}
+
+/* The decoded frames of direction \p d carry the modulated bytes */
+static bool
+check_modulated (const std::vector<nfc_frame> &decoded, const std::vector<qa_frame> &sent, int d)
+{
+    size_t k = 0;
+
+    for (size_t i = 0; i < decoded.size(); i++) {
+        const nfc_frame &f = decoded[i];
+
+        if (f.direction != d) {
+            continue;
+        }
+        if (k == sent.size() || f.len != sent[k].data.size() ||
+            memcmp(f.data, &sent[k].data[0], f.len) != 0 ||
+            bool(f.flags & FRAME_SHORT) != sent[k].is_short ||
+            (f.flags & (FRAME_BROKEN | FRAME_PARITY_ERROR))) {
+            fprintf(stderr, "%s frame %zu (sample %llu) is not the one modulated\n",
+                    d == NFC_READER ? "reader" : "tag", k, (unsigned long long) f.start);
+            return false;
+        }
+        k++;
+    }
+    if (k != sent.size()) {
+        fprintf(stderr, "%s: %zu frames decoded out of %zu\n",
+                d == NFC_READER ? "reader" : "tag", k, sent.size());
+        return false;
+    }
+
+    return true;
+}
+
+struct qa_case
+{
+    const char *name;
+    sample_format format;
+    const std::vector<unsigned char> *items[2];
+    const char *slicer;
+};
+
+/* Both directions through sample_stage and merge_frames, in lockstep */
+static std::vector<nfc_frame>
+decode_serial (const qa_case &c)
+{
+    frame_list out;
+    frame_queue queues[2];
+    frame_queue *active_queues[2] = { &queues[0], &queues[1] };
+    frame_decoder *decoders[2], *running[2];
+    sample_stage *stages[2];
+    agc_config agc;
+    int item_size = format_item_size(c.format);
+    size_t pos[2] = { 0, 0 };
+
+    memset(&agc, 0, sizeof(agc));
+    decoders[NFC_READER] = new miller_decoder(QA_SAMPLE_RATE, &queues[NFC_READER]);
+    decoders[NFC_TAG] = new manchester_decoder(QA_SAMPLE_RATE, &queues[NFC_TAG]);
+    for (int d = 0; d < 2; d++) {
+        slicer_config slicer;
+
+        parse_slicer(c.slicer, &slicer);
+        stages[d] = new sample_stage(c.format, QA_SAMPLE_RATE, slicer, agc, decoders[d]);
+        running[d] = decoders[d];
+    }
+
+    while (running[NFC_READER] || running[NFC_TAG]) {
+        for (int d = 0; d < 2; d++) {
+            size_t nitems = c.items[d]->size() / item_size;
+            int n = int(std::min(nitems - pos[d], size_t(QA_CHUNK)));
+
+            if (!running[d]) {
+                continue;
+            }
+            stages[d]->process(&(*c.items[d])[pos[d] * item_size], n);
+            pos[d] += n;
+            if (pos[d] == nitems) {
+                stages[d]->finish();
+                running[d] = NULL;
+            }
+        }
+        merge_frames(active_queues, running, &out, false);
+    }
+    merge_frames(active_queues, running, &out, true);
+
+    for (int d = 0; d < 2; d++) {
+        delete stages[d];
+        delete decoders[d];
+    }
+
+    return out.frames;
+}
+
+/* Decoding of \p c in chunks must give the \p serial frames. Returns the
+ * failures.
+ */
+static int
+check_chunks (const qa_case &c, const std::vector<nfc_frame> &serial)
+{
+    static const uint64_t chunk_samples[] = { 1 << 12, 1 << 16 };
+    capture_view views[2];
+    const capture_view *present[2] = { &views[0], &views[1] };
+    int failures = 0, diff;
+
+    for (int d = 0; d < 2; d++) {
+        views[d].data = &(*c.items[d])[0];
+        views[d].nsamples = c.items[d]->size() / format_item_size(c.format) *
+            format_item_samples(c.format);
+        views[d].format = c.format;
+        views[d].origin = 0;
+        parse_slicer(c.slicer, &views[d].slicer);
+    }
+
+    for (size_t i = 0; i < sizeof(chunk_samples) / sizeof(chunk_samples[0]); i++) {
+        capture_chunks chunks(present, QA_SAMPLE_RATE, chunk_samples[i]);
+        frame_list parallel;
+
+        if (chunks.nchunks() < 2) {
+            fprintf(stderr, "%s: %llu chunks of %llu samples\n", c.name,
+                    (unsigned long long) chunks.nchunks(), (unsigned long long) chunk_samples[i]);
+            failures++;
+        }
+        decode_parallel(chunks, 4, &parallel);
+        if ((diff = compare_frames(parallel.frames, serial)) >= 0) {
+            fprintf(stderr, "%s: decoding in chunks of %llu samples differs at frame %d "
+                    "(%zu frames, %zu serially)\n", c.name,
+                    (unsigned long long) chunk_samples[i], diff, parallel.frames.size(),
+                    serial.size());
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static bool
+write_file (const std::string &path, const std::vector<unsigned char> &data)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    bool ok;
+
+    if (!fp) {
+        perror(path.c_str());
+        return false;
+    }
+    ok = fwrite(&data[0], 1, data.size(), fp) == data.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        perror(path.c_str());
+    }
+
+    return ok;
+}
+
+static void
+put_le (std::vector<unsigned char> &out, uint64_t v, int n)
+{
+    for (int i = 0; i < n; i++) {
+        out.push_back((unsigned char) (v >> (8 * i)));
+    }
+}
+
+/* Canonical 44-byte WAV header, then the interleaved samples */
+static bool
+write_wav (const std::string &path, const std::vector<unsigned char> *channels[], int nchannels,
+           bool is_float)
+{
+    int sample_size = is_float ? 4 : 2;
+    size_t nframes = channels[0]->size();
+    uint64_t data_size = uint64_t(nframes) * nchannels * sample_size;
+    std::vector<unsigned char> out;
+
+    out.insert(out.end(), "RIFF", "RIFF" + 4);
+    put_le(out, 36 + data_size, 4);
+    out.insert(out.end(), "WAVE", "WAVE" + 4);
+    out.insert(out.end(), "fmt ", "fmt " + 4);
+    put_le(out, 16, 4);
+    put_le(out, is_float ? 3 : 1, 2);
+    put_le(out, nchannels, 2);
+    put_le(out, uint32_t(QA_SAMPLE_RATE), 4);
+    put_le(out, uint32_t(QA_SAMPLE_RATE) * nchannels * sample_size, 4);
+    put_le(out, nchannels * sample_size, 2);
+    put_le(out, 8 * sample_size, 2);
+    out.insert(out.end(), "data", "data" + 4);
+    put_le(out, data_size, 4);
+
+    for (size_t i = 0; i < nframes; i++) {
+        for (int c = 0; c < nchannels; c++) {
+            int level = (*channels[c])[i];
+
+            if (is_float) {
+                float v = float(level);
+                uint32_t bits;
+
+                memcpy(&bits, &v, 4);
+                put_le(out, bits, 4);
+            } else {
+                put_le(out, uint16_t(level * QA_SHORT_LEVEL), 2);
+            }
+        }
+    }
+
+    return write_file(path, out);
+}
+
+template <typename W>
+static bool
+write_packed (const std::string &path, const std::vector<unsigned char> &samples, int d)
+{
+    nfcb_info info;
+    W writer;
+
+    memset(&info, 0, sizeof(info));
+    info.sample_rate = QA_SAMPLE_RATE;
+    info.center_freq = 13.56e6;
+    info.direction = (unsigned char) d;
+    parse_slicer("threshold:0.5", &info.slicer);
+    info.index_interval = 1 << 16;
+
+    if (!writer.open(path.c_str(), info)) {
+        return false;
+    }
+    writer.write(&samples[0], int(samples.size()));
+    if (!writer.close()) {
+        perror(path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+struct qa_file_case
+{
+    const char *name;
+    sample_format format;
+    std::string paths[2];
+    int channels[2];
+    const char *slicer;
+    bool splits;                        /* can_split() expected */
+};
+
+/* Serial decoding of the files of \p c through capture_job, then in chunks
+ * when it can be split. Returns the failures.
+ */
+static int
+check_files (const qa_file_case &c, const std::vector<nfc_frame> &reference)
+{
+    static const uint64_t chunk_samples[] = { 1 << 12, 1 << 16 };
+    capture_config config;
+    int failures = 0, diff;
+
+    config.format = c.format;
+    for (int d = 0; d < 2; d++) {
+        config.paths[d] = c.paths[d];
+        config.channels[d] = c.channels[d];
+        parse_slicer(c.slicer, &config.slicers[d]);
+    }
+
+    /* decode_serial() closes the captures as it goes, one job each */
+    capture_job job(config), split_job(config);
+    frame_list serial;
+
+    if (!job.open() || !split_job.open()) {
+        fprintf(stderr, "%s files: cannot open the captures\n", c.name);
+        return 1;
+    }
+    job.decode_serial(&serial);
+    if (job.failed()) {
+        fprintf(stderr, "%s files: read error\n", c.name);
+        failures++;
+    }
+    if ((diff = compare_frames(serial.frames, reference)) >= 0) {
+        fprintf(stderr, "%s files: serial decoding differs from the char capture at frame %d "
+                "(%zu frames, %zu expected)\n", c.name, diff, serial.frames.size(),
+                reference.size());
+        failures++;
+    }
+
+    if (split_job.can_split() != c.splits) {
+        fprintf(stderr, "%s files: can_split() is %d\n", c.name, int(split_job.can_split()));
+        return failures + 1;
+    }
+    if (!c.splits) {
+        return failures;
+    }
+
+    for (size_t i = 0; i < sizeof(chunk_samples) / sizeof(chunk_samples[0]); i++) {
+        frame_list parallel;
+
+        decode_parallel(split_job.chunks(chunk_samples[i]), 4, &parallel);
+        if ((diff = compare_frames(parallel.frames, serial.frames)) >= 0) {
+            fprintf(stderr, "%s files: decoding in chunks of %llu samples differs at frame %d "
+                    "(%zu frames, %zu serially)\n", c.name,
+                    (unsigned long long) chunk_samples[i], diff, parallel.frames.size(),
+                    serial.frames.size());
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+template <typename T>
+static std::vector<unsigned char>
+as_bytes (const std::vector<T> &v)
+{
+    const unsigned char *p = (const unsigned char *) &v[0];
+
+    return std::vector<unsigned char>(p, p + v.size() * sizeof(T));
+}
+
+int
+main (int argc, char **argv)
+{
+    std::vector<unsigned char> samples[2], packed[2], envelope[2], envelope_short[2];
+    std::vector<qa_frame> sent[2];
+    int failures = 0, diff;
+
+    make_reader(samples[NFC_READER], sent[NFC_READER]);
+    make_tag(samples[NFC_TAG], sent[NFC_TAG]);
+
+    /* Same length, a whole number of packed bytes */
+    size_t nsamples = (std::max(samples[0].size(), samples[1].size()) + 7) / 8 * 8;
+    samples[NFC_READER].resize(nsamples, 1);
+    samples[NFC_TAG].resize(nsamples, 0);
+
+    for (int d = 0; d < 2; d++) {
+        std::vector<float> f(samples[d].begin(), samples[d].end());
+        std::vector<short> s(nsamples);
+
+        packed[d].assign(nsamples / 8, 0);
+        for (size_t i = 0; i < nsamples; i++) {
+            packed[d][i / 8] |= samples[d][i] << (7 - i % 8);
+            s[i] = short(samples[d][i] * QA_SHORT_LEVEL);
+        }
+        envelope[d] = as_bytes(f);
+        envelope_short[d] = as_bytes(s);
+    }
+
+    qa_case cases[] = {
+        { "char", FORMAT_CHAR, { &samples[0], &samples[1] }, "threshold:0.5" },
+        { "packed", FORMAT_PACKED, { &packed[0], &packed[1] }, "threshold:0.5" },
+        { "float", FORMAT_FLOAT, { &envelope[0], &envelope[1] }, "threshold:0.5" },
+        { "short", FORMAT_SHORT, { &envelope_short[0], &envelope_short[1] }, "threshold:4096" },
+    };
+    std::vector<nfc_frame> reference = decode_serial(cases[0]);
+
+    for (int d = 0; d < 2; d++) {
+        failures += !check_modulated(reference, sent[d], d);
+    }
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        std::vector<nfc_frame> frames = decode_serial(cases[i]);
+
+        if ((diff = compare_frames(frames, reference)) >= 0) {
+            fprintf(stderr, "%s: serial decoding differs from the char capture at frame %d "
+                    "(%zu frames, %zu expected)\n", cases[i].name, diff, frames.size(),
+                    reference.size());
+            failures++;
+        }
+        failures += check_chunks(cases[i], frames);
+    }
+
+    static const char *names[2] = { "reader", "tag" };
+    qa_temp_dir dir;
+    bool written = dir.ok();
+    std::string paths[2][6], stereo_path = dir.path("stereo.s16.wav");
+
+    for (int d = 0; d < 2 && written; d++) {
+        std::string base = names[d];
+        const std::vector<unsigned char> *mono[1] = { &samples[d] };
+
+        paths[d][0] = dir.path(base + ".char");
+        paths[d][1] = dir.path(base + ".f32");
+        paths[d][2] = dir.path(base + ".nfcb");
+        paths[d][3] = dir.path(base + ".nfcr");
+        paths[d][4] = dir.path(base + ".f32.wav");
+        paths[d][5] = dir.path(base + ".s16.wav");
+        written = write_file(paths[d][0], samples[d]) && write_file(paths[d][1], envelope[d]) &&
+            write_packed<nfcb_writer>(paths[d][2], samples[d], d) &&
+            write_packed<nfcr_writer>(paths[d][3], samples[d], d) &&
+            write_wav(paths[d][4], mono, 1, true) && write_wav(paths[d][5], mono, 1, false);
+    }
+
+    const std::vector<unsigned char> *stereo[2] = { &samples[NFC_READER], &samples[NFC_TAG] };
+    written = written && write_wav(stereo_path, stereo, 2, false);
+
+    if (!written) {
+        failures++;
+    } else {
+        const std::string *r = paths[NFC_READER], *t = paths[NFC_TAG];
+        qa_file_case file_cases[] = {
+            { "char", FORMAT_CHAR, { r[0], t[0] }, { 0, 0 }, "threshold:0.5", true },
+            { "float", FORMAT_FLOAT, { r[1], t[1] }, { 0, 0 }, "threshold:0.5", true },
+            { "nfcb", FORMAT_NFCB, { r[2], t[2] }, { 0, 0 }, "threshold:0.5", true },
+            { "nfcr", FORMAT_NFCR, { r[3], t[3] }, { 0, 0 }, "threshold:0.5", false },
+            { "float wav", FORMAT_WAV, { r[4], t[4] }, { 0, 0 }, "threshold:0.5", true },
+            { "16-bit wav", FORMAT_WAV, { r[5], t[5] }, { 0, 0 }, "threshold:4096", true },
+            { "stereo wav", FORMAT_WAV, { stereo_path, stereo_path }, { 0, 1 },
+              "threshold:4096", false },
+        };
+
+        for (size_t i = 0; i < sizeof(file_cases) / sizeof(file_cases[0]); i++) {
+            failures += check_files(file_cases[i], reference);
+        }
+    }
+
+    if (failures) {
+        fprintf(stderr, "%s: %d failures\n", argv[0], failures);
+        return 1;
+    }
+
+    return 0;
+}
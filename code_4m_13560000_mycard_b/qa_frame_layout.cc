@@ -0,0 +1,310 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * qa_frame_layout: byte layout of the pcapng and Proxmark3 outputs, read
+ * back field by field the way Wireshark and the Proxmark client do.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "frame_output.h"
+#include "qa_util.h"
+
+using namespace gr::nfc;
+
+#define QA_SAMPLE_RATE                  4e6
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static uint64_t
+get_le (const unsigned char *p, int n)
+{
+    uint64_t v = 0;
+
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static nfc_frame
+make_frame (int direction, uint64_t start, uint64_t end, const unsigned char *data,
+            unsigned int len, unsigned char flags)
+{
+    nfc_frame f;
+
+    memset(&f, 0, sizeof(f));
+    f.direction = (unsigned char) direction;
+    f.start = start;
+    f.end = end;
+    f.len = (unsigned short) len;
+    f.flags = flags;
+    f.nbits = (unsigned short) (flags & FRAME_SHORT ? 7 : 9 * len);
+    memcpy(f.data, data, len);
+    for (unsigned int i = 0; i < len; i++) {
+        /* Any bits, they are copied as received */
+        f.parity[i / 8] |= (data[i] & 1) << (7 - i % 8);
+    }
+
+    return f;
+}
+
+/* REQA, ATQA, a SELECT with its CRC_A, a broken tag frame with a parity
+ * error, and a frame past the 32-bit tick counter of the Proxmark
+ */
+static std::vector<nfc_frame>
+make_frames (uint64_t origin)
+{
+    static const unsigned char reqa[] = { 0x26 };
+    static const unsigned char atqa[] = { 0x44, 0x00 };
+    static const unsigned char select[] = { 0x93, 0x70, 0x88, 0x04, 0x72, 0x56, 0xa8, 0x00, 0xe0,
+                                            0x00, 0x00 };
+    static const unsigned char bad[] = { 0x04, 0xda, 0x17, 0x55, 0xaa, 0x01, 0x02, 0x03, 0x04 };
+    std::vector<nfc_frame> frames;
+    unsigned char crc_select[sizeof(select)];
+    uint16_t crc = nfc_crc_a(select, sizeof(select) - 2);
+
+    memcpy(crc_select, select, sizeof(select));
+    crc_select[sizeof(select) - 2] = crc & 0xff;
+    crc_select[sizeof(select) - 1] = crc >> 8;
+
+    frames.push_back(make_frame(NFC_READER, origin + 2000, origin + 2263, reqa, 1, FRAME_SHORT));
+    frames.push_back(make_frame(NFC_TAG, origin + 2600, origin + 3300, atqa, 2, 0));
+    frames.push_back(make_frame(NFC_READER, origin + 6000, origin + 9700, crc_select,
+                                sizeof(crc_select), 0));
+    frames.push_back(make_frame(NFC_TAG, origin + 10000, origin + 13000, bad, sizeof(bad),
+                                FRAME_PARITY_ERROR | FRAME_BROKEN));
+    frames.push_back(make_frame(NFC_READER, origin + uint64_t(320 * QA_SAMPLE_RATE),
+                                origin + uint64_t(320 * QA_SAMPLE_RATE) + 400000, reqa, 1,
+                                FRAME_SHORT));
+
+    return frames;
+}
+
+static bool
+write_file (const std::string &spec, const output_info &info, const std::vector<nfc_frame> &frames,
+            std::vector<unsigned char> *contents)
+{
+    const char *path = strchr(spec.c_str(), ':') + 1;
+    frame_output *out = open_frame_output(spec.c_str(), info);
+    FILE *fp;
+    bool ok;
+
+    if (!out) {
+        return false;
+    }
+    for (size_t i = 0; i < frames.size(); i++) {
+        out->write(frames[i]);
+    }
+    ok = out->close();
+    delete out;
+
+    if (!ok || !(fp = fopen(path, "rb"))) {
+        return false;
+    }
+    unsigned char buf[4096];
+    size_t n;
+
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        contents->insert(contents->end(), buf, buf + n);
+    }
+    fclose(fp);
+
+    return true;
+}
+
+/* Options of a block from \p p to \p end: code -> value */
+static bool
+find_option (const unsigned char *p, const unsigned char *end, int code, std::string *value)
+{
+    while (p + 4 <= end) {
+        int c = int(get_le(p, 2));
+        size_t len = get_le(p + 2, 2);
+
+        if (c == 0) {
+            return false;
+        }
+        if (c == code) {
+            value->assign((const char *) p + 4, len);
+            return true;
+        }
+        p += 4 + ((len + 3) & ~size_t(3));
+    }
+
+    return false;
+}
+
+static void
+check_pcapng (const std::vector<unsigned char> &file, const output_info &info,
+              const std::vector<nfc_frame> &frames)
+{
+    const unsigned char *p = file.data(), *end = p + file.size();
+    std::string option;
+    size_t k = 0;
+
+    /* Section header: byte order magic, version 1.0, length unknown */
+    CHECK(file.size() >= 28);
+    if (file.size() < 28) {
+        return;
+    }
+    CHECK(get_le(p, 4) == 0x0A0D0D0A);
+    CHECK(get_le(p + 8, 4) == 0x1A2B3C4D);
+    CHECK(get_le(p + 12, 2) == 1 && get_le(p + 14, 2) == 0);
+    CHECK(get_le(p + 16, 8) == UINT64_MAX);
+
+    /* Blocks: lengths at both ends, 32-bit aligned */
+    int idb = 0;
+
+    while (p + 12 <= end) {
+        uint32_t type = uint32_t(get_le(p, 4));
+        size_t len = get_le(p + 4, 4);
+
+        CHECK(len % 4 == 0 && len >= 12 && p + len <= end);
+        if (len % 4 || len < 12 || p + len > end) {
+            return;
+        }
+        CHECK(get_le(p + len - 4, 4) == len);
+
+        if (type == 1) {
+            /* LINKTYPE_ISO_14443, no snap length, ns timestamps */
+            idb++;
+            CHECK(get_le(p + 8, 2) == 264);
+            CHECK(get_le(p + 12, 4) == 0);
+            CHECK(find_option(p + 16, p + len - 4, 9, &option) && option == "\x09");
+        } else if (type == 6) {
+            CHECK(k < frames.size());
+            if (k == frames.size()) {
+                return;
+            }
+            const nfc_frame &f = frames[k++];
+            uint64_t ts = (get_le(p + 12, 4) << 32) | get_le(p + 16, 4);
+            size_t caplen = get_le(p + 20, 4);
+            const unsigned char *pkt = p + 28;
+            const unsigned char *options = pkt + ((caplen + 3) & ~size_t(3));
+            uint32_t flags;
+
+            CHECK(idb == 1);
+            CHECK(get_le(p + 8, 4) == 0);
+            CHECK(int64_t(ts) == output_time_ns(info, f.start));
+            CHECK(caplen == 4u + f.len && get_le(p + 24, 4) == caplen);
+
+            /* Pseudo-header: version, event, length big-endian */
+            CHECK(pkt[0] == 0);
+            CHECK(pkt[1] == (f.direction == NFC_READER ? 0xFE : 0xFF));
+            CHECK(pkt[2] == (f.len >> 8) && pkt[3] == (f.len & 0xff));
+            CHECK(memcmp(pkt + 4, f.data, f.len) == 0);
+
+            CHECK(find_option(options, p + len - 4, 2, &option) && option.size() == 4);
+            flags = uint32_t(get_le((const unsigned char *) option.data(), 4));
+            CHECK((flags & 3) == (f.direction == NFC_READER ? 2u : 1u));
+            CHECK(bool(flags & (1U << 31)) == bool(f.flags & FRAME_PARITY_ERROR));
+            CHECK(bool(flags & (1U << 28)) == bool(f.flags & FRAME_BROKEN));
+
+            bool commented = find_option(options, p + len - 4, 1, &option);
+
+            if (nfc_frame_crc_ok(f)) {
+                CHECK(commented && option.compare(0, 8, "CRC_A ok") == 0);
+            } else if (f.flags & (FRAME_PARITY_ERROR | FRAME_BROKEN)) {
+                CHECK(commented && option == "parity error, broken");
+            } else {
+                CHECK(!commented);
+            }
+        } else {
+            CHECK(type == 0x0A0D0D0A && p == file.data());
+        }
+        p += len;
+    }
+
+    CHECK(p == end);
+    CHECK(k == frames.size());
+}
+
+static void
+check_proxmark (const std::vector<unsigned char> &file, const output_info &info,
+                const std::vector<nfc_frame> &frames)
+{
+    const unsigned char *p = file.data(), *end = p + file.size();
+    double ticks_per_sample = 13.56e6 / info.sample_rate;
+    size_t k = 0;
+
+    while (p + 8 <= end && k < frames.size()) {
+        const nfc_frame &f = frames[k++];
+        uint64_t ticks = uint64_t((f.start - info.start_sample) * ticks_per_sample + 0.5);
+        uint64_t duration = uint64_t((f.end - f.start) * ticks_per_sample + 0.5);
+        size_t len = get_le(p + 6, 2) & 0x7fff;
+        size_t nparity = (len + 7) / 8;
+
+        /* Start time wraps like the 32-bit counter of the device */
+        CHECK(get_le(p, 4) == (ticks & 0xffffffff));
+        CHECK(get_le(p + 4, 2) == (duration > 65535 ? 65535 : duration));
+        CHECK(bool(get_le(p + 6, 2) & 0x8000) == (f.direction == NFC_TAG));
+        CHECK(len == f.len && p + 8 + len + nparity <= end);
+        if (len != f.len || p + 8 + len + nparity > end) {
+            return;
+        }
+        CHECK(memcmp(p + 8, f.data, len) == 0);
+        CHECK(memcmp(p + 8 + len, f.parity, nparity) == 0);
+        p += 8 + len + nparity;
+    }
+
+    CHECK(p == end);
+    CHECK(k == frames.size());
+}
+
+int
+main (int argc, char **argv)
+{
+    qa_temp_dir dir;
+    std::vector<unsigned char> pcapng, proxmark;
+    output_info info;
+
+    if (!dir.ok()) {
+        return 1;
+    }
+
+    info.sample_rate = QA_SAMPLE_RATE;
+    info.start_time_ns = 1700000000000000000LL;
+    info.start_sample = 12345;
+    info.positions = false;
+
+    std::vector<nfc_frame> frames = make_frames(info.start_sample);
+
+    CHECK(write_file("pcapng:" + dir.path("frames.pcapng"), info, frames, &pcapng));
+    CHECK(write_file("proxmark:" + dir.path("frames.trace"), info, frames, &proxmark));
+
+    check_pcapng(pcapng, info, frames);
+    check_proxmark(proxmark, info, frames);
+
+    if (failures) {
+        fprintf(stderr, "%s: %d failures\n", argv[0], failures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,521 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * qa_frame_record: frames written by the bin, cbin and jsonl outputs must
+ * read back unchanged, through frame_record_reader for the binary files
+ * and by parsing the lines for jsonl. A file cut in the middle of a
+ * record must give the frames before it and report the truncation.
+ *
+ * The frame store must give them back as well, and the UID each session
+ * selected from its SELECT on: a double size UID, a single size one,
+ * then the first again.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "frame_output.h"
+#include "frame_record.h"
+#include "frame_store.h"
+#include "qa_util.h"
+
+using namespace gr::nfc;
+
+/* More than two blocks of a compact file */
+#define QA_FRAMES                       (2 * FRAME_BLOCK_FRAMES + 1000)
+
+static uint32_t qa_seed = 1;
+
+static uint32_t
+qa_rand (uint32_t n)
+{
+    qa_seed = qa_seed * 1103515245 + 12345;
+    return (qa_seed >> 8) % n;
+}
+
+/* Frames of every shape: short ones, CRC_A, errors, long ones, starts
+ * going back (the other direction) and far forward
+ */
+static std::vector<nfc_frame>
+make_frames ()
+{
+    std::vector<nfc_frame> frames(QA_FRAMES);
+    uint64_t start = 1000;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        nfc_frame &f = frames[i];
+        uint32_t kind = qa_rand(8);
+
+        memset(&f, 0, sizeof(f));
+        f.direction = qa_rand(2) ? NFC_TAG : NFC_READER;
+
+        if (kind == 0) {
+            f.len = 1;
+            f.data[0] = qa_rand(2) ? 0x26 : 0x52;
+            f.nbits = 7;
+            f.flags = FRAME_SHORT;
+            f.status[0] = BYTE_SHORT;
+        } else {
+            f.len = kind == 7 ? 1 + qa_rand(NFC_MAX_FRAME_BITS / 9) : 1 + qa_rand(20);
+            for (unsigned int k = 0; k < f.len; k++) {
+                f.data[k] = qa_rand(256);
+                f.status[k] = qa_rand(16) ? BYTE_OK : BYTE_PARITY_ERROR;
+                if (f.status[k] == BYTE_PARITY_ERROR) {
+                    f.flags |= FRAME_PARITY_ERROR;
+                }
+            }
+            for (unsigned int k = 0; k < (f.len + 7u) / 8; k++) {
+                f.parity[k] = qa_rand(256);
+            }
+            if (kind == 1 && f.len > 2) {
+                uint16_t crc = nfc_crc_a(f.data, f.len - 2);
+
+                f.data[f.len - 2] = crc & 0xff;
+                f.data[f.len - 1] = crc >> 8;
+            }
+            f.nbits = 9 * f.len;
+            if (kind == 2) {
+                f.flags |= FRAME_BROKEN;
+                f.status[f.len - 1] = BYTE_BROKEN;
+                f.nbits -= 1 + qa_rand(8);
+            }
+            if (kind == 3) {
+                f.flags |= FRAME_NO_PARITY;
+                f.nbits = 8 * f.len;
+            }
+        }
+
+        if (kind == 4 && start > 5000) {
+            start -= qa_rand(5000);
+        } else if (kind == 5) {
+            start += uint64_t(1) << (20 + qa_rand(20));
+        } else {
+            start += 300 + qa_rand(10000);
+        }
+        f.start = start;
+        f.end = start + f.nbits * 38 + qa_rand(40);
+    }
+
+    return frames;
+}
+
+static bool
+same_frame (const nfc_frame &a, const nfc_frame &b)
+{
+    return a.start == b.start && a.end == b.end && a.direction == b.direction &&
+        a.flags == b.flags && a.nbits == b.nbits && a.len == b.len &&
+        memcmp(a.data, b.data, a.len) == 0 && memcmp(a.status, b.status, a.len) == 0 &&
+        memcmp(a.parity, b.parity, (a.len + 7) / 8) == 0;
+}
+
+static bool
+write_frames (const std::string &spec, const output_info &info,
+              const std::vector<nfc_frame> &frames)
+{
+    frame_output *out = open_frame_output(spec.c_str(), info);
+    bool ok;
+
+    if (!out) {
+        return false;
+    }
+    for (size_t i = 0; i < frames.size(); i++) {
+        out->write(frames[i]);
+    }
+    ok = out->close();
+    delete out;
+
+    return ok;
+}
+
+/* Frames of \p path must be the first \p count of \p frames, and the
+ * file truncated or not. Returns the failures.
+ */
+static int
+read_frames (const char *name, const std::string &path, const output_info &info,
+             const std::vector<nfc_frame> &frames, size_t count, bool truncated)
+{
+    frame_record_reader reader;
+    nfc_frame frame;
+    int64_t time_ns;
+    size_t n = 0;
+
+    if (!reader.open(path.c_str())) {
+        return 1;
+    }
+    if (reader.sample_rate() != info.sample_rate ||
+        reader.start_time_ns() != info.start_time_ns ||
+        reader.start_sample() != info.start_sample) {
+        fprintf(stderr, "%s: header differs\n", name);
+        return 1;
+    }
+
+    while (reader.next(&frame, &time_ns)) {
+        if (n == count || !same_frame(frame, frames[n]) ||
+            time_ns != output_time_ns(info, frames[n].start)) {
+            fprintf(stderr, "%s: frame %zu differs\n", name, n);
+            return 1;
+        }
+        n++;
+    }
+    if (n != count || reader.truncated() != truncated) {
+        fprintf(stderr, "%s: %zu frames read out of %zu, truncated %d\n", name, n, count,
+                int(reader.truncated()));
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Value of "key" in a JSON line, NULL if absent */
+static const char *
+json_value (const char *line, const char *key)
+{
+    std::string pattern = std::string("\"") + key + "\":";
+    const char *p = strstr(line, pattern.c_str());
+
+    return p ? p + pattern.size() : NULL;
+}
+
+static bool
+json_bool (const char *line, const char *key, bool *v)
+{
+    const char *p = json_value(line, key);
+
+    if (!p) {
+        return false;
+    }
+    *v = strncmp(p, "true", 4) == 0;
+    return *v || strncmp(p, "false", 5) == 0;
+}
+
+static bool
+json_int (const char *line, const char *key, long long *v)
+{
+    const char *p = json_value(line, key);
+    char *end;
+
+    if (!p) {
+        return false;
+    }
+    *v = strtoll(p, &end, 10);
+    return end != p;
+}
+
+/* Quoted string value, into \p out */
+static bool
+json_string (const char *line, const char *key, std::string *out)
+{
+    const char *p = json_value(line, key);
+    const char *end;
+
+    if (!p || *p != '"' || !(end = strchr(p + 1, '"'))) {
+        return false;
+    }
+    out->assign(p + 1, end);
+    return true;
+}
+
+static bool
+parse_hex (const std::string &s, unsigned char *out, size_t n)
+{
+    if (s.size() != 2 * n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (unsigned char) strtoul(s.substr(2 * i, 2).c_str(), NULL, 16);
+    }
+    return true;
+}
+
+/* Frame of a JSON line (see frame_json_encode), false if malformed */
+static bool
+json_decode (const char *line, nfc_frame *f, int64_t *time_ns, bool *crc_ok)
+{
+    static const char status_letters[] = "opbs";
+    long long start, end, t, nbits;
+    std::string dir, data, status, parity;
+    bool is_short, broken, parity_error, no_parity;
+
+    if (!json_int(line, "start", &start) || !json_int(line, "end", &end) ||
+        !json_int(line, "time_ns", &t) || !json_int(line, "nbits", &nbits) ||
+        !json_string(line, "dir", &dir) || !json_string(line, "data", &data) ||
+        !json_string(line, "status", &status) || !json_string(line, "parity", &parity) ||
+        !json_bool(line, "crc_ok", crc_ok) || !json_bool(line, "short", &is_short) ||
+        !json_bool(line, "broken", &broken) || !json_bool(line, "parity_error", &parity_error) ||
+        !json_bool(line, "no_parity", &no_parity)) {
+        return false;
+    }
+
+    memset(f, 0, sizeof(*f));
+    f->start = uint64_t(start);
+    f->end = uint64_t(end);
+    f->direction = dir == "tag" ? NFC_TAG : NFC_READER;
+    f->nbits = (unsigned short) nbits;
+    f->len = (unsigned short) status.size();
+    f->flags = (is_short ? FRAME_SHORT : 0) | (broken ? FRAME_BROKEN : 0) |
+        (parity_error ? FRAME_PARITY_ERROR : 0) | (no_parity ? FRAME_NO_PARITY : 0);
+    for (size_t i = 0; i < status.size(); i++) {
+        const char *s = strchr(status_letters, status[i]);
+
+        if (!s || !*s) {
+            return false;
+        }
+        f->status[i] = (unsigned char) (s - status_letters);
+    }
+    *time_ns = t;
+
+    return (dir == "reader" || dir == "tag") &&
+        parse_hex(data, f->data, f->len) && parse_hex(parity, f->parity, (f->len + 7) / 8);
+}
+
+static int
+read_json (const std::string &path, const output_info &info, const std::vector<nfc_frame> &frames)
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    std::vector<char> line(FRAME_JSON_MAX + 1);
+    size_t n = 0;
+
+    if (!fp) {
+        perror(path.c_str());
+        return 1;
+    }
+    while (fgets(&line[0], int(line.size()), fp)) {
+        nfc_frame frame;
+        int64_t time_ns;
+        bool crc_ok;
+
+        if (n == frames.size() || !json_decode(&line[0], &frame, &time_ns, &crc_ok) ||
+            !same_frame(frame, frames[n]) || crc_ok != nfc_frame_crc_ok(frames[n]) ||
+            time_ns != output_time_ns(info, frames[n].start)) {
+            fprintf(stderr, "jsonl: line %zu differs: %s", n + 1, &line[0]);
+            fclose(fp);
+            return 1;
+        }
+        n++;
+    }
+    fclose(fp);
+    if (n != frames.size()) {
+        fprintf(stderr, "jsonl: %zu lines out of %zu\n", n, frames.size());
+        return 1;
+    }
+
+    return 0;
+}
+
+static nfc_frame
+make_command (const unsigned char *data, unsigned int len, bool crc, uint64_t start)
+{
+    nfc_frame f;
+
+    memset(&f, 0, sizeof(f));
+    f.direction = NFC_READER;
+    f.len = len + (crc ? 2 : 0);
+    memcpy(f.data, data, len);
+    if (crc) {
+        uint16_t c = nfc_crc_a(data, len);
+
+        f.data[len] = c & 0xff;
+        f.data[len + 1] = c >> 8;
+    }
+    if (len == 1 && !crc) {
+        f.flags = FRAME_SHORT;
+        f.nbits = 7;
+        f.status[0] = BYTE_SHORT;
+    } else {
+        f.nbits = 9 * f.len;
+    }
+    f.start = start;
+    f.end = start + f.nbits * 38;
+
+    return f;
+}
+
+/* Sessions selecting UIDs, after \p start. The uid column entry
+ * expected for each frame goes in \p uids.
+ */
+static void
+add_sessions (std::vector<nfc_frame> *frames, std::vector<uint32_t> *uids, uint64_t start)
+{
+    static const unsigned char reqa[] = { 0x26 };
+    static const unsigned char wupa[] = { 0x52 };
+    static const unsigned char anticoll[] = { 0x93, 0x20 };
+    static const unsigned char cl1_cascade[] = { 0x93, 0x70, 0x88, 0x04, 0x72, 0x56, 0xa8 };
+    static const unsigned char cl2[] = { 0x95, 0x70, 0x1a, 0x2b, 0x3c, 0x4d, 0x40 };
+    static const unsigned char cl1[] = { 0x93, 0x70, 0xde, 0xad, 0xbe, 0xef, 0x22 };
+    static const unsigned char read[] = { 0x30, 0x04 };
+    static const struct {
+        const unsigned char *data;
+        unsigned int len;
+        bool crc;
+        uint32_t uid;
+    } commands[] = {
+        { reqa, 1, false, 0 },
+        { anticoll, 2, false, 0 },
+        { cl1_cascade, 7, true, 0 },
+        { cl2, 7, true, 1 },
+        { read, 2, true, 1 },
+        { wupa, 1, false, 0 },
+        { cl1, 7, true, 2 },
+        { read, 2, true, 2 },
+        { reqa, 1, false, 0 },
+        { cl1_cascade, 7, true, 0 },
+        { cl2, 7, true, 1 },
+        { read, 2, true, 1 },
+        { reqa, 1, false, 0 },
+        { read, 2, true, 0 },
+    };
+
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        start += 20000;
+        frames->push_back(make_command(commands[i].data, commands[i].len, commands[i].crc,
+                                       start));
+        uids->push_back(commands[i].uid);
+    }
+}
+
+/* Store of \p frames, read back, then its UIDs. Returns the failures. */
+static int
+check_store (qa_temp_dir &dir, const output_info &info, const std::vector<nfc_frame> &random)
+{
+    static const unsigned char uid7[] = { 0x04, 0x72, 0x56, 0x1a, 0x2b, 0x3c, 0x4d };
+    static const unsigned char uid4[] = { 0xde, 0xad, 0xbe, 0xef };
+    std::vector<nfc_frame> frames(random);
+    std::vector<uint32_t> uids(random.size(), 0);
+    std::string path = dir.path("store");
+    frame_store_reader store;
+    store_filter filter;
+
+    add_sessions(&frames, &uids, frames.back().start);
+
+    static const char *files[] = { "meta", "time.i64", "start.u64", "end.u64", "session.u32",
+                                   "uid.u32", "offset.u64", "len.u16", "nbits.u16", "dir.u8",
+                                   "flags.u8", "payload", "uids", "zones" };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        dir.path(std::string("store/") + files[i]);
+    }
+
+    if (!write_frames("store:" + path, info, frames) || !store.open(path.c_str())) {
+        return 1;
+    }
+    if (store.rows() != frames.size()) {
+        fprintf(stderr, "store: %llu rows out of %zu\n", (unsigned long long) store.rows(),
+                frames.size());
+        return 1;
+    }
+    for (size_t i = 0; i < frames.size(); i++) {
+        nfc_frame frame;
+        int64_t time_ns;
+
+        store.frame(i, &frame, &time_ns);
+        if (!same_frame(frame, frames[i]) || time_ns != output_time_ns(info, frames[i].start) ||
+            store.uid()[i] != uids[i]) {
+            fprintf(stderr, "store: row %zu differs\n", i);
+            return 1;
+        }
+    }
+
+    const store_uid *first = store.uid_entry(1), *second = store.uid_entry(2);
+    if (!first || first->len != sizeof(uid7) || memcmp(first->uid, uid7, sizeof(uid7)) ||
+        !second || second->len != sizeof(uid4) || memcmp(second->uid, uid4, sizeof(uid4)) ||
+        store.uid_entry(3) || store.find_uid(uid4, sizeof(uid4)) != 2 ||
+        store.find_uid(uid7, 4) != 0) {
+        fprintf(stderr, "store: wrong UIDs\n");
+        return 1;
+    }
+
+    filter.uid_min = filter.uid_max = 1;
+    if (store.count(filter) != 4) {
+        fprintf(stderr, "store: %llu frames of the first UID\n",
+                (unsigned long long) store.count(filter));
+        return 1;
+    }
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    std::vector<nfc_frame> frames = make_frames();
+    qa_temp_dir dir;
+    output_info info;
+    int failures = 0;
+
+    if (!dir.ok()) {
+        return 1;
+    }
+
+    info.sample_rate = 4e6;
+    info.start_time_ns = 1700000000123456789LL;
+    info.start_sample = 1000;
+    info.positions = false;
+
+    static const char *formats[] = { "bin", "cbin" };
+
+    for (int i = 0; i < 2; i++) {
+        std::string path = dir.path(std::string("frames.") + formats[i]);
+        std::string cut_name = std::string(formats[i]) + " cut";
+        size_t complete = frames.size();
+
+        if (!write_frames(std::string(formats[i]) + ":" + path, info, frames)) {
+            failures++;
+            continue;
+        }
+        failures += read_frames(formats[i], path, info, frames, frames.size(), false);
+
+        /* Three bytes short: the last record, or the last block, is lost */
+        FILE *fp = fopen(path.c_str(), "rb");
+        long size = -1;
+
+        if (fp && fseek(fp, 0, SEEK_END) == 0) {
+            size = ftell(fp);
+        }
+        if (fp) {
+            fclose(fp);
+        }
+        if (size < 3 || truncate(path.c_str(), size - 3) != 0) {
+            perror(path.c_str());
+            failures++;
+        } else {
+            complete = i == 0 ? frames.size() - 1 :
+                frames.size() / FRAME_BLOCK_FRAMES * FRAME_BLOCK_FRAMES;
+            failures += read_frames(cut_name.c_str(), path, info, frames, complete, true);
+        }
+    }
+
+    std::string json_path = dir.path("frames.jsonl");
+
+    if (!write_frames("jsonl:" + json_path, info, frames)) {
+        failures++;
+    } else {
+        failures += read_json(json_path, info, frames);
+    }
+
+    failures += check_store(dir, info, frames);
+
+    if (failures) {
+        fprintf(stderr, "%s: %d failures\n", argv[0], failures);
+        return 1;
+    }
+
+    return 0;
+}
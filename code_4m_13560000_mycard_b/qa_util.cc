@@ -0,0 +1,59 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "qa_util.h"
+
+namespace gr {
+  namespace nfc {
+
+    qa_temp_dir::qa_temp_dir()
+    {
+        const char *tmp = getenv("TMPDIR");
+        std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/qa_nfc.XXXXXX";
+
+        if (mkdtemp(&dir[0])) {
+            d_dir = dir;
+        } else {
+            perror(dir.c_str());
+        }
+    }
+
+    qa_temp_dir::~qa_temp_dir()
+    {
+        if (d_dir.empty()) {
+            return;
+        }
+        /* Newest first: the files of a directory before the directory */
+        for (size_t i = d_files.size(); i-- > 0; ) {
+            remove(d_files[i].c_str());
+        }
+        rmdir(d_dir.c_str());
+    }
+
+    std::string
+    qa_temp_dir::path(const std::string &name)
+    {
+        d_files.push_back(d_dir + "/" + name);
+        return d_files.back();
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
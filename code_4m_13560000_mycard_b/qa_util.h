@@ -0,0 +1,58 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_QA_UTIL_H
+#define INCLUDED_NFC_QA_UTIL_H
+
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Scratch directory of a test, under $TMPDIR (default /tmp).
+     *
+     * Removed on destruction together with the files and directories
+     * named through path(), a directory being named before its files.
+     */
+    class qa_temp_dir
+    {
+     public:
+      qa_temp_dir();
+      ~qa_temp_dir();
+
+      /*! False if the directory could not be created (already reported) */
+      bool ok() const { return !d_dir.empty(); }
+
+      /*! Path of \p name in the directory, removed with it */
+      std::string path(const std::string &name);
+
+     private:
+      /* Owns the directory */
+      qa_temp_dir(const qa_temp_dir &);
+      qa_temp_dir &operator=(const qa_temp_dir &);
+
+      std::string d_dir;
+      std::vector<std::string> d_files;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_QA_UTIL_H */
@@ -0,0 +1,531 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <sys/stat.h>
+#include "frame_correlator.h"
+#include "snippet_recorder.h"
+
+namespace gr {
+  namespace nfc {
+
+    static const char *
+    format_name (sample_format format)
+    {
+        switch (format) {
+        case FORMAT_PACKED:
+            return "packed";
+        case FORMAT_FLOAT:
+            return "float";
+        case FORMAT_SHORT:
+            return "short";
+        default:
+            return "char";
+        }
+    }
+
+    static const char *
+    event_name (unsigned int kind)
+    {
+        if (kind & SNIPPET_UID) {
+            return "uid";
+        } else if (kind & SNIPPET_CRC) {
+            return "crc";
+        } else if (kind & SNIPPET_PARITY) {
+            return "parity";
+        } else if (kind & SNIPPET_REQUEST) {
+            return "request";
+        }
+        return "tag";
+    }
+
+    snippet_config::snippet_config()
+      : events(0),
+        uid_len(0),
+        pre(UINT64_MAX),
+        post(UINT64_MAX),
+        dir("."),
+        max_snippets(0)
+    {
+    }
+
+    bool
+    snippet_config::parse_events(const char *s)
+    {
+        std::string list(s);
+        size_t begin = 0;
+
+        while (begin <= list.size()) {
+            size_t comma = list.find(',', begin);
+            std::string event = list.substr(begin, comma == std::string::npos ?
+                                            std::string::npos : comma - begin);
+
+            if (event == "tag") {
+                events |= SNIPPET_TAG;
+            } else if (event == "request") {
+                events |= SNIPPET_REQUEST;
+            } else if (event == "parity") {
+                events |= SNIPPET_PARITY;
+            } else if (event == "crc") {
+                events |= SNIPPET_CRC;
+            } else if (event.compare(0, 4, "uid:") == 0) {
+                std::string hex = event.substr(4);
+
+                if (!nfc_parse_uid(hex.c_str(), uid, &uid_len)) {
+                    fprintf(stderr, "Bad UID %s, 4, 7 or 10 bytes in hex\n", hex.c_str());
+                    return false;
+                }
+                events |= SNIPPET_UID;
+            } else {
+                fprintf(stderr, "Unknown snippet event %s\n", event.c_str());
+                return false;
+            }
+
+            if (comma == std::string::npos) {
+                break;
+            }
+            begin = comma + 1;
+        }
+
+        return true;
+    }
+
+    bool
+    snippet_config::parse_window(const char *s, double sample_rate)
+    {
+        std::string window(s);
+        size_t comma = window.find(',');
+
+        if (!parse_position(window.substr(0, comma).c_str(), sample_rate, &pre) ||
+            (comma != std::string::npos &&
+             !parse_position(window.substr(comma + 1).c_str(), sample_rate, &post))) {
+            fprintf(stderr, "Bad snippet window %s\n", s);
+            return false;
+        }
+        if (comma == std::string::npos) {
+            post = pre;
+        }
+
+        return true;
+    }
+
+    bool
+    nfc_frame_expects_crc (const nfc_frame &frame)
+    {
+        if ((frame.flags & (FRAME_SHORT | FRAME_BROKEN)) || frame.len < 3) {
+            return false;
+        }
+
+        if (frame.direction == NFC_READER) {
+            /* Anticollision frames carry a partial UID, only SELECT has a CRC */
+            unsigned char cmd = frame.data[0];
+
+            if (cmd == ISO14443_SEL_CL1 || cmd == ISO14443_SEL_CL2 || cmd == ISO14443_SEL_CL3) {
+                return frame.data[1] == ISO14443_NVB_SELECT;
+            }
+            return true;
+        }
+
+        /* UID CLn and its BCC */
+        return !(frame.len == 5 &&
+                 (frame.data[0] ^ frame.data[1] ^ frame.data[2] ^ frame.data[3]) == frame.data[4]);
+    }
+
+    sample_ring::sample_ring()
+      : d_item_size(1),
+        d_item_samples(1),
+        d_capacity(0),
+        d_base(0),
+        d_count(0)
+    {
+    }
+
+    void
+    sample_ring::init(sample_format format, uint64_t samples)
+    {
+        d_item_size = format_item_size(format);
+        d_item_samples = format_item_samples(format);
+        d_capacity = (samples + d_item_samples - 1) / d_item_samples;
+        d_buf.assign(size_t(d_capacity) * d_item_size, 0);
+        d_base = 0;
+        d_count = 0;
+    }
+
+    uint64_t
+    sample_ring::begin() const
+    {
+        return d_base + (d_count > d_capacity ? d_count - d_capacity : 0) * d_item_samples;
+    }
+
+    void
+    sample_ring::push(uint64_t position, const void *items, int nitems)
+    {
+        const unsigned char *in = (const unsigned char *) items;
+        uint64_t n = uint64_t(nitems);
+
+        if (d_count == 0 || position != end()) {
+            /* Discontinuity, the samples before it are of no use any more */
+            d_base = position;
+            d_count = 0;
+        }
+
+        if (n > d_capacity) {
+            /* Only the last ones survive */
+            in += (n - d_capacity) * d_item_size;
+            d_count += n - d_capacity;
+            n = d_capacity;
+        }
+
+        while (n > 0) {
+            uint64_t slot = d_count % d_capacity;
+            uint64_t len = std::min(n, d_capacity - slot);
+
+            memcpy(&d_buf[size_t(slot) * d_item_size], in, size_t(len) * d_item_size);
+            in += len * d_item_size;
+            d_count += len;
+            n -= len;
+        }
+    }
+
+    int64_t
+    sample_ring::write(FILE *fp, uint64_t from, uint64_t to, uint64_t *first) const
+    {
+        uint64_t lo = std::max(from, begin());
+        uint64_t hi = std::min(to, end());
+
+        *first = lo;
+        if (lo >= hi) {
+            return 0;
+        }
+
+        /* Whole items */
+        uint64_t item = (lo - d_base) / d_item_samples;
+        uint64_t stop = (hi - d_base + d_item_samples - 1) / d_item_samples;
+
+        *first = d_base + item * d_item_samples;
+        for (uint64_t i = item; i < stop; ) {
+            uint64_t slot = i % d_capacity;
+            uint64_t len = std::min(stop - i, d_capacity - slot);
+
+            if (fwrite(&d_buf[size_t(slot) * d_item_size], d_item_size, size_t(len), fp) != len) {
+                return -1;
+            }
+            i += len;
+        }
+
+        return int64_t((stop - item) * d_item_samples);
+    }
+
+    snippet_recorder::snippet_recorder(const snippet_config &config, const capture_job &job)
+      : d_config(config),
+        d_sample_rate(job.config().sample_rate),
+        d_last_start(0),
+        d_uid_level(0),
+        d_written(0),
+        d_skipped(0),
+        d_ok(true)
+    {
+        if (d_config.pre == UINT64_MAX) {
+            d_config.pre = uint64_t(SNIPPET_PRE_TIME * d_sample_rate);
+        }
+        if (d_config.post == UINT64_MAX) {
+            d_config.post = uint64_t(SNIPPET_POST_TIME * d_sample_rate);
+        }
+        d_margin = std::max(uint64_t(SNIPPET_MARGIN_TIME * d_sample_rate),
+                            uint64_t(SNIPPET_MARGIN_SAMPLES));
+
+        /*
+         * A snippet is written at most a quarter of the margin after its
+         * end, and may be extended by half of it: from its start to then
+         * it never exceeds the ring.
+         */
+        d_max_length = d_config.pre + d_config.post + d_margin / 2;
+
+        for (int d = 0; d < 2; d++) {
+            d_present[d] = !job.config().paths[d].empty();
+            d_formats[d] = job.item_format(d);
+            d_pos[d] = 0;
+            if (d_present[d]) {
+                d_rings[d].init(d_formats[d], d_config.pre + d_config.post + d_margin);
+            }
+        }
+    }
+
+    bool
+    snippet_recorder::open()
+    {
+        if (mkdir(d_config.dir.c_str(), 0755) < 0 && errno != EEXIST) {
+            perror(d_config.dir.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    unsigned int
+    snippet_recorder::triggers(const nfc_frame &frame)
+    {
+        unsigned int kind = 0;
+
+        if (frame.direction == NFC_TAG) {
+            kind |= SNIPPET_TAG;
+        }
+        if (nfc_frame_is_wakeup(frame)) {
+            kind |= SNIPPET_REQUEST;
+            d_uid_level = 0;
+        }
+        if (frame.flags & FRAME_PARITY_ERROR) {
+            kind |= SNIPPET_PARITY;
+        }
+        if (nfc_frame_expects_crc(frame) && !nfc_frame_crc_ok(frame)) {
+            kind |= SNIPPET_CRC;
+        }
+
+        if ((d_config.events & SNIPPET_UID) && frame.direction == NFC_TAG &&
+            frame.len == 5 && !nfc_frame_expects_crc(frame)) {
+            /*
+             * Answer of one cascade level: the cascade tag and 3 bytes of
+             * the UID but on the last level, 4 bytes there. Levels must be
+             * answered in order within a session.
+             */
+            unsigned int levels = (d_config.uid_len - 1) / 3;
+            unsigned char part[4];
+
+            for (int pass = 0; pass < 2; pass++) {
+                unsigned int level = d_uid_level;
+
+                if (level == levels - 1) {
+                    memcpy(part, d_config.uid + 3 * level, 4);
+                } else {
+                    part[0] = ISO14443_CASCADE_TAG;
+                    memcpy(part + 1, d_config.uid + 3 * level, 3);
+                }
+
+                if (!memcmp(part, frame.data, 4)) {
+                    d_uid_level++;
+                    break;
+                }
+                if (level == 0) {
+                    break;
+                }
+                /* Another card, maybe the first level of this one */
+                d_uid_level = 0;
+            }
+
+            if (d_uid_level == levels) {
+                kind |= SNIPPET_UID;
+                d_uid_level = 0;
+            }
+        }
+
+        return kind & d_config.events;
+    }
+
+    void
+    snippet_recorder::write(const nfc_frame &frame)
+    {
+        unsigned int kind = triggers(frame);
+
+        d_last_start = std::max(d_last_start, frame.start);
+        d_frames.push_back(frame);
+
+        if (kind) {
+            uint64_t start = frame.start > d_config.pre ? frame.start - d_config.pre : 0;
+            uint64_t end = frame.end + d_config.post;
+
+            if (!d_open.empty() && start <= d_open.back().end &&
+                end - d_open.back().start <= d_max_length) {
+                d_open.back().end = std::max(d_open.back().end, end);
+            } else {
+                snippet s;
+
+                s.start = start;
+                s.end = std::min(end, start + d_max_length);
+                s.nevents = 0;
+                s.dropped = 0;
+                d_open.push_back(s);
+            }
+
+            snippet &s = d_open.back();
+            if (s.nevents < SNIPPET_MAX_EVENTS) {
+                s.event_start[s.nevents] = frame.start;
+                s.event_direction[s.nevents] = frame.direction;
+                s.event_kind[s.nevents] = kind;
+                s.nevents++;
+            } else {
+                s.dropped++;
+            }
+        }
+
+        flush_ready(false);
+    }
+
+    void
+    snippet_recorder::samples(int d, uint64_t position, const void *items, int nitems)
+    {
+        d_rings[d].push(position, items, nitems);
+        d_pos[d] = d_rings[d].end();
+
+        flush_ready(false);
+    }
+
+    void
+    snippet_recorder::flush_ready(bool all)
+    {
+        uint64_t pos = UINT64_MAX;
+
+        for (int d = 0; d < 2; d++) {
+            if (d_present[d]) {
+                pos = std::min(pos, d_pos[d]);
+            }
+        }
+
+        while (!d_open.empty()) {
+            const snippet &s = d_open.front();
+
+            /* Frames come out in time order, the samples a little ahead of them */
+            if (!all && d_last_start < s.end && pos < s.end + d_margin / 4) {
+                break;
+            }
+
+            if (d_config.max_snippets && d_written >= d_config.max_snippets) {
+                d_skipped++;
+            } else if (!write_snippet(s)) {
+                d_ok = false;
+            }
+            d_open.pop_front();
+        }
+
+        /* Frames before the ring and the open snippets are of no use */
+        uint64_t keep = pos > d_config.pre + d_config.post + d_margin ?
+            pos - (d_config.pre + d_config.post + d_margin) : 0;
+
+        if (!d_open.empty()) {
+            keep = std::min(keep, d_open.front().start);
+        }
+        while (!d_frames.empty() && d_frames.front().end < keep) {
+            d_frames.pop_front();
+        }
+    }
+
+    bool
+    snippet_recorder::write_snippet(const snippet &s)
+    {
+        static const char *names[2] = { "reader", "tag" };
+        char base[64];
+        std::string paths[2];
+        uint64_t first[2] = { s.start, s.start };
+        int64_t lengths[2] = { 0, 0 };
+        uint64_t origin = UINT64_MAX;
+        bool ok = true;
+
+        snprintf(base, sizeof(base), "/snippet-%06lu", d_written + 1);
+
+        for (int d = 0; d < 2; d++) {
+            if (!d_present[d]) {
+                continue;
+            }
+
+            paths[d] = d_config.dir + base + "-" + names[d] + "." + format_name(d_formats[d]);
+            FILE *fp = fopen(paths[d].c_str(), "wb");
+
+            if (!fp) {
+                perror(paths[d].c_str());
+                return false;
+            }
+            lengths[d] = d_rings[d].write(fp, s.start, s.end, &first[d]);
+            if (fclose(fp) != 0 || lengths[d] < 0) {
+                perror(paths[d].c_str());
+                ok = false;
+            }
+            origin = std::min(origin, first[d]);
+        }
+
+        std::string path = d_config.dir + base + ".txt";
+        FILE *fp = fopen(path.c_str(), "w");
+
+        if (!fp) {
+            perror(path.c_str());
+            return false;
+        }
+
+        fprintf(fp, "# snippet %lu: samples %llu to %llu at %.0f Hz\n", d_written + 1,
+                (unsigned long long) s.start, (unsigned long long) s.end, d_sample_rate);
+        for (int d = 0; d < 2; d++) {
+            if (!d_present[d]) {
+                continue;
+            }
+            fprintf(fp, "# %s: %s, %lld samples from %llu", names[d],
+                    paths[d].c_str() + d_config.dir.size() + 1, (long long) lengths[d],
+                    (unsigned long long) first[d]);
+            if (first[d] > s.start) {
+                fprintf(fp, " (clipped)");
+            }
+            fprintf(fp, "\n");
+        }
+        fprintf(fp, "# positions below are relative to sample %llu\n",
+                (unsigned long long) origin);
+        for (unsigned int i = 0; i < s.nevents; i++) {
+            fprintf(fp, "# event %s: %s frame at %llu\n", event_name(s.event_kind[i]),
+                    names[s.event_direction[i]],
+                    (unsigned long long) (s.event_start[i] - origin));
+        }
+        if (s.dropped) {
+            fprintf(fp, "# %u more events\n", s.dropped);
+        }
+
+        for (size_t i = 0; i < d_frames.size(); i++) {
+            const nfc_frame &frame = d_frames[i];
+
+            if (frame.start < s.start || frame.start >= s.end || frame.start < origin) {
+                continue;
+            }
+
+            nfc_frame shifted = frame;
+            shifted.start -= origin;
+            shifted.end -= origin;
+            nfc_frame_print(fp, shifted, true);
+        }
+
+        if (fclose(fp) != 0) {
+            perror(path.c_str());
+            ok = false;
+        }
+
+        d_written++;
+        return ok;
+    }
+
+    bool
+    snippet_recorder::finish()
+    {
+        d_last_start = UINT64_MAX;
+        flush_ready(true);
+
+        return d_ok;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
@@ -0,0 +1,202 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_SNIPPET_RECORDER_H
+#define INCLUDED_NFC_SNIPPET_RECORDER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "capture_job.h"
+#include "nfc_frame.h"
+
+/* Default window kept before the first and after the last triggering
+ * frame of a snippet (s)
+ */
+#define SNIPPET_PRE_TIME                0.005
+#define SNIPPET_POST_TIME               0.005
+
+/* Samples held beyond the window: the longest frame (4096 bits at
+ * 106 kbit/s, 39 ms) and the delay between the samples and their frames
+ * coming out of the decoders, which is a few serial decoding chunks.
+ */
+#define SNIPPET_MARGIN_TIME             0.1
+#define SNIPPET_MARGIN_SAMPLES          262144
+
+/* Triggering frames listed in the annotation of a snippet */
+#define SNIPPET_MAX_EVENTS              64
+
+#define SNIPPET_USAGE \
+    "  -S EVENTS  keep the raw samples around the frames of EVENTS (comma\n" \
+    "             separated): tag (any tag frame), request (REQA/WUPA),\n" \
+    "             parity (parity error), crc (CRC_A failure) or uid:HEX\n" \
+    "             (anticollision of that UID). Serial decoding only.\n" \
+    "  -L PRE[,POST]  samples kept before and after the events (samples or\n" \
+    "             time, default 5ms each)\n" \
+    "  -D DIR     directory of the snippets (default .)\n" \
+    "  -N N       stop after N snippets (default no limit)\n"
+
+namespace gr {
+  namespace nfc {
+
+    enum snippet_event {
+        SNIPPET_TAG = 0x01,             /* Any tag frame */
+        SNIPPET_REQUEST = 0x02,         /* REQA or WUPA */
+        SNIPPET_PARITY = 0x04,          /* Frame with a parity error */
+        SNIPPET_CRC = 0x08,             /* Frame expected to end with a CRC_A that does not */
+        SNIPPET_UID = 0x10,             /* Last cascade level of a given UID answered */
+    };
+
+    /*!
+     * \brief What triggers a snippet and how much of the capture it keeps
+     */
+    struct snippet_config
+    {
+        snippet_config();
+
+        /*! Parse the -S list, false (and a message) on error */
+        bool parse_events(const char *s);
+
+        /*! Parse the -L window, false (and a message) on error */
+        bool parse_window(const char *s, double sample_rate);
+
+        unsigned int events;            /* snippet_event mask */
+        unsigned char uid[10];          /* 4, 7 or 10 bytes */
+        unsigned int uid_len;
+        uint64_t pre;                   /* Samples before the events, UINT64_MAX for the default */
+        uint64_t post;                  /* Samples after the events, likewise */
+        std::string dir;
+        unsigned long max_snippets;     /* 0 for no limit */
+    };
+
+    /*! True if \p frame is normally sent with a CRC_A: 3 bytes or more,
+     * complete, and neither an anticollision frame nor a UID answer
+     */
+    bool nfc_frame_expects_crc(const nfc_frame &frame);
+
+    /*!
+     * \brief The last capture items of one direction, overwritten in a
+     * circle. A discontinuity starts it over.
+     */
+    class sample_ring
+    {
+     public:
+      sample_ring();
+
+      /*! Hold at least \p samples samples of \p format items */
+      void init(sample_format format, uint64_t samples);
+
+      void push(uint64_t position, const void *items, int nitems);
+
+      /*! First sample held and sample after the last one */
+      uint64_t begin() const;
+      uint64_t end() const { return d_base + d_count * d_item_samples; }
+
+      /*!
+       * Write the items covering [\p from, \p to), clipped to what is
+       * held, to \p fp. The first sample written goes to \p first.
+       * Returns the samples written, -1 on a write error.
+       */
+      int64_t write(FILE *fp, uint64_t from, uint64_t to, uint64_t *first) const;
+
+     private:
+      std::vector<unsigned char> d_buf;
+      int d_item_size;
+      int d_item_samples;
+      uint64_t d_capacity;              /* Items */
+      uint64_t d_base;                  /* Sample of the first item since the start over */
+      uint64_t d_count;                 /* Items pushed since then */
+    };
+
+    /*!
+     * \brief Keeps the last raw samples of a serial decoding in memory and
+     * writes the part around some frames to disk.
+     *
+     * The recorder is both the sample_tap of the capture_job and one of
+     * the frame sinks. A ring per direction holds the window plus
+     * SNIPPET_MARGIN_TIME, so memory stays bounded whatever the length of
+     * the capture. A triggering frame opens a snippet from \p pre samples
+     * before its start to \p post samples after its end; triggers falling
+     * in an open snippet extend it. The snippet is written once a frame
+     * starting after it has come out, or once the samples are far enough
+     * past it, as:
+     *
+     *   snippet-NNNNNN-reader.FORMAT, snippet-NNNNNN-tag.FORMAT
+     *     the capture items of each direction, raw (.nfcb as packed,
+     *     WAV channels as float or short), for nfc_decode -f FORMAT
+     *   snippet-NNNNNN.txt
+     *     the absolute position of the first sample, the triggering
+     *     events and the frames of the window, with their positions in
+     *     the snippet (as nfc_decode -p prints them on the snippet)
+     */
+    class snippet_recorder : public frame_sink, public sample_tap
+    {
+     public:
+      snippet_recorder(const snippet_config &config, const capture_job &job);
+
+      /*! Create the directory, false (and a message) on error */
+      bool open();
+
+      void write(const nfc_frame &frame);
+      void samples(int d, uint64_t position, const void *items, int nitems);
+
+      /*! Write the snippets still open, false if any write failed */
+      bool finish();
+
+      unsigned long written() const { return d_written; }
+      unsigned long skipped() const { return d_skipped; }
+
+     private:
+      struct snippet
+      {
+          uint64_t start;
+          uint64_t end;
+          unsigned int nevents;
+          unsigned int dropped;
+          uint64_t event_start[SNIPPET_MAX_EVENTS];
+          unsigned char event_direction[SNIPPET_MAX_EVENTS];
+          unsigned int event_kind[SNIPPET_MAX_EVENTS];
+      };
+
+      unsigned int triggers(const nfc_frame &frame);
+      void flush_ready(bool all);
+      bool write_snippet(const snippet &s);
+
+      snippet_config d_config;
+      double d_sample_rate;
+      bool d_present[2];
+      sample_format d_formats[2];
+      uint64_t d_margin;
+      uint64_t d_max_length;            /* Longest snippet */
+      sample_ring d_rings[2];
+      uint64_t d_pos[2];                /* Sample after the last item of each direction */
+      std::deque<nfc_frame> d_frames;   /* Recent frames, for the annotations */
+      std::deque<snippet> d_open;
+      uint64_t d_last_start;            /* Start of the latest frame */
+      unsigned int d_uid_level;         /* Cascade levels of the UID matched */
+      unsigned long d_written;
+      unsigned long d_skipped;
+      bool d_ok;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_SNIPPET_RECORDER_H */
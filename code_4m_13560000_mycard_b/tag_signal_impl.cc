@@ -680,6 +680,7 @@
 #endif
 
 #include <gnuradio/io_signature.h>
+#include <stdint.h>
 #include "tag_signal_impl.h"
 
 namespace gr {
@@ -692,8 +693,6 @@ namespace gr {
         (new tag_signal_impl());
     }
 
-    static unsigned int x = 0;
-
     /*
      * The private constructor
      */
@@ -725,8 +724,15 @@ namespace gr {
       const float *in = (const float *) input_items[0];
       float *out = (float *) output_items[0];
 
+      /* Absolute position of in[0], 64-bit and per instance so it never
+       * wraps, even for captures running for days.
+       */
+      const uint64_t offset = nitems_read(0);
+
       // Do <+signal processing+>
 for(int i = 0; i < noutput_items; i++) {
+	uint64_t x = offset + i;
+
 	if ( x > 26444720 && x < 26445520 ) {
 		out[i] = in[i] + 0.01;
 	} else if ( x > 26458680 && x < 26460480 ) {
@@ -813,7 +819,6 @@ for(int i = 0; i < noutput_items; i++) {
 	else {
 		out[i] = in[i];
 	}
-	x++;
 }
       // Tell runtime system how many input items we consumed on
       // each input stream.
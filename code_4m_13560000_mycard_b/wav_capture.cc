@@ -0,0 +1,286 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "wav_capture.h"
+#include "nfcb.h"
+
+#define WAV_FORMAT_PCM                  0x0001
+#define WAV_FORMAT_FLOAT                0x0003
+#define WAV_FORMAT_EXTENSIBLE           0xfffe
+
+/* RIFF sizes meaning "see ds64" or "until the end" */
+#define WAV_SIZE_UNKNOWN                0xffffffffULL
+
+namespace gr {
+  namespace nfc {
+
+    wav_reader::wav_reader()
+      : d_sample_rate(0),
+        d_channels(0),
+        d_format(FORMAT_SHORT),
+        d_sample_size(0),
+        d_data_offset(0),
+        d_data_size(0),
+        d_remaining(0)
+    {
+    }
+
+    bool
+    wav_reader::read_bytes(void *out, size_t n)
+    {
+        unsigned char *p = (unsigned char *) out;
+
+        while (n > 0) {
+            const void *view;
+            size_t len = d_file.next(&view, n);
+
+            if (len == 0) {
+                return false;
+            }
+            memcpy(p, view, len);
+            p += len;
+            n -= len;
+        }
+
+        return true;
+    }
+
+    bool
+    wav_reader::skip(uint64_t n)
+    {
+        if (d_file.mapped()) {
+            return d_file.offset() + n <= d_file.size() && d_file.seek(d_file.offset() + n);
+        }
+
+        while (n > 0) {
+            const void *view;
+            size_t len = d_file.next(&view, size_t(std::min(n, uint64_t(1 << 16))));
+
+            if (len == 0) {
+                return false;
+            }
+            n -= len;
+        }
+
+        return true;
+    }
+
+    bool
+    wav_reader::open(const char *path, bool use_mmap)
+    {
+        unsigned char riff[12], chunk[8], fmt[40];
+        uint64_t ds64_data = WAV_SIZE_UNKNOWN;
+        bool rf64, have_fmt = false;
+        int tag = 0, bits = 0;
+
+        if (!d_file.open(path, use_mmap)) {
+            perror(path);
+            return false;
+        }
+
+        if (!read_bytes(riff, sizeof(riff)) || memcmp(riff + 8, "WAVE", 4) != 0 ||
+            (memcmp(riff, "RIFF", 4) != 0 && memcmp(riff, "RF64", 4) != 0)) {
+            fprintf(stderr, "%s: not a WAV file\n", path);
+            return false;
+        }
+        rf64 = memcmp(riff, "RF64", 4) == 0;
+
+        /* Chunks up to the data, which is streamed */
+        for (;;) {
+            uint64_t size;
+
+            if (!read_bytes(chunk, sizeof(chunk))) {
+                fprintf(stderr, "%s: no data chunk\n", path);
+                return false;
+            }
+            size = nfcb_get_le(chunk + 4, 4);
+
+            if (!memcmp(chunk, "data", 4)) {
+                if (!have_fmt) {
+                    fprintf(stderr, "%s: data before the format\n", path);
+                    return false;
+                }
+                if (rf64 && size == WAV_SIZE_UNKNOWN) {
+                    size = ds64_data;
+                }
+                d_data_offset = d_file.offset();
+                d_data_size = (size == 0 || size == WAV_SIZE_UNKNOWN) ? UINT64_MAX : size;
+                break;
+            }
+
+            if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+                size_t n = size_t(std::min(size, uint64_t(sizeof(fmt))));
+
+                if (!read_bytes(fmt, n)) {
+                    break;
+                }
+                size -= n;
+
+                tag = int(nfcb_get_le(fmt, 2));
+                d_channels = int(nfcb_get_le(fmt + 2, 2));
+                d_sample_rate = double(nfcb_get_le(fmt + 4, 4));
+                bits = int(nfcb_get_le(fmt + 14, 2));
+                if (tag == WAV_FORMAT_EXTENSIBLE && n >= 26) {
+                    /* The first two bytes of the sub-format GUID */
+                    tag = int(nfcb_get_le(fmt + 24, 2));
+                }
+                have_fmt = true;
+            } else if (!memcmp(chunk, "ds64", 4) && size >= 24) {
+                unsigned char ds64[24];
+
+                if (!read_bytes(ds64, sizeof(ds64))) {
+                    break;
+                }
+                size -= sizeof(ds64);
+                ds64_data = nfcb_get_le(ds64 + 8, 8);
+            }
+
+            /* Chunks are word aligned */
+            if (!skip(size + (size & 1))) {
+                fprintf(stderr, "%s: truncated WAV file\n", path);
+                return false;
+            }
+        }
+
+        if (tag == WAV_FORMAT_PCM && bits == 16) {
+            d_format = FORMAT_SHORT;
+            d_sample_size = 2;
+        } else if (tag == WAV_FORMAT_FLOAT && bits == 32) {
+            d_format = FORMAT_FLOAT;
+            d_sample_size = 4;
+        } else {
+            fprintf(stderr, "%s: unsupported WAV format %#x, %d bits (16-bit PCM or float)\n",
+                    path, tag, bits);
+            return false;
+        }
+
+        if (d_channels <= 0 || d_sample_rate <= 0) {
+            fprintf(stderr, "%s: bad WAV format\n", path);
+            return false;
+        }
+
+        d_remaining = d_data_size;
+        if (d_file.size()) {
+            d_remaining = std::min(d_remaining, d_file.size() - d_data_offset);
+        }
+
+        return true;
+    }
+
+    void
+    wav_reader::close()
+    {
+        d_file.close();
+    }
+
+    uint64_t
+    wav_reader::nframes() const
+    {
+        uint64_t size = d_data_size;
+
+        if (d_file.size()) {
+            size = std::min(size, d_file.size() - d_data_offset);
+        } else if (size == UINT64_MAX) {
+            return 0;
+        }
+
+        return size / (uint64_t(d_channels) * d_sample_size);
+    }
+
+    size_t
+    wav_reader::read(int channel, void *out, size_t max)
+    {
+        size_t frame = size_t(d_channels) * d_sample_size;
+        const void *view;
+        size_t len, n;
+
+        len = d_file.next(&view, size_t(std::min(uint64_t(max) * frame, d_remaining)), frame);
+        d_remaining -= len;
+        n = len / frame;
+
+        if (d_channels == 1) {
+            memcpy(out, view, len);
+        } else if (d_sample_size == 2) {
+            const short *in = (const short *) view + channel;
+            short *o = (short *) out;
+
+            for (size_t i = 0; i < n; i++) {
+                o[i] = in[i * d_channels];
+            }
+        } else {
+            const float *in = (const float *) view + channel;
+            float *o = (float *) out;
+
+            for (size_t i = 0; i < n; i++) {
+                o[i] = in[i * d_channels];
+            }
+        }
+
+        return n;
+    }
+
+    bool
+    wav_reader::seek(uint64_t frame)
+    {
+        uint64_t target = d_data_offset + frame * d_channels * d_sample_size;
+        uint64_t pos = d_file.offset();
+
+        if (target < pos) {
+            if (!d_file.seek(target)) {
+                return false;
+            }
+            if (d_remaining != UINT64_MAX) {
+                d_remaining += pos - target;
+            }
+            return true;
+        }
+
+        uint64_t n = std::min(target - pos, d_remaining);
+
+        if (!skip(n)) {
+            d_remaining = 0;
+            return false;
+        }
+        if (d_remaining != UINT64_MAX) {
+            d_remaining -= n;
+        }
+
+        return n == target - pos;
+    }
+
+    uint64_t
+    wav_reader::map_data(const void **data)
+    {
+        if (d_channels != 1 || !d_file.mapped()) {
+            return 0;
+        }
+
+        d_file.seek(d_data_offset);
+        return d_file.next(data, size_t(nframes() * d_sample_size), d_sample_size) / d_sample_size;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
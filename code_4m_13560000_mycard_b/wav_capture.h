@@ -0,0 +1,105 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_WAV_CAPTURE_H
+#define INCLUDED_NFC_WAV_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "capture_file.h"
+#include "decode_pipeline.h"
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Streaming reader for WAV and RF64 captures.
+     *
+     * 16-bit PCM and 32-bit float, plain or WAVE_FORMAT_EXTENSIBLE, any
+     * number of channels. The file goes through capture_file, so it is
+     * mapped (or read() from a pipe) and only one view is resident at a
+     * time whatever its size. A data chunk of unknown size (0 or
+     * 0xffffffff, as written by live recorders) extends to the end of
+     * the file.
+     */
+    class wav_reader
+    {
+     public:
+      wav_reader();
+
+      /*! Open \p path, "-" is stdin. False with a message on error */
+      bool open(const char *path, bool use_mmap = true);
+      void close();
+
+      double sample_rate() const { return d_sample_rate; }
+      int channels() const { return d_channels; }
+
+      /*! FORMAT_SHORT (16-bit PCM) or FORMAT_FLOAT */
+      sample_format format() const { return d_format; }
+
+      /*! Bytes of one sample of one channel */
+      int sample_size() const { return d_sample_size; }
+
+      /*! Frames (one sample per channel) in the file, 0 if unknown */
+      uint64_t nframes() const;
+
+      /*! Size of the file in bytes (0 for pipes) */
+      uint64_t size() const { return d_file.size(); }
+
+      bool mapped() const { return d_file.mapped(); }
+
+      /*!
+       * Next samples of \p channel, at most \p max, to \p out (sample_size()
+       * bytes each). Returns the samples, 0 at the end of the data.
+       */
+      size_t read(int channel, void *out, size_t max);
+
+      /*!
+       * Continue reading at \p frame: direct on mapped files, by reading
+       * ahead on pipes (forward only). False past the end of the data.
+       */
+      bool seek(uint64_t frame);
+
+      /*!
+       * View of the whole data chunk of a mapped mono file, for random
+       * access (capture_view). Returns the samples, 0 if not possible.
+       */
+      uint64_t map_data(const void **data);
+
+      /*! True if reading the file failed, the data then ended early */
+      bool failed() const { return d_file.failed(); }
+
+     private:
+      bool read_bytes(void *out, size_t n);
+      bool skip(uint64_t n);
+
+      capture_file d_file;
+      double d_sample_rate;
+      int d_channels;
+      sample_format d_format;
+      int d_sample_size;
+      uint64_t d_data_offset;
+      uint64_t d_data_size;     /* UINT64_MAX when unknown */
+      uint64_t d_remaining;     /* Bytes of the data chunk not read yet */
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_WAV_CAPTURE_H */
@@ -0,0 +1,63 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_WAV_CAPTURE_SOURCE_H
+#define INCLUDED_NFC_WAV_CAPTURE_SOURCE_H
+
+#include <nfc/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief Streams one channel of a WAV or RF64 capture
+     * \ingroup nfc
+     *
+     * 16-bit PCM files give shorts (for envelope_agc_ss and
+     * histogram_slicer_sb), float files give floats, unscaled in both
+     * cases so that the slicer thresholds are the ones of nfc_decode.
+     * The file is streamed in bounded memory, the source stops at its end
+     * or at the end of the range [\p start, \p end) of samples. A mapped
+     * file is entered at \p start directly, with an "abs_offset" tag on
+     * the first sample.
+     */
+    class NFC_API wav_capture_source : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<wav_capture_source> sptr;
+
+      /*!
+       * \param filename WAV or RF64 file, "-" for stdin
+       * \param channel channel to output
+       * \param start first sample, include the pre-roll the decoders need
+       * \param end sample to stop at, 0 for the end of the file
+       */
+      static sptr make(const char *filename, int channel,
+                       uint64_t start = 0, uint64_t end = 0);
+
+      /* From the file header */
+      virtual double sample_rate() const = 0;
+      virtual int channels() const = 0;
+      virtual bool is_float() const = 0;
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_WAV_CAPTURE_SOURCE_H */
@@ -0,0 +1,99 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdexcept>
+#include <algorithm>
+#include <gnuradio/io_signature.h>
+#include "wav_capture_source_impl.h"
+
+namespace gr {
+  namespace nfc {
+
+    wav_capture_source::sptr
+    wav_capture_source::make(const char *filename, int channel, uint64_t start, uint64_t end)
+    {
+      /* The output item size depends on the file */
+      wav_reader *reader = new wav_reader();
+
+      if (!reader->open(filename) || channel < 0 || channel >= reader->channels()) {
+          delete reader;
+          throw std::runtime_error("wav_capture_source: cannot open capture or channel");
+      }
+      if (end && end <= start) {
+          delete reader;
+          throw std::runtime_error("wav_capture_source: empty range");
+      }
+
+      return gnuradio::get_initial_sptr
+        (new wav_capture_source_impl(reader, channel, start, end));
+    }
+
+    /*
+     * The private constructor
+     */
+    wav_capture_source_impl::wav_capture_source_impl(wav_reader *reader, int channel,
+                                                     uint64_t start, uint64_t end)
+      : gr::sync_block("wav_capture_source",
+              gr::io_signature::make(0, 0, 0),
+              gr::io_signature::make(1, 1, reader->sample_size())),
+        d_reader(reader),
+        d_channel(channel),
+        d_start(start),
+        d_remaining(end ? end - start : UINT64_MAX)
+    {
+        /* Past the end, nothing is output */
+        if (!d_reader->seek(start)) {
+            d_remaining = 0;
+        }
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    wav_capture_source_impl::~wav_capture_source_impl()
+    {
+        delete d_reader;
+    }
+
+    int
+    wav_capture_source_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      size_t max = size_t(std::min(uint64_t(noutput_items), d_remaining));
+      size_t n = max ? d_reader->read(d_channel, output_items[0], max) : 0;
+
+      if (n == 0) {
+          return WORK_DONE;
+      }
+
+      if (d_start > 0 && nitems_written(0) == 0) {
+          add_item_tag(0, 0, pmt::intern("abs_offset"), pmt::from_uint64(d_start));
+      }
+      d_remaining -= n;
+
+      // Tell runtime system how many output items we produced.
+      return int(n);
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
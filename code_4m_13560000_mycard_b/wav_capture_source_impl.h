@@ -0,0 +1,53 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_WAV_CAPTURE_SOURCE_IMPL_H
+#define INCLUDED_NFC_WAV_CAPTURE_SOURCE_IMPL_H
+
+#include "wav_capture_source.h"
+#include "wav_capture.h"
+
+namespace gr {
+  namespace nfc {
+
+    class wav_capture_source_impl : public wav_capture_source
+    {
+     private:
+      wav_reader *d_reader;
+      int d_channel;
+      uint64_t d_start;
+      uint64_t d_remaining;     /* Samples left in the range */
+
+     public:
+      wav_capture_source_impl(wav_reader *reader, int channel, uint64_t start, uint64_t end);
+      ~wav_capture_source_impl();
+
+      double sample_rate() const { return d_reader->sample_rate(); }
+      int channels() const { return d_reader->channels(); }
+      bool is_float() const { return d_reader->format() == FORMAT_FLOAT; }
+
+      // Where all the action really happens
+      int work(int noutput_items,
+               gr_vector_const_void_star &input_items,
+               gr_vector_void_star &output_items);
+    };
+
+  } // namespace nfc
+} // namespace gr
+
+#endif /* INCLUDED_NFC_WAV_CAPTURE_SOURCE_IMPL_H */
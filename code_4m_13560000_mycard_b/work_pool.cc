@@ -0,0 +1,183 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include "work_pool.h"
+
+namespace gr {
+  namespace nfc {
+
+    work_pool::work_pool(int nthreads)
+      : d_queued(0),
+        d_pending(0),
+        d_next(0),
+        d_stop(false)
+    {
+        nthreads = std::max(nthreads, 1);
+
+        pthread_mutex_init(&d_lock, NULL);
+        pthread_cond_init(&d_work, NULL);
+        pthread_cond_init(&d_idle, NULL);
+        pthread_key_create(&d_self, NULL);
+
+        for (int i = 0; i < nthreads; i++) {
+            worker *w = new worker;
+
+            w->pool = this;
+            w->index = i;
+            pthread_mutex_init(&w->lock, NULL);
+            d_workers.push_back(w);
+        }
+
+        d_threads.resize(nthreads);
+        for (int i = 0; i < nthreads; i++) {
+            pthread_create(&d_threads[i], NULL, thread_main, d_workers[i]);
+        }
+    }
+
+    work_pool::~work_pool()
+    {
+        wait();
+
+        pthread_mutex_lock(&d_lock);
+        d_stop = true;
+        pthread_cond_broadcast(&d_work);
+        pthread_mutex_unlock(&d_lock);
+
+        for (size_t i = 0; i < d_threads.size(); i++) {
+            pthread_join(d_threads[i], NULL);
+        }
+
+        for (size_t i = 0; i < d_workers.size(); i++) {
+            pthread_mutex_destroy(&d_workers[i]->lock);
+            delete d_workers[i];
+        }
+
+        pthread_key_delete(d_self);
+        pthread_cond_destroy(&d_idle);
+        pthread_cond_destroy(&d_work);
+        pthread_mutex_destroy(&d_lock);
+    }
+
+    void
+    work_pool::submit(work_task *task)
+    {
+        worker *self = (worker *) pthread_getspecific(d_self);
+        worker *w;
+
+        pthread_mutex_lock(&d_lock);
+        d_pending++;
+        w = self ? self : d_workers[d_next++ % d_workers.size()];
+        pthread_mutex_unlock(&d_lock);
+
+        pthread_mutex_lock(&w->lock);
+        w->tasks.push_back(task);
+        pthread_mutex_unlock(&w->lock);
+
+        pthread_mutex_lock(&d_lock);
+        d_queued++;
+        pthread_cond_signal(&d_work);
+        pthread_mutex_unlock(&d_lock);
+    }
+
+    void
+    work_pool::wait()
+    {
+        pthread_mutex_lock(&d_lock);
+        while (d_pending > 0) {
+            pthread_cond_wait(&d_idle, &d_lock);
+        }
+        pthread_mutex_unlock(&d_lock);
+    }
+
+    work_task *
+    work_pool::take(int index)
+    {
+        work_task *task = NULL;
+        size_t n = d_workers.size();
+
+        /* Oldest task of our own deque first */
+        worker *w = d_workers[index];
+        pthread_mutex_lock(&w->lock);
+        if (!w->tasks.empty()) {
+            task = w->tasks.front();
+            w->tasks.pop_front();
+        }
+        pthread_mutex_unlock(&w->lock);
+
+        /* Then steal the newest task of the others */
+        for (size_t i = 1; !task && i < n; i++) {
+            worker *victim = d_workers[(index + i) % n];
+
+            pthread_mutex_lock(&victim->lock);
+            if (!victim->tasks.empty()) {
+                task = victim->tasks.back();
+                victim->tasks.pop_back();
+            }
+            pthread_mutex_unlock(&victim->lock);
+        }
+
+        return task;
+    }
+
+    void *
+    work_pool::thread_main(void *arg)
+    {
+        worker *w = (worker *) arg;
+        work_pool *pool = w->pool;
+
+        pthread_setspecific(pool->d_self, w);
+
+        for (;;) {
+            work_task *task;
+
+            pthread_mutex_lock(&pool->d_lock);
+            while (pool->d_queued == 0 && !pool->d_stop) {
+                pthread_cond_wait(&pool->d_work, &pool->d_lock);
+            }
+            if (pool->d_queued == 0) {
+                pthread_mutex_unlock(&pool->d_lock);
+                break;
+            }
+            /* Reserve one of the queued tasks, it is in some deque */
+            pool->d_queued--;
+            pthread_mutex_unlock(&pool->d_lock);
+
+            do {
+                task = pool->take(w->index);
+            } while (!task);
+
+            task->run();
+            delete task;
+
+            pthread_mutex_lock(&pool->d_lock);
+            if (--pool->d_pending == 0) {
+                pthread_cond_broadcast(&pool->d_idle);
+            }
+            pthread_mutex_unlock(&pool->d_lock);
+        }
+
+        return NULL;
+    }
+
+  } /* namespace nfc */
+} /* namespace gr */
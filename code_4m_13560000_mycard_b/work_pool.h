@@ -0,0 +1,93 @@
+/* -*- c++ -*- */
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_NFC_WORK_POOL_H
+#define INCLUDED_NFC_WORK_POOL_H
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+namespace gr {
+  namespace nfc {
+
+    /*!
+     * \brief A unit of work for the work_pool
+     */
+    class work_task
+    {
+     public:
+      virtual ~work_task() {}
+
+      /*! Called once on one of the pool threads, the task is deleted after */
+      virtual void run() = 0;
+    };
+
+    /*!
+     * \brief Work-stealing thread pool.
+     *
+     * Every thread owns a deque. Tasks submitted from outside are dealt
+     * round-robin over the deques, tasks submitted from a pool thread go
+     * to its own deque. A thread takes the oldest task of its own deque
+     * and, when it is empty, steals the newest task of another one, so no
+     * thread sits idle while work is queued anywhere.
+     */
+    class work_pool
+    {
+     public:
+      work_pool(int nthreads);
+      ~work_pool();
+
+      /*! Queue \p task, the pool takes ownership */
+      void submit(work_task *task);
+
+      /*! Wait until every submitted task has run */
+      void wait();
+
+      int size() const { return int(d_threads.size()); }
+
+     private:
+      struct worker
+      {
+          work_pool *pool;
+          int index;
+          pthread_mutex_t lock;
+          std::deque<work_task *> tasks;
+      };
+
+      static void *thread_main(void *arg);
+      work_task *take(int index);
+
+      std::vector<worker *> d_workers;
+      std::vector<pthread_t> d_threads;
+      pthread_key_t d_self;
+
+      /* Protects the counters below, sleeping threads wait on d_work */
+      pthread_mutex_t d_lock;
+      pthread_cond_t d_work;
+      pthread_cond_t d_idle;
+      unsigned long d_queued;
+      unsigned long d_pending;
+      unsigned long d_next;
+      bool d_stop;
+    };
+
+  } /* namespace nfc */
+} /* namespace gr */
+
+#endif /* INCLUDED_NFC_WORK_POOL_H */
@@ -1,6 +1,8 @@
-unsigned int x = 0;
+const uint64_t offset = nitems_read(0);
 
 for(int i = 0; i < noutput_items; i++) {
+	uint64_t x = offset + i;
+
 	if(in[i] <= 0.105 && in[i] >= 0.06) {
 		if(x > 6500000 && x < 7000000) {
 			out[i] = in[i] + 0.016;
@@ -11,5 +13,4 @@ for(int i = 0; i < noutput_items; i++) {
 	} else {
 		out[i] = -1;
 	}
-x++;
 }
\ No newline at end of file